@@ -22,16 +22,23 @@
     'sources': [
       'src/magpie.1',
       'src/Base/Array.h',
+      'src/Base/Atomic.h',
+      'src/Base/HashIndex.h',
       'src/Base/Macros.h',
       'src/Base/MagpieString.cpp',
       'src/Base/MagpieString.h',
+      'src/Base/MpscQueue.h',
       'src/Base/Queue.h',
       'src/Base/Stack.h',
+      'src/Base/Utf8.cpp',
+      'src/Base/Utf8.h',
       'src/Compiler/Bytecode.h',
       'src/Compiler/Compiler.cpp',
       'src/Compiler/Compiler.h',
       'src/Compiler/ExprCompiler.cpp',
       'src/Compiler/ExprCompiler.h',
+      'src/Compiler/Optimizer.cpp',
+      'src/Compiler/Optimizer.h',
       'src/Compiler/Resolver.cpp',
       'src/Compiler/Resolver.h',
       'src/Memory/ForwardingAddress.h',
@@ -47,6 +54,9 @@
       'src/Platform/Environment_linux.cpp',
       'src/Platform/Environment_mac.cpp',
       'src/Platform/Environment_win.cpp',
+      'src/Platform/MappedFile.h',
+      'src/Platform/MappedFile_posix.cpp',
+      'src/Platform/MappedFile_win.cpp',
       'src/Platform/Path.h',
       'src/Platform/Path.cpp',
       'src/Platform/Path_posix.cpp',
@@ -54,6 +64,9 @@
       'src/Syntax/Ast.cpp',
       'src/Syntax/Ast.generated.h',
       'src/Syntax/Ast.h',
+      'src/Syntax/AstCache.cpp',
+      'src/Syntax/AstCache.generated.h',
+      'src/Syntax/AstCache.h',
       'src/Syntax/ErrorReporter.cpp',
       'src/Syntax/ErrorReporter.h',
       'src/Syntax/Lexer.cpp',
@@ -64,6 +77,8 @@
       'src/Syntax/Token.h',
       'src/VM/Fiber.cpp',
       'src/VM/Fiber.h',
+      'src/VM/Mailbox.cpp',
+      'src/VM/Mailbox.h',
       'src/VM/Method.cpp',
       'src/VM/Method.h',
       'src/VM/Module.cpp',
@@ -72,12 +87,28 @@
       'src/VM/NativesCore.h',
       'src/VM/NativesIO.cpp',
       'src/VM/NativesIO.h',
+      'src/VM/NativesNet.cpp',
+      'src/VM/NativesNet.h',
+      'src/VM/NativesProcess.cpp',
+      'src/VM/NativesProcess.h',
       'src/VM/Object.cpp',
       'src/VM/Object.h',
       'src/VM/ObjectIO.cpp',
       'src/VM/ObjectIO.h',
+      'src/VM/ObjectNet.cpp',
+      'src/VM/ObjectNet.h',
+      'src/VM/ObjectProcess.cpp',
+      'src/VM/ObjectProcess.h',
+      'src/VM/Output.cpp',
+      'src/VM/Output.h',
       'src/VM/Scheduler.cpp',
       'src/VM/Scheduler.h',
+      'src/VM/Serializer.cpp',
+      'src/VM/Serializer.h',
+      'src/VM/TaskPool.cpp',
+      'src/VM/TaskPool.h',
+      'src/VM/TimerWheel.cpp',
+      'src/VM/TimerWheel.h',
       'src/VM/VM.cpp',
       'src/VM/VM.h',
     ],
@@ -106,21 +137,35 @@
       'sources': [
         'src/Test/ArrayTests.cpp',
         'src/Test/ArrayTests.h',
+        'src/Test/AstCacheTests.cpp',
+        'src/Test/AstCacheTests.h',
+        'src/Test/HashIndexTests.cpp',
+        'src/Test/HashIndexTests.h',
         'src/Test/LexerTests.cpp',
         'src/Test/LexerTests.h',
+        'src/Test/MailboxTests.cpp',
+        'src/Test/MailboxTests.h',
         'src/Test/MemoryTests.cpp',
         'src/Test/MemoryTests.h',
+        'src/Test/OptimizerTests.cpp',
+        'src/Test/OptimizerTests.h',
         'src/Test/ParserTests.cpp',
         'src/Test/ParserTests.h',
         'src/Test/QueueTests.cpp',
         'src/Test/QueueTests.h',
         'src/Test/StringTests.cpp',
         'src/Test/StringTests.h',
+        'src/Test/TaskPoolTests.cpp',
+        'src/Test/TaskPoolTests.h',
         'src/Test/Test.cpp',
         'src/Test/Test.h',
         'src/Test/TestMain.cpp',
+        'src/Test/TimerWheelTests.cpp',
+        'src/Test/TimerWheelTests.h',
         'src/Test/TokenTests.cpp',
         'src/Test/TokenTests.h',
+        'src/Test/Utf8Tests.cpp',
+        'src/Test/Utf8Tests.h',
       ],
     },
   ],
@@ -3,10 +3,15 @@
 # Generates the C++ code for defining the AST classes. The classes for defining
 # the Nodes are pretty much complete boilerplate. They are basically dumb
 # data structures. This generates that boilerplate.
+#
+# It also generates the code for reading and writing ASTs to the module cache
+# (see AstCache.h), since that has to walk every field of every node.
 from os.path import dirname, join, realpath
+import zlib
 
 magpie_dir = dirname(dirname(realpath(__file__)))
 header_path = join(magpie_dir, 'src', 'Syntax', 'Ast.generated.h')
+cache_path = join(magpie_dir, 'src', 'Syntax', 'AstCache.generated.h')
 
 # Define the AST classes.
 exprs = sorted({
@@ -215,6 +220,55 @@ private:
 }};
 '''
 
+CACHE_WRITER_HEADER = '''
+// Writes each kind of node as its tag, position and then its fields.
+class AstNodeWriter : public ExprVisitor, public LValueVisitor,
+                      public PatternVisitor
+{
+public:
+  AstNodeWriter(AstWriter& writer)
+  : writer_(writer)
+  {}
+
+'''
+
+CACHE_WRITER_FOOTER = '''
+private:
+  AstWriter& writer_;
+
+  NO_COPY(AstNodeWriter);
+};
+'''
+
+CACHE_WRITE_NODE = '''  virtual void visit({0}{1}& node, int arg)
+  {{
+    writer_.writeTag({2});
+    writer_.write(node.pos());
+{3}  }}
+
+'''
+
+CACHE_READ_HEADER = '''
+gc<{0}> AstReader::read{0}(int tag, gc<SourcePos> pos)
+{{
+  switch (tag)
+  {{
+'''
+
+CACHE_READ_FOOTER = '''  }
+
+  fail();
+  return NULL;
+}
+'''
+
+CACHE_READ_NODE = '''    case {2}:
+    {{
+{3}      return new {0}{1}(pos{4});
+    }}
+
+'''
+
 num_types = 0
 
 def main():
@@ -231,9 +285,66 @@ def main():
         makeAst(file, 'LValue', 'int', lvalues)
         makeAst(file, 'Pattern', 'int', patterns)
 
+    # Create the cache reader and writer.
+    with open(cache_path, 'w') as file:
+        file.write(HEADER)
+
+        # Changing any node invalidates everything in the cache.
+        schema = zlib.crc32(repr((exprs, lvalues, patterns))) & 0xffffffff
+        file.write('static const unsigned int AST_SCHEMA = 0x{0:08x};\n'
+            .format(schema))
+
+        file.write(CACHE_WRITER_HEADER)
+        makeCacheWriter(file, 'Expr', exprs)
+        makeCacheWriter(file, 'LValue', lvalues)
+        makeCacheWriter(file, 'Pattern', patterns)
+        file.write(CACHE_WRITER_FOOTER)
+
+        makeCacheReader(file, 'Expr', exprs)
+        makeCacheReader(file, 'LValue', lvalues)
+        makeCacheReader(file, 'Pattern', patterns)
+
     print 'Created', num_types, 'types.'
 
 
+def cachedFields(fields):
+    """Gets the fields that the parser fills in. The rest are only set once
+    the AST has been resolved, so they aren't cached."""
+    return [(name, type) for name, type in fields
+            if not name.endswith('*') and not type.endswith('*')]
+
+
+def makeCacheWriter(file, name, types):
+    tag = 1
+    for className, fields in types:
+        writes = ''
+        for field, type in cachedFields(fields):
+            writes += '    writer_.write(node.{0}());\n'.format(field)
+
+        file.write(CACHE_WRITE_NODE.format(className, name, tag, writes))
+        tag += 1
+
+
+def makeCacheReader(file, name, types):
+    file.write(CACHE_READ_HEADER.format(name))
+
+    tag = 1
+    for className, fields in types:
+        reads = ''
+        args = ''
+        for field, type in cachedFields(fields):
+            # Read each field into a local first so that they are read in
+            # order.
+            reads += '      {1} {0};\n'.format(field, type)
+            reads += '      read({0});\n'.format(field)
+            args += ', ' + field
+
+        file.write(CACHE_READ_NODE.format(className, name, tag, reads, args))
+        tag += 1
+
+    file.write(CACHE_READ_FOOTER)
+
+
 def forwardDeclare(file, nodes, name):
     for className, fields in nodes:
         file.write('class {0}{1};\n'.format(className, name))
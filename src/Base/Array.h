@@ -250,7 +250,7 @@ namespace magpie
       while (capacity < desiredCapacity) capacity *= GROW_FACTOR;
 
       // Create the new array.
-      void* mem = Memory::allocate(sizeof(T) * capacity);
+      void* mem = Memory::current().allocate(sizeof(T) * capacity);
 
       // Copy the existing items over. Note that this does *not* call any
       // user-defined assignment operators. It just moves the memory straight
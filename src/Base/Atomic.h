@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+namespace magpie
+{
+  // Minimal wrappers around the compiler's atomic intrinsics. All of these
+  // act as full memory barriers.
+
+  // Atomically adds one to [value] and returns the new value.
+  inline int atomicIncrement(volatile int* value)
+  {
+#ifdef _MSC_VER
+    return InterlockedIncrement(reinterpret_cast<volatile long*>(value));
+#else
+    return __sync_add_and_fetch(value, 1);
+#endif
+  }
+
+  // Atomically subtracts one from [value] and returns the new value.
+  inline int atomicDecrement(volatile int* value)
+  {
+#ifdef _MSC_VER
+    return InterlockedDecrement(reinterpret_cast<volatile long*>(value));
+#else
+    return __sync_sub_and_fetch(value, 1);
+#endif
+  }
+
+  // Atomically stores [value] in [target] and returns the previous value.
+  template <class T>
+  inline T* atomicExchange(T* volatile* target, T* value)
+  {
+#ifdef _MSC_VER
+    return static_cast<T*>(InterlockedExchangePointer(
+        reinterpret_cast<void* volatile*>(target), value));
+#else
+    // GCC's __sync_lock_test_and_set() is only an acquire barrier, so follow
+    // it with a full one.
+    T* previous = __sync_lock_test_and_set(target, value);
+    __sync_synchronize();
+    return previous;
+#endif
+  }
+
+  // Reads [source] after every memory operation that precedes it.
+  template <class T>
+  inline T atomicLoad(T volatile* source)
+  {
+#ifdef _MSC_VER
+    MemoryBarrier();
+    T value = *source;
+    MemoryBarrier();
+    return value;
+#else
+    __sync_synchronize();
+    T value = *source;
+    __sync_synchronize();
+    return value;
+#endif
+  }
+
+  // Writes [value] to [target] after every memory operation that precedes it.
+  template <class T>
+  inline void atomicStore(T volatile* target, T value)
+  {
+#ifdef _MSC_VER
+    MemoryBarrier();
+    *target = value;
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+    *target = value;
+    __sync_synchronize();
+#endif
+  }
+}
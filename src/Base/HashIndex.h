@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Macros.h"
+
+namespace magpie
+{
+  // An open-addressed hash table that maps hash codes to indexes in some other
+  // array. This lets a table of keys stored in an Array be searched without
+  // scanning the whole thing.
+  //
+  // Only each key's hash and index are stored, not the key itself, so the
+  // table doesn't care what the keys are and doesn't need to be reached by
+  // the GC when they move. Since different keys can have the same hash, the
+  // caller still has to compare the key at each index it gets back.
+  class HashIndex
+  {
+  public:
+    HashIndex()
+    : capacity_(0),
+      count_(0),
+      hashes_(NULL),
+      indexes_(NULL)
+    {}
+
+    ~HashIndex()
+    {
+      delete [] hashes_;
+      delete [] indexes_;
+    }
+
+    // Gets the number of indexes in the table.
+    int count() const { return count_; }
+
+    // Adds [index] to the table for a key whose hash is [hash].
+    void add(unsigned int hash, int index)
+    {
+      ASSERT(index >= 0, "Index cannot be negative.");
+
+      // Keep the load factor under 3/4. This also guarantees there is always
+      // an empty slot to end a search.
+      if ((count_ + 1) * 4 > capacity_ * 3) grow();
+
+      insert(hash, index);
+      count_++;
+    }
+
+    // Finds the indexes that were added with [hash]. Start with [slot] set to
+    // -1 and call this repeatedly. It returns each matching index in turn,
+    // and -1 once there are no more.
+    int find(unsigned int hash, int& slot) const
+    {
+      if (capacity_ == 0) return -1;
+
+      int mask = capacity_ - 1;
+      int i = (slot == -1) ? static_cast<int>(hash & mask) : (slot + 1) & mask;
+      while (indexes_[i] != -1)
+      {
+        if (hashes_[i] == hash)
+        {
+          slot = i;
+          return indexes_[i];
+        }
+
+        i = (i + 1) & mask;
+      }
+
+      return -1;
+    }
+
+  private:
+    void insert(unsigned int hash, int index)
+    {
+      int mask = capacity_ - 1;
+      int i = static_cast<int>(hash & mask);
+      while (indexes_[i] != -1) i = (i + 1) & mask;
+
+      hashes_[i] = hash;
+      indexes_[i] = index;
+    }
+
+    void grow()
+    {
+      int oldCapacity = capacity_;
+      unsigned int* oldHashes = hashes_;
+      int* oldIndexes = indexes_;
+
+      capacity_ = (capacity_ == 0) ? 16 : capacity_ * 2;
+      hashes_ = new unsigned int[capacity_];
+      indexes_ = new int[capacity_];
+      for (int i = 0; i < capacity_; i++) indexes_[i] = -1;
+
+      for (int i = 0; i < oldCapacity; i++)
+      {
+        if (oldIndexes[i] != -1) insert(oldHashes[i], oldIndexes[i]);
+      }
+
+      delete [] oldHashes;
+      delete [] oldIndexes;
+    }
+
+    int capacity_;
+    int count_;
+    unsigned int* hashes_;
+    int* indexes_;
+
+    NO_COPY(HashIndex);
+  };
+}
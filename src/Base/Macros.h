@@ -58,6 +58,14 @@ while (false) {                                             \
   *(static_cast<T* volatile*>(0)) = static_cast<S*>(0);     \
 }
 
+// Declares a variable with thread-local storage. Each thread gets its own copy
+// of it. The variable must have a POD type.
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 #define UNREACHABLE() \
   ASSERT(false, "Unreachable code.");
 
@@ -12,7 +12,7 @@ namespace magpie
     if (length == -1) length = static_cast<int>(strlen(text));
 
     // Allocate enough memory for the string and its character array.
-    void* mem = Memory::allocate(calcStringSize(length));
+    void* mem = Memory::current().allocate(calcStringSize(length));
 
     // Construct it by calling global placement new.
     gc<String> string = ::new(mem) String(length);
@@ -22,6 +22,7 @@ namespace magpie
     // Make sure its terminated. May not be, for example, when creating a
     // string from a substring.
     string->chars_[length] = '\0';
+    string->hash_ = hash(string->chars_, length);
 
     return string;
   }
@@ -29,7 +30,7 @@ namespace magpie
   gc<String> String::create(const Array<char>& text)
   {
     // Allocate enough memory for the string and its character array.
-    void* mem = Memory::allocate(calcStringSize(text.count()));
+    void* mem = Memory::current().allocate(calcStringSize(text.count()));
 
     // Construct it by calling global placement new.
     gc<String> string = ::new(mem) String(text.count());
@@ -41,6 +42,7 @@ namespace magpie
 
     // Make sure its terminated.
     string->chars_[text.count()] = '\0';
+    string->hash_ = hash(string->chars_, text.count());
 
     return string;
   }
@@ -63,7 +65,7 @@ namespace magpie
   {
     int length = a->length() + b->length();
     // Allocate enough memory for the string and its character array.
-    void* mem = Memory::allocate(calcStringSize(length));
+    void* mem = Memory::current().allocate(calcStringSize(length));
 
     // Construct it by calling global placement new.
     gc<String> string = ::new(mem) String(length);
@@ -73,6 +75,7 @@ namespace magpie
 
     // Make sure its terminated.
     string->chars_[length] = '\0';
+    string->hash_ = hash(string->chars_, length);
 
     return string;
   }
@@ -90,8 +93,7 @@ namespace magpie
     if (this == &right) return true;
 
     if (length_ != right.length_) return false;
-
-    // TODO(bob): Compare hashcodes if we have them.
+    if (hash_ != right.hash_) return false;
 
     return strncmp(chars_, right.chars_, length_) == 0;
   }
@@ -116,6 +118,18 @@ namespace magpie
     return length_;
   }
 
+  unsigned int String::hash(const char* text, int length)
+  {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+      hash ^= static_cast<unsigned char>(text[i]);
+      hash *= 16777619u;
+    }
+
+    return hash;
+  }
+
   const char* String::cString() const
   {
     return chars_;
@@ -139,6 +153,8 @@ namespace magpie
       if (result->chars_[i] == from) result->chars_[i] = to;
     }
 
+    result->hash_ = hash(result->chars_, length_);
+
     return result;
   }
 
@@ -156,7 +172,8 @@ namespace magpie
   }
 
   String::String(int length)
-  : length_(length)
+  : length_(length),
+    hash_(0)
   {
   }
 
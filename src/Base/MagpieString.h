@@ -45,6 +45,13 @@ namespace magpie
     // Gets the number of characters in the string.
     int length() const;
 
+    // Gets the hash code of the string's characters. It's calculated once
+    // when the string is created.
+    unsigned int hash() const { return hash_; }
+
+    // Hashes [length] bytes of [text] using 32-bit FNV-1a.
+    static unsigned int hash(const char* text, int length);
+
     // Gets the raw character array for the string. Returns a reference to
     // a zero-length string, not `NULL`, if the string is empty. Callers must
     // not retain a reference to the returned string: it points directly at
@@ -70,6 +77,7 @@ namespace magpie
     String(int length);
 
     int length_;
+    unsigned int hash_;
     char chars_[FLEXIBLE_SIZE];
     
     NO_COPY(String);
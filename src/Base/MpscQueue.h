@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Atomic.h"
+#include "Macros.h"
+
+namespace magpie
+{
+  // An unbounded queue that any number of threads can enqueue to but only a
+  // single thread may dequeue from. Neither side takes a lock: producers
+  // swing the head with one atomic exchange and the consumer walks the list
+  // from the tail. Based on Dmitry Vyukov's non-intrusive MPSC node queue.
+  //
+  // Nodes live on the native heap, not in a VM's GC heap, so that a queue can
+  // be shared by threads that each have their own heap. Items must be
+  // copyable and default constructible. Anything still queued when the queue
+  // is destroyed is simply dropped.
+  template <class T>
+  class MpscQueue
+  {
+  public:
+    MpscQueue()
+    : head_(&stub_),
+      tail_(&stub_)
+    {
+      stub_.next = NULL;
+    }
+
+    ~MpscQueue()
+    {
+      T item;
+      while (dequeue(item)) {}
+    }
+
+    // Adds [item] to the queue. Can be called from any thread.
+    void enqueue(const T& item)
+    {
+      Node* node = new Node();
+      node->item = item;
+      push(node);
+    }
+
+    // Removes the oldest item from the queue and stores it in [item]. Must
+    // only be called from the consumer thread. Returns false if the queue is
+    // empty.
+    //
+    // Note that this may also return false while a producer is midway through
+    // enqueueing. Callers that need to know when that item lands should have
+    // the producer notify them after enqueue() returns.
+    bool dequeue(T& item)
+    {
+      Node* tail = tail_;
+      Node* next = atomicLoad(&tail->next);
+
+      // Skip over the stub node.
+      if (tail == &stub_)
+      {
+        if (next == NULL) return false;
+
+        tail_ = next;
+        tail = next;
+        next = atomicLoad(&next->next);
+      }
+
+      if (next != NULL)
+      {
+        tail_ = next;
+        item = tail->item;
+        delete tail;
+        return true;
+      }
+
+      // [tail] is the last node. If a producer has already swung the head
+      // past it, the link just isn't visible yet.
+      if (tail != atomicLoad(&head_)) return false;
+
+      // Put the stub back at the end so we can take the last real node.
+      push(&stub_);
+
+      next = atomicLoad(&tail->next);
+      if (next == NULL) return false;
+
+      tail_ = next;
+      item = tail->item;
+      delete tail;
+      return true;
+    }
+
+    // Returns true if there are no items visible to the consumer. Must only be
+    // called from the consumer thread.
+    bool isEmpty()
+    {
+      Node* tail = tail_;
+      Node* next = atomicLoad(&tail->next);
+      return tail == &stub_ && next == NULL;
+    }
+
+  private:
+    struct Node
+    {
+      Node* volatile next;
+      T item;
+    };
+
+    void push(Node* node)
+    {
+      node->next = NULL;
+      Node* previous = atomicExchange(&head_, node);
+      atomicStore(&previous->next, node);
+    }
+
+    // The most recently enqueued node. Producers contend on this.
+    Node* volatile head_;
+
+    // The oldest node that hasn't been dequeued. Only the consumer touches
+    // this.
+    Node* tail_;
+
+    // A placeholder node that keeps the list from ever being empty.
+    Node stub_;
+
+    NO_COPY(MpscQueue);
+  };
+}
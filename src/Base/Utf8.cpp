@@ -0,0 +1,177 @@
+#include <cstring>
+
+#include "Utf8.h"
+
+// The vector paths use GCC and Clang's per-function target attributes so that
+// the rest of the program doesn't need to be compiled for AVX2.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MAGPIE_UTF8_X86 1
+#include <immintrin.h>
+#else
+#define MAGPIE_UTF8_X86 0
+#endif
+
+namespace magpie
+{
+  Utf8::CountAsciiFn Utf8::countAscii_ = Utf8::chooseCountAscii();
+
+  int Utf8::findInvalid(const unsigned char* bytes, int count)
+  {
+    int i = 0;
+    while (i < count)
+    {
+      // Skip over a run of ASCII in bulk.
+      if (bytes[i] < 0x80)
+      {
+        i += countAscii_(bytes + i, count - i);
+        continue;
+      }
+
+      int length = sequenceLength(bytes + i, count - i);
+      if (length == 0) return i;
+      i += length;
+    }
+
+    return -1;
+  }
+
+  int Utf8::countAscii(const unsigned char* bytes, int count)
+  {
+    return countAscii_(bytes, count);
+  }
+
+  int Utf8::countAsciiScalar(const unsigned char* bytes, int count)
+  {
+    const unsigned long long highBits = 0x8080808080808080ULL;
+
+    // Check a word at a time.
+    int i = 0;
+    while (i + 8 <= count)
+    {
+      unsigned long long word;
+      memcpy(&word, bytes + i, 8);
+      if ((word & highBits) != 0) break;
+      i += 8;
+    }
+
+    // Find the exact byte.
+    while (i < count && bytes[i] < 0x80) i++;
+    return i;
+  }
+
+#if MAGPIE_UTF8_X86
+  int Utf8::countAsciiSse2(const unsigned char* bytes, int count)
+  {
+    int i = 0;
+    while (i + 16 <= count)
+    {
+      __m128i chunk = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(bytes + i));
+
+      // The mask has a bit set for each byte whose high bit is set.
+      int mask = _mm_movemask_epi8(chunk);
+      if (mask != 0) return i + __builtin_ctz(mask);
+      i += 16;
+    }
+
+    return i + countAsciiScalar(bytes + i, count - i);
+  }
+
+  __attribute__((target("avx2")))
+  int Utf8::countAsciiAvx2(const unsigned char* bytes, int count)
+  {
+    int i = 0;
+    while (i + 32 <= count)
+    {
+      __m256i chunk = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(bytes + i));
+
+      unsigned int mask = static_cast<unsigned int>(
+          _mm256_movemask_epi8(chunk));
+      if (mask != 0) return i + __builtin_ctz(mask);
+      i += 32;
+    }
+
+    return i + countAsciiSse2(bytes + i, count - i);
+  }
+
+  bool Utf8::supportsSse2()
+  {
+    // Every x86-64 CPU has SSE2.
+    return true;
+  }
+
+  bool Utf8::supportsAvx2()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+#else
+  int Utf8::countAsciiSse2(const unsigned char* bytes, int count)
+  {
+    return countAsciiScalar(bytes, count);
+  }
+
+  int Utf8::countAsciiAvx2(const unsigned char* bytes, int count)
+  {
+    return countAsciiScalar(bytes, count);
+  }
+
+  bool Utf8::supportsSse2() { return false; }
+  bool Utf8::supportsAvx2() { return false; }
+#endif
+
+  Utf8::CountAsciiFn Utf8::chooseCountAscii()
+  {
+    if (supportsAvx2()) return countAsciiAvx2;
+    if (supportsSse2()) return countAsciiSse2;
+    return countAsciiScalar;
+  }
+
+  int Utf8::sequenceLength(const unsigned char* bytes, int count)
+  {
+    unsigned char lead = bytes[0];
+
+    // The lead byte determines the length and the valid range of the second
+    // byte. Narrowing the second byte's range is what rules out overlong
+    // encodings, surrogates and values past U+10FFFF. See table 3-7 in the
+    // Unicode standard.
+    int length;
+    unsigned char min = 0x80;
+    unsigned char max = 0xbf;
+
+    if (lead >= 0xc2 && lead <= 0xdf)
+    {
+      length = 2;
+    }
+    else if (lead >= 0xe0 && lead <= 0xef)
+    {
+      length = 3;
+      if (lead == 0xe0) min = 0xa0;
+      if (lead == 0xed) max = 0x9f;
+    }
+    else if (lead >= 0xf0 && lead <= 0xf4)
+    {
+      length = 4;
+      if (lead == 0xf0) min = 0x90;
+      if (lead == 0xf4) max = 0x8f;
+    }
+    else
+    {
+      // A stray continuation byte, or a lead byte that can only start an
+      // overlong or out of range sequence.
+      return 0;
+    }
+
+    if (count < length) return 0;
+    if (bytes[1] < min || bytes[1] > max) return 0;
+
+    // The rest must be plain continuation bytes.
+    for (int i = 2; i < length; i++)
+    {
+      if ((bytes[i] & 0xc0) != 0x80) return 0;
+    }
+
+    return length;
+  }
+}
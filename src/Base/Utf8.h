@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Macros.h"
+
+namespace magpie
+{
+  // Validates UTF-8 encoded text. Since String stores bytes, decoding UTF-8
+  // is just making sure the bytes are well-formed and then copying them.
+  //
+  // Most text is mostly ASCII, so runs of ASCII bytes are skipped using the
+  // widest vector instructions the CPU supports, which are picked once at
+  // runtime. Multi-byte sequences are checked one at a time.
+  class Utf8
+  {
+  public:
+    // Returns the index of the first byte in [bytes] that isn't part of a
+    // well-formed UTF-8 sequence, or -1 if all [count] of them are valid.
+    // Overlong encodings, surrogates, values past U+10FFFF and sequences cut
+    // off by the end of the input are all invalid.
+    static int findInvalid(const unsigned char* bytes, int count);
+
+    // Returns the number of bytes at the beginning of [bytes] that are ASCII.
+    static int countAscii(const unsigned char* bytes, int count);
+
+    // The implementations of countAscii() for each instruction set. These
+    // are only public so that they can be tested directly. Only call the
+    // vector ones if supportsSse2() or supportsAvx2() says you can.
+    static int countAsciiScalar(const unsigned char* bytes, int count);
+    static int countAsciiSse2(const unsigned char* bytes, int count);
+    static int countAsciiAvx2(const unsigned char* bytes, int count);
+
+    static bool supportsSse2();
+    static bool supportsAvx2();
+
+  private:
+    typedef int (*CountAsciiFn)(const unsigned char* bytes, int count);
+
+    static CountAsciiFn chooseCountAscii();
+
+    // Gets the length of the well-formed sequence starting at [bytes], or 0
+    // if it isn't one. [bytes] must not be ASCII.
+    static int sequenceLength(const unsigned char* bytes, int count);
+
+    static CountAsciiFn countAscii_;
+  };
+}
@@ -9,6 +9,9 @@
 #define GET_B(i)  (static_cast<int>(((i) & 0x00ff0000) >> 16))
 #define GET_C(i)  (static_cast<int>(((i) & 0x0000ff00) >>  8))
 
+// Gets B and C together as a single 16-bit operand, B being the high byte.
+#define GET_BC(i) (static_cast<int>(((i) & 0x00ffff00) >>  8))
+
 namespace magpie
 {
   enum OpCode
@@ -24,7 +27,7 @@ namespace magpie
     OP_BUILT_IN,
     
     // Adds a method to a multimethod. A is the index of the multimethod to
-    // specialize. B is the index of the method to add.
+    // specialize. BC is the index of the method to add.
     OP_METHOD,
     
     // Creates a record from fields on the stack. A is the slot of the first
@@ -103,7 +106,26 @@ namespace magpie
     
     OP_JUMP_IF_FALSE, // R(A) = test slot, B = offset
     OP_JUMP_IF_TRUE, // R(A) = test slot, B = offset
-    
+
+    // Guards a call whose result was computed by the compiler. If the
+    // multimethod with index A has any methods that weren't defined in core,
+    // moves the instruction pointer forward by B to the code that calls it.
+    OP_JUMP_IF_SPECIALIZED,
+
+    // Starts a for loop over a core Range of Ints without calling "iterate".
+    // If slot A holds one, stores one less than its first value in slot A and
+    // its last value in slot B, then skips the next instruction. Otherwise,
+    // stores nothing in slot B and continues with the next instruction, which
+    // should call "iterate" on slot A.
+    OP_RANGE_ITERATE,
+
+    // Advances a for loop started by OP_RANGE_ITERATE without calling
+    // "advance". If slot B holds an Int, increments the Int in slot A and
+    // stores it in slot C, or stores done in slot C if it is past slot B.
+    // Then skips the next instruction. Otherwise, continues with the next
+    // instruction, which should call "advance" on slot A.
+    OP_RANGE_ADVANCE,
+
     // Invokes a top-level method. The index of the method in the global table
     // is A. The arguments to the method are laid out in sequential slots
     // starting at B. The number of slots needed is determined by the
@@ -111,6 +133,14 @@ namespace magpie
     // slot C when the method returns.
     // TODO(bob): Tweak operands so that we can support more than 256 methods.
     OP_CALL,
+
+    // Continues the current call in the body of a method. This follows a
+    // multimethod's tests for that method's parameters, once they have
+    // matched. BC is the index of the method (see VM::addMethod()). Its body
+    // is compiled the first time this runs, and replaces the multimethod's
+    // code in the current call frame, keeping the slots the parameters were
+    // bound to.
+    OP_METHOD_BODY,
     
     // Invokes a native method. The index of the native is A. The result of the
     // call will be placed into register C. Assumes the arguments to the
@@ -138,11 +168,12 @@ namespace magpie
   
   enum BuiltIn
   {
-    BUILT_IN_FALSE     = 0,
-    BUILT_IN_TRUE      = 1,
-    BUILT_IN_NOTHING   = 2,
-    BUILT_IN_NO_METHOD = 3,
-    BUILT_IN_DONE      = 4
+    BUILT_IN_FALSE            = 0,
+    BUILT_IN_TRUE             = 1,
+    BUILT_IN_NOTHING          = 2,
+    BUILT_IN_NO_METHOD        = 3,
+    BUILT_IN_DONE             = 4,
+    BUILT_IN_METHOD_COLLISION = 5
   };
   
   typedef unsigned int instruction;
@@ -31,6 +31,13 @@ namespace magpie
     return ExprCompiler(compiler).compile(multimethod);
   }
 
+  gc<Chunk> Compiler::compileMethod(VM& vm, ErrorReporter& reporter,
+                                    Method& method)
+  {
+    Compiler compiler(vm, reporter);
+    return ExprCompiler(compiler).compile(method);
+  }
+
   void Compiler::compileExpression(VM& vm, ErrorReporter& reporter,
                                    gc<Expr> expr, Module* module)
   {
@@ -23,6 +23,9 @@ namespace magpie
     static gc<Chunk> compileMultimethod(VM& vm, ErrorReporter& reporter,
                                         Multimethod& multimethod);
 
+    static gc<Chunk> compileMethod(VM& vm, ErrorReporter& reporter,
+                                   Method& method);
+
     static void compileExpression(VM& vm, ErrorReporter& reporter,
                                   gc<Expr> expr, Module* module);
 
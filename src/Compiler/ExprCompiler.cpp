@@ -1,8 +1,11 @@
+#include <climits>
+
 #include "ErrorReporter.h"
 #include "Method.h"
 #include "Module.h"
 #include "ExprCompiler.h"
 #include "Object.h"
+#include "Optimizer.h"
 #include "Resolver.h"
 #include "Token.h"
 
@@ -31,6 +34,7 @@ namespace magpie
       compile(module, maxLocals, NULL, NULL, NULL, body);
     }
 
+    Optimizer::optimize(*chunk_);
     chunk_->bind(maxSlots_, numClosures);
     return chunk_;
   }
@@ -44,20 +48,40 @@ namespace magpie
 
     int numClosures = 0;
 
+    // Only the methods' parameter patterns are compiled here. Once a method's
+    // patterns match, OP_METHOD_BODY continues the call in that method's
+    // body, which isn't compiled until the first time that happens. See
+    // compile(Method&).
+    // If two methods have the same patterns, no call can be dispatched.
+    if (multimethod.hasCollision())
+    {
+      write(-1, OP_BUILT_IN, BUILT_IN_METHOD_COLLISION, 0);
+      write(-1, OP_THROW, 0);
+
+      chunk_->bind(maxSlots_, 0);
+      return chunk_;
+    }
+
     // TODO(bob): Lots of work needed here:
     // - Support call-next-method.
-    // - Detect pattern collisions.
     // - Throw AmbiguousMethodError when appropriate.
     for (int i = 0; i < multimethod.methods().count(); i++)
     {
       gc<Method> method = multimethod.methods()[i];
       gc<DefExpr> def = method->def();
-      compile(method->module(),
-              def->resolved().maxLocals(),
-              def->leftParam(), def->rightParam(), def->value(),
-              def->body());
+      startProcedure(method->module(), def->resolved().maxLocals());
 
-      // Keep track of the total number of closures we need.
+      PatternCompiler compiler(*this, true);
+      compileParams(compiler, def->leftParam(), def->rightParam(),
+                    def->value());
+
+      write(def->pos(), OP_METHOD_BODY, 0, method->id() >> 8,
+            method->id() & 0xff);
+
+      compiler.endJumps();
+
+      // Keep track of the total number of closures we need. The parameters
+      // may be bound to upvars here before the body takes them over.
       numClosures = MAX(numClosures, def->resolved().closures().count());
     }
 
@@ -70,6 +94,27 @@ namespace magpie
     return chunk_;
   }
 
+  gc<Chunk> ExprCompiler::compile(Method& method)
+  {
+    gc<DefExpr> def = method.def();
+    startProcedure(method.module(), def->resolved().maxLocals());
+
+    // The multimethod has already matched and bound the parameters, so the
+    // result slot is just after them.
+    int numParamSlots = countParamSlots(def->leftParam()) +
+                        countParamSlots(def->rightParam()) +
+                        countParamSlots(def->value());
+
+    compile(def->body(), numParamSlots);
+    write(def->body()->pos(), OP_RETURN, numParamSlots);
+
+    ASSERT(numTemps_ == 0, "Should not have any temps left.");
+
+    Optimizer::optimize(*chunk_);
+    chunk_->bind(maxSlots_, def->resolved().closures().count());
+    return chunk_;
+  }
+
   gc<Chunk> ExprCompiler::compile(Module* module, FnExpr& function)
   {
     compile(module, function.resolved().maxLocals(),
@@ -81,6 +126,7 @@ namespace magpie
     write(-1, OP_BUILT_IN, 3, 0);
     write(-1, OP_THROW, 0);
 
+    Optimizer::optimize(*chunk_);
     chunk_->bind(maxSlots_, function.resolved().closures().count());
     return chunk_;
   }
@@ -90,6 +136,7 @@ namespace magpie
     compile(module, expr.resolved().maxLocals(),
             NULL, NULL, NULL, expr.body());
 
+    Optimizer::optimize(*chunk_);
     chunk_->bind(maxSlots_, expr.resolved().closures().count());
     return chunk_;
   }
@@ -97,6 +144,24 @@ namespace magpie
   void ExprCompiler::compile(Module* module, int maxLocals,
                              gc<Pattern> leftParam, gc<Pattern> rightParam,
                              gc<Pattern> valueParam, gc<Expr> body)
+  {
+    startProcedure(module, maxLocals);
+
+    PatternCompiler compiler(*this, true);
+    int numParamSlots = compileParams(compiler, leftParam, rightParam,
+                                      valueParam);
+
+    // The result slot is just after the param slots.
+    compile(body, numParamSlots);
+
+    write(body->pos(), OP_RETURN, numParamSlots);
+
+    ASSERT(numTemps_ == 0, "Should not have any temps left.");
+
+    compiler.endJumps();
+  }
+  
+  void ExprCompiler::startProcedure(Module* module, int maxLocals)
   {
     currentFile_ = chunk_->addFile(module->source());
     
@@ -109,9 +174,13 @@ namespace magpie
     // have a more advanced compiler, this is a simple solution.
     numLocals_ = maxLocals;
     maxSlots_ = MAX(maxSlots_, numLocals_);
+  }
 
-    PatternCompiler compiler(*this, true);
-
+  int ExprCompiler::compileParams(PatternCompiler& compiler,
+                                  gc<Pattern> leftParam,
+                                  gc<Pattern> rightParam,
+                                  gc<Pattern> valueParam)
+  {
     // Track the slots used for the arguments and result. This code here
     // must be kept carefully in sync with the similar prelude code in
     // Resolver.
@@ -122,16 +191,20 @@ namespace magpie
     compileParam(compiler, rightParam, numParamSlots);
     compileParam(compiler, valueParam, numParamSlots);
 
-    // The result slot is just after the param slots.
-    compile(body, numParamSlots);
+    return numParamSlots;
+  }
 
-    write(body->pos(), OP_RETURN, numParamSlots);
+  int ExprCompiler::countParamSlots(gc<Pattern> param)
+  {
+    if (param.isNull()) return 0;
 
-    ASSERT(numTemps_ == 0, "Should not have any temps left.");
+    // Must match compileParam().
+    RecordPattern* record = param->asRecordPattern();
+    if (record != NULL) return record->fields().count();
 
-    compiler.endJumps();
+    return 1;
   }
-  
+
   void ExprCompiler::compileParam(PatternCompiler& compiler,
                                     gc<Pattern> param, int& slot)
   {
@@ -216,6 +289,14 @@ namespace magpie
 
   void ExprCompiler::visit(AndExpr& expr, int dest)
   {
+    // If the left side is known, only one side is needed.
+    gc<Expr> left = fold(expr.left());
+    if (!left.isNull())
+    {
+      compile(isTrue(left) ? expr.right() : left, dest);
+      return;
+    }
+
     compile(expr.left(), dest);
 
     // Leave a space for the test and jump instruction.
@@ -261,7 +342,33 @@ namespace magpie
 
   void ExprCompiler::visit(CallExpr& expr, int dest)
   {
+    Array<int> multimethods;
+    gc<Expr> folded = foldCall(expr, multimethods);
+    if (folded.isNull())
+    {
+      compileCall(expr, dest, -1);
+      return;
+    }
+
+    // The folded result is only right if the operators still dispatch to
+    // core's natives. Another module may add methods to them after this is
+    // compiled, so check that at runtime and make the call if not.
+    Array<int> guards;
+    for (int i = 0; i < multimethods.count(); i++)
+    {
+      guards.add(startJump(expr));
+    }
+
+    compile(folded, dest);
+    int done = startJump(expr);
+
+    for (int i = 0; i < guards.count(); i++)
+    {
+      endJump(guards[i], OP_JUMP_IF_SPECIALIZED, multimethods[i]);
+    }
+
     compileCall(expr, dest, -1);
+    endJump(done, OP_JUMP, 1);
   }
 
   void ExprCompiler::visit(CatchExpr& expr, int dest)
@@ -304,7 +411,9 @@ namespace magpie
     int multimethod = compiler_.findMethod(signature);
     methodId method = compiler_.addMethod(new Method(module_, &expr));
 
-    write(expr, OP_METHOD, multimethod, method);
+    // Every method in the program gets its own index, so there can be more
+    // of them than fit in one operand.
+    write(expr, OP_METHOD, multimethod, method >> 8, method & 0xff);
   }
 
   void ExprCompiler::visit(DefClassExpr& expr, int dest)
@@ -367,6 +476,14 @@ namespace magpie
     int advanceMethod = compiler_.findMethod(String::create("0:advance"));
     ASSERT(advanceMethod != -1, "Should have 'advance' method in core.");
 
+    // Looping over a range like "1..10" is common enough to count through its
+    // Ints directly instead of dispatching to "iterate" and "advance". Since
+    // ".." may be redefined, that is decided at runtime, when the range has
+    // been created. This slot holds the last Int when it does. It comes
+    // before the iterator so that the calls below don't overwrite it.
+    bool isRange = isRangeCall(expr.iterator());
+    int last = isRange ? makeTemp() : -1;
+
     // Evaluate the iteratable expression.
     int iterator = makeTemp();
     compile(expr.iterator(), iterator);
@@ -374,11 +491,13 @@ namespace magpie
     // Then call "iterate" on it to get an iterator.
     // TODO(bob): Hackish. An actual intermediate representation would help
     // here.
+    if (isRange) write(expr, OP_RANGE_ITERATE, iterator, last);
     write(expr, OP_CALL, iterateMethod, iterator, iterator);
 
     int loopStart = startJumpBack();
 
     // Call "advance" on the iterator.
+    if (isRange) write(expr, OP_RANGE_ADVANCE, iterator, last, dest);
     write(expr, OP_CALL, advanceMethod, iterator, dest);
 
     // If done, jump to exit.
@@ -401,6 +520,7 @@ namespace magpie
     loop.end();
     
     releaseTemp(); // iterator.
+    if (isRange) releaseTemp(); // last.
 
     // TODO(bob): Need to figure out what the result value should be.
   }
@@ -412,6 +532,26 @@ namespace magpie
 
   void ExprCompiler::visit(IfExpr& expr, int dest)
   {
+    // If the condition is known, only the arm that will be taken is needed.
+    gc<Expr> condition = fold(expr.condition());
+    if (!condition.isNull())
+    {
+      if (isTrue(condition))
+      {
+        compile(expr.thenArm(), dest);
+      }
+      else if (!expr.elseArm().isNull())
+      {
+        compile(expr.elseArm(), dest);
+      }
+      else
+      {
+        write(expr, OP_BUILT_IN, BUILT_IN_NOTHING, dest);
+      }
+
+      return;
+    }
+
     // Compile the condition.
     compile(expr.condition(), dest);
 
@@ -519,6 +659,14 @@ namespace magpie
 
   void ExprCompiler::visit(NotExpr& expr, int dest)
   {
+    gc<Expr> value = fold(expr.value());
+    if (!value.isNull())
+    {
+      write(expr, OP_BUILT_IN, isTrue(value) ? BUILT_IN_FALSE : BUILT_IN_TRUE,
+            dest);
+      return;
+    }
+
     compile(expr.value(), dest);
     write(expr, OP_NOT, dest);
   }
@@ -530,6 +678,14 @@ namespace magpie
 
   void ExprCompiler::visit(OrExpr& expr, int dest)
   {
+    // If the left side is known, only one side is needed.
+    gc<Expr> left = fold(expr.left());
+    if (!left.isNull())
+    {
+      compile(isTrue(left) ? left : expr.right(), dest);
+      return;
+    }
+
     compile(expr.left(), dest);
 
     // Leave a space for the test and jump instruction.
@@ -589,11 +745,13 @@ namespace magpie
 
   void ExprCompiler::visit(SequenceExpr& expr, int dest)
   {
-    for (int i = 0; i < expr.expressions().count(); i++)
+    int last = expr.expressions().count() - 1;
+    for (int i = 0; i <= last; i++)
     {
-      // TODO(bob): Could compile all but the last expression with a special
-      // sigil dest that means "won't use" and some exprs could check that to
-      // omit some unnecessary instructions.
+      // The results of all but the last expression are discarded, so the
+      // ones that don't do anything else can be skipped.
+      if (i < last && isPure(expr.expressions()[i])) continue;
+
       compile(expr.expressions()[i], dest);
     }
   }
@@ -629,19 +787,29 @@ namespace magpie
 
   void ExprCompiler::visit(WhileExpr& expr, int dest)
   {
+    // If the condition is known, there's either no loop at all or no need to
+    // test it.
+    gc<Expr> constant = fold(expr.condition());
+    if (!constant.isNull() && !isTrue(constant)) return;
+
     int loopStart = startJumpBack();
 
     // Compile the condition.
-    int condition = makeTemp();
-    compile(expr.condition(), condition);
-    int loopExit = startJump(expr);
-    releaseTemp(); // condition
+    int condition = -1;
+    int loopExit = -1;
+    if (constant.isNull())
+    {
+      condition = makeTemp();
+      compile(expr.condition(), condition);
+      loopExit = startJump(expr);
+      releaseTemp(); // condition
+    }
 
     Loop loop(this);
     compile(expr.body(), dest);
 
     endJumpBack(expr, loopStart);
-    endJump(loopExit, OP_JUMP_IF_FALSE, condition);
+    if (loopExit != -1) endJump(loopExit, OP_JUMP_IF_FALSE, condition);
     loop.end();
   }
 
@@ -721,6 +889,180 @@ namespace magpie
     }
   }
 
+  gc<Expr> ExprCompiler::fold(gc<Expr> expr)
+  {
+    if (expr.isNull()) return NULL;
+
+    if (expr->asBoolExpr() != NULL ||
+        expr->asFloatExpr() != NULL ||
+        expr->asIntExpr() != NULL ||
+        expr->asNothingExpr() != NULL ||
+        expr->asStringExpr() != NULL)
+    {
+      return expr;
+    }
+
+    NotExpr* notExpr = expr->asNotExpr();
+    if (notExpr != NULL)
+    {
+      gc<Expr> value = fold(notExpr->value());
+      if (value.isNull()) return NULL;
+      return new BoolExpr(expr->pos(), !isTrue(value));
+    }
+
+    // "and" and "or" only evaluate the right side if they have to, so only
+    // that side needs to be known.
+    AndExpr* andExpr = expr->asAndExpr();
+    if (andExpr != NULL)
+    {
+      gc<Expr> left = fold(andExpr->left());
+      if (left.isNull()) return NULL;
+      return isTrue(left) ? fold(andExpr->right()) : left;
+    }
+
+    OrExpr* orExpr = expr->asOrExpr();
+    if (orExpr != NULL)
+    {
+      gc<Expr> left = fold(orExpr->left());
+      if (left.isNull()) return NULL;
+      return isTrue(left) ? left : fold(orExpr->right());
+    }
+
+    return NULL;
+  }
+
+  bool ExprCompiler::isRangeCall(gc<Expr> expr)
+  {
+    CallExpr* call = expr->asCallExpr();
+    if (call == NULL) return false;
+    if (call->leftArg().isNull() || call->rightArg().isNull()) return false;
+
+    const String& name = *call->name();
+    return name == ".." || name == "...";
+  }
+
+  gc<Expr> ExprCompiler::foldOperand(gc<Expr> expr, Array<int>& multimethods)
+  {
+    CallExpr* call = expr->asCallExpr();
+    if (call != NULL) return foldCall(*call, multimethods);
+
+    return fold(expr);
+  }
+
+  gc<Expr> ExprCompiler::foldCall(CallExpr& expr, Array<int>& multimethods)
+  {
+    // Only operators are folded, and they never take record arguments.
+    if (expr.rightArg().isNull()) return NULL;
+
+    // If this doesn't fold, the caller ignores the multimethods anyway.
+    bool isGuarded = false;
+    for (int i = 0; i < multimethods.count(); i++)
+    {
+      if (multimethods[i] == expr.resolved()) isGuarded = true;
+    }
+
+    if (!isGuarded) multimethods.add(expr.resolved());
+
+    const String& name = *expr.name();
+    gc<Expr> right = foldOperand(expr.rightArg(), multimethods);
+    if (right.isNull()) return NULL;
+
+    if (expr.leftArg().isNull())
+    {
+      if (name != "-") return NULL;
+
+      IntExpr* intArg = right->asIntExpr();
+      if (intArg != NULL)
+      {
+        if (intArg->value() == INT_MIN) return NULL;
+        return new IntExpr(expr.pos(), -intArg->value());
+      }
+
+      FloatExpr* floatArg = right->asFloatExpr();
+      if (floatArg != NULL)
+      {
+        return new FloatExpr(expr.pos(), -floatArg->value());
+      }
+
+      return NULL;
+    }
+
+    gc<Expr> left = foldOperand(expr.leftArg(), multimethods);
+    if (left.isNull()) return NULL;
+
+    StringExpr* leftString = left->asStringExpr();
+    StringExpr* rightString = right->asStringExpr();
+    if (leftString != NULL && rightString != NULL)
+    {
+      if (name != "+") return NULL;
+      return new StringExpr(expr.pos(), String::concat(leftString->value(),
+                                                       rightString->value()));
+    }
+
+    IntExpr* leftInt = left->asIntExpr();
+    IntExpr* rightInt = right->asIntExpr();
+    if (leftInt != NULL && rightInt != NULL)
+    {
+      int a = leftInt->value();
+      int b = rightInt->value();
+
+      if (name == "+") return new IntExpr(expr.pos(), a + b);
+      if (name == "-") return new IntExpr(expr.pos(), a - b);
+      if (name == "*") return new IntExpr(expr.pos(), a * b);
+
+      // Leave division by zero and overflow for runtime.
+      if (b == 0 || (a == INT_MIN && b == -1)) return NULL;
+      if (name == "/") return new IntExpr(expr.pos(), a / b);
+      if (name == "%") return new IntExpr(expr.pos(), a % b);
+      return NULL;
+    }
+
+    // Mixed Int and Float arithmetic produces a Float.
+    FloatExpr* leftFloat = left->asFloatExpr();
+    FloatExpr* rightFloat = right->asFloatExpr();
+    if ((leftInt == NULL && leftFloat == NULL) ||
+        (rightInt == NULL && rightFloat == NULL))
+    {
+      return NULL;
+    }
+
+    double a = (leftInt != NULL) ? leftInt->value() : leftFloat->value();
+    double b = (rightInt != NULL) ? rightInt->value() : rightFloat->value();
+
+    if (name == "+") return new FloatExpr(expr.pos(), a + b);
+    if (name == "-") return new FloatExpr(expr.pos(), a - b);
+    if (name == "*") return new FloatExpr(expr.pos(), a * b);
+    if (name == "/") return new FloatExpr(expr.pos(), a / b);
+    return NULL;
+  }
+
+  bool ExprCompiler::isTrue(gc<Expr> literal)
+  {
+    // Must match the toBool() methods in Object.h.
+    BoolExpr* boolExpr = literal->asBoolExpr();
+    if (boolExpr != NULL) return boolExpr->value();
+
+    FloatExpr* floatExpr = literal->asFloatExpr();
+    if (floatExpr != NULL) return floatExpr->value() != 0;
+
+    IntExpr* intExpr = literal->asIntExpr();
+    if (intExpr != NULL) return intExpr->value() != 0;
+
+    return literal->asNothingExpr() == NULL;
+  }
+
+  bool ExprCompiler::isPure(gc<Expr> expr)
+  {
+    if (expr->asCharacterExpr() != NULL) return true;
+
+    // Reading a local can't fail, but reading a module variable can throw if
+    // it hasn't been defined yet.
+    NameExpr* name = expr->asNameExpr();
+    if (name != NULL) return name->resolved()->scope() != NAME_MODULE;
+
+    return !fold(expr).isNull();
+  }
+
   void ExprCompiler::compileCall(const CallExpr& call, int dest,
                                    int valueSlot)
   {
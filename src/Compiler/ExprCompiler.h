@@ -26,10 +26,15 @@ namespace magpie
     
     gc<Chunk> compileBody(Module* module, gc<Expr> body);
 
-    // Compiles [multimethod] to bytecode. Assumes the methods have already
-    // been sorted.
+    // Compiles the code that dispatches a call to [multimethod] to one of
+    // its methods. Assumes the methods have already been sorted.
     gc<Chunk> compile(Multimethod& multimethod);
 
+    // Compiles the body of [method] to bytecode. It runs in the same call
+    // frame as the multimethod's dispatch code, after that has bound the
+    // method's parameters.
+    gc<Chunk> compile(Method& method);
+
     // Compiles [function] to bytecode.
     gc<Chunk> compile(Module* module, FnExpr& function);
 
@@ -40,6 +45,15 @@ namespace magpie
                  gc<Pattern> leftParam, gc<Pattern> rightParam,
                  gc<Pattern> valueParam, gc<Expr> body);
 
+    // Starts compiling a method, function or other body of code in [module]
+    // that uses [maxLocals] local variable slots.
+    void startProcedure(Module* module, int maxLocals);
+
+    // Compiles the tests and bindings for a procedure's parameters. Returns
+    // the number of slots they use.
+    int compileParams(PatternCompiler& compiler, gc<Pattern> leftParam,
+                      gc<Pattern> rightParam, gc<Pattern> valueParam);
+    static int countParamSlots(gc<Pattern> param);
     void compileParam(PatternCompiler& compiler, gc<Pattern> param, int& slot);
     void compileParamField(PatternCompiler& compiler, gc<Pattern> param,
                            int slot);
@@ -90,6 +104,32 @@ namespace magpie
 
     void compileMatch(const Array<MatchClause>& clauses, int dest);
 
+    // Evaluates [expr] at compile time if it's a literal, or a "not", "and"
+    // or "or" of literals. Returns the resulting literal, or NULL if [expr]
+    // can't be folded. Calls are never folded here since any module may add
+    // methods to them.
+    static gc<Expr> fold(gc<Expr> expr);
+
+    // Folds a call to one of the core arithmetic or string concatenation
+    // operators on literal arguments, doing what core's natives would do at
+    // runtime. Adds the index of each multimethod the result depends on to
+    // [multimethods], so that the caller can check that none of them have
+    // been specialized outside of core before using it.
+    static gc<Expr> foldCall(CallExpr& expr, Array<int>& multimethods);
+
+    // Folds an argument to an operator, which may itself be a call.
+    static gc<Expr> foldOperand(gc<Expr> expr, Array<int>& multimethods);
+
+    // Gets whether [literal], a result of fold(), is true in a condition.
+    static bool isTrue(gc<Expr> literal);
+
+    // Returns true if evaluating [expr] has no side effects, so that it can
+    // be omitted if its result isn't used.
+    static bool isPure(gc<Expr> expr);
+
+    // Returns true if [expr] calls ".." or "..." to create a range.
+    static bool isRangeCall(gc<Expr> expr);
+
     // Compiles a method call. If `valueSlot` is -1, then it's a regular call.
     // Otherwise, it's a call to a setter, and `valueSlot` is the slot holding
     // the right-hand side value.
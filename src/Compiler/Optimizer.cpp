@@ -0,0 +1,603 @@
+#include <cstring>
+
+#include "Method.h"
+#include "Optimizer.h"
+
+namespace magpie
+{
+  void Optimizer::optimize(Chunk& chunk)
+  {
+    Optimizer optimizer(chunk);
+    if (!optimizer.decode()) return;
+
+    for (int round = 0; round < MAX_ROUNDS; round++)
+    {
+      bool changed = false;
+
+      optimizer.findBlocks();
+      optimizer.findLiveness();
+      if (optimizer.coalesceMoves())
+      {
+        changed = true;
+        optimizer.compact();
+        optimizer.findBlocks();
+      }
+
+      if (optimizer.propagateCopies()) changed = true;
+
+      optimizer.findLiveness();
+      if (optimizer.removeDeadStores())
+      {
+        changed = true;
+        optimizer.compact();
+      }
+
+      if (!changed) break;
+    }
+
+    optimizer.encode();
+  }
+
+  Optimizer::Optimizer(Chunk& chunk)
+  : chunk_(chunk),
+    ops_(NULL),
+    numOps_(0),
+    isLeader_(NULL),
+    liveOut_(NULL)
+  {}
+
+  Optimizer::~Optimizer()
+  {
+    delete [] ops_;
+    delete [] isLeader_;
+    delete [] liveOut_;
+  }
+
+  bool Optimizer::decode()
+  {
+    numOps_ = chunk_.count();
+    if (numOps_ == 0) return false;
+
+    ops_ = new Op[numOps_];
+    isLeader_ = new bool[numOps_];
+    liveOut_ = new unsigned int[numOps_ * SLOT_WORDS];
+
+    for (int i = 0; i < numOps_; i++)
+    {
+      instruction ins = chunk_.code()[i];
+      Op& op = ops_[i];
+      op.op = GET_OP(ins);
+      op.a = GET_A(ins);
+      op.b = GET_B(ins);
+      op.c = GET_C(ins);
+      op.file = chunk_.codePos(i).file;
+      op.line = chunk_.codePos(i).line;
+    }
+
+    int i = 0;
+    while (i < numOps_)
+    {
+      Op& op = ops_[i];
+      int numData = 0;
+
+      switch (op.op)
+      {
+        case OP_ENTER_TRY:
+        case OP_EXIT_TRY:
+        case OP_GET_CLASS_FIELD:
+        case OP_SET_CLASS_FIELD:
+        case OP_METHOD_BODY:
+        case OP_NATIVE:
+          return false;
+
+        case OP_CLASS:
+          // Followed by the superclass slots.
+          numData = 1;
+          break;
+
+        case OP_FUNCTION:
+        case OP_ASYNC:
+          // Followed by the upvars to capture.
+          numData = chunk_.getChunk(op.a)->numUpvars();
+          break;
+
+        case OP_JUMP:
+          op.target = (op.a == 1) ? i + 1 + op.b : i + 1 - op.b;
+          break;
+
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_JUMP_IF_SPECIALIZED:
+          op.target = i + 1 + op.b;
+          break;
+
+        default:
+          break;
+      }
+
+      for (int j = 1; j <= numData; j++) ops_[i + j].isData = true;
+      i += 1 + numData;
+    }
+
+    return true;
+  }
+
+  void Optimizer::encode()
+  {
+    for (int i = 0; i < numOps_; i++)
+    {
+      Op& op = ops_[i];
+      int a = op.a;
+      int b = op.b;
+
+      if (op.target != -1)
+      {
+        int offset = op.target - (i + 1);
+        if (op.op == OP_JUMP)
+        {
+          a = (offset >= 0) ? 1 : 0;
+          b = (offset >= 0) ? offset : -offset;
+        }
+        else
+        {
+          b = offset;
+        }
+      }
+
+      chunk_.rewrite(i, op.file, op.line, MAKE_ABC(a, b, op.c, op.op));
+    }
+
+    chunk_.truncate(numOps_);
+  }
+
+  bool Optimizer::coalesceMoves()
+  {
+    bool changed = false;
+
+    for (int i = 1; i < numOps_; i++)
+    {
+      Op& move = ops_[i];
+      if (move.op != OP_MOVE || move.isData || isLeader_[i]) continue;
+      if (move.a == move.b || ops_[i - 1].isRemoved) continue;
+
+      int* def = getRetargetableDef(i - 1);
+      if (def == NULL || *def != move.a) continue;
+
+      // The moved-from slot must not be needed for anything else.
+      if (isLiveAfter(i, move.a)) continue;
+
+      *def = move.b;
+      move.isRemoved = true;
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  bool Optimizer::propagateCopies()
+  {
+    bool changed = false;
+
+    // For each slot, the slot it currently holds a copy of, or -1.
+    int copyOf[256];
+
+    for (int i = 0; i < numOps_; i++)
+    {
+      if (isLeader_[i])
+      {
+        for (int slot = 0; slot < 256; slot++) copyOf[slot] = -1;
+      }
+
+      Op& op = ops_[i];
+      if (op.isData) continue;
+
+      // Replace reads of copies with the original. Only single slot operands
+      // are changed, since the slots for arguments and the like must stay
+      // contiguous.
+      int* read1 = NULL;
+      int* read2 = NULL;
+      switch (op.op)
+      {
+        case OP_MOVE:
+        case OP_GET_FIELD:
+        case OP_TEST_FIELD:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_RETURN:
+        case OP_THROW:
+        case OP_TEST_MATCH:
+          read1 = &op.a;
+          break;
+
+        case OP_EQUAL:
+        case OP_IS:
+          read1 = &op.a;
+          read2 = &op.b;
+          break;
+
+        case OP_SET_UPVAR:
+          read1 = &op.b;
+          break;
+
+        case OP_SET_VAR:
+          read1 = &op.c;
+          break;
+
+        default:
+          break;
+      }
+
+      if (read1 != NULL && copyOf[*read1] != -1)
+      {
+        *read1 = copyOf[*read1];
+        changed = true;
+      }
+
+      if (read2 != NULL && copyOf[*read2] != -1)
+      {
+        *read2 = copyOf[*read2];
+        changed = true;
+      }
+
+      // Forget any copies whose slots are overwritten. A call uses the slots
+      // from its first argument on for the called method's frame.
+      int firstClobbered = (op.op == OP_CALL) ? op.b : 256;
+      int def = getDef(i);
+      for (int slot = 0; slot < 256; slot++)
+      {
+        if (copyOf[slot] == -1) continue;
+
+        if (slot == def || copyOf[slot] == def ||
+            slot >= firstClobbered || copyOf[slot] >= firstClobbered)
+        {
+          copyOf[slot] = -1;
+        }
+      }
+
+      if (op.op == OP_MOVE && op.a != op.b) copyOf[op.b] = op.a;
+    }
+
+    return changed;
+  }
+
+  bool Optimizer::removeDeadStores()
+  {
+    bool changed = false;
+
+    for (int i = 0; i < numOps_; i++)
+    {
+      Op& op = ops_[i];
+      if (op.isData) continue;
+
+      int slot;
+      switch (op.op)
+      {
+        case OP_MOVE:
+          // Moving a slot to itself does nothing.
+          if (op.a == op.b)
+          {
+            op.isRemoved = true;
+            changed = true;
+            continue;
+          }
+
+          slot = op.b;
+          break;
+
+        case OP_CONSTANT:
+        case OP_BUILT_IN:
+        case OP_GET_UPVAR:
+          slot = op.b;
+          break;
+
+        default:
+          continue;
+      }
+
+      if (!isLiveAfter(i, slot))
+      {
+        op.isRemoved = true;
+        changed = true;
+      }
+    }
+
+    return changed;
+  }
+
+  void Optimizer::compact()
+  {
+    // Find where each op will end up. A jump to a removed op goes to the
+    // next one that remains.
+    int* newIndex = new int[numOps_ + 1];
+    int count = 0;
+    for (int i = 0; i < numOps_; i++)
+    {
+      newIndex[i] = count;
+      if (!ops_[i].isRemoved) count++;
+    }
+
+    newIndex[numOps_] = count;
+
+    for (int i = 0; i < numOps_; i++)
+    {
+      if (ops_[i].isRemoved) continue;
+
+      Op op = ops_[i];
+      if (op.target != -1) op.target = newIndex[op.target];
+      ops_[newIndex[i]] = op;
+    }
+
+    numOps_ = count;
+    delete [] newIndex;
+  }
+
+  void Optimizer::findBlocks()
+  {
+    for (int i = 0; i < numOps_; i++) isLeader_[i] = false;
+    isLeader_[0] = true;
+
+    int successors[2];
+    for (int i = 0; i < numOps_; i++)
+    {
+      Op& op = ops_[i];
+      if (op.isData) continue;
+
+      int numSuccessors = getSuccessors(i, successors);
+      bool isBranch = numSuccessors != 1 || successors[0] != i + 1;
+      if (!isBranch) continue;
+
+      for (int j = 0; j < numSuccessors; j++)
+      {
+        if (successors[j] < numOps_) isLeader_[successors[j]] = true;
+      }
+
+      if (i + 1 < numOps_) isLeader_[i + 1] = true;
+    }
+  }
+
+  void Optimizer::findLiveness()
+  {
+    memset(liveOut_, 0, sizeof(unsigned int) * numOps_ * SLOT_WORDS);
+
+    // Iterate backwards until nothing changes. Loops mean that liveness can
+    // flow back around to code that has already been visited.
+    unsigned int liveIn[SLOT_WORDS];
+    int successors[2];
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+
+      for (int i = numOps_ - 1; i >= 0; i--)
+      {
+        unsigned int* out = &liveOut_[i * SLOT_WORDS];
+        int numSuccessors = getSuccessors(i, successors);
+
+        for (int j = 0; j < numSuccessors; j++)
+        {
+          int successor = successors[j];
+          if (successor >= numOps_) continue;
+
+          // Live in to the successor is what it uses plus what's live after
+          // it that it doesn't overwrite.
+          memcpy(liveIn, &liveOut_[successor * SLOT_WORDS], sizeof(liveIn));
+
+          int def = getDef(successor);
+
+          // A failed OP_TEST_FIELD doesn't write its destination.
+          if (def != -1 && ops_[successor].op != OP_TEST_FIELD)
+          {
+            liveIn[def / 32] &= ~(1u << (def % 32));
+          }
+
+          addUses(successor, liveIn);
+
+          for (int k = 0; k < SLOT_WORDS; k++)
+          {
+            if ((out[k] | liveIn[k]) != out[k])
+            {
+              out[k] |= liveIn[k];
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void Optimizer::addUses(int index, unsigned int* slots) const
+  {
+    const Op& op = ops_[index];
+    if (op.isData) return;
+
+    switch (op.op)
+    {
+      case OP_MOVE:
+      case OP_GET_FIELD:
+      case OP_TEST_FIELD:
+      case OP_NOT:
+      case OP_JUMP_IF_FALSE:
+      case OP_JUMP_IF_TRUE:
+      case OP_RETURN:
+      case OP_THROW:
+      case OP_TEST_MATCH:
+        addSlot(slots, op.a);
+        break;
+
+      case OP_RANGE_ITERATE:
+        addSlot(slots, op.a);
+        break;
+
+      case OP_EQUAL:
+      case OP_IS:
+      case OP_RANGE_ADVANCE:
+        addSlot(slots, op.a);
+        addSlot(slots, op.b);
+        break;
+
+      case OP_SET_UPVAR:
+        addSlot(slots, op.b);
+        break;
+
+      case OP_SET_VAR:
+        addSlot(slots, op.c);
+        break;
+
+      case OP_LIST:
+        for (int i = 0; i < op.b; i++) addSlot(slots, op.a + i);
+        break;
+
+      case OP_CLASS:
+      {
+        const Op& superclasses = ops_[index + 1];
+        for (int i = 0; i < superclasses.b; i++)
+        {
+          addSlot(slots, superclasses.a + i);
+        }
+        break;
+      }
+
+      case OP_RECORD:
+        // The number of fields depends on the record type, so assume the
+        // record uses everything after the first one.
+        addSlotsFrom(slots, op.a);
+        break;
+
+      case OP_CALL:
+        // Likewise, the number of arguments depends on the method.
+        addSlotsFrom(slots, op.b);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  int Optimizer::getDef(int index) const
+  {
+    const Op& op = ops_[index];
+    if (op.isData) return -1;
+
+    switch (op.op)
+    {
+      case OP_NOT:
+        return op.a;
+
+      case OP_MOVE:
+      case OP_CONSTANT:
+      case OP_BUILT_IN:
+      case OP_FUNCTION:
+      case OP_GET_UPVAR:
+        return op.b;
+
+      case OP_RECORD:
+      case OP_LIST:
+      case OP_CLASS:
+      case OP_GET_FIELD:
+      case OP_TEST_FIELD:
+      case OP_GET_VAR:
+      case OP_EQUAL:
+      case OP_IS:
+      case OP_CALL:
+        return op.c;
+
+      default:
+        return -1;
+    }
+  }
+
+  int* Optimizer::getRetargetableDef(int index)
+  {
+    Op& op = ops_[index];
+    if (op.isData) return NULL;
+
+    // All of these read their operands before writing the result, so it
+    // doesn't matter if the new destination is also one of their operands.
+    switch (op.op)
+    {
+      case OP_MOVE:
+      case OP_CONSTANT:
+      case OP_BUILT_IN:
+      case OP_FUNCTION:
+      case OP_GET_UPVAR:
+        return &op.b;
+
+      case OP_RECORD:
+      case OP_LIST:
+      case OP_GET_FIELD:
+      case OP_GET_VAR:
+      case OP_EQUAL:
+      case OP_IS:
+      case OP_CALL:
+        return &op.c;
+
+      default:
+        return NULL;
+    }
+  }
+
+  int Optimizer::getSuccessors(int index, int* successors) const
+  {
+    const Op& op = ops_[index];
+    if (op.isData)
+    {
+      successors[0] = index + 1;
+      return 1;
+    }
+
+    switch (op.op)
+    {
+      case OP_JUMP:
+        successors[0] = op.target;
+        return 1;
+
+      case OP_JUMP_IF_FALSE:
+      case OP_JUMP_IF_TRUE:
+      case OP_JUMP_IF_SPECIALIZED:
+        successors[0] = index + 1;
+        successors[1] = op.target;
+        return 2;
+
+      case OP_TEST_FIELD:
+        // Either falls into the following jump or skips over it.
+        successors[0] = index + 1;
+        successors[1] = index + 2;
+        return 2;
+
+      case OP_RANGE_ITERATE:
+      case OP_RANGE_ADVANCE:
+        // Either falls into the following call or skips over it.
+        successors[0] = index + 1;
+        successors[1] = index + 2;
+        return 2;
+
+      case OP_RETURN:
+      case OP_THROW:
+        return 0;
+
+      default:
+        successors[0] = index + 1;
+        return 1;
+    }
+  }
+
+  bool Optimizer::isLiveAfter(int index, int slot) const
+  {
+    return hasSlot(&liveOut_[index * SLOT_WORDS], slot);
+  }
+
+  void Optimizer::addSlot(unsigned int* slots, int slot)
+  {
+    slots[slot / 32] |= 1u << (slot % 32);
+  }
+
+  void Optimizer::addSlotsFrom(unsigned int* slots, int first)
+  {
+    for (int slot = first; slot < 256; slot++) addSlot(slots, slot);
+  }
+
+  bool Optimizer::hasSlot(const unsigned int* slots, int slot)
+  {
+    return (slots[slot / 32] & (1u << (slot % 32))) != 0;
+  }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "Macros.h"
+
+namespace magpie
+{
+  class Chunk;
+
+  // Rewrites the bytecode of a compiled chunk so that it does the same thing
+  // with fewer instructions. ExprCompiler generates code in a single pass over
+  // the AST, so it often computes a value into one slot only to move it
+  // straight into another.
+  //
+  // The optimizer decodes a chunk into a list of ops whose jumps point to
+  // other ops instead of being offsets. It runs each pass over that until
+  // none of them can do any more, and then encodes the ops back into the
+  // chunk.
+  //
+  // Chunks that use catch handlers, natives, class fields or method bodies
+  // are left alone. Those read and write slots that aren't named by their
+  // operands.
+  class Optimizer
+  {
+  public:
+    static void optimize(Chunk& chunk);
+
+  private:
+    // The number of words in a set of slots. Slot operands are one byte, so
+    // a set holds 256 of them.
+    static const int SLOT_WORDS = 256 / 32;
+
+    // The most times to run the passes over a chunk.
+    static const int MAX_ROUNDS = 4;
+
+    // A single decoded instruction.
+    struct Op
+    {
+      Op()
+      : op(OP_MOVE),
+        a(0),
+        b(0),
+        c(0),
+        target(-1),
+        isData(false),
+        isRemoved(false),
+        file(0),
+        line(0)
+      {}
+
+      OpCode op;
+      int a;
+      int b;
+      int c;
+
+      // If this is a jump, the index of the op it jumps to.
+      int target;
+
+      // True if this isn't executed itself but holds extra operands for an
+      // earlier op, like the upvars captured by OP_FUNCTION.
+      bool isData;
+
+      // Set by a pass to remove this op.
+      bool isRemoved;
+
+      // The source location the op came from.
+      int file;
+      int line;
+    };
+
+    Optimizer(Chunk& chunk);
+    ~Optimizer();
+
+    // Decodes the chunk. Returns false if it can't be optimized.
+    bool decode();
+    void encode();
+
+    // The passes. Each returns true if it changed anything.
+
+    // Removes a move out of a slot just written by the previous op by
+    // having that op write to the move's destination instead.
+    bool coalesceMoves();
+
+    // Within a basic block, reads a value from the slot it was moved out of
+    // instead of the slot it was moved to, so that the move may be dead.
+    bool propagateCopies();
+
+    // Removes moves and loads of values into slots that are never read.
+    bool removeDeadStores();
+
+    // Deletes the removed ops and fixes up jumps to point past them.
+    void compact();
+
+    // Finds the ops that start basic blocks.
+    void findBlocks();
+
+    // Finds the slots that are live after each op.
+    void findLiveness();
+
+    // Adds the slots read by the op at [index] to [slots].
+    void addUses(int index, unsigned int* slots) const;
+
+    // Gets the slot the op at [index] writes to, or -1 if it doesn't. Ops that
+    // write more than one slot, like OP_RANGE_ADVANCE, also return -1. That
+    // keeps earlier stores to those slots alive, which is always safe.
+    int getDef(int index) const;
+
+    // Gets the operand holding the slot the op at [index] writes its result
+    // to, if the op can be told to write it somewhere else. Otherwise NULL.
+    int* getRetargetableDef(int index);
+
+    // Gets the ops that execution may continue with after the op at [index].
+    // Returns the number of them.
+    int getSuccessors(int index, int* successors) const;
+
+    bool isLiveAfter(int index, int slot) const;
+
+    static void addSlot(unsigned int* slots, int slot);
+    static void addSlotsFrom(unsigned int* slots, int first);
+    static bool hasSlot(const unsigned int* slots, int slot);
+
+    Chunk& chunk_;
+
+    Op* ops_;
+    int numOps_;
+
+    // Whether each op starts a basic block.
+    bool* isLeader_;
+
+    // The set of slots live after each op.
+    unsigned int* liveOut_;
+
+    NO_COPY(Optimizer);
+  };
+}
@@ -21,6 +21,6 @@ namespace magpie
 
   void* Managed::operator new(size_t s)
   {
-    return Memory::allocate(s);
+    return Memory::current().allocate(s);
   }
 }
@@ -24,10 +24,16 @@ namespace magpie
     virtual Managed* getForwardingAddress() const { return NULL; }
 
     // This will be called by the garbage collector when this object has been
-    // reached. Subclasses should override this and call Memory::copy() on any
-    // gc<T> references that the object contains.
+    // reached. Subclasses should override this and call reach() on any gc<T>
+    // references that the object contains.
     virtual void reach() {}
 
+    // Called by the garbage collector when an object that was registered with
+    // Memory::addFinalizer() is found to be unreachable. Use this to release
+    // native resources the object owns. This is called in the middle of a
+    // collection, so it must not touch any other GC objects.
+    virtual void finalize() {}
+
     virtual void trace(std::ostream& out) const;
     
     void* operator new(size_t s);
@@ -7,13 +7,36 @@
 
 namespace magpie
 {  
-  RootSource* Memory::roots_ = NULL;
-  Semispace Memory::a_;
-  Semispace Memory::b_;
-  int Memory::numCollections_ = 0;
-  Semispace* Memory::to_ = NULL;
-  Semispace* Memory::from_ = NULL;
-  
+  THREAD_LOCAL Memory* Memory::current_ = NULL;
+
+  Memory* Memory::setCurrent(Memory* memory)
+  {
+    Memory* previous = current_;
+    current_ = memory;
+    return previous;
+  }
+
+  Memory::Memory()
+  : roots_(NULL),
+    from_(NULL),
+    to_(NULL),
+    a_(),
+    b_(),
+    numCollections_(0),
+    finalizable_(NULL),
+    numFinalizable_(0),
+    finalizableCapacity_(0)
+  {}
+
+  Memory::~Memory()
+  {
+    finalizeAll();
+    delete [] finalizable_;
+
+    // Don't leave a dangling current heap behind.
+    if (current_ == this) current_ = NULL;
+  }
+
   void Memory::initialize(RootSource* roots, size_t heapSize)
   {
     ASSERT_NOT_NULL(roots);
@@ -30,6 +53,8 @@ namespace magpie
   void Memory::shutDown()
   {
     ASSERT(roots_ != NULL, "Not initialized.");
+
+    finalizeAll();
     
     roots_ = NULL;
     a_.shutDown();
@@ -56,6 +81,10 @@ namespace magpie
       reached = to_->getNext(reached);
     }
 
+    // Now that we know what's alive, finalize what isn't. This has to happen
+    // before from-space is cleared since that's where the dead objects are.
+    sweepFinalizers();
+
     // We've copied everything reachable from from_ so it can be cleared now.
     from_->reset();
     
@@ -103,6 +132,58 @@ namespace magpie
     return from_->allocate(size);
   }
   
+  void Memory::addFinalizer(Managed* object)
+  {
+    if (numFinalizable_ == finalizableCapacity_)
+    {
+      int capacity = finalizableCapacity_ == 0 ? 16 : finalizableCapacity_ * 2;
+      Managed** finalizable = new Managed*[capacity];
+      for (int i = 0; i < numFinalizable_; i++)
+      {
+        finalizable[i] = finalizable_[i];
+      }
+
+      delete [] finalizable_;
+      finalizable_ = finalizable;
+      finalizableCapacity_ = capacity;
+    }
+
+    finalizable_[numFinalizable_++] = object;
+  }
+
+  void Memory::sweepFinalizers()
+  {
+    int numAlive = 0;
+    for (int i = 0; i < numFinalizable_; i++)
+    {
+      Managed* object = finalizable_[i];
+      Managed* forward = object->getForwardingAddress();
+
+      if (forward != NULL)
+      {
+        // It survived, so track it at its new location.
+        finalizable_[numAlive++] = forward;
+      }
+      else
+      {
+        // It wasn't copied, so it's garbage.
+        object->finalize();
+      }
+    }
+
+    numFinalizable_ = numAlive;
+  }
+
+  void Memory::finalizeAll()
+  {
+    for (int i = 0; i < numFinalizable_; i++)
+    {
+      finalizable_[i]->finalize();
+    }
+
+    numFinalizable_ = 0;
+  }
+
   Managed* Memory::copy(Managed* obj)
   {
     // See if what we're pointing to has already been moved.
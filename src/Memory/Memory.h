@@ -35,37 +35,80 @@ namespace magpie
   //     are on the stack.
   //
   // What can I say, it's my first GC.
+  //
+  // Each VM owns its own heap, so a single process can host several
+  // independent VMs. Allocation doesn't take a heap argument (operator new
+  // can't), so instead each thread has a "current" heap that allocations go
+  // to. A VM makes its heap current when it's created. If you hand a VM off to
+  // a different thread, call setCurrent() on that thread before using it.
   class Memory
   {
     template <class> friend class gc;
     
   public:
-    static void initialize(RootSource* roots, size_t heapSize);
-    static void shutDown();
+    // Gets the heap that allocations on the calling thread will go to.
+    static Memory& current()
+    {
+      ASSERT(current_ != NULL, "No heap is current on this thread.");
+      return *current_;
+    }
+
+    // Makes [memory] the heap that allocations on the calling thread will go
+    // to. Returns the previously current heap, which may be NULL.
+    static Memory* setCurrent(Memory* memory);
+
+    Memory();
+    ~Memory();
+
+    void initialize(RootSource* roots, size_t heapSize);
+    void shutDown();
     
-    static bool checkCollect();
+    bool checkCollect();
     
-    static void* allocate(size_t size);
+    void* allocate(size_t size);
+
+    // Registers [object], which must have been allocated on this heap, to have
+    // its finalize() method called once it is no longer reachable. Any objects
+    // still alive when the heap is shut down are finalized then.
+    void addFinalizer(Managed* object);
     
-    static int numCollections() { return numCollections_; }
+    int numCollections() const { return numCollections_; }
     
   private:
     // If the pointed-to object is in from-space, copies it to to-space and
     // leaves a forwarding pointer. If it's a forwarding pointer already, just
     // updates the reference. Returns the new address of the object.
-    static Managed* copy(Managed* obj);
+    Managed* copy(Managed* obj);
+
+    // Called after live objects have been copied to to-space. Finalizes the
+    // registered objects that were left behind and updates the rest to their
+    // new locations.
+    void sweepFinalizers();
+
+    // Finalizes every registered object.
+    void finalizeAll();
     
-    static RootSource*  roots_;
+    static THREAD_LOCAL Memory* current_;
+
+    RootSource*  roots_;
     
     // Pointers to a and b. These will swap back and forth on each collection.
-    static Semispace* from_;
-    static Semispace* to_;
+    Semispace* from_;
+    Semispace* to_;
     
     // The actual semispaces.
-    static Semispace a_;
-    static Semispace b_;
+    Semispace a_;
+    Semispace b_;
     
-    static int numCollections_;
+    int numCollections_;
+
+    // The objects that need finalizing. This is allocated on the native heap
+    // so that it doesn't move during a collection.
+    Managed** finalizable_;
+    int numFinalizable_;
+    int finalizableCapacity_;
+
+    NO_COPY(Memory);
   };
   
   // A reference to an object on the garbage-collected heap. It's basically a
@@ -147,7 +190,7 @@ namespace magpie
     void reach()
     {
       if (object_ == NULL) return;
-      object_ = static_cast<T*>(Memory::copy(object_));
+      object_ = static_cast<T*>(Memory::current().copy(object_));
     }
     
     bool isNull() const { return object_ == NULL; }
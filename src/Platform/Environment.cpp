@@ -1,9 +1,78 @@
+#include <cstdio>
+#include <cstring>
+
 #include "Macros.h"
 #include "Environment.h"
 #include "Path.h"
 
 namespace magpie
 {
+  char* readFileBytes(const char* path, int& length)
+  {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    // Start with room for what the OS says the size is, plus one byte so that
+    // hitting the end doesn't need another allocation. The size is only a
+    // hint: some files (like ones in /proc) report the wrong size, so keep
+    // reading until the end either way.
+    long size = 0;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    if (size < 0 || size > 0x7ffffffe) size = 0;
+    rewind(file);
+
+    int capacity = static_cast<int>(size) + 1;
+    char* bytes = new char[capacity];
+    bool failed = false;
+    length = 0;
+
+    while (true)
+    {
+      if (length == capacity)
+      {
+        // Don't overflow an int.
+        if (capacity > 0x3fffffff)
+        {
+          failed = true;
+          break;
+        }
+
+        char* bigger = new char[capacity * 2];
+        memcpy(bigger, bytes, length);
+        delete [] bytes;
+        bytes = bigger;
+        capacity *= 2;
+      }
+
+      size_t read = fread(bytes + length, 1, capacity - length, file);
+      length += static_cast<int>(read);
+      if (read == 0) break;
+    }
+
+    if (ferror(file)) failed = true;
+    fclose(file);
+
+    if (failed)
+    {
+      delete [] bytes;
+      length = 0;
+      return NULL;
+    }
+
+    return bytes;
+  }
+
+  gc<String> readFile(gc<String> path)
+  {
+    int length;
+    char* bytes = readFileBytes(path->cString(), length);
+    if (bytes == NULL) return gc<String>();
+
+    gc<String> result = String::create(bytes, length);
+    delete [] bytes;
+    return result;
+  }
+
   gc<String> locateModule(gc<String> programDir, gc<String> name)
   {
     // Build a relative path from the module name.
@@ -10,6 +10,12 @@ namespace magpie
   // modules.
   gc<String> getCoreLibDir();
 
+  // Reads the entire file at [path] into a new array on the native heap, and
+  // sets [length] to its size. The caller owns the array. Returns NULL if the
+  // file could not be read or is too big to fit. Doesn't touch the GC heap,
+  // so it's safe to call from a worker thread.
+  char* readFileBytes(const char* path, int& length);
+
   // TODO(bob): Move this into a File module/class.
   // TODO(bob): Better error reporting.
   // Reads the text file at [path] and returns its contents. Returns NULL if
@@ -1,6 +1,5 @@
 #include <mach-o/dyld.h>
 #include <cstring>
-#include <fstream>
 #include <limits.h>
 
 #include "Macros.h"
@@ -47,29 +46,4 @@ namespace magpie
     realpath(relativePath, path);
     return String::create(path);
   }
-
-  // Reads a file from the given path into a String.
-  gc<String> readFile(gc<String> path)
-  {
-    // TODO(bob): Use platform-native API for this?
-    using namespace std;
-    
-    ifstream stream(path->cString());
-
-    if (stream.fail()) return gc<String>();
-
-    // From: http://stackoverflow.com/questions/2602013/read-whole-ascii-file-into-c-stdstring.
-    string str;
-
-    // Allocate a std::string big enough for the file.
-    stream.seekg(0, ios::end);
-    str.reserve(stream.tellg());
-    stream.seekg(0, ios::beg);
-
-    // Read it in.
-    str.assign((istreambuf_iterator<char>(stream)),
-               istreambuf_iterator<char>());
-    
-    return String::create(str.c_str());
-  }
 }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Macros.h"
+
+namespace magpie
+{
+  // A read-only view of a file's contents mapped directly into memory. The
+  // OS pages the data in as it's touched, so opening even a huge file is
+  // cheap, and the data lives outside of the garbage collected heap.
+  class MappedFile
+  {
+  public:
+    // Maps the file at [path]. Returns NULL if it couldn't be opened or
+    // mapped.
+    static MappedFile* open(const char* path);
+
+    // Unmaps the file.
+    ~MappedFile();
+
+    const unsigned char* data() const { return data_; }
+    int size() const { return size_; }
+
+  private:
+    MappedFile(const unsigned char* data, int size, void* handle)
+    : data_(data),
+      size_(size),
+      handle_(handle)
+    {}
+
+    const unsigned char* data_;
+    int size_;
+
+    // Platform-specific data needed to unmap the file.
+    void* handle_;
+
+    NO_COPY(MappedFile);
+  };
+}
@@ -0,0 +1,45 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+namespace magpie
+{
+  MappedFile* MappedFile::open(const char* path)
+  {
+    int file = ::open(path, O_RDONLY);
+    if (file == -1) return NULL;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_size > 0x7fffffff)
+    {
+      close(file);
+      return NULL;
+    }
+
+    // Can't map an empty file, but there's nothing to map anyway.
+    if (info.st_size == 0)
+    {
+      close(file);
+      return new MappedFile(NULL, 0, NULL);
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    // The mapping keeps its own reference to the file.
+    close(file);
+
+    if (data == MAP_FAILED) return NULL;
+
+    return new MappedFile(static_cast<const unsigned char*>(data),
+                          static_cast<int>(info.st_size), NULL);
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (data_ != NULL) munmap(const_cast<unsigned char*>(data_), size_);
+  }
+}
@@ -0,0 +1,53 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "MappedFile.h"
+
+namespace magpie
+{
+  MappedFile* MappedFile::open(const char* path)
+  {
+    HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart > 0x7fffffff)
+    {
+      CloseHandle(file);
+      return NULL;
+    }
+
+    // Can't map an empty file, but there's nothing to map anyway.
+    if (size.QuadPart == 0)
+    {
+      CloseHandle(file);
+      return new MappedFile(NULL, 0, NULL);
+    }
+
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    // The mapping keeps its own reference to the file.
+    CloseHandle(file);
+
+    if (mapping == NULL) return NULL;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+      CloseHandle(mapping);
+      return NULL;
+    }
+
+    return new MappedFile(static_cast<const unsigned char*>(data),
+                          static_cast<int>(size.QuadPart), mapping);
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (data_ == NULL) return;
+
+    UnmapViewOfFile(data_);
+    CloseHandle(static_cast<HANDLE>(handle_));
+  }
+}
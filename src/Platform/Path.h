@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdio>
+
 #include "MagpieString.h"
 
 namespace magpie
@@ -23,5 +25,11 @@ namespace magpie
 
     // Returns true if there is a file at [path].
     bool fileExists(gc<String> path);
+
+    // Creates a new file next to [path] to write to, with a name that no
+    // other process or thread will also pick, and opens it for writing in
+    // binary mode. Stores its path in [tempPath]. Returns NULL if it couldn't
+    // be created.
+    FILE* createTemp(gc<String> path, gc<String>& tempPath);
   }
 }
@@ -6,7 +6,9 @@
 #include <limits.h>
 #endif
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "MagpieString.h"
 #include "Path.h"
@@ -30,5 +32,33 @@ namespace magpie
       struct stat dummy;
       return stat(path->cString(), &dummy) == 0;
     }
+
+    FILE* createTemp(gc<String> path, gc<String>& tempPath)
+    {
+      // mkstemp() fills in the X's and fails instead of opening a file that
+      // already exists.
+      gc<String> pattern = String::format("%s.XXXXXX", path->cString());
+      char name[PATH_MAX];
+      strncpy(name, pattern->cString(), PATH_MAX - 1);
+      name[PATH_MAX - 1] = '\0';
+
+      int fd = mkstemp(name);
+      if (fd == -1) return NULL;
+
+      // mkstemp() only lets the owner read it, but the file is going to
+      // replace one that others may need to read.
+      fchmod(fd, 0644);
+
+      FILE* file = fdopen(fd, "wb");
+      if (file == NULL)
+      {
+        close(fd);
+        unlink(name);
+        return NULL;
+      }
+
+      tempPath = String::create(name);
+      return file;
+    }
   }
 }
@@ -22,5 +22,15 @@ namespace magpie
       DWORD fileAttribs = GetFileAttributes(path->cString());
       return (fileAttribs != INVALID_FILE_ATTRIBUTES) && !(fileAttribs & FILE_ATTRIBUTE_DIRECTORY);
     }
+
+    FILE* createTemp(gc<String> path, gc<String>& tempPath)
+    {
+      // A thread can only write one file at a time, so the process and thread
+      // IDs are enough to keep the name from colliding.
+      tempPath = String::format("%s.%lu.%lu.tmp", path->cString(),
+          static_cast<unsigned long>(GetCurrentProcessId()),
+          static_cast<unsigned long>(GetCurrentThreadId()));
+      return fopen(tempPath->cString(), "wb");
+    }
   }
 }
@@ -0,0 +1,549 @@
+#include <cstdio>
+#include <cstring>
+
+#include "AstCache.h"
+#include "Path.h"
+
+namespace magpie
+{
+#include "AstCache.generated.h"
+
+  void AstWriter::writeTag(int tag)
+  {
+    writeUnsigned(static_cast<unsigned int>(tag));
+  }
+
+  void AstWriter::write(bool value)
+  {
+    bytes_.add(value ? 1 : 0);
+  }
+
+  void AstWriter::write(int value)
+  {
+    // Zig-zag encode so that small negative numbers stay small.
+    writeUnsigned((static_cast<unsigned int>(value) << 1) ^
+                  static_cast<unsigned int>(value >> 31));
+  }
+
+  void AstWriter::write(unsigned int value)
+  {
+    writeUnsigned(value);
+  }
+
+  void AstWriter::write(double value)
+  {
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    for (int i = 0; i < 8; i++)
+    {
+      bytes_.add(static_cast<unsigned char>(bits >> (i * 8)));
+    }
+  }
+
+  void AstWriter::write(gc<String> value)
+  {
+    // Zero means there is no string, so lengths are written one higher.
+    if (value.isNull())
+    {
+      writeUnsigned(0);
+      return;
+    }
+
+    writeUnsigned(static_cast<unsigned int>(value->length()) + 1);
+
+    const char* text = value->cString();
+    for (int i = 0; i < value->length(); i++)
+    {
+      bytes_.add(static_cast<unsigned char>(text[i]));
+    }
+  }
+
+  void AstWriter::write(gc<SourcePos> pos)
+  {
+    write(pos->startLine());
+    write(pos->startCol());
+    write(pos->endLine());
+    write(pos->endCol());
+  }
+
+  void AstWriter::write(gc<Expr> expr)
+  {
+    if (expr.isNull())
+    {
+      writeTag(0);
+      return;
+    }
+
+    AstNodeWriter writer(*this);
+    expr->accept(writer, 0);
+  }
+
+  void AstWriter::write(gc<CallExpr> expr)
+  {
+    gc<Expr> callExpr = expr;
+    write(callExpr);
+  }
+
+  void AstWriter::write(gc<LValue> lvalue)
+  {
+    if (lvalue.isNull())
+    {
+      writeTag(0);
+      return;
+    }
+
+    AstNodeWriter writer(*this);
+    lvalue->accept(writer, 0);
+  }
+
+  void AstWriter::write(gc<Pattern> pattern)
+  {
+    if (pattern.isNull())
+    {
+      writeTag(0);
+      return;
+    }
+
+    AstNodeWriter writer(*this);
+    pattern->accept(writer, 0);
+  }
+
+  void AstWriter::write(const Array<gc<Expr> >& exprs)
+  {
+    writeUnsigned(exprs.count());
+    for (int i = 0; i < exprs.count(); i++) write(exprs[i]);
+  }
+
+  void AstWriter::write(const Array<gc<ClassField> >& fields)
+  {
+    writeUnsigned(fields.count());
+    for (int i = 0; i < fields.count(); i++)
+    {
+      write(fields[i]->isMutable());
+      write(fields[i]->name());
+      write(fields[i]->pattern());
+      write(fields[i]->initializer());
+    }
+  }
+
+  void AstWriter::write(const Array<MatchClause>& clauses)
+  {
+    writeUnsigned(clauses.count());
+    for (int i = 0; i < clauses.count(); i++)
+    {
+      write(clauses[i].pattern());
+      write(clauses[i].body());
+    }
+  }
+
+  void AstWriter::write(const Array<Field>& fields)
+  {
+    writeUnsigned(fields.count());
+    for (int i = 0; i < fields.count(); i++)
+    {
+      write(fields[i].name);
+      write(fields[i].value);
+    }
+  }
+
+  void AstWriter::write(const Array<LValueField>& fields)
+  {
+    writeUnsigned(fields.count());
+    for (int i = 0; i < fields.count(); i++)
+    {
+      write(fields[i].name);
+      write(fields[i].value);
+    }
+  }
+
+  void AstWriter::write(const Array<PatternField>& fields)
+  {
+    writeUnsigned(fields.count());
+    for (int i = 0; i < fields.count(); i++)
+    {
+      write(fields[i].name);
+      write(fields[i].value);
+    }
+  }
+
+  void AstWriter::writeUnsigned(unsigned int value)
+  {
+    // Seven bits at a time, low bits first. The high bit is set on every byte
+    // but the last.
+    while (value >= 0x80)
+    {
+      bytes_.add(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+
+    bytes_.add(static_cast<unsigned char>(value));
+  }
+
+  void AstReader::read(bool& value)
+  {
+    value = readUnsigned() != 0;
+  }
+
+  void AstReader::read(int& value)
+  {
+    unsigned int bits = readUnsigned();
+    value = static_cast<int>(bits >> 1) ^ -static_cast<int>(bits & 1);
+  }
+
+  void AstReader::read(unsigned int& value)
+  {
+    value = readUnsigned();
+  }
+
+  void AstReader::read(double& value)
+  {
+    value = 0;
+    if (size_ - position_ < 8)
+    {
+      fail();
+      return;
+    }
+
+    unsigned long long bits = 0;
+    for (int i = 0; i < 8; i++)
+    {
+      bits |= static_cast<unsigned long long>(data_[position_++]) << (i * 8);
+    }
+
+    memcpy(&value, &bits, sizeof(value));
+  }
+
+  void AstReader::read(gc<String>& value)
+  {
+    value = NULL;
+
+    unsigned int length = readUnsigned();
+    if (length == 0) return;
+    length--;
+
+    if (length > static_cast<unsigned int>(size_ - position_))
+    {
+      fail();
+      return;
+    }
+
+    value = String::create(reinterpret_cast<const char*>(data_ + position_),
+                           static_cast<int>(length));
+    position_ += length;
+  }
+
+  void AstReader::read(gc<Expr>& expr)
+  {
+    expr = NULL;
+
+    int tag = static_cast<int>(readUnsigned());
+    if (tag == 0) return;
+
+    gc<SourcePos> pos = readPos();
+    expr = readExpr(tag, pos);
+  }
+
+  void AstReader::read(gc<CallExpr>& expr)
+  {
+    gc<Expr> callExpr;
+    read(callExpr);
+
+    expr = NULL;
+    if (callExpr.isNull()) return;
+
+    expr = callExpr->asCallExpr();
+    if (expr.isNull()) fail();
+  }
+
+  void AstReader::read(gc<LValue>& lvalue)
+  {
+    lvalue = NULL;
+
+    int tag = static_cast<int>(readUnsigned());
+    if (tag == 0) return;
+
+    gc<SourcePos> pos = readPos();
+    lvalue = readLValue(tag, pos);
+  }
+
+  void AstReader::read(gc<Pattern>& pattern)
+  {
+    pattern = NULL;
+
+    int tag = static_cast<int>(readUnsigned());
+    if (tag == 0) return;
+
+    gc<SourcePos> pos = readPos();
+    pattern = readPattern(tag, pos);
+  }
+
+  void AstReader::read(Array<gc<Expr> >& exprs)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      gc<Expr> expr;
+      read(expr);
+      exprs.add(expr);
+    }
+  }
+
+  void AstReader::read(Array<gc<ClassField> >& fields)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      bool isMutable;
+      gc<String> name;
+      gc<Pattern> pattern;
+      gc<Expr> initializer;
+      read(isMutable);
+      read(name);
+      read(pattern);
+      read(initializer);
+      fields.add(new ClassField(isMutable, name, pattern, initializer));
+    }
+  }
+
+  void AstReader::read(Array<MatchClause>& clauses)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      gc<Pattern> pattern;
+      gc<Expr> body;
+      read(pattern);
+      read(body);
+      clauses.add(MatchClause(pattern, body));
+    }
+  }
+
+  void AstReader::read(Array<Field>& fields)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      gc<String> name;
+      gc<Expr> value;
+      read(name);
+      read(value);
+      fields.add(Field(name, value));
+    }
+  }
+
+  void AstReader::read(Array<LValueField>& fields)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      gc<String> name;
+      gc<LValue> value;
+      read(name);
+      read(value);
+      fields.add(LValueField(name, value));
+    }
+  }
+
+  void AstReader::read(Array<PatternField>& fields)
+  {
+    int count = readCount();
+    for (int i = 0; i < count; i++)
+    {
+      gc<String> name;
+      gc<Pattern> value;
+      read(name);
+      read(value);
+      fields.add(PatternField(name, value));
+    }
+  }
+
+  unsigned int AstReader::readUnsigned()
+  {
+    unsigned int value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+      if (failed_ || position_ == size_)
+      {
+        fail();
+        return 0;
+      }
+
+      unsigned char byte = data_[position_++];
+      value |= static_cast<unsigned int>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return value;
+    }
+
+    // Too many bytes for an int.
+    fail();
+    return 0;
+  }
+
+  gc<SourcePos> AstReader::readPos()
+  {
+    int startLine, startCol, endLine, endCol;
+    read(startLine);
+    read(startCol);
+    read(endLine);
+    read(endCol);
+    return new SourcePos(file_, startLine, startCol, endLine, endCol);
+  }
+
+  int AstReader::readCount()
+  {
+    unsigned int count = readUnsigned();
+
+    // Every element takes at least one byte.
+    if (count > static_cast<unsigned int>(size_ - position_))
+    {
+      fail();
+      return 0;
+    }
+
+    return static_cast<int>(count);
+  }
+
+  gc<String> AstCache::cachePath(gc<String> path)
+  {
+    return String::format("%sc", path->cString());
+  }
+
+  // Cache files start with this, then the header fields, then the AST.
+  static const char MAGIC[] = { 'M', 'A', 'G', 'C' };
+
+  void AstCache::write(AstWriter& writer, gc<SourceFile> source,
+                       gc<ModuleAst> ast)
+  {
+    gc<String> code = source->source();
+
+    writer.write(VERSION);
+    writer.write(AST_SCHEMA);
+    writer.write(static_cast<unsigned int>(code->length()));
+    writer.write(String::hash(code->cString(), code->length()));
+
+    gc<Expr> body = ast->body();
+    writer.write(body);
+  }
+
+  gc<ModuleAst> AstCache::read(const unsigned char* data, int size,
+                               gc<SourceFile> source)
+  {
+    gc<String> code = source->source();
+    AstReader reader(data, size, source);
+
+    unsigned int version;
+    unsigned int schema;
+    unsigned int length;
+    unsigned int sourceHash;
+    reader.read(version);
+    reader.read(schema);
+    reader.read(length);
+    reader.read(sourceHash);
+
+    if (reader.failed() || version != VERSION || schema != AST_SCHEMA ||
+        length != static_cast<unsigned int>(code->length()) ||
+        sourceHash != String::hash(code->cString(), code->length()))
+    {
+      return NULL;
+    }
+
+    gc<Expr> body;
+    reader.read(body);
+    if (reader.failed() || !reader.isAtEnd() || body.isNull()) return NULL;
+
+    gc<SequenceExpr> sequence = body->asSequenceExpr();
+    if (sequence.isNull()) return NULL;
+
+    return new ModuleAst(sequence);
+  }
+
+  gc<ModuleAst> AstCache::load(gc<String> path, gc<SourceFile> source)
+  {
+    FILE* file = fopen(path->cString(), "rb");
+    if (file == NULL) return NULL;
+
+    long size = 0;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    rewind(file);
+
+    // The header is the magic number followed by the length and hash of the
+    // rest of the file, so that a partly written file is never used.
+    const int headerSize = sizeof(MAGIC) + 8;
+    if (size < headerSize || size > 0x7fffffff)
+    {
+      fclose(file);
+      return NULL;
+    }
+
+    unsigned char* data = new unsigned char[size];
+    bool success = fread(data, 1, size, file) == static_cast<size_t>(size);
+    fclose(file);
+
+    gc<ModuleAst> ast;
+    if (success && memcmp(data, MAGIC, sizeof(MAGIC)) == 0)
+    {
+      const unsigned char* header = data + sizeof(MAGIC);
+      unsigned int payloadSize = 0;
+      unsigned int payloadHash = 0;
+      for (int i = 0; i < 4; i++)
+      {
+        payloadSize |= static_cast<unsigned int>(header[i]) << (i * 8);
+        payloadHash |= static_cast<unsigned int>(header[i + 4]) << (i * 8);
+      }
+
+      const unsigned char* payload = data + headerSize;
+      int actualSize = static_cast<int>(size) - headerSize;
+      if (payloadSize == static_cast<unsigned int>(actualSize) &&
+          payloadHash == String::hash(
+              reinterpret_cast<const char*>(payload), actualSize))
+      {
+        ast = read(payload, actualSize, source);
+      }
+    }
+
+    delete [] data;
+    return ast;
+  }
+
+  void AstCache::save(gc<String> path, gc<SourceFile> source,
+                      gc<ModuleAst> ast)
+  {
+    AstWriter writer;
+    write(writer, source, ast);
+
+    const Array<unsigned char>& payload = writer.bytes();
+    unsigned int payloadSize = static_cast<unsigned int>(payload.count());
+    unsigned int payloadHash = String::hash(
+        reinterpret_cast<const char*>(&payload[0]), payload.count());
+
+    unsigned char header[8];
+    for (int i = 0; i < 4; i++)
+    {
+      header[i] = static_cast<unsigned char>(payloadSize >> (i * 8));
+      header[i + 4] = static_cast<unsigned char>(payloadHash >> (i * 8));
+    }
+
+    // Write to a temporary file and move it into place so that other
+    // processes never see a partly written cache. Each writer gets its own
+    // temporary file, so two processes saving the same module at once can't
+    // interleave their writes. The last one to rename its file wins.
+    gc<String> tempPath;
+    FILE* file = path::createTemp(path, tempPath);
+    if (file == NULL) return;
+
+    bool success = fwrite(MAGIC, 1, sizeof(MAGIC), file) == sizeof(MAGIC) &&
+        fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+        fwrite(&payload[0], 1, payload.count(), file) ==
+            static_cast<size_t>(payload.count());
+    success = fclose(file) == 0 && success;
+
+    if (success && rename(tempPath->cString(), path->cString()) != 0)
+    {
+      // On Windows, rename() won't replace an existing file.
+      remove(path->cString());
+      success = rename(tempPath->cString(), path->cString()) == 0;
+    }
+
+    if (!success) remove(tempPath->cString());
+  }
+}
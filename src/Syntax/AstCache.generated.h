@@ -0,0 +1,701 @@
+// Automatically generated by script/generate_ast.py.
+// Do not hand-edit.
+
+static const unsigned int AST_SCHEMA = 0x561c07cd;
+
+// Writes each kind of node as its tag, position and then its fields.
+class AstNodeWriter : public ExprVisitor, public LValueVisitor,
+                      public PatternVisitor
+{
+public:
+  AstNodeWriter(AstWriter& writer)
+  : writer_(writer)
+  {}
+
+  virtual void visit(AndExpr& node, int arg)
+  {
+    writer_.writeTag(1);
+    writer_.write(node.pos());
+    writer_.write(node.left());
+    writer_.write(node.right());
+  }
+
+  virtual void visit(AssignExpr& node, int arg)
+  {
+    writer_.writeTag(2);
+    writer_.write(node.pos());
+    writer_.write(node.lvalue());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(AsyncExpr& node, int arg)
+  {
+    writer_.writeTag(3);
+    writer_.write(node.pos());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(BoolExpr& node, int arg)
+  {
+    writer_.writeTag(4);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(BreakExpr& node, int arg)
+  {
+    writer_.writeTag(5);
+    writer_.write(node.pos());
+  }
+
+  virtual void visit(CallExpr& node, int arg)
+  {
+    writer_.writeTag(6);
+    writer_.write(node.pos());
+    writer_.write(node.leftArg());
+    writer_.write(node.name());
+    writer_.write(node.rightArg());
+  }
+
+  virtual void visit(CatchExpr& node, int arg)
+  {
+    writer_.writeTag(7);
+    writer_.write(node.pos());
+    writer_.write(node.body());
+    writer_.write(node.catches());
+  }
+
+  virtual void visit(CharacterExpr& node, int arg)
+  {
+    writer_.writeTag(8);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(DefExpr& node, int arg)
+  {
+    writer_.writeTag(9);
+    writer_.write(node.pos());
+    writer_.write(node.leftParam());
+    writer_.write(node.name());
+    writer_.write(node.rightParam());
+    writer_.write(node.value());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(DefClassExpr& node, int arg)
+  {
+    writer_.writeTag(10);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+    writer_.write(node.isNative());
+    writer_.write(node.superclasses());
+    writer_.write(node.fields());
+  }
+
+  virtual void visit(DoExpr& node, int arg)
+  {
+    writer_.writeTag(11);
+    writer_.write(node.pos());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(FloatExpr& node, int arg)
+  {
+    writer_.writeTag(12);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(FnExpr& node, int arg)
+  {
+    writer_.writeTag(13);
+    writer_.write(node.pos());
+    writer_.write(node.pattern());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(ForExpr& node, int arg)
+  {
+    writer_.writeTag(14);
+    writer_.write(node.pos());
+    writer_.write(node.pattern());
+    writer_.write(node.iterator());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(GetFieldExpr& node, int arg)
+  {
+    writer_.writeTag(15);
+    writer_.write(node.pos());
+    writer_.write(node.index());
+  }
+
+  virtual void visit(IfExpr& node, int arg)
+  {
+    writer_.writeTag(16);
+    writer_.write(node.pos());
+    writer_.write(node.condition());
+    writer_.write(node.thenArm());
+    writer_.write(node.elseArm());
+  }
+
+  virtual void visit(ImportExpr& node, int arg)
+  {
+    writer_.writeTag(17);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+  }
+
+  virtual void visit(IntExpr& node, int arg)
+  {
+    writer_.writeTag(18);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(IsExpr& node, int arg)
+  {
+    writer_.writeTag(19);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+    writer_.write(node.type());
+  }
+
+  virtual void visit(ListExpr& node, int arg)
+  {
+    writer_.writeTag(20);
+    writer_.write(node.pos());
+    writer_.write(node.elements());
+  }
+
+  virtual void visit(MatchExpr& node, int arg)
+  {
+    writer_.writeTag(21);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+    writer_.write(node.cases());
+  }
+
+  virtual void visit(NameExpr& node, int arg)
+  {
+    writer_.writeTag(22);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+  }
+
+  virtual void visit(NativeExpr& node, int arg)
+  {
+    writer_.writeTag(23);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+  }
+
+  virtual void visit(NotExpr& node, int arg)
+  {
+    writer_.writeTag(24);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(NothingExpr& node, int arg)
+  {
+    writer_.writeTag(25);
+    writer_.write(node.pos());
+  }
+
+  virtual void visit(OrExpr& node, int arg)
+  {
+    writer_.writeTag(26);
+    writer_.write(node.pos());
+    writer_.write(node.left());
+    writer_.write(node.right());
+  }
+
+  virtual void visit(RecordExpr& node, int arg)
+  {
+    writer_.writeTag(27);
+    writer_.write(node.pos());
+    writer_.write(node.fields());
+  }
+
+  virtual void visit(ReturnExpr& node, int arg)
+  {
+    writer_.writeTag(28);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(SequenceExpr& node, int arg)
+  {
+    writer_.writeTag(29);
+    writer_.write(node.pos());
+    writer_.write(node.expressions());
+  }
+
+  virtual void visit(SetFieldExpr& node, int arg)
+  {
+    writer_.writeTag(30);
+    writer_.write(node.pos());
+    writer_.write(node.index());
+  }
+
+  virtual void visit(StringExpr& node, int arg)
+  {
+    writer_.writeTag(31);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(ThrowExpr& node, int arg)
+  {
+    writer_.writeTag(32);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(VariableExpr& node, int arg)
+  {
+    writer_.writeTag(33);
+    writer_.write(node.pos());
+    writer_.write(node.isMutable());
+    writer_.write(node.pattern());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(WhileExpr& node, int arg)
+  {
+    writer_.writeTag(34);
+    writer_.write(node.pos());
+    writer_.write(node.condition());
+    writer_.write(node.body());
+  }
+
+  virtual void visit(CallLValue& node, int arg)
+  {
+    writer_.writeTag(1);
+    writer_.write(node.pos());
+    writer_.write(node.call());
+  }
+
+  virtual void visit(NameLValue& node, int arg)
+  {
+    writer_.writeTag(2);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+  }
+
+  virtual void visit(RecordLValue& node, int arg)
+  {
+    writer_.writeTag(3);
+    writer_.write(node.pos());
+    writer_.write(node.fields());
+  }
+
+  virtual void visit(WildcardLValue& node, int arg)
+  {
+    writer_.writeTag(4);
+    writer_.write(node.pos());
+  }
+
+  virtual void visit(RecordPattern& node, int arg)
+  {
+    writer_.writeTag(1);
+    writer_.write(node.pos());
+    writer_.write(node.fields());
+  }
+
+  virtual void visit(TypePattern& node, int arg)
+  {
+    writer_.writeTag(2);
+    writer_.write(node.pos());
+    writer_.write(node.type());
+  }
+
+  virtual void visit(ValuePattern& node, int arg)
+  {
+    writer_.writeTag(3);
+    writer_.write(node.pos());
+    writer_.write(node.value());
+  }
+
+  virtual void visit(VariablePattern& node, int arg)
+  {
+    writer_.writeTag(4);
+    writer_.write(node.pos());
+    writer_.write(node.name());
+    writer_.write(node.pattern());
+  }
+
+
+private:
+  AstWriter& writer_;
+
+  NO_COPY(AstNodeWriter);
+};
+
+gc<Expr> AstReader::readExpr(int tag, gc<SourcePos> pos)
+{
+  switch (tag)
+  {
+    case 1:
+    {
+      gc<Expr> left;
+      read(left);
+      gc<Expr> right;
+      read(right);
+      return new AndExpr(pos, left, right);
+    }
+
+    case 2:
+    {
+      gc<LValue> lvalue;
+      read(lvalue);
+      gc<Expr> value;
+      read(value);
+      return new AssignExpr(pos, lvalue, value);
+    }
+
+    case 3:
+    {
+      gc<Expr> body;
+      read(body);
+      return new AsyncExpr(pos, body);
+    }
+
+    case 4:
+    {
+      bool value;
+      read(value);
+      return new BoolExpr(pos, value);
+    }
+
+    case 5:
+    {
+      return new BreakExpr(pos);
+    }
+
+    case 6:
+    {
+      gc<Expr> leftArg;
+      read(leftArg);
+      gc<String> name;
+      read(name);
+      gc<Expr> rightArg;
+      read(rightArg);
+      return new CallExpr(pos, leftArg, name, rightArg);
+    }
+
+    case 7:
+    {
+      gc<Expr> body;
+      read(body);
+      Array<MatchClause> catches;
+      read(catches);
+      return new CatchExpr(pos, body, catches);
+    }
+
+    case 8:
+    {
+      unsigned int value;
+      read(value);
+      return new CharacterExpr(pos, value);
+    }
+
+    case 9:
+    {
+      gc<Pattern> leftParam;
+      read(leftParam);
+      gc<String> name;
+      read(name);
+      gc<Pattern> rightParam;
+      read(rightParam);
+      gc<Pattern> value;
+      read(value);
+      gc<Expr> body;
+      read(body);
+      return new DefExpr(pos, leftParam, name, rightParam, value, body);
+    }
+
+    case 10:
+    {
+      gc<String> name;
+      read(name);
+      bool isNative;
+      read(isNative);
+      Array<gc<Expr> > superclasses;
+      read(superclasses);
+      Array<gc<ClassField> > fields;
+      read(fields);
+      return new DefClassExpr(pos, name, isNative, superclasses, fields);
+    }
+
+    case 11:
+    {
+      gc<Expr> body;
+      read(body);
+      return new DoExpr(pos, body);
+    }
+
+    case 12:
+    {
+      double value;
+      read(value);
+      return new FloatExpr(pos, value);
+    }
+
+    case 13:
+    {
+      gc<Pattern> pattern;
+      read(pattern);
+      gc<Expr> body;
+      read(body);
+      return new FnExpr(pos, pattern, body);
+    }
+
+    case 14:
+    {
+      gc<Pattern> pattern;
+      read(pattern);
+      gc<Expr> iterator;
+      read(iterator);
+      gc<Expr> body;
+      read(body);
+      return new ForExpr(pos, pattern, iterator, body);
+    }
+
+    case 15:
+    {
+      int index;
+      read(index);
+      return new GetFieldExpr(pos, index);
+    }
+
+    case 16:
+    {
+      gc<Expr> condition;
+      read(condition);
+      gc<Expr> thenArm;
+      read(thenArm);
+      gc<Expr> elseArm;
+      read(elseArm);
+      return new IfExpr(pos, condition, thenArm, elseArm);
+    }
+
+    case 17:
+    {
+      gc<String> name;
+      read(name);
+      return new ImportExpr(pos, name);
+    }
+
+    case 18:
+    {
+      int value;
+      read(value);
+      return new IntExpr(pos, value);
+    }
+
+    case 19:
+    {
+      gc<Expr> value;
+      read(value);
+      gc<Expr> type;
+      read(type);
+      return new IsExpr(pos, value, type);
+    }
+
+    case 20:
+    {
+      Array<gc<Expr> > elements;
+      read(elements);
+      return new ListExpr(pos, elements);
+    }
+
+    case 21:
+    {
+      gc<Expr> value;
+      read(value);
+      Array<MatchClause> cases;
+      read(cases);
+      return new MatchExpr(pos, value, cases);
+    }
+
+    case 22:
+    {
+      gc<String> name;
+      read(name);
+      return new NameExpr(pos, name);
+    }
+
+    case 23:
+    {
+      gc<String> name;
+      read(name);
+      return new NativeExpr(pos, name);
+    }
+
+    case 24:
+    {
+      gc<Expr> value;
+      read(value);
+      return new NotExpr(pos, value);
+    }
+
+    case 25:
+    {
+      return new NothingExpr(pos);
+    }
+
+    case 26:
+    {
+      gc<Expr> left;
+      read(left);
+      gc<Expr> right;
+      read(right);
+      return new OrExpr(pos, left, right);
+    }
+
+    case 27:
+    {
+      Array<Field> fields;
+      read(fields);
+      return new RecordExpr(pos, fields);
+    }
+
+    case 28:
+    {
+      gc<Expr> value;
+      read(value);
+      return new ReturnExpr(pos, value);
+    }
+
+    case 29:
+    {
+      Array<gc<Expr> > expressions;
+      read(expressions);
+      return new SequenceExpr(pos, expressions);
+    }
+
+    case 30:
+    {
+      int index;
+      read(index);
+      return new SetFieldExpr(pos, index);
+    }
+
+    case 31:
+    {
+      gc<String> value;
+      read(value);
+      return new StringExpr(pos, value);
+    }
+
+    case 32:
+    {
+      gc<Expr> value;
+      read(value);
+      return new ThrowExpr(pos, value);
+    }
+
+    case 33:
+    {
+      bool isMutable;
+      read(isMutable);
+      gc<Pattern> pattern;
+      read(pattern);
+      gc<Expr> value;
+      read(value);
+      return new VariableExpr(pos, isMutable, pattern, value);
+    }
+
+    case 34:
+    {
+      gc<Expr> condition;
+      read(condition);
+      gc<Expr> body;
+      read(body);
+      return new WhileExpr(pos, condition, body);
+    }
+
+  }
+
+  fail();
+  return NULL;
+}
+
+gc<LValue> AstReader::readLValue(int tag, gc<SourcePos> pos)
+{
+  switch (tag)
+  {
+    case 1:
+    {
+      gc<CallExpr> call;
+      read(call);
+      return new CallLValue(pos, call);
+    }
+
+    case 2:
+    {
+      gc<String> name;
+      read(name);
+      return new NameLValue(pos, name);
+    }
+
+    case 3:
+    {
+      Array<LValueField> fields;
+      read(fields);
+      return new RecordLValue(pos, fields);
+    }
+
+    case 4:
+    {
+      return new WildcardLValue(pos);
+    }
+
+  }
+
+  fail();
+  return NULL;
+}
+
+gc<Pattern> AstReader::readPattern(int tag, gc<SourcePos> pos)
+{
+  switch (tag)
+  {
+    case 1:
+    {
+      Array<PatternField> fields;
+      read(fields);
+      return new RecordPattern(pos, fields);
+    }
+
+    case 2:
+    {
+      gc<Expr> type;
+      read(type);
+      return new TypePattern(pos, type);
+    }
+
+    case 3:
+    {
+      gc<Expr> value;
+      read(value);
+      return new ValuePattern(pos, value);
+    }
+
+    case 4:
+    {
+      gc<String> name;
+      read(name);
+      gc<Pattern> pattern;
+      read(pattern);
+      return new VariablePattern(pos, name, pattern);
+    }
+
+  }
+
+  fail();
+  return NULL;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Array.h"
+#include "Ast.h"
+#include "Macros.h"
+#include "Managed.h"
+#include "Token.h"
+
+namespace magpie
+{
+  // Flattens a parsed AST into bytes. Ints are written as variable-length
+  // quantities since most of them (lines, columns, tags) are small.
+  class AstWriter
+  {
+  public:
+    AstWriter() {}
+
+    const Array<unsigned char>& bytes() const { return bytes_; }
+
+    void writeTag(int tag);
+
+    void write(bool value);
+    void write(int value);
+    void write(unsigned int value);
+    void write(double value);
+    void write(gc<String> value);
+    void write(gc<SourcePos> pos);
+
+    void write(gc<Expr> expr);
+    void write(gc<CallExpr> expr);
+    void write(gc<LValue> lvalue);
+    void write(gc<Pattern> pattern);
+
+    void write(const Array<gc<Expr> >& exprs);
+    void write(const Array<gc<ClassField> >& fields);
+    void write(const Array<MatchClause>& clauses);
+    void write(const Array<Field>& fields);
+    void write(const Array<LValueField>& fields);
+    void write(const Array<PatternField>& fields);
+
+  private:
+    void writeUnsigned(unsigned int value);
+
+    Array<unsigned char> bytes_;
+
+    NO_COPY(AstWriter);
+  };
+
+  // Rebuilds an AST written by AstWriter. If the data is truncated or
+  // malformed, it stops reading sensibly and failed() returns true.
+  class AstReader
+  {
+  public:
+    // Reads from [size] bytes of [data]. Positions in the AST will refer to
+    // [file].
+    AstReader(const unsigned char* data, int size, gc<SourceFile> file)
+    : data_(data),
+      size_(size),
+      position_(0),
+      failed_(false),
+      file_(file)
+    {}
+
+    bool failed() const { return failed_; }
+    bool isAtEnd() const { return position_ == size_; }
+
+    void read(bool& value);
+    void read(int& value);
+    void read(unsigned int& value);
+    void read(double& value);
+    void read(gc<String>& value);
+
+    void read(gc<Expr>& expr);
+    void read(gc<CallExpr>& expr);
+    void read(gc<LValue>& lvalue);
+    void read(gc<Pattern>& pattern);
+
+    void read(Array<gc<Expr> >& exprs);
+    void read(Array<gc<ClassField> >& fields);
+    void read(Array<MatchClause>& clauses);
+    void read(Array<Field>& fields);
+    void read(Array<LValueField>& fields);
+    void read(Array<PatternField>& fields);
+
+  private:
+    unsigned int readUnsigned();
+    gc<SourcePos> readPos();
+
+    // Reads the count of an array. Fails if there obviously aren't that many
+    // elements left.
+    int readCount();
+
+    // Creates the node for [tag] at [pos], reading its fields.
+    gc<Expr> readExpr(int tag, gc<SourcePos> pos);
+    gc<LValue> readLValue(int tag, gc<SourcePos> pos);
+    gc<Pattern> readPattern(int tag, gc<SourcePos> pos);
+
+    void fail() { failed_ = true; }
+
+    const unsigned char* data_;
+    int size_;
+    int position_;
+    bool failed_;
+    gc<SourceFile> file_;
+
+    NO_COPY(AstReader);
+  };
+
+  // Caches parsed modules on disk so that later runs can skip lexing and
+  // parsing them. A cache file stores the AST as the parser produced it,
+  // before it is resolved, along with a hash of the source it came from. It's
+  // only used if that still matches the source, and if it was written by a
+  // VM with the same cache format and AST classes.
+  //
+  // Only the parse can be cached. Resolving and compiling depend on the
+  // indexes of every other module, method and symbol in the program, so they
+  // still happen on every run.
+  class AstCache
+  {
+  public:
+    // Gets the path of the cache file for the module at [path].
+    static gc<String> cachePath(gc<String> path);
+
+    // Serializes [ast], parsed from [source], to bytes.
+    static void write(AstWriter& writer, gc<SourceFile> source,
+                      gc<ModuleAst> ast);
+
+    // Reads a module AST for [source] from [size] bytes of [data]. Returns
+    // NULL if the data is for a different source or VM, or is corrupt.
+    static gc<ModuleAst> read(const unsigned char* data, int size,
+                              gc<SourceFile> source);
+
+    // Loads the cached AST for [source] from [path]. Returns NULL if there is
+    // no usable cache file.
+    static gc<ModuleAst> load(gc<String> path, gc<SourceFile> source);
+
+    // Writes the AST for [source] to [path]. Failing to write the cache isn't
+    // an error, since it's just an optimization.
+    static void save(gc<String> path, gc<SourceFile> source,
+                     gc<ModuleAst> ast);
+
+  private:
+    // Bump this when the layout of cache files changes. Changes to the AST
+    // classes are caught by AST_SCHEMA.
+    static const unsigned int VERSION = 1;
+  };
+}
@@ -11,6 +11,7 @@ namespace magpie
     if (needMoreLines_) return;
     
     numErrors_++;
+    if (isQuiet_) return;
 
     // TODO(bob): Hackish. Need to figure out if we want C-style, C++-style or
     // Magpie GC strings.
@@ -12,6 +12,7 @@ namespace magpie
   public:
     ErrorReporter(bool isRepl = false)
     : isRepl_(isRepl),
+      isQuiet_(false),
       numErrors_(0),
       needMoreLines_(false)
     {}
@@ -19,11 +20,15 @@ namespace magpie
     void error(gc<SourcePos> pos, const char* format, ...);
     void setNeedMoreLines();
 
+    // Stops errors from being printed. They are still counted.
+    void setQuiet() { isQuiet_ = true; }
+
     int numErrors() const { return numErrors_; }
     bool needMoreLines() const { return needMoreLines_; }
 
   private:
     bool isRepl_;
+    bool isQuiet_;
     int numErrors_;
     bool needMoreLines_;
   };
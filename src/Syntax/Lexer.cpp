@@ -7,13 +7,13 @@
 
 namespace magpie
 {
-  gc<Token> Lexer::readToken()
+  Token Lexer::readToken()
   {
     while (true)
     {
-      gc<Token> token = readRawToken();
+      Token token = readRawToken();
 
-      switch (token->type())
+      switch (token.type())
       {
         // Ignore newlines after tokens that can't end an expression.
         case TOKEN_LEFT_PAREN:
@@ -73,7 +73,7 @@ namespace magpie
     }
   }
 
-  gc<Token> Lexer::readRawToken()
+  Token Lexer::readRawToken()
   {
     while (true)
     {
@@ -81,7 +81,7 @@ namespace magpie
       startRow_ = currentRow_;
       startCol_ = currentCol_;
 
-      if (isDone()) return makeToken(TOKEN_EOF, String::create(""));
+      if (isDone()) return makeToken(TOKEN_EOF);
 
       char c = advance();
       switch (c)
@@ -230,21 +230,97 @@ namespace magpie
     return c;
   }
 
-  gc<Token> Lexer::makeToken(TokenType type)
+  gc<String> Lexer::text(const Token& token) const
   {
-    return makeToken(type, source_->substring(start_, pos_));
+    switch (token.type())
+    {
+      case TOKEN_ERROR:
+        return token.message();
+
+      case TOKEN_FIELD:
+        // Leave off the ":".
+        return source_->substring(token.start(), token.end() - 1);
+
+      case TOKEN_CHARACTER:
+        // Skip the opening quote.
+        return source_->substring(token.start() + 1, token.start() + 2);
+
+      case TOKEN_STRING:
+      {
+        // Skip the quotes.
+        int start = token.start() + 1;
+        int end = token.end() - 1;
+
+        // Most strings have no escapes, so can be used as they are.
+        bool hasEscapes = false;
+        for (int i = start; i < end; i++)
+        {
+          if ((*source_)[i] == '\\')
+          {
+            hasEscapes = true;
+            break;
+          }
+        }
+
+        if (!hasEscapes) return source_->substring(start, end);
+
+        // The lexer has already validated the escapes.
+        Array<char> chars(end - start);
+        for (int i = start; i < end; i++)
+        {
+          char c = (*source_)[i];
+          if (c == '\\')
+          {
+            switch ((*source_)[++i])
+            {
+              case 'n':  c = '\n'; break;
+              case '"':  c = '"'; break;
+              case '\\': c = '\\'; break;
+              case 't':  c = '\t'; break;
+              default:
+                ASSERT(false, "Unknown escape sequence.");
+            }
+          }
+
+          chars.add(c);
+        }
+
+        return String::create(chars);
+      }
+
+      default:
+        return source_->substring(token.start(), token.end());
+    }
+  }
+
+  gc<SourcePos> Lexer::pos(const Token& token) const
+  {
+    return new SourcePos(source_, token.startLine(), token.startCol(),
+                         token.endLine(), token.endCol());
   }
 
-  gc<Token> Lexer::makeToken(TokenType type, gc<String> text)
+  bool Lexer::is(const Token& token, const char* text) const
   {
-    gc<SourcePos> pos = new SourcePos(source_,
-        startRow_, startCol_, currentRow_, currentCol_);
-    return new Token(type, text, pos);
+    int length = token.end() - token.start();
+    for (int i = 0; i < length; i++)
+    {
+      if ((*source_)[token.start() + i] != text[i]) return false;
+    }
+
+    return text[length] == '\0';
   }
 
-  gc<Token> Lexer::error(gc<String> message)
+  Token Lexer::makeToken(TokenType type)
   {
-    return makeToken(TOKEN_ERROR, message);
+    return Token(type, start_, pos_,
+                 startRow_, startCol_, currentRow_, currentCol_);
+  }
+
+  Token Lexer::error(gc<String> message)
+  {
+    Token token = makeToken(TOKEN_ERROR);
+    token.setMessage(message);
+    return token;
   }
 
   void Lexer::skipLineComment()
@@ -283,66 +359,29 @@ namespace magpie
     }
   }
 
-  gc<Token> Lexer::readName()
+  Token Lexer::readName()
   {
     while (isName(peek())) advance();
 
-    gc<String> text = source_->substring(start_, pos_);
-    
     // See if it's a field.
     if (peek() == ':')
     {
       advance();
-      return makeToken(TOKEN_FIELD, text);
+      return makeToken(TOKEN_FIELD);
     }
-    
-    // See if it's a reserved word.
-    TokenType type = TOKEN_NAME;
-    if      (*text == "and"     ) type = TOKEN_AND;
-    else if (*text == "as"      ) type = TOKEN_AS;
-    else if (*text == "async"   ) type = TOKEN_ASYNC;
-    else if (*text == "break"   ) type = TOKEN_BREAK;
-    else if (*text == "case"    ) type = TOKEN_CASE;
-    else if (*text == "catch"   ) type = TOKEN_CATCH;
-    else if (*text == "def"     ) type = TOKEN_DEF;
-    else if (*text == "defclass") type = TOKEN_DEFCLASS;
-    else if (*text == "do"      ) type = TOKEN_DO;
-    else if (*text == "else"    ) type = TOKEN_ELSE;
-    else if (*text == "end"     ) type = TOKEN_END;
-    else if (*text == "false"   ) type = TOKEN_FALSE;
-    else if (*text == "fn"      ) type = TOKEN_FN;
-    else if (*text == "for"     ) type = TOKEN_FOR;
-    else if (*text == "if"      ) type = TOKEN_IF;
-    else if (*text == "import"  ) type = TOKEN_IMPORT;
-    else if (*text == "in"      ) type = TOKEN_IN;
-    else if (*text == "is"      ) type = TOKEN_IS;
-    else if (*text == "match"   ) type = TOKEN_MATCH;
-    else if (*text == "not"     ) type = TOKEN_NOT;
-    else if (*text == "nothing" ) type = TOKEN_NOTHING;
-    else if (*text == "or"      ) type = TOKEN_OR;
-    else if (*text == "return"  ) type = TOKEN_RETURN;
-    else if (*text == "then"    ) type = TOKEN_THEN;
-    else if (*text == "throw"   ) type = TOKEN_THROW;
-    else if (*text == "true"    ) type = TOKEN_TRUE;
-    else if (*text == "val"     ) type = TOKEN_VAL;
-    else if (*text == "var"     ) type = TOKEN_VAR;
-    else if (*text == "while"   ) type = TOKEN_WHILE;
-    else if (*text == "xor"     ) type = TOKEN_XOR;
-
-    return makeToken(type, text);
+
+    return makeToken(keywordType());
   }
 
-  gc<Token> Lexer::readNumber()
+  Token Lexer::readNumber()
   {
     while (isDigit(peek())) advance();
     
     // See if it's a field.
     if (peek() == ':')
     {
-      gc<String> text = source_->substring(start_, pos_);
-      
       advance();
-      return makeToken(TOKEN_FIELD, text);
+      return makeToken(TOKEN_FIELD);
     }
     
     // Read the fractional part, if any.
@@ -357,14 +396,12 @@ namespace magpie
     return makeToken(type);
   }
   
-  gc<Token> Lexer::readOperator()
+  Token Lexer::readOperator()
   {
     while (isOperator(peek())) advance();
     
-    gc<String> text = source_->substring(start_, pos_);
-    
     TokenType type;
-    switch ((*text)[0])
+    switch ((*source_)[start_])
     {
       case '+':
       case '-':
@@ -380,25 +417,24 @@ namespace magpie
         ASSERT(false, "Unexpected operator character.");
     }
     
-    return makeToken(type, text);
+    return makeToken(type);
   }
 
-  gc<Token> Lexer::readCharacter()
+  Token Lexer::readCharacter()
   {
     // TODO(bob): Needs lots of work:
     // - Handle missing '.
     // - Handle EOF.
     // - Handle non-printing characters.
     
-    char c[1];
-    c[0] = advance();
+    advance();
     if (advance() != '\'') return error(String::create("Unterminated character."));
-    return makeToken(TOKEN_CHARACTER, String::create(c, 1));
+    return makeToken(TOKEN_CHARACTER);
   }
   
-  gc<Token> Lexer::readString()
+  Token Lexer::readString()
   {
-    Array<char> chars;
+    // Just validate the string here. Lexer::text() creates its value.
     while (true)
     {
       if (isDone())
@@ -407,11 +443,7 @@ namespace magpie
       }
 
       char c = advance();
-      if (c == '"')
-      {
-        gc<String> text = String::create(chars);
-        return makeToken(TOKEN_STRING, text);
-      }
+      if (c == '"') return makeToken(TOKEN_STRING);
 
       // An escape sequence.
       if (c == '\\')
@@ -424,19 +456,72 @@ namespace magpie
         char e = advance();
         switch (e)
         {
-          case 'n':  chars.add('\n'); break;
-          case '"':  chars.add('"'); break;
-          case '\\': chars.add('\\'); break;
-          case 't':  chars.add('\t'); break;
+          case 'n':
+          case '"':
+          case '\\':
+          case 't':
+            break;
           default:
             return error(String::format("Unknown escape sequence '%c'.", e));
         }
       }
-      else
-      {
-        // Normal character.
-        chars.add(c);
-      }
     }
   }
+
+  TokenType Lexer::keywordType() const
+  {
+    struct Keyword
+    {
+      const char* text;
+      TokenType type;
+    };
+
+    static const Keyword keywords[] = {
+      { "and",      TOKEN_AND },
+      { "as",       TOKEN_AS },
+      { "async",    TOKEN_ASYNC },
+      { "break",    TOKEN_BREAK },
+      { "case",     TOKEN_CASE },
+      { "catch",    TOKEN_CATCH },
+      { "def",      TOKEN_DEF },
+      { "defclass", TOKEN_DEFCLASS },
+      { "do",       TOKEN_DO },
+      { "else",     TOKEN_ELSE },
+      { "end",      TOKEN_END },
+      { "false",    TOKEN_FALSE },
+      { "fn",       TOKEN_FN },
+      { "for",      TOKEN_FOR },
+      { "if",       TOKEN_IF },
+      { "import",   TOKEN_IMPORT },
+      { "in",       TOKEN_IN },
+      { "is",       TOKEN_IS },
+      { "match",    TOKEN_MATCH },
+      { "not",      TOKEN_NOT },
+      { "nothing",  TOKEN_NOTHING },
+      { "or",       TOKEN_OR },
+      { "return",   TOKEN_RETURN },
+      { "then",     TOKEN_THEN },
+      { "throw",    TOKEN_THROW },
+      { "true",     TOKEN_TRUE },
+      { "val",      TOKEN_VAL },
+      { "var",      TOKEN_VAR },
+      { "while",    TOKEN_WHILE },
+      { "xor",      TOKEN_XOR }
+    };
+
+    // Compare against the source directly so that names don't need to be
+    // copied out of it.
+    int length = pos_ - start_;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+    {
+      const char* keyword = keywords[i].text;
+      if (keyword[0] != (*source_)[start_]) continue;
+
+      int j = 1;
+      while (j < length && keyword[j] == (*source_)[start_ + j]) j++;
+      if (j == length && keyword[j] == '\0') return keywords[i].type;
+    }
+
+    return TOKEN_NAME;
+  }
 }
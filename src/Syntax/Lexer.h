@@ -23,13 +23,27 @@ namespace magpie
       currentCol_(1)
     {}
 
+    gc<SourceFile> source() const { return source_; }
+
     // Lexes and returns the next full Token read from the source. Handles
     // eliding newlines that should ignored.
-    gc<Token> readToken();
+    Token readToken();
+
+    // Creates a String for the text of [token]. For names, operators and
+    // numbers, this is the source text. For strings and characters, it's the
+    // value of the literal with any escapes processed, and for fields, it's
+    // the name without the ":". For errors, it's the error message.
+    gc<String> text(const Token& token) const;
+
+    // Creates a SourcePos for the span of source [token] was lexed from.
+    gc<SourcePos> pos(const Token& token) const;
+
+    // Gets whether the source text of [token] is [text].
+    bool is(const Token& token, const char* text) const;
 
   private:
     // Reads a single token without and newline processing.
-    gc<Token> readRawToken();
+    Token readRawToken();
     
     bool isDone() const;
 
@@ -43,18 +57,21 @@ namespace magpie
     bool match(char c);
     char advance();
 
-    gc<Token> makeToken(TokenType type);
-    gc<Token> makeToken(TokenType type, gc<String> text);
-    gc<Token> error(gc<String> message);
+    Token makeToken(TokenType type);
+    Token error(gc<String> message);
     
     void skipLineComment();
     void skipBlockComment();
 
-    gc<Token> readName();
-    gc<Token> readNumber();
-    gc<Token> readOperator();
-    gc<Token> readCharacter();
-    gc<Token> readString();
+    Token readName();
+    Token readNumber();
+    Token readOperator();
+    Token readCharacter();
+    Token readString();
+
+    // Gets the keyword token type for the name from [start_] to [pos_], or
+    // TOKEN_NAME if it isn't a keyword.
+    TokenType keywordType() const;
 
     gc<SourceFile> source_;
     int     pos_;
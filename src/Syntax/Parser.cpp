@@ -110,7 +110,7 @@ namespace magpie
     // An empty module is equivalent to `nothing`.
     if (exprs.count() == 0)
     {
-      exprs.add(new NothingExpr(last()->pos()));
+      exprs.add(new NothingExpr(pos(last())));
     }
 
     return new ModuleAst(new SequenceExpr(spanFrom(exprs[0]), exprs));
@@ -168,12 +168,12 @@ namespace magpie
       if (lookAhead(TOKEN_EOF))
       {
         checkForMissingLine();
-        reporter_.error(current()->pos(), "Unterminated block.");
+        reporter_.error(pos(current()), "Unterminated block.");
       }
       
       // Return which kind of token we ended the block with, for callers that
       // care.
-      *outEndToken = current()->type();
+      *outEndToken = current().type();
 
       // If the block ends with 'end', then we want to consume that token,
       // otherwise we want to leave it unconsumed to be consistent with the
@@ -205,11 +205,11 @@ namespace magpie
     else if (lookAhead(TOKEN_EOF))
     {
       checkForMissingLine();
-      reporter_.error(current()->pos(),
+      reporter_.error(pos(current()),
           "Expected block or expression but reached end of file.");
       
       // Return a fake node so we can continue and report errors.
-      return new NothingExpr(current()->pos());
+      return new NothingExpr(pos(current()));
     }
     else
     {
@@ -221,7 +221,7 @@ namespace magpie
 
   gc<Expr> Parser::maybeImport()
   {
-    gc<Token> start = current();
+    Token start = current();
     if (!match(TOKEN_IMPORT)) return NULL;
 
     Array<gc<String> > names;
@@ -229,9 +229,9 @@ namespace magpie
     {
       const char* firstError = "Expect name after 'import'.";
       const char* restError = "Expect name after '.' in import.";
-      gc<Token> namePart = consume(TOKEN_NAME,
+      Token namePart = consume(TOKEN_NAME,
                                    names.count() == 0 ? firstError : restError);
-      names.add(namePart->text());
+      names.add(text(namePart));
     } while (match(TOKEN_DOT));
 
     // TODO(bob): Create String::join() to optimize this?
@@ -246,7 +246,7 @@ namespace magpie
   
   gc<Expr> Parser::topLevelExpression()
   {
-    gc<Token> start = current();
+    Token start = current();
     
     if (match(TOKEN_DEF))
     {
@@ -279,7 +279,7 @@ namespace magpie
           lookAhead(TOKEN_TERM_OP) ||
           lookAhead(TOKEN_PRODUCT_OP))
       {
-        name = consume()->text();
+        name = text(consume());
         
         if (match(TOKEN_LEFT_PAREN))
         {
@@ -306,9 +306,9 @@ namespace magpie
       }
       else
       {
-        reporter_.error(current()->pos(),
+        reporter_.error(pos(current()),
             "Expect a method name or pattern after 'def' but got '%s'.",
-            current()->text()->cString());
+            text(current())->cString());
       }
       
       // See if it's a setter.
@@ -321,12 +321,12 @@ namespace magpie
       
       // See if this is a native method.
       gc<Expr> body;
-      if (lookAhead(TOKEN_NAME) && (*current()->text() == "native"))
+      if (lookAhead(TOKEN_NAME) && lexer_.is(current(), "native"))
       {
         consume();
-        gc<Token> text = consume(TOKEN_STRING,
-                                 "Expect string after 'native'.");
-        body = new NativeExpr(text->pos(), text->text());
+        Token nativeName = consume(TOKEN_STRING,
+                                   "Expect string after 'native'.");
+        body = new NativeExpr(pos(nativeName), text(nativeName));
       }
       else
       {
@@ -339,7 +339,7 @@ namespace magpie
     
     if (match(TOKEN_DEFCLASS))
     {
-      gc<Token> name = consume(TOKEN_NAME,
+      Token name = consume(TOKEN_NAME,
                                "Expect name after 'defclass'.");
 
       Array<gc<Expr> > superclasses;
@@ -347,10 +347,10 @@ namespace magpie
       {
         do
         {
-          gc<Token> superclassName = consume(TOKEN_NAME,
+          Token superclassName = consume(TOKEN_NAME,
                                              "Expect superclass name.");
-          gc<Expr> superclass = new NameExpr(superclassName->pos(),
-                                             superclassName->text());
+          gc<Expr> superclass = new NameExpr(pos(superclassName),
+                                             text(superclassName));
           superclasses.add(superclass);
         }
         while (match(TOKEN_COMMA));
@@ -359,7 +359,7 @@ namespace magpie
       bool isNative = false;
       Array<gc<ClassField> > fields;
 
-      if (lookAhead(TOKEN_NAME) && (*current()->text() == "native"))
+      if (lookAhead(TOKEN_NAME) && lexer_.is(current(), "native"))
       {
         consume();
         isNative = true;
@@ -372,8 +372,8 @@ namespace magpie
         {
           if (match(TOKEN_VAR) || match(TOKEN_VAL))
           {
-            bool isMutable = last()->is(TOKEN_VAR);
-            gc<String> name = consume(TOKEN_NAME, "Expect field name.")->text();
+            bool isMutable = last().is(TOKEN_VAR);
+            gc<String> name = text(consume(TOKEN_NAME, "Expect field name."));
             gc<Pattern> pattern;
             gc<Expr> initializer;
 
@@ -400,7 +400,7 @@ namespace magpie
         }
       }
       
-      return new DefClassExpr(spanFrom(start), name->text(), isNative,
+      return new DefClassExpr(spanFrom(start), text(name), isNative,
                               superclasses, fields);
     }
 
@@ -409,7 +409,7 @@ namespace magpie
     
   gc<Expr> Parser::statement(bool allowBlockArgument)
   {
-    gc<Token> start = current();
+    Token start = current();
 
     if (match(TOKEN_ASYNC))
     {
@@ -427,7 +427,7 @@ namespace magpie
     if (match(TOKEN_DEF))
     {
       // Methods can only be declared at the top level. Show a friendly error.
-      reporter_.error(current()->pos(),
+      reporter_.error(pos(current()),
           "Methods can only be declared at the top level of a module.");
     }
     
@@ -445,7 +445,7 @@ namespace magpie
 
     if (match(TOKEN_VAR) || match(TOKEN_VAL))
     {
-      bool isMutable = last()->is(TOKEN_VAR);
+      bool isMutable = last().is(TOKEN_VAR);
 
       gc<Pattern> pattern = parsePattern(false);
       consume(TOKEN_EQ, "Expect '=' after variable declaration.");
@@ -459,7 +459,7 @@ namespace magpie
 
   gc<Expr> Parser::flowControl(bool allowBlockArgument)
   {
-    gc<Token> start = current();
+    Token start = current();
     
     if (match(TOKEN_DO))
     {
@@ -559,7 +559,7 @@ namespace magpie
       gc<Pattern> pattern;
 
       // Parse the pattern if there is one.
-      if (last()->is(TOKEN_AS))
+      if (last().is(TOKEN_AS))
       {
         pattern = parsePattern(true);
         pattern = expandFunctionPattern(pattern->pos(), pattern);
@@ -618,25 +618,42 @@ namespace magpie
 
   gc<Expr> Parser::parsePrecedence(int precedence)
   {
-    gc<Token> token = consume();
-    PrefixParseFn prefix = expressions_[token->type()].prefix;
+    Token token = consume();
+    PrefixParseFn prefix = expressions_[token.type()].prefix;
 
     if (prefix == NULL)
     {
-      gc<String> tokenText = token->toString();
-      reporter_.error(token->pos(), "Unexpected token '%s'.",
+      // Show literals and names by their text, and everything else by what
+      // kind of token it is.
+      gc<String> tokenText;
+      switch (token.type())
+      {
+        case TOKEN_FIELD:
+        case TOKEN_NAME:
+        case TOKEN_CHARACTER:
+        case TOKEN_FLOAT:
+        case TOKEN_INT:
+        case TOKEN_STRING:
+          tokenText = text(token);
+          break;
+
+        default:
+          tokenText = String::create(Token::typeString(token.type()));
+      }
+
+      reporter_.error(pos(token), "Unexpected token '%s'.",
                       tokenText->cString());
       
       // Return a fake expression so we can keep parsing to find more errors.
-      return new NothingExpr(token->pos());
+      return new NothingExpr(pos(token));
     }
 
     gc<Expr> left = (this->*prefix)(token);
 
-    while (precedence <= expressions_[current()->type()].precedence)
+    while (precedence <= expressions_[current().type()].precedence)
     {
       token = consume();
-      InfixParseFn infix = expressions_[token->type()].infix;
+      InfixParseFn infix = expressions_[token.type()].infix;
       left = (this->*infix)(left, token);
     }
 
@@ -645,24 +662,24 @@ namespace magpie
 
   // Prefix parsers -----------------------------------------------------------
 
-  gc<Expr> Parser::boolean(gc<Token> token)
+  gc<Expr> Parser::boolean(const Token& token)
   {
-    return new BoolExpr(token->pos(), token->type() == TOKEN_TRUE);
+    return new BoolExpr(pos(token), token.type() == TOKEN_TRUE);
   }
 
-  gc<Expr> Parser::character(gc<Token> token)
+  gc<Expr> Parser::character(const Token& token)
   {
     // TODO(bob): Handle non-literal characters.
-    return new CharacterExpr(token->pos(), (*token->text())[0]);
+    return new CharacterExpr(pos(token), (*text(token))[0]);
   }
 
-  gc<Expr> Parser::float_(gc<Token> token)
+  gc<Expr> Parser::float_(const Token& token)
   {
-    double value = atof(token->text()->cString());
-    return new FloatExpr(token->pos(), value);
+    double value = atof(text(token)->cString());
+    return new FloatExpr(pos(token), value);
   }
   
-  gc<Expr> Parser::function(gc<Token> token)
+  gc<Expr> Parser::function(const Token& token)
   {
     gc<Pattern> pattern;
     bool hasPattern = false;
@@ -725,20 +742,20 @@ namespace magpie
                                new RecordPattern(pos, fields));
   }
   
-  gc<Expr> Parser::group(gc<Token> token)
+  gc<Expr> Parser::group(const Token& token)
   {
     gc<Expr> expr = flowControl(true);
     consume(TOKEN_RIGHT_PAREN, "Expect ')'.");
     return expr;
   }
 
-  gc<Expr> Parser::int_(gc<Token> token)
+  gc<Expr> Parser::int_(const Token& token)
   {
-    int value = atoi(token->text()->cString());
-    return new IntExpr(token->pos(), value);
+    int value = atoi(text(token)->cString());
+    return new IntExpr(pos(token), value);
   }
   
-  gc<Expr> Parser::list(gc<Token> token)
+  gc<Expr> Parser::list(const Token& token)
   {
     Array<gc<Expr> > elements;
     
@@ -757,28 +774,28 @@ namespace magpie
     return new ListExpr(spanFrom(token), elements);
   }
   
-  gc<Expr> Parser::name(gc<Token> token)
+  gc<Expr> Parser::name(const Token& token)
   {
     return call(gc<Expr>(), token);
   }
 
-  gc<Expr> Parser::not_(gc<Token> token)
+  gc<Expr> Parser::not_(const Token& token)
   {
     gc<Expr> value = parsePrecedence(PRECEDENCE_CALL);
     return new NotExpr(spanFrom(token), value);
   }
 
-  gc<Expr> Parser::nothing(gc<Token> token)
+  gc<Expr> Parser::nothing(const Token& token)
   {
-    return new NothingExpr(token->pos());
+    return new NothingExpr(pos(token));
   }
 
-  gc<Expr> Parser::record(gc<Token> token)
+  gc<Expr> Parser::record(const Token& token)
   {
     Array<Field> fields;
 
     gc<Expr> value = parsePrecedence(PRECEDENCE_RECORD + 1);
-    fields.add(Field(token->text(), value));
+    fields.add(Field(text(token), value));
 
     int i = 1;
     while (match(TOKEN_COMMA))
@@ -787,7 +804,7 @@ namespace magpie
       if (match(TOKEN_FIELD))
       {
         // A named field.
-        name = last()->text();
+        name = text(last());
       }
       else
       {
@@ -800,7 +817,7 @@ namespace magpie
       {
         if (*name == *fields[j].name)
         {
-          reporter_.error(current()->pos(),
+          reporter_.error(pos(current()),
                           "Cannot use field '%s' twice in a record.",
                           name->cString());
         }
@@ -815,12 +832,12 @@ namespace magpie
     return new RecordExpr(spanFrom(token), fields);
   }
 
-  gc<Expr> Parser::string(gc<Token> token)
+  gc<Expr> Parser::string(const Token& token)
   {
-    return new StringExpr(token->pos(), token->text());
+    return new StringExpr(pos(token), text(token));
   }
 
-  gc<Expr> Parser::throw_(gc<Token> token)
+  gc<Expr> Parser::throw_(const Token& token)
   {
     gc<Expr> value = parsePrecedence(PRECEDENCE_LOGICAL);
     return new ThrowExpr(spanFrom(token), value);
@@ -828,20 +845,20 @@ namespace magpie
 
   // Infix parsers ------------------------------------------------------------
 
-  gc<Expr> Parser::and_(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::and_(gc<Expr> left, const Token& token)
   {
-    gc<Expr> right = parsePrecedence(expressions_[token->type()].precedence);
-    return new AndExpr(token->pos(), left, right);
+    gc<Expr> right = parsePrecedence(expressions_[token.type()].precedence);
+    return new AndExpr(pos(token), left, right);
   }
   
-  gc<Expr> Parser::assignment(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::assignment(gc<Expr> left, const Token& token)
   {
     gc<LValue> lvalue = convertToLValue(left);
     gc<Expr> value = parsePrecedence(PRECEDENCE_ASSIGNMENT);
     return new AssignExpr(spanFrom(left), lvalue, value);
   }
   
-  gc<Expr> Parser::call(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::call(gc<Expr> left, const Token& token)
   {
     // See if we have an argument on the right.
     bool hasRightArg = false;
@@ -866,23 +883,23 @@ namespace magpie
     if (left.isNull() && !hasRightArg)
     {
       // Just a bare name.
-      return new NameExpr(spanFrom(token), token->text());
+      return new NameExpr(spanFrom(token), text(token));
     }
 
-    return new CallExpr(spanFrom(token), left, token->text(), right);
+    return new CallExpr(spanFrom(token), left, text(token), right);
   }
     
-  gc<Expr> Parser::infixCall(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::infixCall(gc<Expr> left, const Token& token)
   {
     // TODO(bob): Support right-associative infix. Needs to do precedence
     // - 1 here, to be right-assoc.
     gc<Expr> right = parsePrecedence(
-        expressions_[token->type()].precedence + 1);
+        expressions_[token.type()].precedence + 1);
     
-    return new CallExpr(spanFrom(left), left, token->text(), right);
+    return new CallExpr(spanFrom(left), left, text(token), right);
   }
   
-  gc<Expr> Parser::infixRecord(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::infixRecord(gc<Expr> left, const Token& token)
   {
     Array<Field> fields;
 
@@ -897,7 +914,7 @@ namespace magpie
       if (match(TOKEN_FIELD))
       {
         // A named field.
-        name = last()->text();
+        name = text(last());
       }
       else
       {
@@ -910,7 +927,7 @@ namespace magpie
       {
         if (*name == *fields[j].name)
         {
-          reporter_.error(current()->pos(),
+          reporter_.error(pos(current()),
                           "Cannot use field '%s' twice in a record.",
                           name->cString());
         }
@@ -926,25 +943,25 @@ namespace magpie
     return new RecordExpr(spanFrom(left), fields);
   }
 
-  gc<Expr> Parser::is(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::is(gc<Expr> left, const Token& token)
   {
     gc<Expr> type = parsePrecedence(PRECEDENCE_CALL);
     return new IsExpr(spanFrom(left), left, type);
   }
 
-  gc<Expr> Parser::or_(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::or_(gc<Expr> left, const Token& token)
   {
-    gc<Expr> right = parsePrecedence(expressions_[token->type()].precedence);
+    gc<Expr> right = parsePrecedence(expressions_[token.type()].precedence);
     return new OrExpr(spanFrom(left), left, right);
   }
 
-  gc<Expr> Parser::prefixCall(gc<Token> token)
+  gc<Expr> Parser::prefixCall(const Token& token)
   {
     gc<Expr> right = parsePrecedence(PRECEDENCE_PREFIX);
-    return new CallExpr(spanFrom(token), NULL, token->text(), right);
+    return new CallExpr(spanFrom(token), NULL, text(token), right);
   }
   
-  gc<Expr> Parser::subscript(gc<Expr> left, gc<Token> token)
+  gc<Expr> Parser::subscript(gc<Expr> left, const Token& token)
   {
     // Parse the subscript.
     // TODO(bob): Is this right? Do we want to allow variable declarations
@@ -965,7 +982,7 @@ namespace magpie
   gc<Pattern> Parser::recordPattern(bool isMethod)
   {
     bool hasField = false;
-    gc<Token> start = current();
+    Token start = current();
     Array<PatternField> fields;
 
     do
@@ -973,7 +990,7 @@ namespace magpie
       gc<String> name;
       if (match(TOKEN_FIELD))
       {
-        name = last()->text();
+        name = text(last());
         hasField = true;
       }
       else
@@ -986,7 +1003,7 @@ namespace magpie
       {
         if (*name == *fields[j].name)
         {
-          reporter_.error(current()->pos(),
+          reporter_.error(pos(current()),
               "Cannot use field '%s' twice in a record pattern.",
               name->cString());
         }
@@ -996,7 +1013,7 @@ namespace magpie
 
       if (value.isNull())
       {
-        reporter_.error(current()->pos(), "Expect pattern.");
+        reporter_.error(pos(current()), "Expect pattern.");
       }
 
       fields.add(PatternField(name, value));
@@ -1017,9 +1034,9 @@ namespace magpie
   {
     if (match(TOKEN_NAME))
     {
-      gc<Token> name = last();
+      Token name = last();
       gc<Pattern> inner = primaryPattern(isMethod);
-      return new VariablePattern(spanFrom(name), name->text(), inner);
+      return new VariablePattern(spanFrom(name), text(name), inner);
     }
     else
     {
@@ -1029,7 +1046,7 @@ namespace magpie
 
   gc<Pattern> Parser::primaryPattern(bool isMethod)
   {
-    gc<Token> start = last();
+    Token start = last();
 
     if (match(TOKEN_TRUE) || match(TOKEN_FALSE))
     {
@@ -1094,9 +1111,9 @@ namespace magpie
     // Can only use names in method patterns.
     if (isMethod)
     {
-      gc<Token> name = consume(TOKEN_NAME,
+      Token name = consume(TOKEN_NAME,
           "An expression in a method pattern can only be a simple name.");
-      return new NameExpr(name->pos(), name->text());
+      return new NameExpr(pos(name), text(name));
     }
 
     return parsePrecedence(PRECEDENCE_COMPARISON);
@@ -1145,7 +1162,7 @@ namespace magpie
   gc<Expr> Parser::createSequence(const Array<gc<Expr> >& exprs)
   {
     // If the sequence is empty, just default it to nothing.
-    if (exprs.count() == 0) return new NothingExpr(last()->pos());
+    if (exprs.count() == 0) return new NothingExpr(pos(last()));
 
     // If there is just one expression in the sequence, don't wrap it.
     if (exprs.count() == 1) return exprs[0];
@@ -1153,7 +1170,7 @@ namespace magpie
     return new SequenceExpr(spanFrom(exprs[0]), exprs);
   }
 
-  const gc<Token> Parser::current()
+  Token Parser::current()
   {
     fillLookAhead(1);
     return read_[0];
@@ -1162,13 +1179,13 @@ namespace magpie
   bool Parser::lookAhead(TokenType type)
   {
     fillLookAhead(1);
-    return read_[0]->type() == type;
+    return read_[0].type() == type;
   }
 
   bool Parser::lookAhead(TokenType current, TokenType next)
   {
     fillLookAhead(2);
-    return read_[0]->is(current) && read_[1]->is(next);
+    return read_[0].is(current) && read_[1].is(next);
   }
 
   bool Parser::match(TokenType type)
@@ -1186,27 +1203,27 @@ namespace magpie
 
   void Parser::expect(TokenType expected, const char* errorMessage)
   {
-    if (!lookAhead(expected)) reporter_.error(current()->pos(), errorMessage);
+    if (!lookAhead(expected)) reporter_.error(pos(current()), errorMessage);
   }
 
-  gc<Token> Parser::consume()
+  Token Parser::consume()
   {
     fillLookAhead(1);
     last_ = read_.dequeue();
     return last_;
   }
 
-  gc<Token> Parser::consume(TokenType expected, const char* errorMessage)
+  Token Parser::consume(TokenType expected, const char* errorMessage)
   {
     if (lookAhead(expected)) return consume();
     
     if (expected == TOKEN_LINE) checkForMissingLine();
-    reporter_.error(current()->pos(), errorMessage);
+    reporter_.error(pos(current()), errorMessage);
 
     // Try to consume tokens until we find what we're looking for (or we run
     // out). This should reduce the number of cascaded errors caused after this
     // one.
-    gc<Token> token = consume();
+    Token token = consume();
     while (!match(expected) && !lookAhead(TOKEN_EOF))
     {
       token = consume();
@@ -1223,24 +1240,27 @@ namespace magpie
     }
   }
 
-  gc<SourcePos> Parser::spanFrom(gc<Token> from)
+  gc<SourcePos> Parser::spanFrom(const Token& from)
   {
-    return from->pos()->spanTo(last()->pos());
+    return new SourcePos(lexer_.source(), from.startLine(), from.startCol(),
+                         last_.endLine(), last_.endCol());
   }
   
   gc<SourcePos> Parser::spanFrom(gc<Expr> from)
   {
-    return from->pos()->spanTo(last()->pos());
+    gc<SourcePos> start = from->pos();
+    return new SourcePos(start->file(), start->startLine(), start->startCol(),
+                         last_.endLine(), last_.endCol());
   }
 
   void Parser::fillLookAhead(int count)
   {
     while (read_.count() < count)
     {
-      gc<Token> token = lexer_.readToken();
-      if (token->is(TOKEN_ERROR))
+      Token token = lexer_.readToken();
+      if (token.is(TOKEN_ERROR))
       {
-        reporter_.error(token->pos(), token->text()->cString());
+        reporter_.error(pos(token), text(token)->cString());
       }
       else
       {
@@ -31,8 +31,9 @@ namespace magpie
     gc<Expr> parseExpression();
     
   private:
-    typedef gc<Expr> (Parser::*PrefixParseFn)(gc<Token> token);
-    typedef gc<Expr> (Parser::*InfixParseFn)(gc<Expr> left, gc<Token> token);
+    typedef gc<Expr> (Parser::*PrefixParseFn)(const Token& token);
+    typedef gc<Expr> (Parser::*InfixParseFn)(gc<Expr> left,
+                                             const Token& token);
     
     struct Parselet
     {
@@ -57,30 +58,30 @@ namespace magpie
     gc<Expr> parsePrecedence(int precedence = 0);
     
     // Prefix expression parsers.
-    gc<Expr> boolean(gc<Token> token);
-    gc<Expr> character(gc<Token> token);
-    gc<Expr> float_(gc<Token> token);
-    gc<Expr> function(gc<Token> token);
-    gc<Expr> group(gc<Token> token);
-    gc<Expr> int_(gc<Token> token);
-    gc<Expr> list(gc<Token> token);
-    gc<Expr> name(gc<Token> token);
-    gc<Expr> not_(gc<Token> token);
-    gc<Expr> nothing(gc<Token> token);
-    gc<Expr> record(gc<Token> token);
-    gc<Expr> string(gc<Token> token);
-    gc<Expr> throw_(gc<Token> token);
+    gc<Expr> boolean(const Token& token);
+    gc<Expr> character(const Token& token);
+    gc<Expr> float_(const Token& token);
+    gc<Expr> function(const Token& token);
+    gc<Expr> group(const Token& token);
+    gc<Expr> int_(const Token& token);
+    gc<Expr> list(const Token& token);
+    gc<Expr> name(const Token& token);
+    gc<Expr> not_(const Token& token);
+    gc<Expr> nothing(const Token& token);
+    gc<Expr> record(const Token& token);
+    gc<Expr> string(const Token& token);
+    gc<Expr> throw_(const Token& token);
 
     // Infix expression parsers.
-    gc<Expr> and_(gc<Expr> left, gc<Token> token);
-    gc<Expr> assignment(gc<Expr> left, gc<Token> token);
-    gc<Expr> call(gc<Expr> left, gc<Token> token);
-    gc<Expr> infixCall(gc<Expr> left, gc<Token> token);
-    gc<Expr> infixRecord(gc<Expr> left, gc<Token> token);
-    gc<Expr> is(gc<Expr> left, gc<Token> token);
-    gc<Expr> or_(gc<Expr> left, gc<Token> token);
-    gc<Expr> prefixCall(gc<Token> token);
-    gc<Expr> subscript(gc<Expr> left, gc<Token> token);
+    gc<Expr> and_(gc<Expr> left, const Token& token);
+    gc<Expr> assignment(gc<Expr> left, const Token& token);
+    gc<Expr> call(gc<Expr> left, const Token& token);
+    gc<Expr> infixCall(gc<Expr> left, const Token& token);
+    gc<Expr> infixRecord(gc<Expr> left, const Token& token);
+    gc<Expr> is(gc<Expr> left, const Token& token);
+    gc<Expr> or_(gc<Expr> left, const Token& token);
+    gc<Expr> prefixCall(const Token& token);
+    gc<Expr> subscript(gc<Expr> left, const Token& token);
 
     // Pattern parsing.
     gc<Pattern> parsePattern(bool isMethod);
@@ -106,10 +107,14 @@ namespace magpie
     gc<Expr> createSequence(const Array<gc<Expr> >& exprs);
 
     // Gets the token the parser is currently looking at.
-    const gc<Token> current();
+    Token current();
     
     // Gets the most recently consumed token.
-    const gc<Token> last() const { return last_; }
+    const Token& last() const { return last_; }
+
+    // Creates the text or position of [token] for the AST.
+    gc<String> text(const Token& token) const { return lexer_.text(token); }
+    gc<SourcePos> pos(const Token& token) const { return lexer_.pos(token); }
     
     // Returns true if the current token is the given type.
     bool lookAhead(TokenType type);
@@ -128,11 +133,11 @@ namespace magpie
     void expect(TokenType expected, const char* errorMessage);
     
     // Consumes the current token and advances the parser.
-    gc<Token> consume();
+    Token consume();
     
     // Consumes the current token if it matches the expected type.
     // Otherwise reports the given error message and returns a null temp.
-    gc<Token> consume(TokenType expected, const char* errorMessage);
+    Token consume(TokenType expected, const char* errorMessage);
     
     // Detects if the lexer ran out of input when another line is expected.
     // This lets the REPL know it needs to read another line.
@@ -142,7 +147,7 @@ namespace magpie
 
     // Creates a [SourcePos] that spans the code starting at [from] up to the
     // last consumed [Token].
-    gc<SourcePos> spanFrom(gc<Token> from);
+    gc<SourcePos> spanFrom(const Token& from);
     gc<SourcePos> spanFrom(gc<Expr> from);
 
     static Parselet expressions_[TOKEN_NUM_TYPES];
@@ -152,10 +157,10 @@ namespace magpie
     ErrorReporter& reporter_;
     
     // The 2 here is the maximum number of lookahead tokens.
-    Queue<gc<Token>, 2> read_;
+    Queue<Token, 2> read_;
     
     // The most recently consumed token.
-    gc<Token> last_;
+    Token last_;
     
     NO_COPY(Parser);
   };
@@ -65,12 +65,6 @@ namespace magpie
     file_.reach();
   }
 
-  Token::Token(TokenType type, gc<String> text, gc<SourcePos> pos)
-  : type_(type),
-    text_(text),
-    pos_(pos)
-  {}
-
   const char* Token::typeString(TokenType type)
   {
     switch (type)
@@ -139,33 +133,4 @@ namespace magpie
         ASSERT(false, "Unknown TokenType.");
     }
   }
-
-  void Token::reach()
-  {
-    text_.reach();
-  }
-
-  void Token::trace(std::ostream& out) const
-  {
-    switch (type_)
-    {
-      case TOKEN_NAME:
-      case TOKEN_CHARACTER:
-      case TOKEN_FLOAT:
-      case TOKEN_INT:
-      case TOKEN_STRING:
-      case TOKEN_ERROR:
-        // Show the text.
-        out << text_;
-        break;
-
-      case TOKEN_FIELD:
-        out << text_ << ":";
-        break;
-
-      default:
-        // It's a token type with a fixed text, so just use that.
-        out << typeString(type_);
-    }
-  }
 }
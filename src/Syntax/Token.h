@@ -135,27 +135,63 @@ namespace magpie
   
   // A single meaningful Token of source code. Generated by the Lexer, and
   // consumed by the Parser.
-  class Token : public Managed
+  //
+  // Tokens are small values that point back into the source instead of
+  // owning their text, so lexing doesn't allocate anything on the GC heap.
+  // The Lexer turns a Token into a String or a SourcePos only when the parser
+  // actually needs one. See Lexer::text() and Lexer::pos().
+  class Token
   {
   public:
-    Token(TokenType type, gc<String> text, gc<SourcePos> pos);
-    
+    Token()
+    : type_(TOKEN_EOF),
+      start_(0),
+      end_(0),
+      startLine_(0),
+      startCol_(0),
+      endLine_(0),
+      endCol_(0)
+    {}
+
+    Token(TokenType type, int start, int end, int startLine, int startCol,
+          int endLine, int endCol)
+    : type_(type),
+      start_(start),
+      end_(end),
+      startLine_(startLine),
+      startCol_(startCol),
+      endLine_(endLine),
+      endCol_(endCol)
+    {}
+
     static const char* typeString(TokenType type);
-    
-    TokenType      type() const { return type_; }
-    gc<String>     text() const { return text_; }
-    gc<SourcePos>  pos()  const { return pos_; }
-    
+
+    TokenType type() const { return type_; }
+
+    // The range of characters in the source that this token was lexed from.
+    int start() const { return start_; }
+    int end() const { return end_; }
+
+    int startLine() const { return startLine_; }
+    int startCol() const { return startCol_; }
+    int endLine() const { return endLine_; }
+    int endCol() const { return endCol_; }
+
     // Gets whether this token is of the given type.
     bool is(TokenType type) const { return type_ == type; }
-    
-    virtual void reach();
-    virtual void trace(std::ostream& out) const;
-    
+
+    // For an error token, the message describing the error.
+    gc<String> message() const { return message_; }
+    void setMessage(gc<String> message) { message_ = message; }
+
   private:
     TokenType     type_;
-    gc<String>    text_;
-    gc<SourcePos> pos_;
+    int           start_;
+    int           end_;
+    int           startLine_;
+    int           startCol_;
+    int           endLine_;
+    int           endCol_;
+    gc<String>    message_;
   };
 }
-
@@ -0,0 +1,118 @@
+#include "AstCache.h"
+#include "AstCacheTests.h"
+#include "ErrorReporter.h"
+#include "Memory.h"
+#include "Parser.h"
+
+namespace magpie
+{
+  static const char* CODE =
+      "import io\n"
+      "defclass Point\n"
+      "    var x is Int = 1\n"
+      "    val y\n"
+      "end\n"
+      "def (a is Point) + (b == 2.5) a\n"
+      "def foo(x: a, y: [b, c])\n"
+      "    match a\n"
+      "        case 1 then -1\n"
+      "        case \"s\" then nothing\n"
+      "        else true\n"
+      "    end\n"
+      "catch is Error then false\n"
+      "end\n"
+      "var x, y = 3, 4\n"
+      "while x < 10 do x = x + 1\n"
+      "for i in 1..3 do if i == 2 then break\n"
+      "fn(a) a or not false\n";
+
+  static gc<ModuleAst> parse(gc<SourceFile> source)
+  {
+    ErrorReporter reporter;
+    Parser parser(source, reporter);
+    return parser.parseModule();
+  }
+
+  static bool sameBytes(const Array<unsigned char>& a,
+                        const Array<unsigned char>& b)
+  {
+    if (a.count() != b.count()) return false;
+
+    for (int i = 0; i < a.count(); i++)
+    {
+      if (a[i] != b[i]) return false;
+    }
+
+    return true;
+  }
+
+  void AstCacheTests::runTests()
+  {
+    roundTrip();
+    changedSource();
+    corruptData();
+  }
+
+  void AstCacheTests::roundTrip()
+  {
+    gc<SourceFile> source = new SourceFile(String::create("<file>"),
+                                           String::create(CODE));
+    gc<ModuleAst> module = parse(source);
+    EXPECT(!module.isNull());
+
+    AstWriter writer;
+    AstCache::write(writer, source, module);
+
+    const Array<unsigned char>& bytes = writer.bytes();
+    gc<ModuleAst> cached = AstCache::read(&bytes[0], bytes.count(), source);
+    EXPECT(!cached.isNull());
+    EXPECT_EQUAL(*module->toString(), *cached->toString());
+    EXPECT_EQUAL(module->body()->expressions().count(),
+                 cached->body()->expressions().count());
+
+    // Writing the cached AST again should give exactly the same bytes.
+    AstWriter rewriter;
+    AstCache::write(rewriter, source, cached);
+    EXPECT(sameBytes(bytes, rewriter.bytes()));
+  }
+
+  void AstCacheTests::changedSource()
+  {
+    gc<SourceFile> source = new SourceFile(String::create("<file>"),
+                                           String::create(CODE));
+    gc<ModuleAst> module = parse(source);
+
+    AstWriter writer;
+    AstCache::write(writer, source, module);
+
+    gc<String> code = String::format("%s\n", CODE);
+    gc<SourceFile> changed = new SourceFile(String::create("<file>"), code);
+
+    const Array<unsigned char>& bytes = writer.bytes();
+    EXPECT(AstCache::read(&bytes[0], bytes.count(), changed).isNull());
+  }
+
+  void AstCacheTests::corruptData()
+  {
+    gc<SourceFile> source = new SourceFile(String::create("<file>"),
+                                           String::create(CODE));
+    gc<ModuleAst> module = parse(source);
+
+    AstWriter writer;
+    AstCache::write(writer, source, module);
+
+    // Truncated.
+    const Array<unsigned char>& bytes = writer.bytes();
+    EXPECT(AstCache::read(&bytes[0], bytes.count() - 1, source).isNull());
+
+    // Trailing garbage.
+    Array<unsigned char> extra;
+    for (int i = 0; i < bytes.count(); i++) extra.add(bytes[i]);
+    extra.add(0);
+    EXPECT(AstCache::read(&extra[0], extra.count(), source).isNull());
+
+    // An unknown node tag.
+    unsigned char garbage[] = { 1, 0, 0, 0, 0xff, 0x7f, 0, 0, 0, 0 };
+    EXPECT(AstCache::read(garbage, sizeof(garbage), source).isNull());
+  }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class AstCacheTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void roundTrip();
+    void changedSource();
+    void corruptData();
+  };
+}
+
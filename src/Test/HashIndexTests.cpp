@@ -0,0 +1,72 @@
+#include "HashIndexTests.h"
+#include "HashIndex.h"
+
+namespace magpie
+{
+  void HashIndexTests::runTests()
+  {
+    find();
+    collisions();
+    grow();
+  }
+
+  void HashIndexTests::find()
+  {
+    HashIndex index;
+    int slot = -1;
+
+    // Empty.
+    EXPECT_EQUAL(0, index.count());
+    EXPECT_EQUAL(-1, index.find(123, slot));
+
+    index.add(123, 0);
+    index.add(456, 1);
+    EXPECT_EQUAL(2, index.count());
+
+    slot = -1;
+    EXPECT_EQUAL(0, index.find(123, slot));
+    EXPECT_EQUAL(-1, index.find(123, slot));
+
+    slot = -1;
+    EXPECT_EQUAL(1, index.find(456, slot));
+    EXPECT_EQUAL(-1, index.find(456, slot));
+
+    slot = -1;
+    EXPECT_EQUAL(-1, index.find(789, slot));
+  }
+
+  void HashIndexTests::collisions()
+  {
+    HashIndex index;
+
+    // These all land in the same slot, and some have the same hash.
+    index.add(3, 0);
+    index.add(19, 1);
+    index.add(3, 2);
+    index.add(35, 3);
+
+    int slot = -1;
+    EXPECT_EQUAL(0, index.find(3, slot));
+    EXPECT_EQUAL(2, index.find(3, slot));
+    EXPECT_EQUAL(-1, index.find(3, slot));
+
+    slot = -1;
+    EXPECT_EQUAL(3, index.find(35, slot));
+    EXPECT_EQUAL(-1, index.find(35, slot));
+  }
+
+  void HashIndexTests::grow()
+  {
+    HashIndex index;
+
+    for (int i = 0; i < 1000; i++) index.add(i * 7919u, i);
+    EXPECT_EQUAL(1000, index.count());
+
+    for (int i = 0; i < 1000; i++)
+    {
+      int slot = -1;
+      EXPECT_EQUAL(i, index.find(i * 7919u, slot));
+      EXPECT_EQUAL(-1, index.find(i * 7919u, slot));
+    }
+  }
+}
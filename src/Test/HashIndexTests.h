@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class HashIndexTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void find();
+    void collisions();
+    void grow();
+  };
+}
@@ -9,6 +9,8 @@ namespace magpie
   {
     create();
     stringLiteral();
+    namesAndFields();
+    errors();
   }
 
   void LexerTests::create()
@@ -17,29 +19,29 @@ namespace magpie
     gc<SourceFile> source = new SourceFile(String::create("<file>"), code);
     Lexer lexer(source);
 
-    gc<Token> token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_LEFT_PAREN, token->type());
-    EXPECT_EQUAL("(", *token->text());
+    Token token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_LEFT_PAREN, token.type());
+    EXPECT_EQUAL("(", *lexer.text(token));
 
     token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_RIGHT_PAREN, token->type());
-    EXPECT_EQUAL(")", *token->text());
+    EXPECT_EQUAL(TOKEN_RIGHT_PAREN, token.type());
+    EXPECT_EQUAL(")", *lexer.text(token));
 
     token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_LEFT_BRACKET, token->type());
-    EXPECT_EQUAL("[", *token->text());
+    EXPECT_EQUAL(TOKEN_LEFT_BRACKET, token.type());
+    EXPECT_EQUAL("[", *lexer.text(token));
 
     token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_RIGHT_BRACKET, token->type());
-    EXPECT_EQUAL("]", *token->text());
+    EXPECT_EQUAL(TOKEN_RIGHT_BRACKET, token.type());
+    EXPECT_EQUAL("]", *lexer.text(token));
 
     token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_LEFT_BRACE, token->type());
-    EXPECT_EQUAL("{", *token->text());
+    EXPECT_EQUAL(TOKEN_LEFT_BRACE, token.type());
+    EXPECT_EQUAL("{", *lexer.text(token));
 
     token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_RIGHT_BRACE, token->type());
-    EXPECT_EQUAL("}", *token->text());
+    EXPECT_EQUAL(TOKEN_RIGHT_BRACE, token.type());
+    EXPECT_EQUAL("}", *lexer.text(token));
   }
   
   void LexerTests::stringLiteral()
@@ -48,9 +50,55 @@ namespace magpie
     gc<SourceFile> source = new SourceFile(String::create("<file>"), code);
     Lexer lexer(source);
 
-    gc<Token> token = lexer.readToken();
-    EXPECT_EQUAL(TOKEN_STRING, token->type());
-    EXPECT_EQUAL("st\nr", *token->text());
+    Token token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_STRING, token.type());
+    EXPECT_EQUAL("st\nr", *lexer.text(token));
+  }
+
+  void LexerTests::namesAndFields()
+  {
+    gc<String> code = String::create("defclass define x: 'c' \"plain\"");
+    gc<SourceFile> source = new SourceFile(String::create("<file>"), code);
+    Lexer lexer(source);
+
+    Token token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_DEFCLASS, token.type());
+    EXPECT(lexer.is(token, "defclass"));
+    EXPECT_FALSE(lexer.is(token, "def"));
+
+    token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_NAME, token.type());
+    EXPECT_EQUAL("define", *lexer.text(token));
+
+    token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_FIELD, token.type());
+    EXPECT_EQUAL("x", *lexer.text(token));
+
+    gc<SourcePos> pos = lexer.pos(token);
+    EXPECT_EQUAL(1, pos->startLine());
+    EXPECT_EQUAL(17, pos->startCol());
+    EXPECT_EQUAL(19, pos->endCol());
+
+    token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_CHARACTER, token.type());
+    EXPECT_EQUAL("c", *lexer.text(token));
+
+    token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_STRING, token.type());
+    EXPECT_EQUAL("plain", *lexer.text(token));
+
+    token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_EOF, token.type());
   }
-}
 
+  void LexerTests::errors()
+  {
+    gc<String> code = String::create("\"a\\q\"");
+    gc<SourceFile> source = new SourceFile(String::create("<file>"), code);
+    Lexer lexer(source);
+
+    Token token = lexer.readToken();
+    EXPECT_EQUAL(TOKEN_ERROR, token.type());
+    EXPECT_EQUAL("Unknown escape sequence 'q'.", *lexer.text(token));
+  }
+}
@@ -12,6 +12,8 @@ namespace magpie
   private:
     void create();
     void stringLiteral();
+    void namesAndFields();
+    void errors();
   };
 }
 
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "uv.h"
+
+#include "MailboxTests.h"
+#include "VM.h"
+#include "Module.h"
+
+namespace magpie
+{
+  // Waits for the other VM to publish its mailbox, then sends it a list that
+  // contains itself along with a mailbox to reply on.
+  static const char* SENDER =
+      "var other = nothing\n"
+      "while other == nothing do\n"
+      "    other = Mailbox find(\"mailbox tests receiver\")\n"
+      "    if other == nothing then sleep(ms: 1)\n"
+      "end\n"
+      "val inbox = Mailbox new\n"
+      "val cycle = [\"ping\", inbox]\n"
+      "cycle add(cycle)\n"
+      "other send(cycle)\n"
+      "val testResult = inbox receive\n";
+
+  // Receives the list, checks that its cycle survived, and replies.
+  static const char* RECEIVER =
+      "val inbox = Mailbox new\n"
+      "inbox publish(\"mailbox tests receiver\")\n"
+      "val cycle = inbox receive\n"
+      "val testResult = cycle[0] == \"ping\" and cycle[2] == cycle and\n"
+      "    cycle[2][2] == cycle\n"
+      "cycle[1] send(\"pong\")\n";
+
+  struct Program
+  {
+    const char* name;
+    const char* source;
+    char path[1024];
+
+    // Set from the program's "testResult" variable once it has run.
+    bool isTrue;
+    bool isPong;
+  };
+
+  // Writes [program]'s source to a file in the system's temporary directory.
+  // Returns false if it couldn't.
+  static bool writeProgram(Program& program)
+  {
+    const char* dir = getenv("TMPDIR");
+    if (dir == NULL) dir = getenv("TEMP");
+    if (dir == NULL) dir = "/tmp";
+
+    snprintf(program.path, sizeof(program.path), "%s/%s", dir, program.name);
+
+    FILE* file = fopen(program.path, "w");
+    if (file == NULL) return false;
+
+    bool success = fputs(program.source, file) >= 0;
+    return fclose(file) == 0 && success;
+  }
+
+  static void runProgram(void* data)
+  {
+    Program* program = static_cast<Program*>(data);
+
+    // Each VM has its own heap and event loop on its own thread.
+    VM vm;
+    if (!vm.runProgram(String::create(program->path))) return;
+
+    for (int i = 0; i < vm.numModules(); i++)
+    {
+      Module* module = vm.getModule(i);
+      int index = module->findVariable(String::create("testResult"));
+      if (index == -1) continue;
+
+      gc<Object> result = module->getVariable(index);
+      if (result.isNull()) continue;
+
+      program->isTrue = result->equalsBool(true);
+      program->isPong = result->equalsString(String::create("pong"));
+    }
+  }
+
+  void MailboxTests::runTests()
+  {
+    sendBetweenVMs();
+  }
+
+  void MailboxTests::sendBetweenVMs()
+  {
+    Program programs[2] = {
+      { "mailbox_tests_sender.mag", SENDER, "", false, false },
+      { "mailbox_tests_receiver.mag", RECEIVER, "", false, false }
+    };
+
+    // The sender waits forever for the receiver, so don't start either one
+    // unless both can run.
+    bool written = writeProgram(programs[0]) && writeProgram(programs[1]);
+    EXPECT_MSG(written, "Could not write the test programs.");
+
+    if (written)
+    {
+      uv_thread_t threads[2];
+      for (int i = 0; i < 2; i++)
+      {
+        uv_thread_create(&threads[i], runProgram, &programs[i]);
+      }
+
+      for (int i = 0; i < 2; i++) uv_thread_join(&threads[i]);
+
+      EXPECT(programs[0].isPong);
+      EXPECT(programs[1].isTrue);
+    }
+
+    for (int i = 0; i < 2; i++) remove(programs[i].path);
+  }
+}
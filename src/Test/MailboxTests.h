@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class MailboxTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void sendBetweenVMs();
+  };
+}
@@ -18,6 +18,29 @@ namespace magpie
     gc<Cons> next;
   };
   
+  // Counts how many instances have been finalized.
+  struct Finalized : public Managed
+  {
+    Finalized(int* count) : count(count) {}
+
+    virtual void finalize()
+    {
+      (*count)++;
+    }
+
+    int* count;
+  };
+
+  struct FinalizedRoots : public RootSource
+  {
+    virtual void reachRoots()
+    {
+      root.reach();
+    }
+
+    gc<Finalized> root;
+  };
+
   struct ConsRoots : public RootSource
   {
     virtual void reachRoots()
@@ -31,16 +54,18 @@ namespace magpie
   void MemoryTests::runTests()
   {
     collect();
+    separateHeaps();
+    finalize();
   }
 
   void MemoryTests::collect()
   {
-    Memory::shutDown();
-    
     ConsRoots roots;
-    Memory::initialize(&roots, sizeof(Cons) * 400);
+    Memory heap;
+    heap.initialize(&roots, sizeof(Cons) * 400);
+    Memory* previous = Memory::setCurrent(&heap);
 
-    EXPECT_EQUAL(0, Memory::numCollections());
+    EXPECT_EQUAL(0, heap.numCollections());
 
     gc<Cons> notRoot;
     
@@ -50,7 +75,7 @@ namespace magpie
     int id = 0;
     for (int i = 0; i <= 600; i++)
     {
-      Memory::checkCollect();
+      heap.checkCollect();
       
       a->set(new Cons(id));
       a = &((*a)->next);
@@ -70,7 +95,77 @@ namespace magpie
     }
 
     // Make sure it actually did a collection.
-    EXPECT(Memory::numCollections() > 0);
+    EXPECT(heap.numCollections() > 0);
+
+    Memory::setCurrent(previous);
+    heap.shutDown();
   }
-}
 
+  void MemoryTests::separateHeaps()
+  {
+    ConsRoots rootsA;
+    Memory heapA;
+    heapA.initialize(&rootsA, sizeof(Cons) * 400);
+
+    ConsRoots rootsB;
+    Memory heapB;
+    heapB.initialize(&rootsB, sizeof(Cons) * 400);
+
+    Memory* previous = Memory::setCurrent(&heapA);
+    EXPECT(&Memory::current() == &heapA);
+
+    // Fill up heap A, collecting as we go.
+    for (int i = 0; i < 600; i++)
+    {
+      heapA.checkCollect();
+      rootsA.root = new Cons(i);
+    }
+
+    // Allocating in heap B shouldn't touch heap A.
+    Memory::setCurrent(&heapB);
+    EXPECT(&Memory::current() == &heapB);
+    rootsB.root = new Cons(123);
+    heapB.checkCollect();
+
+    EXPECT(heapA.numCollections() > 0);
+    EXPECT_EQUAL(0, heapB.numCollections());
+    EXPECT_EQUAL(599, rootsA.root->id);
+    EXPECT_EQUAL(123, rootsB.root->id);
+
+    Memory::setCurrent(previous);
+    heapA.shutDown();
+    heapB.shutDown();
+  }
+
+  void MemoryTests::finalize()
+  {
+    FinalizedRoots roots;
+    Memory heap;
+    heap.initialize(&roots, sizeof(Cons) * 400);
+    Memory* previous = Memory::setCurrent(&heap);
+
+    int numFinalized = 0;
+
+    // One finalizable object stays rooted, and the other is dropped.
+    roots.root = new Finalized(&numFinalized);
+    heap.addFinalizer(&(*roots.root));
+    heap.addFinalizer(new Finalized(&numFinalized));
+
+    // Churn until we've collected a few times.
+    while (heap.numCollections() < 3)
+    {
+      heap.checkCollect();
+      new Cons(1);
+    }
+
+    // Only the unreachable one has been finalized, and the live one has been
+    // tracked as it moved.
+    EXPECT_EQUAL(1, numFinalized);
+    EXPECT(roots.root->count == &numFinalized);
+
+    // Anything left is finalized when the heap goes away.
+    Memory::setCurrent(previous);
+    heap.shutDown();
+    EXPECT_EQUAL(2, numFinalized);
+  }
+}
@@ -11,6 +11,8 @@ namespace magpie
 
   private:
     void collect();
+    void separateHeaps();
+    void finalize();
   };
 }
 
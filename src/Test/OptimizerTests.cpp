@@ -0,0 +1,110 @@
+#include "OptimizerTests.h"
+#include "Method.h"
+#include "Optimizer.h"
+
+namespace magpie
+{
+  void OptimizerTests::runTests()
+  {
+    coalesceMoves();
+    propagateCopies();
+    keepLiveSlots();
+    fixJumps();
+    skipCatch();
+  }
+
+  void OptimizerTests::coalesceMoves()
+  {
+    gc<Chunk> chunk = new Chunk();
+    chunk->write(0, 1, MAKE_ABC(0, 2, 0xff, OP_CONSTANT));
+    chunk->write(0, 2, MAKE_ABC(2, 3, 0xff, OP_MOVE));
+    chunk->write(0, 3, MAKE_ABC(3, 0xff, 0xff, OP_RETURN));
+
+    Optimizer::optimize(*chunk);
+
+    // The constant is loaded straight into the moved-to slot.
+    EXPECT_EQUAL(2, chunk->count());
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(0, 3, 0xff, OP_CONSTANT)),
+                 chunk->code()[0]);
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(3, 0xff, 0xff, OP_RETURN)),
+                 chunk->code()[1]);
+
+    // Source lines stay with their instructions.
+    EXPECT_EQUAL(1, chunk->codePos(0).line);
+    EXPECT_EQUAL(3, chunk->codePos(1).line);
+  }
+
+  void OptimizerTests::propagateCopies()
+  {
+    gc<Chunk> chunk = new Chunk();
+    chunk->write(0, 1, MAKE_ABC(0, 1, 0xff, OP_MOVE));
+    chunk->write(0, 2, MAKE_ABC(1, 0xff, 0xff, OP_RETURN));
+
+    Optimizer::optimize(*chunk);
+
+    // Returns the original slot, so the move is no longer needed.
+    EXPECT_EQUAL(1, chunk->count());
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(0, 0xff, 0xff, OP_RETURN)),
+                 chunk->code()[0]);
+  }
+
+  void OptimizerTests::keepLiveSlots()
+  {
+    gc<Chunk> chunk = new Chunk();
+    chunk->write(0, 1, MAKE_ABC(0, 1, 0xff, OP_CONSTANT));
+    chunk->write(0, 1, MAKE_ABC(1, 2, 0xff, OP_MOVE));
+    chunk->write(0, 1, MAKE_ABC(2, 1, 3, OP_EQUAL));
+    chunk->write(0, 1, MAKE_ABC(3, 0xff, 0xff, OP_RETURN));
+
+    Optimizer::optimize(*chunk);
+
+    // Both slots are read afterwards, but the second read can use the
+    // original slot.
+    EXPECT_EQUAL(3, chunk->count());
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(0, 1, 0xff, OP_CONSTANT)),
+                 chunk->code()[0]);
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(1, 1, 3, OP_EQUAL)),
+                 chunk->code()[1]);
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(3, 0xff, 0xff, OP_RETURN)),
+                 chunk->code()[2]);
+  }
+
+  void OptimizerTests::fixJumps()
+  {
+    gc<Chunk> chunk = new Chunk();
+    chunk->write(0, 1, MAKE_ABC(0, 1, 0xff, OP_CONSTANT));
+    chunk->write(0, 1, MAKE_ABC(1, 2, 0xff, OP_MOVE));
+    chunk->write(0, 1, MAKE_ABC(2, 1, 0xff, OP_JUMP_IF_FALSE));
+    chunk->write(0, 1, MAKE_ABC(1, 2, 0xff, OP_BUILT_IN));
+    chunk->write(0, 1, MAKE_ABC(2, 0xff, 0xff, OP_RETURN));
+
+    Optimizer::optimize(*chunk);
+
+    EXPECT_EQUAL(4, chunk->count());
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(0, 2, 0xff, OP_CONSTANT)),
+                 chunk->code()[0]);
+    EXPECT_EQUAL(
+        static_cast<instruction>(MAKE_ABC(2, 1, 0xff, OP_JUMP_IF_FALSE)),
+        chunk->code()[1]);
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(1, 2, 0xff, OP_BUILT_IN)),
+                 chunk->code()[2]);
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(2, 0xff, 0xff, OP_RETURN)),
+                 chunk->code()[3]);
+  }
+
+  void OptimizerTests::skipCatch()
+  {
+    gc<Chunk> chunk = new Chunk();
+    chunk->write(0, 1, MAKE_ABC(2, 0xff, 0xff, OP_ENTER_TRY));
+    chunk->write(0, 1, MAKE_ABC(0, 1, 0xff, OP_MOVE));
+    chunk->write(0, 1, MAKE_ABC(0xff, 0xff, 0xff, OP_EXIT_TRY));
+    chunk->write(0, 1, MAKE_ABC(1, 0xff, 0xff, OP_RETURN));
+
+    Optimizer::optimize(*chunk);
+
+    // A thrown error jumps to the catch handler, so the chunk isn't touched.
+    EXPECT_EQUAL(4, chunk->count());
+    EXPECT_EQUAL(static_cast<instruction>(MAKE_ABC(0, 1, 0xff, OP_MOVE)),
+                 chunk->code()[1]);
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class OptimizerTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void coalesceMoves();
+    void propagateCopies();
+    void keepLiveSlots();
+    void fixJumps();
+    void skipCatch();
+  };
+}
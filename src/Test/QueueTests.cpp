@@ -1,3 +1,6 @@
+#include "uv.h"
+
+#include "MpscQueue.h"
 #include "QueueTests.h"
 #include "Queue.h"
 
@@ -10,6 +13,8 @@ namespace magpie
     multipleEnqueue();
     count();
     subscript();
+    mpscEnqueueDequeue();
+    mpscMultipleProducers();
   }
   
   void QueueTests::enqueueDequeue()
@@ -112,5 +117,89 @@ namespace magpie
     EXPECT_EQUAL(7, queue[1]);
     EXPECT_EQUAL(8, queue[2]);
   }
-}
 
+  void QueueTests::mpscEnqueueDequeue()
+  {
+    MpscQueue<int> queue;
+    int result;
+
+    EXPECT(queue.isEmpty());
+    EXPECT_FALSE(queue.dequeue(result));
+
+    queue.enqueue(1);
+    queue.enqueue(2);
+    EXPECT(!queue.isEmpty());
+
+    EXPECT(queue.dequeue(result));
+    EXPECT_EQUAL(1, result);
+
+    queue.enqueue(3);
+
+    EXPECT(queue.dequeue(result));
+    EXPECT_EQUAL(2, result);
+    EXPECT(queue.dequeue(result));
+    EXPECT_EQUAL(3, result);
+
+    EXPECT(queue.isEmpty());
+    EXPECT_FALSE(queue.dequeue(result));
+
+    // Works again after being drained.
+    queue.enqueue(4);
+    EXPECT(queue.dequeue(result));
+    EXPECT_EQUAL(4, result);
+    EXPECT_FALSE(queue.dequeue(result));
+  }
+
+  static const int NUM_PRODUCERS = 4;
+  static const int ITEMS_PER_PRODUCER = 10000;
+
+  struct Producer
+  {
+    MpscQueue<int>* queue;
+    int id;
+  };
+
+  static void produce(void* data)
+  {
+    Producer* producer = static_cast<Producer*>(data);
+    for (int i = 0; i < ITEMS_PER_PRODUCER; i++)
+    {
+      producer->queue->enqueue(producer->id * ITEMS_PER_PRODUCER + i);
+    }
+  }
+
+  void QueueTests::mpscMultipleProducers()
+  {
+    MpscQueue<int> queue;
+    Producer producers[NUM_PRODUCERS];
+    uv_thread_t threads[NUM_PRODUCERS];
+
+    for (int i = 0; i < NUM_PRODUCERS; i++)
+    {
+      producers[i].queue = &queue;
+      producers[i].id = i;
+      uv_thread_create(&threads[i], produce, &producers[i]);
+    }
+
+    // Consume concurrently with the producers. Each producer's items must
+    // come out in the order it sent them.
+    int next[NUM_PRODUCERS] = { 0 };
+    int received = 0;
+    bool inOrder = true;
+    while (received < NUM_PRODUCERS * ITEMS_PER_PRODUCER)
+    {
+      int item;
+      if (!queue.dequeue(item)) continue;
+
+      int producer = item / ITEMS_PER_PRODUCER;
+      if (item % ITEMS_PER_PRODUCER != next[producer]) inOrder = false;
+      next[producer]++;
+      received++;
+    }
+
+    for (int i = 0; i < NUM_PRODUCERS; i++) uv_thread_join(&threads[i]);
+
+    EXPECT(inOrder);
+    EXPECT(queue.isEmpty());
+  }
+}
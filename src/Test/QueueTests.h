@@ -15,6 +15,8 @@ namespace magpie
     void multipleEnqueue();
     void count();
     void subscript();
+    void mpscEnqueueDequeue();
+    void mpscMultipleProducers();
   };
 }
 
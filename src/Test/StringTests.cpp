@@ -12,6 +12,7 @@ namespace magpie
     subscript();
     equals();
     substring();
+    hash();
   }
 
   void StringTests::create()
@@ -98,5 +99,19 @@ namespace magpie
     sub = s->substring(4, 6);
     EXPECT_EQUAL("ef", *sub);
   }
-}
 
+  void StringTests::hash()
+  {
+    gc<String> s = String::create("abc");
+
+    // Every way of creating the same characters gives the same hash.
+    EXPECT_EQUAL(s->hash(), String::create("xabcx")->substring(1, 4)->hash());
+    EXPECT_EQUAL(s->hash(), String::concat(String::create("a"),
+                                           String::create("bc"))->hash());
+    EXPECT_EQUAL(s->hash(), String::format("a%sc", "b")->hash());
+    EXPECT_EQUAL(s->hash(), String::create("xbc")->replace('x', 'a')->hash());
+    EXPECT_EQUAL(s->hash(), String::hash("abc", 3));
+
+    EXPECT(s->hash() != String::create("abd")->hash());
+  }
+}
@@ -15,6 +15,7 @@ namespace magpie
     void subscript();
     void equals();
     void substring();
+    void hash();
   };
 }
 
@@ -0,0 +1,74 @@
+#include "TaskPool.h"
+#include "TaskPoolTests.h"
+
+namespace magpie
+{
+  void TaskPoolTests::runTests()
+  {
+    reuse();
+    sizes();
+    trim();
+  }
+
+  void TaskPoolTests::reuse()
+  {
+    TaskPool::trim();
+
+    void* a = TaskPool::allocate(100);
+    TaskPool::free(a, 100);
+    EXPECT_EQUAL(1, TaskPool::numFree());
+
+    // Should get the same block back, even for a slightly different size in
+    // the same class.
+    void* b = TaskPool::allocate(120);
+    EXPECT(a == b);
+    EXPECT_EQUAL(0, TaskPool::numFree());
+
+    TaskPool::free(b, 120);
+    TaskPool::trim();
+  }
+
+  void TaskPoolTests::sizes()
+  {
+    TaskPool::trim();
+
+    void* small = TaskPool::allocate(32);
+    void* medium = TaskPool::allocate(500);
+    TaskPool::free(small, 32);
+    TaskPool::free(medium, 500);
+    EXPECT_EQUAL(2, TaskPool::numFree());
+
+    // Blocks aren't shared across size classes.
+    void* other = TaskPool::allocate(300);
+    EXPECT(other != small);
+    EXPECT(other != medium);
+    TaskPool::free(other, 300);
+
+    EXPECT(TaskPool::allocate(500) == medium);
+    TaskPool::free(medium, 500);
+
+    // Huge blocks go straight back to the system.
+    void* huge = TaskPool::allocate(4096);
+    TaskPool::free(huge, 4096);
+    EXPECT_EQUAL(3, TaskPool::numFree());
+
+    TaskPool::trim();
+  }
+
+  void TaskPoolTests::trim()
+  {
+    static const int NUM_BLOCKS = 100;
+
+    TaskPool::trim();
+
+    void* blocks[NUM_BLOCKS];
+    for (int i = 0; i < NUM_BLOCKS; i++) blocks[i] = TaskPool::allocate(64);
+    for (int i = 0; i < NUM_BLOCKS; i++) TaskPool::free(blocks[i], 64);
+
+    // The pool doesn't hang onto an unbounded number of blocks.
+    EXPECT(TaskPool::numFree() < NUM_BLOCKS);
+
+    TaskPool::trim();
+    EXPECT_EQUAL(0, TaskPool::numFree());
+  }
+}
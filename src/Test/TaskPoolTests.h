@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class TaskPoolTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void reuse();
+    void sizes();
+    void trim();
+  };
+}
@@ -36,11 +36,14 @@ namespace magpie
   {
     // Set up a heap for this suite.
     TestRoot root;
-    Memory::initialize(&root, 1024 * 1024 * 10);
+    Memory heap;
+    heap.initialize(&root, 1024 * 1024 * 10);
+    Memory* previous = Memory::setCurrent(&heap);
     
     runTests();
     
-    Memory::shutDown();
+    Memory::setCurrent(previous);
+    heap.shutDown();
   }
 }
 
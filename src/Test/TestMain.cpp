@@ -1,22 +1,36 @@
 #include <iostream>
 
 #include "ArrayTests.h"
+#include "AstCacheTests.h"
+#include "HashIndexTests.h"
 #include "LexerTests.h"
+#include "MailboxTests.h"
 #include "MemoryTests.h"
+#include "OptimizerTests.h"
 #include "QueueTests.h"
 #include "StringTests.h"
+#include "TaskPoolTests.h"
+#include "TimerWheelTests.h"
 #include "TokenTests.h"
+#include "Utf8Tests.h"
 
 int main (int argc, char * const argv[])
 {
   using namespace magpie;
 
   ArrayTests().run();
+  AstCacheTests().run();
+  HashIndexTests().run();
   LexerTests().run();
+  MailboxTests().run();
   MemoryTests().run();
+  OptimizerTests().run();
   QueueTests().run();
   StringTests().run();
+  TaskPoolTests().run();
+  TimerWheelTests().run();
   TokenTests().run();
+  Utf8Tests().run();
 
   Test::showResults();
   return 0;
@@ -0,0 +1,176 @@
+#include "uv.h"
+
+#include "TimerWheel.h"
+#include "TimerWheelTests.h"
+
+namespace magpie
+{
+  // Records the order that timers fire in.
+  class TestTimer : public Timer
+  {
+  public:
+    TestTimer()
+    : Timer(),
+      id(-1),
+      delay(0),
+      firedAt(0),
+      log(NULL),
+      logCount(NULL)
+    {}
+
+    virtual void fire()
+    {
+      firedAt = uv_now(loop);
+      log[(*logCount)++] = id;
+    }
+
+    int id;
+    int delay;
+    uv_loop_t* loop;
+    uint64_t firedAt;
+    int* log;
+    int* logCount;
+  };
+
+  // A timer that schedules another timer when it fires.
+  class ChainTimer : public Timer
+  {
+  public:
+    ChainTimer(TimerWheel& wheel, Timer& next)
+    : Timer(),
+      wheel_(wheel),
+      next_(next)
+    {}
+
+    virtual void fire()
+    {
+      wheel_.add(&next_, 5);
+    }
+
+  private:
+    TimerWheel& wheel_;
+    Timer& next_;
+  };
+
+  void TimerWheelTests::runTests()
+  {
+    fireInOrder();
+    remove();
+    addFromCallback();
+  }
+
+  void TimerWheelTests::fireInOrder()
+  {
+    static const int NUM_TIMERS = 200;
+
+    uv_loop_t* loop = uv_loop_new();
+    TimerWheel wheel;
+    wheel.start(loop);
+
+    TestTimer timers[NUM_TIMERS];
+    int log[NUM_TIMERS];
+    int logCount = 0;
+
+    // Scatter the delays so that they land in both of the lower levels and
+    // have some duplicates.
+    uint64_t start = uv_now(loop);
+    unsigned int seed = 12345;
+    for (int i = 0; i < NUM_TIMERS; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      timers[i].id = i;
+      timers[i].delay = (seed >> 16) % 300;
+      timers[i].loop = loop;
+      timers[i].log = log;
+      timers[i].logCount = &logCount;
+      wheel.add(&timers[i], timers[i].delay);
+    }
+
+    EXPECT_EQUAL(NUM_TIMERS, wheel.count());
+
+    uv_run(loop);
+
+    EXPECT_EQUAL(NUM_TIMERS, logCount);
+    EXPECT_EQUAL(0, wheel.count());
+
+    bool inOrder = true;
+    bool onTime = true;
+    for (int i = 0; i < logCount; i++)
+    {
+      TestTimer& timer = timers[log[i]];
+      if (timer.firedAt < start + timer.delay) onTime = false;
+
+      if (i > 0)
+      {
+        TestTimer& previous = timers[log[i - 1]];
+        if (previous.delay > timer.delay) inOrder = false;
+        if (previous.delay == timer.delay && previous.id > timer.id)
+        {
+          inOrder = false;
+        }
+      }
+    }
+
+    EXPECT(inOrder);
+    EXPECT(onTime);
+
+    uv_loop_delete(loop);
+  }
+
+  void TimerWheelTests::remove()
+  {
+    uv_loop_t* loop = uv_loop_new();
+    TimerWheel wheel;
+    wheel.start(loop);
+
+    TestTimer timers[3];
+    int log[3];
+    int logCount = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+      timers[i].id = i;
+      timers[i].loop = loop;
+      timers[i].log = log;
+      timers[i].logCount = &logCount;
+      wheel.add(&timers[i], 100 * i);
+    }
+
+    wheel.remove(&timers[1]);
+    EXPECT_FALSE(timers[1].isPending());
+    EXPECT_EQUAL(2, wheel.count());
+
+    uv_run(loop);
+
+    EXPECT_EQUAL(2, logCount);
+    EXPECT_EQUAL(0, log[0]);
+    EXPECT_EQUAL(2, log[1]);
+
+    uv_loop_delete(loop);
+  }
+
+  void TimerWheelTests::addFromCallback()
+  {
+    uv_loop_t* loop = uv_loop_new();
+    TimerWheel wheel;
+    wheel.start(loop);
+
+    TestTimer last;
+    int log[1];
+    int logCount = 0;
+    last.id = 7;
+    last.loop = loop;
+    last.log = log;
+    last.logCount = &logCount;
+
+    ChainTimer first(wheel, last);
+    wheel.add(&first, 70);
+
+    uv_run(loop);
+
+    EXPECT_EQUAL(1, logCount);
+    EXPECT_EQUAL(7, log[0]);
+
+    uv_loop_delete(loop);
+  }
+}
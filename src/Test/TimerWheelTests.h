@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class TimerWheelTests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void fireInOrder();
+    void remove();
+    void addFromCallback();
+  };
+}
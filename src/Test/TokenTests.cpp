@@ -13,24 +13,23 @@ namespace magpie
 
   void TokenTests::create()
   {
-    gc<String> text = String::create("foo");
-    gc<SourceFile> source = new SourceFile(String::create("<file>"), text);
-    gc<Token> token = new Token(TOKEN_NAME, text,
-                                new SourcePos(source, -1, -1, -1, -1));
+    Token token(TOKEN_NAME, 2, 5, 1, 3, 1, 6);
 
-    EXPECT_EQUAL(TOKEN_NAME, token->type());
-    EXPECT_EQUAL("foo", *token->text());
+    EXPECT_EQUAL(TOKEN_NAME, token.type());
+    EXPECT_EQUAL(2, token.start());
+    EXPECT_EQUAL(5, token.end());
+    EXPECT_EQUAL(1, token.startLine());
+    EXPECT_EQUAL(3, token.startCol());
+    EXPECT_EQUAL(1, token.endLine());
+    EXPECT_EQUAL(6, token.endCol());
   }
   
   void TokenTests::is()
   {
-    gc<String> text = String::create("foo");
-    gc<SourceFile> source = new SourceFile(String::create("<file>"), text);
-    gc<Token> token = new Token(TOKEN_NAME, text,
-                                new SourcePos(source, -1, -1, -1, -1));
+    Token token(TOKEN_NAME, 0, 3, 1, 1, 1, 4);
     
-    EXPECT(token->is(TOKEN_NAME));
-    EXPECT_FALSE(token->is(TOKEN_FLOAT));
+    EXPECT(token.is(TOKEN_NAME));
+    EXPECT_FALSE(token.is(TOKEN_FLOAT));
   }
 }
 
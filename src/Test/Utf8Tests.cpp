@@ -0,0 +1,98 @@
+#include <cstring>
+
+#include "Utf8.h"
+#include "Utf8Tests.h"
+
+namespace magpie
+{
+  void Utf8Tests::runTests()
+  {
+    countAscii();
+    valid();
+    invalid();
+  }
+
+  // Returns the index of the first invalid byte in [text].
+  static int findInvalid(const char* text)
+  {
+    return Utf8::findInvalid(reinterpret_cast<const unsigned char*>(text),
+                             static_cast<int>(strlen(text)));
+  }
+
+  void Utf8Tests::countAscii()
+  {
+    // Long enough to go through the vector loops and the tails after them.
+    unsigned char bytes[100];
+    memset(bytes, 'a', sizeof(bytes));
+
+    // Put the non-ASCII byte at each position so that every lane of every
+    // path gets checked.
+    for (int i = 0; i <= 100; i++)
+    {
+      if (i < 100) bytes[i] = 0xc3;
+
+      EXPECT_EQUAL(i, Utf8::countAsciiScalar(bytes, 100));
+      if (Utf8::supportsSse2())
+      {
+        EXPECT_EQUAL(i, Utf8::countAsciiSse2(bytes, 100));
+      }
+      if (Utf8::supportsAvx2())
+      {
+        EXPECT_EQUAL(i, Utf8::countAsciiAvx2(bytes, 100));
+      }
+      EXPECT_EQUAL(i, Utf8::countAscii(bytes, 100));
+
+      if (i < 100) bytes[i] = 'a';
+    }
+
+    EXPECT_EQUAL(0, Utf8::countAscii(bytes, 0));
+  }
+
+  void Utf8Tests::valid()
+  {
+    EXPECT_EQUAL(-1, findInvalid(""));
+    EXPECT_EQUAL(-1, findInvalid("plain ascii"));
+
+    // Each sequence length, including the smallest and largest values.
+    EXPECT_EQUAL(-1, findInvalid("\xc2\x80 \xdf\xbf"));
+    EXPECT_EQUAL(-1, findInvalid("\xe0\xa0\x80 \xef\xbf\xbf"));
+    EXPECT_EQUAL(-1, findInvalid("\xf0\x90\x80\x80 \xf4\x8f\xbf\xbf"));
+
+    // Right next to the surrogates.
+    EXPECT_EQUAL(-1, findInvalid("\xed\x9f\xbf \xee\x80\x80"));
+
+    // Mixed in with long runs of ASCII.
+    EXPECT_EQUAL(-1, findInvalid(
+        "a long run of plain ascii text that goes on for a while "
+        "\xe2\x9c\x93 and then some more ascii text after the check mark"));
+  }
+
+  void Utf8Tests::invalid()
+  {
+    // Stray continuation bytes.
+    EXPECT_EQUAL(0, findInvalid("\x80"));
+    EXPECT_EQUAL(3, findInvalid("abc\xbf"));
+
+    // Overlong encodings.
+    EXPECT_EQUAL(0, findInvalid("\xc0\x80"));
+    EXPECT_EQUAL(0, findInvalid("\xc1\xbf"));
+    EXPECT_EQUAL(0, findInvalid("\xe0\x9f\xbf"));
+    EXPECT_EQUAL(0, findInvalid("\xf0\x8f\xbf\xbf"));
+
+    // Surrogates.
+    EXPECT_EQUAL(1, findInvalid("a\xed\xa0\x80"));
+
+    // Past U+10FFFF.
+    EXPECT_EQUAL(0, findInvalid("\xf4\x90\x80\x80"));
+    EXPECT_EQUAL(0, findInvalid("\xf5\x80\x80\x80"));
+    EXPECT_EQUAL(0, findInvalid("\xff"));
+
+    // Cut off.
+    EXPECT_EQUAL(2, findInvalid("ab\xe2\x9c"));
+    EXPECT_EQUAL(0, findInvalid("\xe2\x9c" "a"));
+
+    // After a long run of ASCII.
+    EXPECT_EQUAL(40, findInvalid(
+        "0123456789012345678901234567890123456789\xc3("));
+  }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+namespace magpie
+{
+  class Utf8Tests : public Test
+  {
+  public:
+    virtual void runTests();
+
+  private:
+    void countAscii();
+    void valid();
+    void invalid();
+  };
+}
@@ -7,18 +7,19 @@
 
 namespace magpie
 {
-  int Fiber::nextId_ = 0;
-
   Fiber::Fiber(VM& vm, Scheduler& scheduler, gc<FunctionObject> function,
                gc<Fiber> successor)
   : vm_(vm),
     scheduler_(scheduler),
     successor_(successor),
     isMain_(false),
-    id_(nextId_++),
+    id_(scheduler.nextFiberId()),
     stack_(),
     callFrames_(),
-    nearestCatch_()
+    nearestCatch_(),
+    sendingValue_(),
+    timeout_(NULL),
+    didTimeOut_(false)
   {
     call(function, 0);
   }
@@ -32,7 +33,7 @@ namespace magpie
   {
     while (true)
     {
-      if (Memory::checkCollect()) return FIBER_DID_GC;
+      if (vm_.heap().checkCollect()) return FIBER_DID_GC;
       
       CallFrame& frame = callFrames_[-1];
       Chunk& chunk = *frame.function->chunk();
@@ -68,9 +69,9 @@ namespace magpie
         case OP_METHOD:
         {
           // Adds a method to a multimethod. A is the index of the multimethod to
-          // specialize. B is the index of the method to add.
+          // specialize. BC is the index of the method to add.
           int multimethod = GET_A(ins);
-          int method = GET_B(ins);
+          int method = GET_BC(ins);
           vm_.defineMethod(multimethod, method);
           break;
         }
@@ -336,7 +337,79 @@ namespace magpie
           }
           break;
         }
-          
+
+        case OP_JUMP_IF_SPECIALIZED:
+        {
+          gc<Multimethod> multimethod = vm_.getMultimethod(GET_A(ins));
+          if (multimethod->isSpecialized())
+          {
+            int offset = GET_B(ins);
+            frame.ip += offset;
+          }
+          break;
+        }
+
+        case OP_RANGE_ITERATE:
+        {
+          gc<Object> value = load(frame, GET_A(ins));
+
+          // Only a Range from core is known to iterate over its Ints in
+          // order. Anything else, including a Range-like object returned by
+          // a user's own "..", goes through "iterate".
+          bool isRange = !vm_.rangeClass().isNull() &&
+              value->getClass(vm_).sameAs(vm_.rangeClass());
+
+          if (isRange)
+          {
+            gc<DynamicObject> range = asDynamic(value);
+            gc<Object> first = range->getField(0);
+            gc<Object> last = range->getField(1);
+            isRange = first->getClass(vm_).sameAs(vm_.intClass()) &&
+                      last->getClass(vm_).sameAs(vm_.intClass());
+
+            if (isRange)
+            {
+              // Start one before the first value like RangeIterator does.
+              int lastValue = asInt(last);
+              if (!range->getField(2)->toBool()) lastValue--;
+
+              store(frame, GET_A(ins), new IntObject(asInt(first) - 1));
+              store(frame, GET_B(ins), new IntObject(lastValue));
+
+              // Skip the call to "iterate".
+              frame.ip++;
+            }
+          }
+
+          if (!isRange) store(frame, GET_B(ins), vm_.nothing());
+          break;
+        }
+
+        case OP_RANGE_ADVANCE:
+        {
+          gc<Object> last = load(frame, GET_B(ins));
+
+          // If the loop didn't start with OP_RANGE_ITERATE, slot A holds an
+          // iterator, so let the next instruction call "advance" on it.
+          if (!last->getClass(vm_).sameAs(vm_.intClass())) break;
+
+          int current = asInt(load(frame, GET_A(ins)));
+          if (current + 1 > asInt(last))
+          {
+            store(frame, GET_C(ins), vm_.getBuiltIn(BUILT_IN_DONE));
+          }
+          else
+          {
+            gc<Object> next = new IntObject(current + 1);
+            store(frame, GET_A(ins), next);
+            store(frame, GET_C(ins), next);
+          }
+
+          // Skip the call to "advance".
+          frame.ip++;
+          break;
+        }
+
         case OP_CALL:
         {
           gc<Multimethod> multimethod = vm_.getMultimethod(GET_A(ins));
@@ -347,6 +420,29 @@ namespace magpie
           call(function, stackStart);
           break;
         }
+
+        case OP_METHOD_BODY:
+        {
+          gc<Method> method = vm_.getMethod(GET_BC(ins));
+          gc<FunctionObject> body = method->getBody(vm_);
+
+          if (body->chunk()->numUpvars() > 0)
+          {
+            // Closures need their own upvars for each call. Take over any
+            // that binding the parameters created.
+            body = FunctionObject::create(body->chunk());
+            for (int i = 0; i < body->chunk()->numUpvars(); i++)
+            {
+              body->setUpvar(i, frame.function->getUpvar(i));
+            }
+          }
+
+          // Run the body in this call frame so that it sees the parameters.
+          stack_.grow(frame.stackStart + body->chunk()->numSlots());
+          frame.function = body;
+          frame.ip = 0;
+          break;
+        }
           
         case OP_NATIVE:
         {
@@ -459,6 +555,13 @@ namespace magpie
 
   void Fiber::ready()
   {
+    // It didn't time out, so don't let the timeout wake it later.
+    if (timeout_ != NULL)
+    {
+      timeout_->cancel();
+      timeout_ = NULL;
+    }
+
     scheduler_.add(this);
   }
 
@@ -547,9 +650,12 @@ namespace magpie
         {
           // TODO(bob): Can do better here. Would be nice to show enclosing
           // method/function/async block.
-          std::cerr << "[" << source->path() << " line " << line
-                    << "]" << std::endl;
-          std::cerr << source->getLine(line) << std::endl;
+          Output& err = scheduler_.err();
+          err.write("[");
+          err.write(source->path());
+          err.write(String::format(" line %d]\n", line));
+          err.write(source->getLine(line));
+          err.write("\n");
         }
       }
       return false;
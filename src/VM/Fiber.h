@@ -11,6 +11,7 @@ namespace magpie
   class FunctionObject;
   class Object;
   class Scheduler;
+  class Task;
   class Upvar;
   class VM;
 
@@ -73,8 +74,18 @@ namespace magpie
     void storeReturn(gc<Object> value);
 
     // Mark this fiber as being no longer blocked on a channel and able to run.
+    // Cancels the fiber's timeout if it has one.
     void ready();
 
+    // Sets the task that will wake this fiber if it stays blocked on a channel
+    // for too long. Pass NULL to clear it.
+    void setTimeout(Task* timeout) { timeout_ = timeout; }
+
+    // Whether the last timed receive on a channel ran out of time. This is
+    // kept out of band so that any value, even a TimeoutError, can be sent.
+    bool didTimeOut() const { return didTimeOut_; }
+    void setDidTimeOut(bool didTimeOut) { didTimeOut_ = didTimeOut; }
+
     // Suspend this fiber until another fiber will receive the given value on
     // the channel this one is sending on.
     void waitToSend(gc<Object> value);
@@ -136,8 +147,6 @@ namespace magpie
 
     gc<Upvar> captureUpvar(int slot);
 
-    static int nextId_;
-
     VM& vm_;
     Scheduler& scheduler_;
 
@@ -158,6 +167,13 @@ namespace magpie
     // that value.
     gc<Object> sendingValue_;
 
+    // If this fiber is blocked on a channel with a timeout, this is the task
+    // that will wake it up when the time runs out.
+    Task* timeout_;
+
+    // True if the fiber was woken by [timeout_] running out.
+    bool didTimeOut_;
+
     //    gc<Suspension>      suspension_;
 
     NO_COPY(Fiber);
@@ -0,0 +1,486 @@
+#include <cstring>
+
+#include "Fiber.h"
+#include "Mailbox.h"
+#include "Serializer.h"
+#include "VM.h"
+
+namespace magpie
+{
+  // A name that a mailbox has been published under.
+  struct PublishedMailbox
+  {
+    char* name;
+    Mailbox* mailbox;
+    PublishedMailbox* next;
+  };
+
+  // The process-wide table of published mailboxes. Guarded by [registryLock].
+  static PublishedMailbox* registry = NULL;
+  static uv_mutex_t registryLock;
+  static uv_once_t registryOnce = UV_ONCE_INIT;
+
+  static void initRegistry()
+  {
+    uv_mutex_init(&registryLock);
+  }
+
+  gc<MailboxObject> asMailbox(gc<Object> obj)
+  {
+    return static_cast<MailboxObject*>(&(*obj));
+  }
+
+  Mailbox::Mailbox(Scheduler& owner)
+  : refCount_(1),
+    isOpen_(1),
+    owner_(&owner),
+    async_(new uv_async_t),
+    queue_(),
+    firstReceiver_(NULL),
+    lastReceiver_(NULL)
+  {
+    uv_rwlock_init(&asyncLock_);
+
+    async_->data = this;
+    uv_async_init(owner.loop(), async_, asyncCallback);
+
+    // An idle mailbox shouldn't keep the owner's event loop alive. It only
+    // holds a reference while fibers are waiting on it.
+    uv_unref(reinterpret_cast<uv_handle_t*>(async_));
+  }
+
+  Mailbox::~Mailbox()
+  {
+    Message* message;
+    while (queue_.dequeue(message)) delete message;
+
+    uv_rwlock_destroy(&asyncLock_);
+  }
+
+  void Mailbox::retain()
+  {
+    atomicIncrement(&refCount_);
+  }
+
+  void Mailbox::release()
+  {
+    if (atomicDecrement(&refCount_) == 0) delete this;
+  }
+
+  bool Mailbox::isOpen()
+  {
+    return atomicLoad(&isOpen_) != 0;
+  }
+
+  bool Mailbox::send(Message* message)
+  {
+    if (!isOpen())
+    {
+      delete message;
+      return false;
+    }
+
+    queue_.enqueue(message);
+    notify();
+    return true;
+  }
+
+  void Mailbox::close()
+  {
+    atomicStore(&isOpen_, 0);
+    notify();
+  }
+
+  gc<Object> Mailbox::receive(gc<Fiber> fiber)
+  {
+    ASSERT(isOwnedBy(fiber->scheduler()),
+           "Only the VM that created a mailbox can receive from it.");
+
+    // Don't jump ahead of fibers that are already waiting.
+    if (firstReceiver_ == NULL)
+    {
+      gc<Object> value = take(fiber->vm());
+      if (!value.isNull()) return value;
+
+      if (!isOpen() || async_ == NULL)
+      {
+        return fiber->vm().getBuiltIn(BUILT_IN_DONE);
+      }
+    }
+
+    addReceiver(new ReceiveTask(fiber, this));
+    return NULL;
+  }
+
+  void Mailbox::detach()
+  {
+    close();
+
+    uv_rwlock_wrlock(&asyncLock_);
+    uv_async_t* async = async_;
+    async_ = NULL;
+    uv_rwlock_wrunlock(&asyncLock_);
+
+    if (async != NULL)
+    {
+      // The handle is freed the next time the loop runs. When the VM shuts
+      // down, the scheduler detaches its mailboxes before its last run of
+      // the loop so that this still happens.
+      uv_close(reinterpret_cast<uv_handle_t*>(async), freeHandle);
+    }
+  }
+
+  bool Mailbox::publish(const char* name, Mailbox* mailbox)
+  {
+    uv_once(&registryOnce, initRegistry);
+    uv_mutex_lock(&registryLock);
+
+    for (PublishedMailbox* entry = registry; entry != NULL;
+         entry = entry->next)
+    {
+      if (strcmp(entry->name, name) == 0)
+      {
+        uv_mutex_unlock(&registryLock);
+        return false;
+      }
+    }
+
+    PublishedMailbox* entry = new PublishedMailbox;
+    entry->name = new char[strlen(name) + 1];
+    strcpy(entry->name, name);
+    entry->mailbox = mailbox;
+    entry->next = registry;
+    registry = entry;
+
+    mailbox->retain();
+
+    uv_mutex_unlock(&registryLock);
+    return true;
+  }
+
+  Mailbox* Mailbox::find(const char* name)
+  {
+    uv_once(&registryOnce, initRegistry);
+    uv_mutex_lock(&registryLock);
+
+    Mailbox* mailbox = NULL;
+    for (PublishedMailbox* entry = registry; entry != NULL;
+         entry = entry->next)
+    {
+      if (strcmp(entry->name, name) == 0)
+      {
+        mailbox = entry->mailbox;
+        mailbox->retain();
+        break;
+      }
+    }
+
+    uv_mutex_unlock(&registryLock);
+    return mailbox;
+  }
+
+  void Mailbox::asyncCallback(uv_async_t* handle, int status)
+  {
+    static_cast<Mailbox*>(handle->data)->dispatch();
+  }
+
+  void Mailbox::freeHandle(uv_handle_t* handle)
+  {
+    delete reinterpret_cast<uv_async_t*>(handle);
+  }
+
+  void Mailbox::notify()
+  {
+    uv_rwlock_rdlock(&asyncLock_);
+    if (async_ != NULL) uv_async_send(async_);
+    uv_rwlock_rdunlock(&asyncLock_);
+  }
+
+  void Mailbox::dispatch()
+  {
+    // Completing a task runs fibers, which may receive again, close this
+    // mailbox, or kill the remaining waiters, so re-check everything each
+    // time through.
+    while (firstReceiver_ != NULL)
+    {
+      ReceiveTask* task = firstReceiver_;
+      VM& vm = task->fiber()->vm();
+
+      gc<Object> value = take(vm);
+      if (value.isNull())
+      {
+        // Nothing to hand out until something is sent or it's closed.
+        if (isOpen()) return;
+
+        value = vm.getBuiltIn(BUILT_IN_DONE);
+      }
+
+      removeReceiver(task);
+      task->complete(value);
+    }
+  }
+
+  gc<Object> Mailbox::take(VM& vm)
+  {
+    Message* message;
+    if (!queue_.dequeue(message)) return NULL;
+
+    gc<Object> value = Serializer::deserialize(vm, *message);
+    delete message;
+
+    // If the message named a class this VM doesn't have, there's nothing
+    // meaningful to give the receiver.
+    if (value.isNull()) value = vm.nothing();
+
+    return value;
+  }
+
+  void Mailbox::addReceiver(ReceiveTask* task)
+  {
+    if (firstReceiver_ == NULL)
+    {
+      firstReceiver_ = task;
+
+      // Keep the event loop alive while someone is waiting.
+      if (async_ != NULL) uv_ref(reinterpret_cast<uv_handle_t*>(async_));
+    }
+    else
+    {
+      lastReceiver_->nextReceiver_ = task;
+    }
+
+    lastReceiver_ = task;
+  }
+
+  void Mailbox::removeReceiver(ReceiveTask* task)
+  {
+    ReceiveTask* previous = NULL;
+    ReceiveTask* receiver = firstReceiver_;
+    while (receiver != NULL && receiver != task)
+    {
+      previous = receiver;
+      receiver = receiver->nextReceiver_;
+    }
+
+    if (receiver == NULL) return;
+
+    if (previous == NULL)
+    {
+      firstReceiver_ = task->nextReceiver_;
+    }
+    else
+    {
+      previous->nextReceiver_ = task->nextReceiver_;
+    }
+
+    if (lastReceiver_ == task) lastReceiver_ = previous;
+    task->nextReceiver_ = NULL;
+
+    if (firstReceiver_ == NULL && async_ != NULL)
+    {
+      uv_unref(reinterpret_cast<uv_handle_t*>(async_));
+    }
+  }
+
+  ReceiveTask::ReceiveTask(gc<Fiber> fiber, Mailbox* mailbox)
+  : Task(fiber),
+    mailbox_(mailbox),
+    nextReceiver_(NULL)
+  {}
+
+  void ReceiveTask::kill()
+  {
+    mailbox_->removeReceiver(this);
+  }
+
+  MailboxSet::~MailboxSet()
+  {
+    for (int i = 0; i < capacity_; i++)
+    {
+      Entry* entry = buckets_[i];
+      while (entry != NULL)
+      {
+        Entry* next = entry->next;
+
+        // The heap outlives this, so don't let the objects call back into it
+        // when they are finalized.
+        if (entry->object != NULL) entry->object->set_ = NULL;
+
+        release(entry);
+        entry = next;
+      }
+    }
+
+    delete [] buckets_;
+  }
+
+  gc<Object> MailboxSet::wrap(Mailbox* mailbox)
+  {
+    Entry* entry = find(mailbox);
+    if (entry != NULL && entry->object != NULL) return entry->object;
+
+    if (entry == NULL)
+    {
+      entry = new Entry;
+      entry->mailbox = mailbox;
+      entry->object = NULL;
+      add(entry);
+
+      mailbox->retain();
+    }
+    else
+    {
+      // The mailbox came back after its object was collected.
+      numOrphans_--;
+    }
+
+    gc<MailboxObject> object = new MailboxObject(this, entry);
+    entry->object = &(*object);
+    Memory::current().addFinalizer(&(*object));
+    return object;
+  }
+
+  void MailboxSet::sweep()
+  {
+    if (numOrphans_ == 0) return;
+
+    for (int i = 0; i < capacity_; i++)
+    {
+      Entry** link = &buckets_[i];
+      while (*link != NULL)
+      {
+        Entry* entry = *link;
+        if (entry->object == NULL && entry->mailbox->isUnshared())
+        {
+          *link = entry->next;
+          release(entry);
+          count_--;
+          numOrphans_--;
+        }
+        else
+        {
+          link = &entry->next;
+        }
+      }
+    }
+  }
+
+  void MailboxSet::detachAll()
+  {
+    for (int i = 0; i < capacity_; i++)
+    {
+      for (Entry* entry = buckets_[i]; entry != NULL; entry = entry->next)
+      {
+        if (entry->mailbox->isOwnedBy(scheduler_)) entry->mailbox->detach();
+      }
+    }
+  }
+
+  MailboxSet::Entry* MailboxSet::find(Mailbox* mailbox) const
+  {
+    if (capacity_ == 0) return NULL;
+
+    for (Entry* entry = buckets_[bucket(mailbox)]; entry != NULL;
+         entry = entry->next)
+    {
+      if (entry->mailbox == mailbox) return entry;
+    }
+
+    return NULL;
+  }
+
+  void MailboxSet::add(Entry* entry)
+  {
+    // Keep the chains short.
+    if ((count_ + 1) * 4 > capacity_ * 3) grow();
+
+    int index = bucket(entry->mailbox);
+    entry->next = buckets_[index];
+    buckets_[index] = entry;
+    count_++;
+  }
+
+  void MailboxSet::grow()
+  {
+    int oldCapacity = capacity_;
+    Entry** oldBuckets = buckets_;
+
+    capacity_ = (capacity_ == 0) ? 16 : capacity_ * 2;
+    buckets_ = new Entry*[capacity_];
+    for (int i = 0; i < capacity_; i++) buckets_[i] = NULL;
+
+    for (int i = 0; i < oldCapacity; i++)
+    {
+      Entry* entry = oldBuckets[i];
+      while (entry != NULL)
+      {
+        Entry* next = entry->next;
+        int index = bucket(entry->mailbox);
+        entry->next = buckets_[index];
+        buckets_[index] = entry;
+        entry = next;
+      }
+    }
+
+    delete [] oldBuckets;
+  }
+
+  void MailboxSet::collect(Entry* entry)
+  {
+    entry->object = NULL;
+
+    // Other VMs may still send to a mailbox this one owns, and it may be sent
+    // back here to be received from, so keep it attached until sweep() sees
+    // that they are done with it.
+    if (entry->mailbox->isOwnedBy(scheduler_) &&
+        !entry->mailbox->isUnshared())
+    {
+      numOrphans_++;
+      return;
+    }
+
+    Entry** link = &buckets_[bucket(entry->mailbox)];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    count_--;
+
+    release(entry);
+  }
+
+  void MailboxSet::release(Entry* entry)
+  {
+    if (entry->mailbox->isOwnedBy(scheduler_)) entry->mailbox->detach();
+    entry->mailbox->release();
+    delete entry;
+  }
+
+  int MailboxSet::bucket(Mailbox* mailbox) const
+  {
+    // Mailboxes are allocated with at least 8 byte alignment, so the low bits
+    // are always the same.
+    size_t address = reinterpret_cast<size_t>(mailbox);
+    return static_cast<int>((address >> 3) & (capacity_ - 1));
+  }
+
+  gc<ClassObject> MailboxObject::getClass(VM& vm) const
+  {
+    return vm.mailboxClass();
+  }
+
+  gc<String> MailboxObject::toString() const
+  {
+    return String::create("[mailbox]");
+  }
+
+  void MailboxObject::reach()
+  {
+    // This is only called once the object has been copied, so let the set
+    // know where it went.
+    if (set_ != NULL) entry_->object = this;
+  }
+
+  void MailboxObject::finalize()
+  {
+    if (set_ != NULL) set_->collect(entry_);
+  }
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "uv.h"
+
+#include "Macros.h"
+#include "Managed.h"
+#include "MpscQueue.h"
+#include "Object.h"
+#include "Scheduler.h"
+
+namespace magpie
+{
+  class Mailbox;
+  class MailboxObject;
+  class Message;
+  class ReceiveTask;
+
+  // Unsafe downcasting functions. These must *only* be called after the object
+  // has been verified as being the right type.
+  gc<MailboxObject> asMailbox(gc<Object> obj);
+
+  // A buffered queue of messages that lets separate VMs talk to each other.
+  // Any VM (on any thread) that has a reference to a mailbox can send to it,
+  // but only the VM that created it can receive from it.
+  //
+  // Sending never blocks: the value is serialized into a Message, pushed onto
+  // a lock-free queue, and the receiving VM's event loop is woken up with a
+  // uv_async_t so that it can rebuild the value on its own heap and hand it
+  // to a waiting fiber.
+  //
+  // Mailboxes live on the native heap and are reference counted since they
+  // are shared between VMs that can go away independently.
+  class Mailbox
+  {
+    friend class ReceiveTask;
+
+  public:
+    // Creates a new open mailbox that will be received from on [owner]'s
+    // event loop. The caller owns the initial reference. Must be called on
+    // [owner]'s thread.
+    Mailbox(Scheduler& owner);
+
+    void retain();
+    void release();
+
+    bool isOpen();
+
+    // Returns true if the caller holds the only reference to this. Getting a
+    // new reference requires an existing one, so no other thread can be about
+    // to take one.
+    bool isUnshared() { return atomicLoad(&refCount_) == 1; }
+
+    // Returns true if fibers on [scheduler] may receive from this mailbox.
+    bool isOwnedBy(const Scheduler& scheduler) const
+    {
+      return owner_ == &scheduler;
+    }
+
+    // Queues [message] for the owner and takes ownership of it. Returns false
+    // (and discards the message) if the mailbox has been closed. Can be called
+    // from any thread.
+    bool send(Message* message);
+
+    // Closes the mailbox. Messages already sent are still delivered, after
+    // which receivers get 'done'. Can be called from any thread.
+    void close();
+
+    // Takes the next message and returns it rebuilt on [fiber]'s heap. If
+    // nothing has been sent yet, suspends [fiber] and returns NULL. Must only
+    // be called by the owner.
+    gc<Object> receive(gc<Fiber> fiber);
+
+    // Closes the mailbox and disconnects it from the owner's event loop. After
+    // this, it can no longer be received from. Must only be called by the
+    // owner.
+    void detach();
+
+    // Makes [mailbox] findable by [name] from any VM. Holds a reference to it
+    // for the rest of the process. Returns false if the name is already used.
+    static bool publish(const char* name, Mailbox* mailbox);
+
+    // Looks up the mailbox published with [name]. If found, returns it with a
+    // new reference owned by the caller. Otherwise returns NULL.
+    static Mailbox* find(const char* name);
+
+  private:
+    ~Mailbox();
+
+    static void asyncCallback(uv_async_t* handle, int status);
+    static void freeHandle(uv_handle_t* handle);
+
+    // Wakes up the owner's event loop. Can be called from any thread.
+    void notify();
+
+    // Hands queued messages (or 'done' if closed) to waiting receivers. Runs
+    // on the owner's thread.
+    void dispatch();
+
+    // Pulls the next value off the queue and rebuilds it on [vm]'s heap. If
+    // there isn't one, returns NULL.
+    gc<Object> take(VM& vm);
+
+    void addReceiver(ReceiveTask* task);
+    void removeReceiver(ReceiveTask* task);
+
+    volatile int refCount_;
+    volatile int isOpen_;
+
+    // The scheduler that created this mailbox. Other threads only ever compare
+    // against this, never dereference it.
+    Scheduler* owner_;
+
+    // Used to wake up the owner's event loop. This is NULL once the mailbox
+    // has been detached. Senders hold [asyncLock_] for reading while they use
+    // it so that the owner can't free it out from under them.
+    uv_async_t* async_;
+    uv_rwlock_t asyncLock_;
+
+    MpscQueue<Message*> queue_;
+
+    // The fibers suspended waiting for a message. Only touched by the owner.
+    ReceiveTask* firstReceiver_;
+    ReceiveTask* lastReceiver_;
+
+    NO_COPY(Mailbox);
+  };
+
+  // A fiber waiting to receive from a mailbox.
+  class ReceiveTask : public Task
+  {
+    friend class Mailbox;
+
+  public:
+    ReceiveTask(gc<Fiber> fiber, Mailbox* mailbox);
+
+    virtual void kill();
+
+  private:
+    Mailbox* mailbox_;
+    ReceiveTask* nextReceiver_;
+  };
+
+  // The mailboxes that a single VM has handles to. This ensures that a VM
+  // only ever has one MailboxObject for any given mailbox so that identity
+  // works as expected, and holds a reference to each mailbox while its object
+  // is alive.
+  //
+  // The set doesn't keep the objects alive. When one is collected, its
+  // finalizer releases the mailbox. If this VM owns the mailbox and other
+  // VMs can still send to it, it stays attached until they let go. When the
+  // set is destroyed, it detaches the mailboxes its VM owns.
+  class MailboxSet
+  {
+    friend class MailboxObject;
+
+  public:
+    MailboxSet(Scheduler& scheduler)
+    : scheduler_(scheduler),
+      buckets_(NULL),
+      capacity_(0),
+      count_(0),
+      numOrphans_(0)
+    {}
+
+    ~MailboxSet();
+
+    // Gets the MailboxObject for [mailbox], creating it if needed.
+    gc<Object> wrap(Mailbox* mailbox);
+
+    // Frees the owned mailboxes whose objects have been collected once no
+    // other VM refers to them. Called at the start of each collection.
+    void sweep();
+
+    // Detaches every mailbox this VM owns. Called by the scheduler when the
+    // program ends, while the event loop can still free their handles.
+    void detachAll();
+
+  private:
+    struct Entry
+    {
+      Mailbox* mailbox;
+
+      // The handle for the mailbox, or NULL if it has been collected. This
+      // isn't a gc<> since the set must not keep it alive. The object keeps
+      // it up to date as it moves.
+      MailboxObject* object;
+
+      Entry* next;
+    };
+
+    Entry* find(Mailbox* mailbox) const;
+    void add(Entry* entry);
+    void grow();
+
+    // Called when the object for [entry] has been collected.
+    void collect(Entry* entry);
+
+    // Releases the mailbox for [entry] and deletes it. Does not unlink it.
+    void release(Entry* entry);
+
+    int bucket(Mailbox* mailbox) const;
+
+    Scheduler& scheduler_;
+
+    // A hash table of entries chained through Entry::next. The capacity is
+    // always a power of two.
+    Entry** buckets_;
+    int capacity_;
+    int count_;
+
+    // The number of entries whose object has been collected.
+    int numOrphans_;
+
+    NO_COPY(MailboxSet);
+  };
+
+  // The Magpie-side handle to a Mailbox.
+  class MailboxObject : public Object
+  {
+    friend class MailboxSet;
+
+  public:
+    Mailbox* mailbox() { return mailbox_; }
+
+    virtual gc<ClassObject> getClass(VM& vm) const;
+    virtual gc<String> toString() const;
+
+    virtual void reach();
+    virtual void finalize();
+
+  private:
+    MailboxObject(MailboxSet* set, MailboxSet::Entry* entry)
+    : Object(),
+      mailbox_(entry->mailbox),
+      set_(set),
+      entry_(entry)
+    {}
+
+    // Not owned. The VM's MailboxSet keeps this alive.
+    Mailbox* mailbox_;
+
+    // The set this is in. NULL once the set has been destroyed.
+    MailboxSet* set_;
+    MailboxSet::Entry* entry_;
+  };
+}
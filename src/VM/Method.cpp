@@ -25,6 +25,18 @@ namespace magpie
     code_[pos] = ins;
   }
 
+  void Chunk::rewrite(int pos, int file, int line, instruction ins)
+  {
+    code_[pos] = ins;
+    codePos_[pos] = CodePos(file, line);
+  }
+
+  void Chunk::truncate(int count)
+  {
+    code_.truncate(count);
+    codePos_.truncate(count);
+  }
+
   int Chunk::addFile(gc<SourceFile> file)
   {
     // See if it's already in the list.
@@ -120,7 +132,7 @@ namespace magpie
         break;
         
       case OP_METHOD:
-        cout << "METHOD          " << a << " <- " << b
+        cout << "METHOD          " << a << " <- " << GET_BC(ins)
              << " \"" << vm.getMultimethod(a)->signature() << "\"";
         break;
         
@@ -200,7 +212,23 @@ namespace magpie
       case OP_JUMP_IF_TRUE:
         cout << "JUMP_IF_TRUE    " << a << "? " << b;
         break;
-        
+
+      case OP_JUMP_IF_SPECIALIZED:
+      {
+        gc<Multimethod> method = vm.getMultimethod(a);
+        cout << "JUMP_IF_SPECIAL " << a << "? " << b << " \""
+             << method->signature() << "\"";
+        break;
+      }
+
+      case OP_RANGE_ITERATE:
+        cout << "RANGE_ITERATE   " << a << " to " << b;
+        break;
+
+      case OP_RANGE_ADVANCE:
+        cout << "RANGE_ADVANCE   " << a << " to " << b << " -> " << c;
+        break;
+
       case OP_CALL:
       {
         gc<Multimethod> method = vm.getMultimethod(a);
@@ -209,6 +237,10 @@ namespace magpie
         break;
       }
         
+      case OP_METHOD_BODY:
+        cout << "METHOD_BODY     " << GET_BC(ins);
+        break;
+
       case OP_NATIVE:
         cout << "NATIVE          " << a << "(" << b << ") -> " << c;
         break;
@@ -244,22 +276,41 @@ namespace magpie
     files_.reach();
   }
 
+  gc<FunctionObject> Method::getBody(VM& vm)
+  {
+    if (body_.isNull())
+    {
+      ErrorReporter reporter;
+      gc<Chunk> chunk = Compiler::compileMethod(vm, reporter, *this);
+      body_ = FunctionObject::create(chunk);
+    }
+
+    return body_;
+  }
+
   void Method::reach()
   {
     def_.reach();
+    body_.reach();
   }
 
   Multimethod::Multimethod(gc<String> signature)
   : signature_(signature),
     function_(),
-    methods_()
+    methods_(),
+    pending_(),
+    hasCollision_(false),
+    isSpecialized_(false)
   {}
   
   void Multimethod::addMethod(gc<Method> method)
   {
-    methods_.add(method);
+    pending_.add(method);
+
+    if (*method->module()->name() != "core") isSpecialized_ = true;
     
-    // Clear out the code since it needs to be recompiled.
+    // Clear out the dispatch code since it needs to be recompiled. The bodies
+    // of the existing methods don't change.
     function_ = NULL;
   }
   
@@ -269,8 +320,10 @@ namespace magpie
     // called.
     if (function_.isNull())
     {
-      // Determine their specialization order.
-      sort(vm);
+      // Determine the specialization order of any new methods.
+      for (int i = 0; i < pending_.count(); i++) insert(vm, pending_[i]);
+      pending_.clear();
+
       ErrorReporter reporter;
       
       gc<Chunk> chunk = Compiler::compileMultimethod(vm, reporter, *this);
@@ -285,45 +338,42 @@ namespace magpie
     signature_.reach();
     function_.reach();
     methods_.reach();
+    pending_.reach();
   }
 
-  void Multimethod::sort(VM& vm)
+  void Multimethod::insert(VM& vm, gc<Method> method)
   {
-    Array<gc<Method> > sorted;
-
-    // TODO(bob): This is a really primitive topological sort. We end up
-    // comparing the same set of methods multiple times. Could do lots better.
-    while (sorted.count() < methods_.count())
-    {
-      for (int i = 0; i < methods_.count(); i++)
+    // The existing methods are already in a valid order, so the new one just
+    // has to go after the last method more specialized than it, and before
+    // the first one it's more specialized than. Putting it as late as possible
+    // keeps unrelated methods in the order they were defined.
+    int lastBefore = -1;
+    int firstAfter = methods_.count();
+    for (int i = 0; i < methods_.count(); i++)
+    {
+      switch (compare(vm, method, methods_[i]))
       {
-        if (methods_[i].isNull()) continue;
+        case ORDER_BEFORE:
+          if (firstAfter == methods_.count()) firstAfter = i;
+          break;
 
-        // See if any other method is more specialized than this one.
-        bool covered = false;
-        for (int j = 0; j < methods_.count(); j++)
-        {
-          if (i == j) continue;
-          if (methods_[j].isNull()) continue;
-          
-          MethodOrder order = compare(vm, methods_[i], methods_[j]);
-          if (order == ORDER_AFTER)
-          {
-            covered = true;
-            break;
-          }
-        }
+        case ORDER_AFTER:
+          lastBefore = i;
+          break;
 
-        if (!covered)
-        {
-          sorted.add(methods_[i]);
-          methods_[i] = NULL;
-        }
+        case ORDER_EQUAL:
+          hasCollision_ = true;
+          break;
+
+        case ORDER_NONE:
+          break;
       }
     }
 
-    methods_.clear();
-    methods_.addAll(sorted);
+    // If the patterns don't order transitively, there's no right place, so
+    // just make sure the methods more specialized than this one still win.
+    int index = MAX(firstAfter, lastBefore + 1);
+    methods_.insert(method, index);
   }
 
   MethodOrder Multimethod::compare(VM& vm, gc<Method> a, gc<Method> b)
@@ -372,6 +422,7 @@ namespace magpie
   MethodOrder Multimethod::unifyOrders(const Array<MethodOrder>& orders)
   {
     MethodOrder order = ORDER_NONE;
+    bool unordered = false;
 
     for (int i = 0; i < orders.count(); i++)
     {
@@ -390,7 +441,7 @@ namespace magpie
           break;
 
         case ORDER_NONE:
-          // Do nothing.
+          unordered = true;
           break;
 
         case ORDER_EQUAL:
@@ -399,6 +450,9 @@ namespace magpie
       }
     }
 
+    // Methods are only equivalent if every pair of patterns is.
+    if (order == ORDER_EQUAL && unordered) return ORDER_NONE;
+
     return order;
   }
 
@@ -515,10 +569,7 @@ namespace magpie
     if (value != NULL)
     {
       // Check for collision.
-      gc<Object> a = getValue(node.value());
-      gc<Object> b = getValue(value->value());
-
-      if (a->equals(b))
+      if (equalValues(node.value(), value->value()))
       {
         *result_ = ORDER_EQUAL;
       }
@@ -683,6 +734,40 @@ namespace magpie
     return order;
   }
 
+  bool PatternComparer::equalValues(gc<Expr> a, gc<Expr> b)
+  {
+    // Compare literals of the same type directly so that we don't have to
+    // create objects for them.
+    if (a->asBoolExpr() != NULL && b->asBoolExpr() != NULL)
+    {
+      return a->asBoolExpr()->value() == b->asBoolExpr()->value();
+    }
+
+    if (a->asCharacterExpr() != NULL && b->asCharacterExpr() != NULL)
+    {
+      return a->asCharacterExpr()->value() == b->asCharacterExpr()->value();
+    }
+
+    if (a->asFloatExpr() != NULL && b->asFloatExpr() != NULL)
+    {
+      return a->asFloatExpr()->value() == b->asFloatExpr()->value();
+    }
+
+    if (a->asIntExpr() != NULL && b->asIntExpr() != NULL)
+    {
+      return a->asIntExpr()->value() == b->asIntExpr()->value();
+    }
+
+    if (a->asNothingExpr() != NULL && b->asNothingExpr() != NULL) return true;
+
+    if (a->asStringExpr() != NULL && b->asStringExpr() != NULL)
+    {
+      return *a->asStringExpr()->value() == *b->asStringExpr()->value();
+    }
+
+    return getValue(a)->equals(getValue(b));
+  }
+
   gc<Object> PatternComparer::getValue(gc<Expr> expr)
   {
     // Handle literal values.
@@ -710,6 +795,8 @@ namespace magpie
       return new IntObject(intExpr->value());
     }
 
+    if (expr->asNothingExpr() != NULL) return vm_.nothing();
+
     StringExpr* stringExpr = expr->asStringExpr();
     if (stringExpr != NULL)
     {
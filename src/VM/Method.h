@@ -21,6 +21,11 @@ namespace magpie
   // corresponds to.
   struct CodePos
   {
+    CodePos()
+    : file(-1),
+      line(-1)
+    {}
+
     CodePos(int file, int line)
     : file(file),
       line(line)
@@ -54,6 +59,16 @@ namespace magpie
     void write(int file, int line, instruction ins);
     void rewrite(int pos, instruction ins);
 
+    // Replaces the instruction at [pos] along with the source location it
+    // came from.
+    void rewrite(int pos, int file, int line, instruction ins);
+
+    // Discards all but the first [count] instructions.
+    void truncate(int count);
+
+    // Gets the source location of the instruction at [pos].
+    const CodePos& codePos(int pos) const { return codePos_[pos]; }
+
     // Gets the number of instructions in this chunk.
     int count() const { return code_.count(); }
 
@@ -106,25 +121,38 @@ namespace magpie
 
   // Intermediate representation of a single method in a multimethod. This is
   // produced during module compilation and "halfway" compiles the method to
-  // bytecode. The final compilation to bytecode occurs once all methods for a
-  // multimethod are known. The Expr for the body here should already be
-  // resolved.
+  // bytecode. Its parameter patterns are compiled into the multimethod's
+  // dispatch code once all methods for a multimethod are known. Its body is
+  // compiled separately, the first time the method is called. The Expr for
+  // the body here should already be resolved.
   class Method : public Managed
   {
   public:
     Method(Module* module, gc<DefExpr> def)
     : module_(module),
-      def_(def)
+      def_(def),
+      id_(-1),
+      body_()
     {}
 
     Module* module() { return module_; }
     gc<DefExpr> def() { return def_; }
 
+    // Gets the index of this method in the VM (see VM::addMethod()).
+    methodId id() const { return id_; }
+    void setId(methodId id) { id_ = id; }
+
+    // Gets the compiled body of the method, compiling it the first time it's
+    // called.
+    gc<FunctionObject> getBody(VM& vm);
+
     virtual void reach();
 
   private:
     Module* module_;
     gc<DefExpr> def_;
+    methodId id_;
+    gc<FunctionObject> body_;
   };
 
   // The relative ordering of two methods. When a method comes "before" another,
@@ -151,16 +179,32 @@ namespace magpie
     Multimethod(gc<String> signature);
 
     gc<String> signature() { return signature_; }
+
+    // Gets the code that dispatches calls to the appropriate method. It's
+    // rebuilt when a method is added, but the methods' bodies are not.
     gc<FunctionObject> getFunction(VM& vm);
 
+    // Gets the methods that have been ordered, from most to least
+    // specialized.
     Array<gc<Method> >& methods() { return methods_; }
 
+    // Returns true if two of the methods have equivalent patterns, so calls
+    // can't be dispatched.
+    bool hasCollision() const { return hasCollision_; }
+
+    // Returns true if a module other than core has added a method to this.
+    // The compiler assumes calls to core's operators reach core's natives
+    // only as long as this is false.
+    bool isSpecialized() const { return isSpecialized_; }
+
     void addMethod(gc<Method> method);
 
     virtual void reach();
 
   private:
-    void sort(VM& vm);
+    // Inserts [method] into the order of the existing methods. Compares it
+    // once against each of them.
+    void insert(VM& vm, gc<Method> method);
     MethodOrder compare(VM& vm, gc<Method> a, gc<Method> b);
 
     // Given an array of orders, determines the overall ordering. This is used
@@ -171,6 +215,14 @@ namespace magpie
     gc<String> signature_;
     gc<FunctionObject> function_;
     Array<gc<Method> > methods_;
+
+    // Methods that have been added but not ordered yet. They are inserted
+    // when the dispatch code is next needed, since until then their patterns
+    // may refer to variables that haven't been defined yet.
+    Array<gc<Method> > pending_;
+
+    bool hasCollision_;
+    bool isSpecialized_;
   };
 
   // Compares two patterns to see which takes precedence over the other. The
@@ -219,6 +271,9 @@ namespace magpie
     // them into their inner pattern. May return NULL.
     static gc<Pattern> skipVariables(gc<Pattern> pattern);
     MethodOrder compareRecords(RecordPattern& a, RecordPattern& b);
+
+    // Returns true if value patterns [a] and [b] match the same value.
+    bool equalValues(gc<Expr> a, gc<Expr> b);
     gc<Object> getValue(gc<Expr> expr);
   };
 }
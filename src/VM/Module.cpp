@@ -1,3 +1,9 @@
+#include <cstring>
+
+#include "uv.h"
+
+#include "AstCache.h"
+#include "Atomic.h"
 #include "Compiler.h"
 #include "Environment.h"
 #include "Module.h"
@@ -5,10 +11,176 @@
 #include "Method.h"
 #include "Object.h"
 #include "Parser.h"
+#include "RootSource.h"
 #include "VM.h"
 
 namespace magpie
 {
+  // Each thread parsing modules for Module::parseAll() gets its own heap of
+  // this size. It only has to hold one module's source and AST at a time.
+  static const size_t PARSE_HEAP_SIZE = 1024 * 1024 * 2;
+
+  // Parses [source], or loads its AST from the cache if [useCache] is true
+  // and the cache is still valid. Writes the cache after a clean parse.
+  static gc<ModuleAst> parseSource(ErrorReporter& reporter,
+                                   gc<SourceFile> source, bool useCache)
+  {
+    gc<String> cachePath;
+    if (useCache)
+    {
+      cachePath = AstCache::cachePath(source->path());
+      gc<ModuleAst> ast = AstCache::load(cachePath, source);
+      if (!ast.isNull()) return ast;
+    }
+
+    int errors = reporter.numErrors();
+    Parser parser(source, reporter);
+    gc<ModuleAst> ast = parser.parseModule();
+
+    if (useCache && !ast.isNull() && reporter.numErrors() == errors)
+    {
+      AstCache::save(cachePath, source, ast);
+    }
+
+    return ast;
+  }
+
+  // Parses one module on a worker thread for Module::parseAll(). Objects
+  // can't be shared between heaps, so the worker parses into a heap of its
+  // own and hands back the source text and the serialized AST as plain bytes.
+  // The VM's thread then rebuilds them in the VM's heap.
+  class ParseJob : public RootSource
+  {
+  public:
+    ParseJob()
+    : module_(NULL),
+      path_(NULL),
+      useCache_(false),
+      code_(NULL),
+      codeLength_(0),
+      ast_(NULL),
+      astLength_(0)
+    {}
+
+    ~ParseJob()
+    {
+      delete [] path_;
+      delete [] code_;
+      delete [] ast_;
+    }
+
+    // Sets up the job to parse [module]. This must be called on the VM's
+    // thread since it reads the module's path out of the VM's heap.
+    void setModule(Module* module, bool useCache)
+    {
+      module_ = module;
+      useCache_ = useCache;
+
+      int length = module->path()->length();
+      path_ = new char[length + 1];
+      strcpy(path_, module->path()->cString());
+    }
+
+    Module* module() const { return module_; }
+
+    // Whether the worker parsed the module cleanly.
+    bool succeeded() const { return ast_ != NULL; }
+
+    const char* code() const { return code_; }
+    int codeLength() const { return codeLength_; }
+    const unsigned char* ast() const { return ast_; }
+    int astLength() const { return astLength_; }
+
+    void run();
+
+    virtual void reachRoots()
+    {
+      // Nothing in the worker's heap outlives run().
+    }
+
+  private:
+    Module* module_;
+    char* path_;
+    bool useCache_;
+
+    char* code_;
+    int codeLength_;
+    unsigned char* ast_;
+    int astLength_;
+
+    NO_COPY(ParseJob);
+  };
+
+  void ParseJob::run()
+  {
+    Memory heap;
+    heap.initialize(this, PARSE_HEAP_SIZE);
+    Memory* previous = Memory::setCurrent(&heap);
+
+    gc<String> path = String::create(path_);
+    gc<String> code = readFile(path);
+    if (!code.isNull())
+    {
+      // Errors aren't shown here. If there are any, the VM's thread parses
+      // the module again so that they're reported in a deterministic order.
+      ErrorReporter reporter;
+      reporter.setQuiet();
+
+      gc<SourceFile> source = new SourceFile(path, code);
+      gc<ModuleAst> ast = parseSource(reporter, source, useCache_);
+
+      if (!ast.isNull() && reporter.numErrors() == 0)
+      {
+        AstWriter writer;
+        AstCache::write(writer, source, ast);
+
+        codeLength_ = code->length();
+        code_ = new char[codeLength_];
+        memcpy(code_, code->cString(), codeLength_);
+
+        astLength_ = writer.bytes().count();
+        ast_ = new unsigned char[astLength_];
+        for (int i = 0; i < astLength_; i++) ast_[i] = writer.bytes()[i];
+      }
+    }
+
+    heap.shutDown();
+    Memory::setCurrent(previous);
+  }
+
+  // The jobs for one call to Module::parseAll(). Worker threads pull jobs off
+  // it until they run out.
+  struct ParseQueue
+  {
+    ParseJob* jobs;
+    int numJobs;
+    volatile int next;
+  };
+
+  static void parseWorker(void* data)
+  {
+    ParseQueue* queue = static_cast<ParseQueue*>(data);
+
+    while (true)
+    {
+      int job = atomicIncrement(&queue->next) - 1;
+      if (job >= queue->numJobs) return;
+
+      queue->jobs[job].run();
+    }
+  }
+
+  // Gets the number of threads worth using to parse in parallel.
+  static int numParseThreads()
+  {
+    uv_cpu_info_t* cpus;
+    int numCpus;
+    if (uv_cpu_info(&cpus, &numCpus).code != UV_OK) return 1;
+
+    uv_free_cpu_info(cpus, numCpus);
+    return MAX(numCpus, 1);
+  }
+
   bool Module::parse(ErrorReporter& reporter)
   {
     ASSERT(ast_.isNull(), "Module is already parsed.");
@@ -21,13 +193,69 @@ namespace magpie
     }
 
     source_ = new SourceFile(path_, code);
-
-    Parser parser(source_, reporter);
-    ast_ = parser.parseModule();
+    ast_ = parseSource(reporter, source_, useCache_);
 
     return !ast_.isNull();
   }
 
+  bool Module::parseAll(ErrorReporter& reporter,
+                        const Array<Module*>& modules)
+  {
+    // Not worth spinning up threads for a single module.
+    if (modules.count() == 1) return modules[0]->parse(reporter);
+
+    ParseJob* jobs = new ParseJob[modules.count()];
+    for (int i = 0; i < modules.count(); i++)
+    {
+      jobs[i].setModule(modules[i], modules[i]->useCache_);
+    }
+
+    ParseQueue queue;
+    queue.jobs = jobs;
+    queue.numJobs = modules.count();
+    queue.next = 0;
+
+    // The VM's thread just waits, so it doesn't count as one of the workers.
+    int numThreads = numParseThreads();
+    if (numThreads > modules.count()) numThreads = modules.count();
+
+    uv_thread_t* threads = new uv_thread_t[numThreads];
+    for (int i = 0; i < numThreads; i++)
+    {
+      uv_thread_create(&threads[i], parseWorker, &queue);
+    }
+
+    for (int i = 0; i < numThreads; i++)
+    {
+      uv_thread_join(&threads[i]);
+    }
+
+    delete [] threads;
+
+    // Bring the results into the VM's heap in order.
+    bool success = true;
+    for (int i = 0; i < modules.count(); i++)
+    {
+      Module* module = modules[i];
+      ParseJob& job = jobs[i];
+
+      if (job.succeeded())
+      {
+        gc<String> code = String::create(job.code(), job.codeLength());
+        module->source_ = new SourceFile(module->path_, code);
+        module->ast_ = AstCache::read(job.ast(), job.astLength(),
+                                      module->source_);
+      }
+
+      // If the worker couldn't parse it, do it again here to report the
+      // errors.
+      if (module->ast_.isNull() && !module->parse(reporter)) success = false;
+    }
+
+    delete [] jobs;
+    return success;
+  }
+
   void Module::addImports(VM& vm, ErrorReporter& reporter)
   {
     // Implicitly import core (unless we are core).
@@ -66,15 +294,18 @@ namespace magpie
   
   void Module::addVariable(gc<String> name, gc<Object> value)
   {
+    variableIndex_.add(name->hash(), variableNames_.count());
     variableNames_.add(name);
     variables_.add(value);
   }
   
   int Module::findVariable(gc<String> name)
   {
-    for (int i = 0; i < variableNames_.count(); i++)
+    int slot = -1;
+    int index;
+    while ((index = variableIndex_.find(name->hash(), slot)) != -1)
     {
-      if (variableNames_[i] == name) return i;
+      if (variableNames_[index] == name) return index;
     }
     
     return -1;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Array.h"
+#include "HashIndex.h"
 #include "Macros.h"
 #include "Managed.h"
 
@@ -15,14 +16,16 @@ namespace magpie
   class Module
   {
   public:
-    Module(gc<String> name, gc<String> path)
+    Module(gc<String> name, gc<String> path, bool useCache = false)
     : name_(name),
       path_(path),
+      useCache_(useCache),
       ast_(),
       body_(),
       imports_(),
       variables_(),
-      variableNames_()
+      variableNames_(),
+      variableIndex_()
     {}
 
     // Gets the name of the module.
@@ -34,7 +37,18 @@ namespace magpie
     // Gets the source file for the module.
     gc<SourceFile> source() const { return source_; }
 
+    // Reads and parses the module's source. If the module was created with
+    // [useCache], the AST is loaded from the module's cache file when that's
+    // still valid, and the cache file is written otherwise. See AstCache.
     bool parse(ErrorReporter& reporter);
+
+    // Parses all of [modules], spreading them across a pool of threads. None
+    // of them may have been parsed already. Any errors are reported in the
+    // order of [modules] regardless of which thread found them. Returns false
+    // if any module failed to parse.
+    static bool parseAll(ErrorReporter& reporter,
+                         const Array<Module*>& modules);
+
     void addImports(VM& vm, ErrorReporter& reporter);
     bool compile(VM& vm);
     
@@ -65,6 +79,9 @@ namespace magpie
     // The path to the file the module was loaded from.
     gc<String> path_;
 
+    // Whether the parsed AST should be cached on disk.
+    bool useCache_;
+
     // The source file for this module. This will only be non-null after
     // [parse()] has been called.
     gc<SourceFile> source_;
@@ -83,6 +100,9 @@ namespace magpie
     // The top-level variables defined by this module.
     Array<gc<Object> > variables_;
     Array<gc<String> > variableNames_;
+
+    // Hashes of [variableNames_] so that they can be looked up quickly.
+    HashIndex variableIndex_;
     
     NO_COPY(Module);
   };
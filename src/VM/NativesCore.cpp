@@ -1,70 +1,49 @@
 #include <sstream>
 
+#include "Mailbox.h"
 #include "Object.h"
 #include "NativesCore.h"
+#include "Serializer.h"
 #include "VM.h"
 
 namespace magpie
 {
-  // TODO(bob): Move this to be closer to other Task classes.
-  class PrintTask : public Task
+  // Wakes up a fiber blocked receiving on a channel if nothing is sent to it
+  // in time.
+  class ChannelTimeoutTask : public Task, public Timer
   {
-    friend class TaskList;
-
   public:
-    PrintTask(gc<Fiber> fiber, gc<Object> value, int numBuffers);
-    virtual void kill();
-    virtual void reach();
+    ChannelTimeoutTask(gc<Fiber> fiber, gc<ChannelObject> channel)
+    : Task(fiber),
+      Timer(),
+      channel_(channel)
+    {}
 
-    uv_stream_t* stream()
+    virtual void kill()
     {
-      return reinterpret_cast<uv_stream_t*>(fiber()->scheduler().tty());
+      fiber()->scheduler().timers().remove(this);
     }
 
-    gc<Object> value() { return value_; }
-    
-  private:
-    uv_write_t   request_;
-    uv_stream_t* stream_;
-    uv_buf_t     buffers_[2];
-    gc<Object>   value_;
-  };
-
-  void printCallback(uv_write_t* req, int status)
-  {
-    // TODO(bob): Check status.
-    PrintTask* task = (PrintTask*) req->data;
-    task->complete(task->value());
-  }
-
-  PrintTask::PrintTask(gc<Fiber> fiber, gc<Object> value, int numBuffers)
-  : Task(fiber),
-    value_(value)
-  {
-    request_.data = this;
-
-    buffers_[0].base = const_cast<char*>(asString(value)->cString());
-    buffers_[0].len = asString(value)->length();
+    virtual void fire()
+    {
+      gc<Fiber> waiting = fiber();
+      channel_->cancelReceive(waiting);
+      waiting->setTimeout(NULL);
+      waiting->setDidTimeOut(true);
 
-    buffers_[1].base = const_cast<char*>("\n");
-    buffers_[1].len = 1;
+      complete(NULL);
+    }
 
-    uv_write(&request_,
-             reinterpret_cast<uv_stream_t*>(fiber->scheduler().tty()),
-             buffers_, 2, printCallback);
-  }
+    virtual void reach()
+    {
+      Task::reach();
+      channel_.reach();
+    }
 
-  void PrintTask::kill()
-  {
-    // TODO(bob): Do nothing? What about the request?
-  }
+  private:
+    gc<ChannelObject> channel_;
+  };
 
-  void PrintTask::reach()
-  {
-    Task::reach();
-    value_.reach();
-  }
-  
   NATIVE(bindCore)
   {
     vm.bindCore();
@@ -100,10 +79,20 @@ namespace magpie
   
   NATIVE(printString)
   {
-    new PrintTask(&fiber, args[0], 2);
+    Output& out = fiber.scheduler().out();
+    out.write(asString(args[0]));
+    out.write("\n", 1);
 
-    result = NATIVE_RESULT_SUSPEND;
-    return NULL;
+    // Printing doesn't normally wait for the output to be written, but don't
+    // let a fiber get too far ahead of it.
+    if (out.isBackedUp())
+    {
+      out.wait(new OutputWaitTask(&fiber, out, args[0]));
+      result = NATIVE_RESULT_SUSPEND;
+      return NULL;
+    }
+
+    return args[0];
   }
 
   NATIVE(stringPlusString)
@@ -336,6 +325,34 @@ namespace magpie
     return value;
   }
 
+  NATIVE(channelReceiveTimeout)
+  {
+    fiber.setDidTimeOut(false);
+
+    gc<ChannelObject> channel = asChannel(args[0]);
+    gc<Object> value = channel->receive(vm, &fiber);
+
+    // If we don't have an immediate value, suspend this fiber until one is
+    // sent or we run out of time.
+    if (value.isNull())
+    {
+      ChannelTimeoutTask* task = new ChannelTimeoutTask(&fiber, channel);
+      fiber.setTimeout(task);
+      fiber.scheduler().timers().add(task, asInt(args[1]));
+
+      result = NATIVE_RESULT_SUSPEND;
+    }
+
+    return value;
+  }
+
+  NATIVE(channelDidTimeOut)
+  {
+    bool didTimeOut = fiber.didTimeOut();
+    fiber.setDidTimeOut(false);
+    return vm.getBool(didTimeOut);
+  }
+
   NATIVE(channelSend)
   {
     gc<ChannelObject> channel = asChannel(args[0]);
@@ -348,6 +365,69 @@ namespace magpie
     return NULL;
   }
 
+  NATIVE(mailboxClose)
+  {
+    asMailbox(args[0])->mailbox()->close();
+    return vm.nothing();
+  }
+
+  NATIVE(mailboxFindString)
+  {
+    Mailbox* mailbox = Mailbox::find(asString(args[1])->cString());
+    if (mailbox == NULL) return vm.nothing();
+
+    gc<Object> object = vm.mailboxes().wrap(mailbox);
+    mailbox->release();
+    return object;
+  }
+
+  NATIVE(mailboxIsOpen)
+  {
+    return vm.getBool(asMailbox(args[0])->mailbox()->isOpen());
+  }
+
+  NATIVE(mailboxIsOwner)
+  {
+    Mailbox* mailbox = asMailbox(args[0])->mailbox();
+    return vm.getBool(mailbox->isOwnedBy(fiber.scheduler()));
+  }
+
+  NATIVE(mailboxNew)
+  {
+    Mailbox* mailbox = new Mailbox(fiber.scheduler());
+    gc<Object> object = vm.mailboxes().wrap(mailbox);
+    mailbox->release();
+    return object;
+  }
+
+  NATIVE(mailboxPublishString)
+  {
+    Mailbox* mailbox = asMailbox(args[0])->mailbox();
+    return vm.getBool(Mailbox::publish(asString(args[1])->cString(), mailbox));
+  }
+
+  NATIVE(mailboxReceive)
+  {
+    gc<Object> value = asMailbox(args[0])->mailbox()->receive(&fiber);
+
+    // If nothing has been sent yet, suspend this fiber.
+    if (value.isNull())
+    {
+      result = NATIVE_RESULT_SUSPEND;
+    }
+
+    return value;
+  }
+
+  NATIVE(mailboxSend)
+  {
+    Message* message = Serializer::serialize(vm, args[1]);
+    if (message == NULL) return vm.getBool(false);
+
+    // Unlike a channel, the sender doesn't wait for the value to be received.
+    return vm.getBool(asMailbox(args[0])->mailbox()->send(message));
+  }
+
   NATIVE(functionCall)
   {
     result = NATIVE_RESULT_CALL;
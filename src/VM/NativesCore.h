@@ -53,7 +53,17 @@ namespace magpie
   NATIVE(channelIsOpen);
   NATIVE(channelNew);
   NATIVE(channelReceive);
+  NATIVE(channelReceiveTimeout);
+  NATIVE(channelDidTimeOut);
   NATIVE(channelSend);
+  NATIVE(mailboxClose);
+  NATIVE(mailboxFindString);
+  NATIVE(mailboxIsOpen);
+  NATIVE(mailboxIsOwner);
+  NATIVE(mailboxNew);
+  NATIVE(mailboxPublishString);
+  NATIVE(mailboxReceive);
+  NATIVE(mailboxSend);
   NATIVE(functionCall);
   NATIVE(listAdd);
   NATIVE(listClear);
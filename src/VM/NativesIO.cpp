@@ -1,7 +1,9 @@
+#include <cstring>
 #include <sstream>
 
 #include "ObjectIO.h"
 #include "NativesIO.h"
+#include "Utf8.h"
 #include "VM.h"
 
 namespace magpie
@@ -21,19 +23,101 @@ namespace magpie
     return NULL;
   }
   
+  NATIVE(fileAppend)
+  {
+    FileObject::open(&fiber, asString(args[1]), FILE_MODE_APPEND);
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileCreate)
+  {
+    FileObject::open(&fiber, asString(args[1]), FILE_MODE_WRITE);
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileDelete)
+  {
+    FileObject::remove(&fiber, asString(args[1]));
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileFlush)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    if (!fileObj->flush(&fiber))
+    {
+      result = NATIVE_RESULT_SUSPEND;
+      return NULL;
+    }
+
+    return vm.getBool(!fileObj->hasWriteFailed());
+  }
+
   NATIVE(fileIsOpen)
   {
     gc<FileObject> fileObj = asFile(args[0]);
     return vm.getBool(fileObj->isOpen());
   }
+
+  NATIVE(fileIsWritable)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    return vm.getBool(fileObj->isWritable());
+  }
   
   NATIVE(fileOpen)
   {
-    FileObject::open(&fiber, asString(args[1]));
+    FileObject::open(&fiber, asString(args[1]), FILE_MODE_READ);
     result = NATIVE_RESULT_SUSPEND;
     return NULL;
   }
 
+  NATIVE(fileReadText)
+  {
+    ReadTextTask* task = new ReadTextTask(&fiber, asString(args[1]));
+    task->start();
+
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileSync)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    fileObj->sync(&fiber);
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileWriteBuffer)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    gc<BufferObject> buffer = asBuffer(args[1]);
+    if (!fileObj->write(&fiber, buffer->data(), buffer->count()))
+    {
+      result = NATIVE_RESULT_SUSPEND;
+      return NULL;
+    }
+
+    return vm.getBool(!fileObj->hasWriteFailed());
+  }
+
+  NATIVE(fileWriteString)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    gc<String> text = asString(args[1]);
+    if (!fileObj->write(&fiber, text->cString(), text->length()))
+    {
+      result = NATIVE_RESULT_SUSPEND;
+      return NULL;
+    }
+
+    return vm.getBool(!fileObj->hasWriteFailed());
+  }
+
   NATIVE(fileSize)
   {
     gc<FileObject> fileObj = asFile(args[0]);
@@ -50,13 +134,38 @@ namespace magpie
     return NULL;
   }
 
-  NATIVE(fileStreamBytes)
+  NATIVE(fileReadAt)
   {
-    gc<StreamObject> stream = new StreamObject();
-    // TODO(bob): Hook up to file.
-    return stream;
+    // Note: core validates the arguments before calling this.
+    gc<FileObject> fileObj = asFile(args[0]);
+    fileObj->readAt(&fiber, asInt(args[1]), asInt(args[2]));
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileReadRanges)
+  {
+    // Note: core validates the ranges and makes sure there is at least one.
+    gc<FileObject> fileObj = asFile(args[0]);
+    fileObj->readRanges(&fiber, asList(args[1]), asList(args[2]));
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(fileStreamBytesInt)
+  {
+    gc<FileObject> fileObj = asFile(args[0]);
+    return fileObj->streamBytes(&fiber, asInt(args[1]));
   }
   
+  NATIVE(streamAdvance)
+  {
+    gc<StreamObject> stream = asStream(args[0]);
+    gc<Object> chunk = stream->read(&fiber);
+    if (chunk.isNull()) result = NATIVE_RESULT_SUSPEND;
+    return chunk;
+  }
+
   NATIVE(bufferNewSize)
   {
     return BufferObject::create(asInt(args[1]));
@@ -68,6 +177,73 @@ namespace magpie
     return new IntObject(buffer->count());
   }
 
+  NATIVE(bufferCrc32)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+
+    if (buffer->count() < WorkTask::MIN_OFFLOAD_SIZE)
+    {
+      unsigned int crc = BufferObject::crc32(
+          static_cast<unsigned char*>(buffer->data()), buffer->count());
+      return new IntObject(static_cast<int>(crc));
+    }
+
+    // Large buffers are checksummed on the thread pool so that other fibers
+    // can run in the meantime.
+    Crc32Task* task = new Crc32Task(&fiber, buffer);
+    task->start();
+
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(bufferCompareToBuffer)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    return new IntObject(buffer->compare(asBuffer(args[1])));
+  }
+
+  NATIVE(bufferCopyIntoBuffer)
+  {
+    // Note: bounds checking is handled by core before calling this.
+    gc<BufferObject> source = asBuffer(args[0]);
+    gc<BufferObject> dest = asBuffer(args[1]);
+    int offset = asInt(args[2]);
+
+    // Use memmove() since they may be views of the same buffer.
+    memmove(dest->data() + offset, source->data(), source->count());
+    return vm.nothing();
+  }
+
+  NATIVE(bufferFillInt)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    memset(buffer->data(), asInt(args[1]), buffer->count());
+    return vm.nothing();
+  }
+
+  NATIVE(bufferIndexOfBuffer)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    return new IntObject(buffer->indexOf(asBuffer(args[1]), asInt(args[2])));
+  }
+
+  NATIVE(bufferIndexOfInt)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    unsigned char value = static_cast<unsigned char>(asInt(args[1]));
+    return new IntObject(buffer->indexOf(value, asInt(args[2])));
+  }
+
+  NATIVE(bufferReadInt)
+  {
+    // Note: bounds checking is handled by core before calling this.
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    int value = buffer->readInt(asInt(args[1]), asInt(args[2]),
+                                args[3]->toBool(), args[4]->toBool());
+    return new IntObject(value);
+  }
+
   NATIVE(bufferSubscriptInt)
   {
     // Note: bounds checking is handled by core before calling this.
@@ -75,6 +251,16 @@ namespace magpie
     return new IntObject(buffer->get(asInt(args[1])));
   }
   
+  NATIVE(bufferSubscriptRange)
+  {
+    // Note: bounds checking is handled by core before calling this.
+    gc<BufferObject> buffer = asBuffer(args[0]);
+    int first = asInt(args[1]);
+    int last = asInt(args[2]);
+
+    return BufferObject::createView(buffer, first, last - first);
+  }
+
   NATIVE(bufferSubscriptSetInt)
   {
     // Note: bounds checking is handled by core before calling this.
@@ -92,5 +278,80 @@ namespace magpie
         String::create(reinterpret_cast<char*>(buffer->data()),
                        buffer->count()));
   }
-}
 
+  NATIVE(bufferDecodeUtf8)
+  {
+    gc<BufferObject> buffer = asBuffer(args[0]);
+
+    // If it isn't valid, return where the problem is so core can report it.
+    int invalid = Utf8::findInvalid(buffer->data(), buffer->count());
+    if (invalid != -1) return new IntObject(invalid);
+
+    return new StringObject(
+        String::create(reinterpret_cast<char*>(buffer->data()),
+                       buffer->count()));
+  }
+
+  NATIVE(fileMap)
+  {
+    gc<MappedBufferObject> buffer = MappedBufferObject::create(
+        asString(args[1]));
+    if (buffer.isNull()) return vm.nothing();
+    return buffer;
+  }
+
+  NATIVE(mappedBufferClose)
+  {
+    asMappedBuffer(args[0])->close();
+    return vm.nothing();
+  }
+
+  NATIVE(mappedBufferCount)
+  {
+    return new IntObject(asMappedBuffer(args[0])->count());
+  }
+
+  NATIVE(mappedBufferDecodeAscii)
+  {
+    gc<MappedBufferObject> buffer = asMappedBuffer(args[0]);
+    return new StringObject(
+        String::create(reinterpret_cast<const char*>(buffer->data()),
+                       buffer->count()));
+  }
+
+  NATIVE(mappedBufferDecodeUtf8)
+  {
+    gc<MappedBufferObject> buffer = asMappedBuffer(args[0]);
+
+    int invalid = Utf8::findInvalid(buffer->data(), buffer->count());
+    if (invalid != -1) return new IntObject(invalid);
+
+    return new StringObject(
+        String::create(reinterpret_cast<const char*>(buffer->data()),
+                       buffer->count()));
+  }
+
+  NATIVE(mappedBufferIsOpen)
+  {
+    return vm.getBool(asMappedBuffer(args[0])->isOpen());
+  }
+
+  NATIVE(mappedBufferSubscriptInt)
+  {
+    // Note: bounds checking is handled by core before calling this.
+    gc<MappedBufferObject> buffer = asMappedBuffer(args[0]);
+    return new IntObject(buffer->get(asInt(args[1])));
+  }
+
+  NATIVE(mappedBufferSubscriptRange)
+  {
+    // Note: bounds checking is handled by core before calling this.
+    gc<MappedBufferObject> source = asMappedBuffer(args[0]);
+    int first = asInt(args[1]);
+    int last = asInt(args[2]);
+
+    gc<BufferObject> buffer = BufferObject::create(last - first);
+    memcpy(buffer->data(), source->data() + first, last - first);
+    return buffer;
+  }
+}
@@ -9,16 +9,45 @@
 namespace magpie
 {
   NATIVE(bindIO);
+  NATIVE(fileAppend);
   NATIVE(fileClose);
+  NATIVE(fileCreate);
+  NATIVE(fileDelete);
+  NATIVE(fileFlush);
   NATIVE(fileIsOpen);
+  NATIVE(fileIsWritable);
   NATIVE(fileOpen);
+  NATIVE(fileSync);
+  NATIVE(fileWriteBuffer);
+  NATIVE(fileWriteString);
   NATIVE(fileSize);
+  NATIVE(fileReadAt);
   NATIVE(fileReadBytesInt);
-  NATIVE(fileStreamBytes);
+  NATIVE(fileReadRanges);
+  NATIVE(fileReadText);
+  NATIVE(fileStreamBytesInt);
+  NATIVE(streamAdvance);
   NATIVE(bufferNewSize);
   NATIVE(bufferCount);
+  NATIVE(bufferCompareToBuffer);
+  NATIVE(bufferCopyIntoBuffer);
+  NATIVE(bufferCrc32);
+  NATIVE(bufferFillInt);
+  NATIVE(bufferIndexOfBuffer);
+  NATIVE(bufferIndexOfInt);
+  NATIVE(bufferReadInt);
   NATIVE(bufferSubscriptInt);
+  NATIVE(bufferSubscriptRange);
   NATIVE(bufferSubscriptSetInt);
   NATIVE(bufferDecodeAscii);
+  NATIVE(bufferDecodeUtf8);
+  NATIVE(fileMap);
+  NATIVE(mappedBufferClose);
+  NATIVE(mappedBufferCount);
+  NATIVE(mappedBufferDecodeAscii);
+  NATIVE(mappedBufferDecodeUtf8);
+  NATIVE(mappedBufferIsOpen);
+  NATIVE(mappedBufferSubscriptInt);
+  NATIVE(mappedBufferSubscriptRange);
 }
 
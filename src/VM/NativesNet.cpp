@@ -0,0 +1,108 @@
+#include "ObjectIO.h"
+#include "ObjectNet.h"
+#include "NativesNet.h"
+#include "VM.h"
+
+namespace magpie
+{
+  NATIVE(bindNet)
+  {
+    vm.bindNet();
+    return vm.nothing();
+  }
+
+  NATIVE(socketClose)
+  {
+    asSocket(args[0])->close();
+    return vm.nothing();
+  }
+
+  NATIVE(socketConnect)
+  {
+    // Note: the port is range checked by core before calling this.
+    if (!SocketObject::connect(&fiber, asString(args[1]), asInt(args[2])))
+    {
+      return vm.nothing();
+    }
+
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(socketIsOpen)
+  {
+    return vm.getBool(asSocket(args[0])->isOpen());
+  }
+
+  NATIVE(socketRead)
+  {
+    // Note: core makes sure the socket is open before calling this.
+    gc<SocketObject> socket = asSocket(args[0]);
+    gc<Object> chunk = socket->connection()->read(&fiber);
+    if (chunk.isNull()) result = NATIVE_RESULT_SUSPEND;
+    return chunk;
+  }
+
+  NATIVE(socketWriteBuffer)
+  {
+    // Note: core makes sure the socket is open before calling this.
+    gc<SocketObject> socket = asSocket(args[0]);
+    gc<BufferObject> buffer = asBuffer(args[1]);
+    if (!socket->connection()->write(&fiber, buffer->data(),
+                                     buffer->count()))
+    {
+      return vm.getBool(false);
+    }
+
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(socketWriteString)
+  {
+    gc<SocketObject> socket = asSocket(args[0]);
+    gc<String> text = asString(args[1]);
+    if (!socket->connection()->write(&fiber, text->cString(),
+                                     text->length()))
+    {
+      return vm.getBool(false);
+    }
+
+    result = NATIVE_RESULT_SUSPEND;
+    return NULL;
+  }
+
+  NATIVE(tcpServerAccept)
+  {
+    // Note: core makes sure the server is open before calling this.
+    gc<TcpServerObject> server = asTcpServer(args[0]);
+    gc<Object> socket = server->server()->accept(&fiber);
+    if (socket.isNull()) result = NATIVE_RESULT_SUSPEND;
+    return socket;
+  }
+
+  NATIVE(tcpServerClose)
+  {
+    asTcpServer(args[0])->close();
+    return vm.nothing();
+  }
+
+  NATIVE(tcpServerIsOpen)
+  {
+    return vm.getBool(asTcpServer(args[0])->isOpen());
+  }
+
+  NATIVE(tcpServerListen)
+  {
+    gc<TcpServerObject> server = TcpServerObject::listen(
+        fiber.scheduler().loop(), asString(args[1]), asInt(args[2]));
+    if (server.isNull()) return vm.nothing();
+    return server;
+  }
+
+  NATIVE(tcpServerPort)
+  {
+    gc<TcpServerObject> server = asTcpServer(args[0]);
+    return new IntObject(server->server()->port());
+  }
+}
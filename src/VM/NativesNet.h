@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Fiber.h"
+#include "Macros.h"
+#include "Memory.h"
+
+#define NATIVE(name) gc<Object> name##Native(VM& vm, Fiber& fiber, ArrayView<gc<Object> >& args, NativeResult& result)
+
+namespace magpie
+{
+  NATIVE(bindNet);
+  NATIVE(socketClose);
+  NATIVE(socketConnect);
+  NATIVE(socketIsOpen);
+  NATIVE(socketRead);
+  NATIVE(socketWriteBuffer);
+  NATIVE(socketWriteString);
+  NATIVE(tcpServerAccept);
+  NATIVE(tcpServerClose);
+  NATIVE(tcpServerIsOpen);
+  NATIVE(tcpServerListen);
+  NATIVE(tcpServerPort);
+}
+
@@ -0,0 +1,69 @@
+#include "ObjectProcess.h"
+#include "NativesProcess.h"
+#include "VM.h"
+
+namespace magpie
+{
+  NATIVE(bindProcess)
+  {
+    vm.bindProcess();
+    return vm.nothing();
+  }
+
+  NATIVE(processIsRunning)
+  {
+    return vm.getBool(asProcess(args[0])->process()->isRunning());
+  }
+
+  NATIVE(processKill)
+  {
+    gc<ProcessObject> process = asProcess(args[0]);
+    return vm.getBool(process->process()->kill(asInt(args[1])));
+  }
+
+  NATIVE(processPid)
+  {
+    return new IntObject(asProcess(args[0])->process()->pid());
+  }
+
+  NATIVE(processSpawn)
+  {
+    // Note: core makes sure the arguments and environment only contain
+    // strings. The environment and working directory are nothing if they
+    // aren't given.
+    gc<ListObject> env;
+    if (!args[3].sameAs(vm.nothing())) env = asList(args[3]);
+
+    gc<String> cwd;
+    if (!args[4].sameAs(vm.nothing())) cwd = asString(args[4]);
+
+    gc<ProcessObject> process = ProcessObject::spawn(
+        fiber.scheduler().loop(), asString(args[1]), asList(args[2]), env,
+        cwd);
+    if (process.isNull()) return vm.nothing();
+    return process;
+  }
+
+  NATIVE(processStderr)
+  {
+    return asProcess(args[0])->stderrPipe();
+  }
+
+  NATIVE(processStdin)
+  {
+    return asProcess(args[0])->stdinPipe();
+  }
+
+  NATIVE(processStdout)
+  {
+    return asProcess(args[0])->stdoutPipe();
+  }
+
+  NATIVE(processWait)
+  {
+    gc<ProcessObject> process = asProcess(args[0]);
+    gc<Object> code = process->process()->wait(&fiber);
+    if (code.isNull()) result = NATIVE_RESULT_SUSPEND;
+    return code;
+  }
+}
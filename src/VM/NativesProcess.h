@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Fiber.h"
+#include "Macros.h"
+#include "Memory.h"
+
+#define NATIVE(name) gc<Object> name##Native(VM& vm, Fiber& fiber, ArrayView<gc<Object> >& args, NativeResult& result)
+
+namespace magpie
+{
+  NATIVE(bindProcess);
+  NATIVE(processIsRunning);
+  NATIVE(processKill);
+  NATIVE(processPid);
+  NATIVE(processSpawn);
+  NATIVE(processStderr);
+  NATIVE(processStdin);
+  NATIVE(processStdout);
+  NATIVE(processWait);
+}
+
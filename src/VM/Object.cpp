@@ -136,6 +136,20 @@ namespace magpie
     return;
   }
 
+  bool ChannelObject::cancelReceive(gc<Fiber> receiver)
+  {
+    for (int i = 0; i < receivers_.count(); i++)
+    {
+      if (receivers_[i].sameAs(receiver))
+      {
+        receivers_.removeAt(i);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
   gc<ClassObject> ChannelObject::getClass(VM& vm) const
   {
     return vm.channelClass();
@@ -168,7 +182,7 @@ namespace magpie
       int numSuperclasses, const ArrayView<gc<Object> >& superclasses)
   {
     // Allocate enough memory for the record and its fields.
-    void* mem = Memory::allocate(sizeof(ClassObject) +
+    void* mem = Memory::current().allocate(sizeof(ClassObject) +
         sizeof(gc<ClassObject>) * (numSuperclasses - 1));
 
     // Construct it by calling global placement new.
@@ -221,13 +235,22 @@ namespace magpie
 
   gc<DynamicObject> DynamicObject::create(gc<ClassObject> classObj)
   {
-    ASSERT(classObj->numFields() == 0, "Class cannot have fields.");
-    
-    // Allocate enough memory for the object.
-    void* mem = Memory::allocate(sizeof(DynamicObject));
+    // Allocate enough memory for the object and its fields. The object already
+    // has room for one field.
+    int extraFields = MAX(classObj->numFields() - 1, 0);
+    void* mem = Memory::current().allocate(sizeof(DynamicObject) +
+        sizeof(gc<Object>) * extraFields);
 
     // Construct it by calling global placement new.
-    return ::new(mem) DynamicObject(classObj);
+    gc<DynamicObject> object = ::new(mem) DynamicObject(classObj);
+
+    // Clear the fields so that a GC before they're set doesn't see garbage.
+    for (int i = 0; i < classObj->numFields(); i++)
+    {
+      object->fields_[i] = gc<Object>();
+    }
+
+    return object;
   }
 
   gc<DynamicObject> DynamicObject::create(ArrayView<gc<Object> >& args)
@@ -235,7 +258,7 @@ namespace magpie
     gc<ClassObject> classObj = asClass(args[0]);
     
     // Allocate enough memory for the object and its fields.
-    void* mem = Memory::allocate(sizeof(DynamicObject) +
+    void* mem = Memory::current().allocate(sizeof(DynamicObject) +
         sizeof(gc<Object>) * (classObj->numFields() - 1));
 
     // Construct it by calling global placement new.
@@ -296,7 +319,7 @@ namespace magpie
   gc<FunctionObject> FunctionObject::create(gc<Chunk> chunk)
   {
     // Allocate enough memory for the object and its upvars.
-    void* mem = Memory::allocate(sizeof(FunctionObject) +
+    void* mem = Memory::current().allocate(sizeof(FunctionObject) +
                                  sizeof(gc<Upvar>) * (chunk->numUpvars() - 1));
 
     // Construct it by calling global placement new.
@@ -385,8 +408,8 @@ namespace magpie
   gc<RecordType> RecordType::create(const Array<int>& fields)
   {
     // Allocate enough memory for the record and its fields.
-    void* mem = Memory::allocate(sizeof(RecordType) + 
-                                 sizeof(int) * (fields.count() - 1));
+    void* mem = Memory::current().allocate(sizeof(RecordType) +
+        sizeof(int) * (fields.count() - 1));
     
     // Construct it by calling global placement new.
     return ::new(mem) RecordType(fields);
@@ -425,8 +448,8 @@ namespace magpie
       const Array<gc<Object> >& stack, int startIndex)
   {
     // Allocate enough memory for the record and its fields.
-    void* mem = Memory::allocate(sizeof(RecordObject) + 
-                                 sizeof(gc<Object>) * (type->numFields() - 1));
+    void* mem = Memory::current().allocate(sizeof(RecordObject) +
+        sizeof(gc<Object>) * (type->numFields() - 1));
     
     // Construct it by calling global placement new.
     gc<RecordObject> record = ::new(mem) RecordObject(type);
@@ -51,6 +51,9 @@ namespace magpie
     // Returns the boolean value of the object.
     virtual bool toBool() const { return true; }
 
+    // Returns the object as a DynamicObject if it is one, otherwise `NULL`.
+    virtual DynamicObject* toDynamic() { return NULL; }
+
     // Returns the object as a RecordObject if it is one, otherwise `NULL`.
     virtual RecordObject* toRecord() { return NULL; }
 
@@ -115,6 +118,10 @@ namespace magpie
     // Sends a value along this channel.
     void send(gc<Fiber> sender, gc<Object> value);
 
+    // Stops [receiver] from waiting on this channel. Returns false if it
+    // wasn't waiting.
+    bool cancelReceive(gc<Fiber> receiver);
+
     virtual gc<ClassObject> getClass(VM& vm) const;
 
     virtual gc<String> toString() const;
@@ -191,8 +198,8 @@ namespace magpie
   class DynamicObject : public Object
   {
   public:
-    // Creates a new instance of [classObj]. This should only be used for
-    // built-in classes which do not have any fields.
+    // Creates a new instance of [classObj]. Its fields are all NULL and must
+    // be initialized using [setField()] before the object is used.
     static gc<DynamicObject> create(gc<ClassObject> classObj);
 
     // Creates a new instance of [classObj] using [args] to initialize its
@@ -201,6 +208,7 @@ namespace magpie
 
     virtual gc<ClassObject> getClass(VM& vm) const;
 
+    virtual DynamicObject* toDynamic() { return this; }
     virtual gc<String> toString() const;
 
     gc<ClassObject> classObj() { return class_; }
@@ -363,6 +371,8 @@ namespace magpie
     static gc<Object> create(gc<RecordType> type,
                              const Array<gc<Object> >& stack, int startIndex);
 
+    gc<RecordType> type() const { return type_; }
+
     gc<Object> getField(int symbol);
 
     virtual gc<ClassObject> getClass(VM& vm) const;
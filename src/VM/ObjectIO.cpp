@@ -1,8 +1,12 @@
+#include <cstdio>
+#include <cstring>
 #include <sstream>
 #include <fcntl.h>
 
 #include "Array.h"
+#include "Environment.h"
 #include "ObjectIO.h"
+#include "Utf8.h"
 #include "VM.h"
 
 namespace magpie
@@ -19,6 +23,11 @@ namespace magpie
     return static_cast<FileObject*>(&(*obj));
   }
 
+  gc<MappedBufferObject> asMappedBuffer(gc<Object> obj)
+  {
+    return static_cast<MappedBufferObject*>(&(*obj));
+  }
+
   gc<StreamObject> asStream(gc<Object> obj)
   {
     return static_cast<StreamObject*>(&(*obj));
@@ -27,6 +36,9 @@ namespace magpie
   FSTask::FSTask(gc<Fiber> fiber)
   : Task(fiber)
   {
+    // The request may not be submitted right away, and kill() shouldn't
+    // mistake leftovers from a recycled task for a live request.
+    memset(&fs_, 0, sizeof(fs_));
     fs_.data = this;
   }
 
@@ -52,6 +64,149 @@ namespace magpie
     buffer_.reach();
   }
 
+  PositionalReadTask::PositionalReadTask(gc<Fiber> fiber, int numReads,
+                                         bool returnList)
+  : Task(fiber),
+    requests_(new uv_fs_t[numReads]),
+    buffers_(new char*[numReads]),
+    numReads_(numReads),
+    numPending_(numReads),
+    returnList_(returnList)
+  {
+    memset(requests_, 0, sizeof(uv_fs_t) * numReads);
+    for (int i = 0; i < numReads; i++) buffers_[i] = NULL;
+  }
+
+  PositionalReadTask::~PositionalReadTask()
+  {
+    for (int i = 0; i < numReads_; i++)
+    {
+      uv_fs_req_cleanup(&requests_[i]);
+      delete [] buffers_[i];
+    }
+
+    delete [] requests_;
+    delete [] buffers_;
+  }
+
+  void PositionalReadTask::read(int index, uv_file file, int offset, int size)
+  {
+    buffers_[index] = new char[size > 0 ? size : 1];
+    requests_[index].data = this;
+
+    uv_fs_read(loop(), &requests_[index], file, buffers_[index], size,
+               offset, readCallback);
+  }
+
+  void PositionalReadTask::kill()
+  {
+    // Reads that haven't started yet can be dropped. The rest will still call
+    // back when they finish.
+    for (int i = 0; i < numReads_; i++)
+    {
+      uv_cancel(reinterpret_cast<uv_req_t*>(&requests_[i]));
+    }
+  }
+
+  void PositionalReadTask::readCallback(uv_fs_t* request)
+  {
+    PositionalReadTask* task = static_cast<PositionalReadTask*>(request->data);
+
+    task->numPending_--;
+    if (task->numPending_ > 0) return;
+
+    if (task->isKilled())
+    {
+      task->complete(NULL);
+      return;
+    }
+
+    task->complete(task->finish());
+  }
+
+  gc<Object> PositionalReadTask::finish()
+  {
+    VM& vm = fiber()->vm();
+
+    // If any read failed, the whole thing does.
+    for (int i = 0; i < numReads_; i++)
+    {
+      if (requests_[i].result < 0) return vm.nothing();
+    }
+
+    gc<ListObject> list;
+    if (returnList_) list = new ListObject(numReads_);
+
+    for (int i = 0; i < numReads_; i++)
+    {
+      int count = static_cast<int>(requests_[i].result);
+      gc<BufferObject> buffer = BufferObject::create(count);
+      memcpy(buffer->data(), buffers_[i], count);
+
+      if (!returnList_) return buffer;
+      list->elements().add(buffer);
+    }
+
+    return list;
+  }
+
+  Crc32Task::Crc32Task(gc<Fiber> fiber, gc<BufferObject> buffer)
+  : WorkTask(fiber),
+    bytes_(NULL),
+    count_(buffer->count()),
+    crc_(0)
+  {
+    bytes_ = copyInput(buffer->data(), count_);
+  }
+
+  void Crc32Task::work()
+  {
+    crc_ = BufferObject::crc32(bytes_, count_);
+  }
+
+  gc<Object> Crc32Task::finish()
+  {
+    return new IntObject(static_cast<int>(crc_));
+  }
+
+  ReadTextTask::ReadTextTask(gc<Fiber> fiber, gc<String> path)
+  : WorkTask(fiber),
+    path_(NULL),
+    text_(NULL),
+    length_(0),
+    failed_(false),
+    invalid_(-1)
+  {
+    path_ = reinterpret_cast<const char*>(
+        copyInput(path->cString(), path->length() + 1));
+  }
+
+  ReadTextTask::~ReadTextTask()
+  {
+    delete [] text_;
+  }
+
+  void ReadTextTask::work()
+  {
+    text_ = readFileBytes(path_, length_);
+    if (text_ == NULL)
+    {
+      failed_ = true;
+      return;
+    }
+
+    invalid_ = Utf8::findInvalid(
+        reinterpret_cast<const unsigned char*>(text_), length_);
+  }
+
+  gc<Object> ReadTextTask::finish()
+  {
+    if (failed_) return fiber()->vm().nothing();
+    if (invalid_ != -1) return new IntObject(invalid_);
+
+    return new StringObject(String::create(text_, length_));
+  }
+
   HandleTask::HandleTask(gc<Fiber> fiber, uv_handle_t* handle)
   : Task(fiber),
     handle_(handle)
@@ -71,22 +226,62 @@ namespace magpie
     handle_ = NULL;
   }
 
+  // The lookup table for the standard (IEEE 802.3) CRC-32 polynomial. It's
+  // filled in during static initialization so that worker threads never race
+  // to build it.
+  static struct Crc32Table
+  {
+    Crc32Table()
+    {
+      for (unsigned int i = 0; i < 256; i++)
+      {
+        unsigned int crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+          crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+        entries[i] = crc;
+      }
+    }
+
+    unsigned int entries[256];
+  } crc32Table;
+
   gc<BufferObject> BufferObject::create(int count)
   {
     // Allocate enough memory for the buffer and its data.
-    void* mem = Memory::allocate(sizeof(BufferObject) +
-                                 sizeof(unsigned char) * (count - 1));
+    void* mem = Memory::current().allocate(sizeof(BufferObject) +
+        sizeof(unsigned char) * (count - 1));
 
     // Construct it by calling global placement new.
     gc<BufferObject> buffer = ::new(mem) BufferObject(count);
 
     // Fill with zero.
-    for (int i = 0; i < count; i++)
+    memset(buffer->bytes_, 0, count);
+
+    return buffer;
+  }
+
+  gc<BufferObject> BufferObject::createView(gc<BufferObject> buffer,
+                                            int offset, int count)
+  {
+    // Views don't need any inline storage.
+    void* mem = Memory::current().allocate(sizeof(BufferObject));
+    gc<BufferObject> view = ::new(mem) BufferObject(count);
+
+    // A view of a view just points at the original buffer.
+    if (buffer->parent_.isNull())
     {
-      buffer->bytes_[i] = 0;
+      view->parent_ = buffer;
+      view->offset_ = offset;
+    }
+    else
+    {
+      view->parent_ = buffer->parent_;
+      view->offset_ = buffer->offset_ + offset;
     }
 
-    return buffer;
+    return view;
   }
 
   gc<ClassObject> BufferObject::getClass(VM& vm) const
@@ -98,6 +293,8 @@ namespace magpie
   {
     if (count_ == 0) return String::create("[buffer]");
 
+    const unsigned char* bytes = data();
+
     gc<String> result = String::create("[buffer");
 
     if (count_ <= 8)
@@ -105,7 +302,7 @@ namespace magpie
       // Small buffer, so show the whole contents.
       for (int i = 0; i < count_; i++)
       {
-        result = String::format("%s %02x", result->cString(), bytes_[i]);
+        result = String::format("%s %02x", result->cString(), bytes[i]);
       }
     }
     else
@@ -113,45 +310,186 @@ namespace magpie
       // Long buffer, so just shows the first and last few octets.
       for (int i = 0; i < 4; i++)
       {
-        result = String::format("%s %02x", result->cString(), bytes_[i]);
+        result = String::format("%s %02x", result->cString(), bytes[i]);
       }
 
       result = String::format("%s ...", result->cString());
 
       for (int i = count_ - 4; i < count_; i++)
       {
-        result = String::format("%s %02x", result->cString(), bytes_[i]);
+        result = String::format("%s %02x", result->cString(), bytes[i]);
       }
     }
 
     return String::format("%s]", result->cString());
   }
 
+  void BufferObject::reach()
+  {
+    parent_.reach();
+  }
+
+  int BufferObject::indexOf(unsigned char value, int start)
+  {
+    if (start >= count_) return -1;
+
+    unsigned char* bytes = data();
+    void* found = memchr(bytes + start, value, count_ - start);
+    if (found == NULL) return -1;
+
+    return static_cast<int>(static_cast<unsigned char*>(found) - bytes);
+  }
+
+  int BufferObject::indexOf(gc<BufferObject> sequence, int start)
+  {
+    int length = sequence->count();
+    if (length == 0) return start <= count_ ? start : -1;
+
+    unsigned char* bytes = data();
+    unsigned char* target = sequence->data();
+    int last = count_ - length;
+
+    // Let memchr() skip ahead to each place the first byte matches and only
+    // compare the rest there.
+    int i = start;
+    while (i <= last)
+    {
+      void* found = memchr(bytes + i, target[0], last - i + 1);
+      if (found == NULL) return -1;
+
+      i = static_cast<int>(static_cast<unsigned char*>(found) - bytes);
+      if (memcmp(bytes + i + 1, target + 1, length - 1) == 0) return i;
+
+      i++;
+    }
+
+    return -1;
+  }
+
+  int BufferObject::compare(gc<BufferObject> other)
+  {
+    int length = count_ < other->count_ ? count_ : other->count_;
+    int result = memcmp(data(), other->data(), length);
+
+    // If the common part is the same, the shorter one is first.
+    if (result == 0) result = count_ - other->count_;
+
+    return sgn(result);
+  }
+
+  int BufferObject::readInt(int offset, int size, bool isSigned,
+                            bool isBigEndian)
+  {
+    unsigned char* bytes = data() + offset;
+
+    unsigned int value = 0;
+    for (int i = 0; i < size; i++)
+    {
+      int index = isBigEndian ? i : size - i - 1;
+      value = (value << 8) | bytes[index];
+    }
+
+    // Sign extend.
+    if (isSigned && size < 4)
+    {
+      int shift = 32 - size * 8;
+      return static_cast<int>(value << shift) >> shift;
+    }
+
+    return static_cast<int>(value);
+  }
+
+  unsigned int BufferObject::crc32(const unsigned char* bytes, int count)
+  {
+    unsigned int crc = 0xffffffff;
+    for (int i = 0; i < count; i++)
+    {
+      crc = crc32Table.entries[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+  }
+
   void BufferObject::truncate(int count)
   {
     ASSERT(count <= count_, "Cannot truncate to a larger size.");
     count_ = count;
   }
 
+  gc<MappedBufferObject> MappedBufferObject::create(gc<String> path)
+  {
+    MappedFile* file = MappedFile::open(path->cString());
+    if (file == NULL) return NULL;
+
+    gc<MappedBufferObject> buffer = new MappedBufferObject(file);
+    Memory::current().addFinalizer(&(*buffer));
+    return buffer;
+  }
+
+  gc<ClassObject> MappedBufferObject::getClass(VM& vm) const
+  {
+    return vm.mappedBufferClass();
+  }
+
+  gc<String> MappedBufferObject::toString() const
+  {
+    return String::format("[mapped buffer %d]", count());
+  }
+
+  void MappedBufferObject::finalize()
+  {
+    close();
+  }
+
+  void MappedBufferObject::close()
+  {
+    delete file_;
+    file_ = NULL;
+  }
+
   static void openFileCallback(uv_fs_t* handle)
   {
     // TODO(bob): Handle errors!
     Task* task = static_cast<Task*>(handle->data);
 
+    bool isWritable = (handle->flags & O_WRONLY) != 0;
+
     // Note that the file descriptor is returned in [result] and not [file].
-    task->complete(new FileObject(handle->result));
+    task->complete(new FileObject(handle->result, isWritable));
   }
 
-  void FileObject::open(gc<Fiber> fiber, gc<String> path)
+  void FileObject::open(gc<Fiber> fiber, gc<String> path, FileMode mode)
   {
     FSTask* task = new FSTask(fiber);
 
-    // TODO(bob): Make this configurable.
-    int flags = O_RDONLY;
+    int flags;
+    switch (mode)
+    {
+      case FILE_MODE_READ: flags = O_RDONLY; break;
+      case FILE_MODE_WRITE: flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+      case FILE_MODE_APPEND: flags = O_WRONLY | O_CREAT | O_APPEND; break;
+    }
+
     // TODO(bob): Make this configurable when creating a file.
-    int mode = 0;
-    uv_fs_open(task->loop(), task->request(), path->cString(), flags, mode,
-               openFileCallback);
+    int permissions = 0644;
+    uv_fs_open(task->loop(), task->request(), path->cString(), flags,
+               permissions, openFileCallback);
+  }
+
+  static void removeFileCallback(uv_fs_t* handle)
+  {
+    // TODO(bob): Handle errors!
+    Task* task = static_cast<Task*>(handle->data);
+
+    // Delete returns nothing.
+    task->complete(NULL);
+  }
+
+  void FileObject::remove(gc<Fiber> fiber, gc<String> path)
+  {
+    FSTask* task = new FSTask(fiber);
+    uv_fs_unlink(task->loop(), task->request(), path->cString(),
+                 removeFileCallback);
   }
 
   static void getSizeCallback(uv_fs_t* handle)
@@ -170,22 +508,6 @@ namespace magpie
     uv_fs_fstat(task->loop(), task->request(), file_, getSizeCallback);
   }
 
-  // TODO(bob): Stream-based code. Saving it for later.
-  /*
-   static uv_buf_t allocateCallback(uv_handle_t *handle, size_t suggested_size)
-   {
-   printf("Alloc %ld\n", suggested_size);
-   // TODO(bob): Don't use malloc() here.
-   return uv_buf_init((char*) malloc(suggested_size), suggested_size);
-   }
-
-   static void readCallback(uv_stream_t *stream, ssize_t nread, uv_buf_t buf)
-   {
-   // TODO(bob): Implement me!
-   printf("Read %ld bytes\n", nread);
-   }
-   */
-
   static void readBytesCallback(uv_fs_t *request)
   {
     // TODO(bob): Handle errors!
@@ -214,28 +536,48 @@ namespace magpie
     uv_fs_read(task->loop(), task->request(), file_,
                task->buffer()->data(), task->buffer()->count(), -1,
                readBytesCallback);
+  }
 
-    // TODO(bob): Use this for the streaming methods:
-    /*
-     // TODO(bob): What if you call read on the same file multiple times?
-     // Should the pipe be reused?
-     // Get a pipe to the file.
-     uv_pipe_t* pipe = tasks_.createPipe(fiber);
-     uv_pipe_init(loop_, pipe, 0);
-     uv_pipe_open(pipe, file->file());
+  void FileObject::readAt(gc<Fiber> fiber, int offset, int size)
+  {
+    PositionalReadTask* task = new PositionalReadTask(fiber, 1, false);
+    task->read(0, file_, offset, size);
+  }
+
+  void FileObject::readRanges(gc<Fiber> fiber, gc<ListObject> offsets,
+                              gc<ListObject> sizes)
+  {
+    int count = offsets->elements().count();
+    PositionalReadTask* task = new PositionalReadTask(fiber, count, true);
+    for (int i = 0; i < count; i++)
+    {
+      task->read(i, file_, asInt(offsets->elements()[i]),
+                 asInt(sizes->elements()[i]));
+    }
+  }
+
+  // Resumes the fiber closing a file with whether it succeeded.
+  static void completeClose(Task* task, bool success)
+  {
+    if (task->isKilled())
+    {
+      task->complete(NULL);
+      return;
+    }
 
-     // TODO(bob): Check result.
-     uv_read_start(reinterpret_cast<uv_stream_t*>(pipe), allocateCallback,
-     readCallback);
-     */
+    task->complete(task->fiber()->vm().getBool(success));
   }
 
   static void closeFileCallback(uv_fs_t* handle)
   {
-    Task* task = static_cast<Task*>(handle->data);
+    completeClose(static_cast<Task*>(handle->data), handle->result == 0);
+  }
 
-    // Close returns nothing.
-    task->complete(NULL);
+  // Closes a file whose writer lost some of the data written to it, so the
+  // close fails even if the OS closes the file.
+  static void closeFailedWriterCallback(uv_fs_t* handle)
+  {
+    completeClose(static_cast<Task*>(handle->data), false);
   }
 
   void FileObject::close(gc<Fiber> fiber)
@@ -245,10 +587,84 @@ namespace magpie
     isOpen_ = false;
 
     FSTask* task = new FSTask(fiber);
+
+    // If the file is being streamed, let the reader close it once it isn't
+    // in the middle of reading from it.
+    if (reader_ != NULL)
+    {
+      FileReader* reader = reader_;
+      reader_ = NULL;
+      reader->close(task);
+      return;
+    }
+
+    // Likewise, the writer closes it after writing out what's buffered.
+    if (writer_ != NULL)
+    {
+      FileWriter* writer = writer_;
+      writer_ = NULL;
+      writer->close(task);
+      return;
+    }
+
     uv_fs_close(task->loop(), task->request(), file_,
                 closeFileCallback);
   }
 
+  bool FileObject::write(gc<Fiber> fiber, const void* data, int size)
+  {
+    ASSERT(isOpen_, "IO library should not write to a closed file.");
+
+    if (writer_ == NULL)
+    {
+      writer_ = new FileWriter(fiber->scheduler().loop(), file_);
+    }
+
+    return writer_->write(fiber, data, size);
+  }
+
+  bool FileObject::flush(gc<Fiber> fiber)
+  {
+    ASSERT(isOpen_, "IO library should not flush a closed file.");
+
+    if (writer_ == NULL) return true;
+    return writer_->flush(fiber);
+  }
+
+  bool FileObject::hasWriteFailed() const
+  {
+    return writer_ != NULL && writer_->hasFailed();
+  }
+
+  static void syncCallback(uv_fs_t* handle)
+  {
+    // TODO(bob): Handle errors!
+    Task* task = static_cast<Task*>(handle->data);
+
+    // Sync returns nothing.
+    task->complete(NULL);
+  }
+
+  void FileObject::sync(gc<Fiber> fiber)
+  {
+    ASSERT(isOpen_, "IO library should not sync a closed file.");
+
+    FSTask* task = new FSTask(fiber);
+    uv_fs_fsync(task->loop(), task->request(), file_, syncCallback);
+  }
+
+  gc<StreamObject> FileObject::streamBytes(gc<Fiber> fiber, int chunkSize)
+  {
+    ASSERT(isOpen_, "IO library should not stream a closed file.");
+
+    if (reader_ == NULL)
+    {
+      reader_ = new FileReader(fiber->scheduler().loop(), file_, chunkSize);
+    }
+
+    return new StreamObject(this);
+  }
+
   gc<ClassObject> FileObject::getClass(VM& vm) const
   {
     return vm.fileClass();
@@ -266,6 +682,460 @@ namespace magpie
   }
 
 
+  FileReader::FileReader(uv_loop_t* loop, uv_file file, int chunkSize)
+  : loop_(loop),
+    file_(file),
+    chunkSize_(chunkSize),
+    isReading_(false),
+    isDone_(false),
+    failed_(false),
+    isDispatching_(false),
+    closeTask_(NULL),
+    buffers_(new unsigned char[NUM_CHUNKS * chunkSize]),
+    first_(0),
+    numFull_(0),
+    firstWaiting_(NULL),
+    lastWaiting_(NULL)
+  {
+    request_.data = this;
+
+    // Start reading right away so the first chunk is ready sooner.
+    readAhead();
+  }
+
+  FileReader::~FileReader()
+  {
+    delete [] buffers_;
+  }
+
+  gc<Object> FileReader::read(gc<Fiber> fiber)
+  {
+    if (numFull_ > 0)
+    {
+      gc<Object> chunk = take(fiber->vm());
+
+      // Now that a buffer is free, refill it.
+      readAhead();
+      return chunk;
+    }
+
+    if (isDone_) return end(fiber->vm());
+
+    // Nothing has been read yet, so wait for it. Since there are no full
+    // buffers, there must be a read in flight to wake us up.
+    StreamReadTask* task = new StreamReadTask(fiber, this);
+    if (lastWaiting_ == NULL)
+    {
+      firstWaiting_ = task;
+    }
+    else
+    {
+      lastWaiting_->nextWaiting_ = task;
+    }
+
+    lastWaiting_ = task;
+
+    readAhead();
+    return NULL;
+  }
+
+  void FileReader::close(FSTask* closeTask)
+  {
+    closeTask_ = closeTask;
+
+    // Throw away anything read ahead. Fibers still waiting will get done.
+    isDone_ = true;
+    numFull_ = 0;
+
+    if (!isReading_ && !isDispatching_) finishClose();
+  }
+
+  void FileReader::readCallback(uv_fs_t* request)
+  {
+    FileReader* reader = static_cast<FileReader*>(request->data);
+    int result = request->result;
+    uv_fs_req_cleanup(request);
+
+    reader->isReading_ = false;
+
+    if (reader->isDone_)
+    {
+      // The file was closed while this read was in flight, so ignore it.
+    }
+    else if (result > 0)
+    {
+      int slot = (reader->first_ + reader->numFull_) % NUM_CHUNKS;
+      reader->counts_[slot] = result;
+      reader->numFull_++;
+    }
+    else
+    {
+      // Reading zero bytes means we hit the end of the file. Anything less
+      // is an error, which ends the stream too.
+      reader->isDone_ = true;
+      if (result < 0) reader->failed_ = true;
+    }
+
+    reader->dispatch();
+  }
+
+  void FileReader::readAhead()
+  {
+    if (isReading_ || isDone_ || numFull_ == NUM_CHUNKS) return;
+
+    int slot = (first_ + numFull_) % NUM_CHUNKS;
+    isReading_ = true;
+    uv_fs_read(loop_, &request_, file_, buffers_ + slot * chunkSize_,
+               chunkSize_, -1, readCallback);
+  }
+
+  void FileReader::dispatch()
+  {
+    // Resuming a fiber may cause it to read from or close this reader, so
+    // don't let close() free it out from under us.
+    isDispatching_ = true;
+
+    while (firstWaiting_ != NULL && (numFull_ > 0 || isDone_))
+    {
+      StreamReadTask* task = firstWaiting_;
+      removeWaiting(task);
+
+      VM& vm = task->fiber()->vm();
+      gc<Object> chunk;
+      if (numFull_ > 0)
+      {
+        chunk = take(vm);
+      }
+      else
+      {
+        chunk = end(vm);
+      }
+
+      task->complete(chunk);
+    }
+
+    isDispatching_ = false;
+
+    if (closeTask_ != NULL)
+    {
+      if (!isReading_) finishClose();
+      return;
+    }
+
+    readAhead();
+  }
+
+  gc<Object> FileReader::take(VM& vm)
+  {
+    gc<BufferObject> buffer = BufferObject::create(counts_[first_]);
+    memcpy(buffer->data(), buffers_ + first_ * chunkSize_, counts_[first_]);
+
+    first_ = (first_ + 1) % NUM_CHUNKS;
+    numFull_--;
+
+    return buffer;
+  }
+
+  gc<Object> FileReader::end(VM& vm)
+  {
+    if (failed_) return vm.nothing();
+    return vm.getBuiltIn(BUILT_IN_DONE);
+  }
+
+  void FileReader::removeWaiting(StreamReadTask* task)
+  {
+    StreamReadTask* previous = NULL;
+    StreamReadTask* waiting = firstWaiting_;
+    while (waiting != NULL && waiting != task)
+    {
+      previous = waiting;
+      waiting = waiting->nextWaiting_;
+    }
+
+    if (waiting == NULL) return;
+
+    if (previous == NULL)
+    {
+      firstWaiting_ = task->nextWaiting_;
+    }
+    else
+    {
+      previous->nextWaiting_ = task->nextWaiting_;
+    }
+
+    if (lastWaiting_ == task) lastWaiting_ = previous;
+    task->nextWaiting_ = NULL;
+  }
+
+  void FileReader::finishClose()
+  {
+    uv_fs_close(loop_, closeTask_->request(), file_, closeFileCallback);
+    delete this;
+  }
+
+  StreamReadTask::StreamReadTask(gc<Fiber> fiber, FileReader* reader)
+  : Task(fiber),
+    reader_(reader),
+    nextWaiting_(NULL)
+  {}
+
+  void StreamReadTask::kill()
+  {
+    reader_->removeWaiting(this);
+  }
+
+  FileWriter::FileWriter(uv_loop_t* loop, uv_file file)
+  : loop_(loop),
+    file_(file),
+    isWriting_(false),
+    failed_(false),
+    isDispatching_(false),
+    closeTask_(NULL),
+    written_(0),
+    firstWaiting_(NULL),
+    lastWaiting_(NULL)
+  {
+    request_.data = this;
+
+    pending_.bytes = new unsigned char[BUFFER_SIZE];
+    pending_.count = 0;
+    pending_.capacity = BUFFER_SIZE;
+
+    writing_.bytes = new unsigned char[BUFFER_SIZE];
+    writing_.count = 0;
+    writing_.capacity = BUFFER_SIZE;
+  }
+
+  FileWriter::~FileWriter()
+  {
+    delete [] pending_.bytes;
+    delete [] writing_.bytes;
+  }
+
+  bool FileWriter::write(gc<Fiber> fiber, const void* data, int size)
+  {
+    // There's nowhere for the data to go.
+    if (failed_) return true;
+
+    // Always take the data, even if that means growing the buffer past its
+    // usual size. The fiber may not get to run again before the heap object
+    // holding the data moves.
+    if (pending_.count + size > pending_.capacity)
+    {
+      int capacity = pending_.capacity;
+      while (capacity < pending_.count + size) capacity *= 2;
+
+      unsigned char* bytes = new unsigned char[capacity];
+      memcpy(bytes, pending_.bytes, pending_.count);
+      delete [] pending_.bytes;
+
+      pending_.bytes = bytes;
+      pending_.capacity = capacity;
+    }
+
+    memcpy(pending_.bytes + pending_.count, data, size);
+    pending_.count += size;
+
+    if (pending_.count < BUFFER_SIZE) return true;
+
+    // The buffer is full. If the disk is keeping up, hand it off and keep
+    // going. Otherwise, wait for the write in flight to finish.
+    if (!isWriting_)
+    {
+      startWrite();
+      return true;
+    }
+
+    wait(fiber, false);
+    return false;
+  }
+
+  bool FileWriter::flush(gc<Fiber> fiber)
+  {
+    if (isIdle()) return true;
+
+    startWrite();
+    wait(fiber, true);
+    return false;
+  }
+
+  void FileWriter::close(FSTask* closeTask)
+  {
+    closeTask_ = closeTask;
+
+    if (isIdle() && !isDispatching_)
+    {
+      finishClose();
+      return;
+    }
+
+    startWrite();
+  }
+
+  void FileWriter::writeCallback(uv_fs_t* request)
+  {
+    FileWriter* writer = static_cast<FileWriter*>(request->data);
+    int result = request->result;
+    uv_fs_req_cleanup(request);
+
+    if (result > 0)
+    {
+      writer->written_ += result;
+
+      // Keep going if only part of it got written.
+      if (writer->written_ < writer->writing_.count)
+      {
+        writer->writeRemaining();
+        return;
+      }
+    }
+
+    else
+    {
+      // The OS won't take the data, so the rest of it won't get written
+      // either. Drop it and fail every write from now on.
+      writer->failed_ = true;
+      writer->pending_.count = 0;
+    }
+
+    writer->writing_.count = 0;
+    writer->isWriting_ = false;
+
+    // Only write again now if the buffer has filled up or someone is waiting
+    // for it to be written. Otherwise, let it collect more data.
+    if (writer->pending_.count >= BUFFER_SIZE ||
+        writer->firstWaiting_ != NULL ||
+        writer->closeTask_ != NULL)
+    {
+      writer->startWrite();
+    }
+
+    writer->dispatch();
+  }
+
+  void FileWriter::startWrite()
+  {
+    if (isWriting_ || pending_.count == 0) return;
+
+    // Swap the buffers so that new writes can keep collecting while this one
+    // is in flight.
+    Block block = writing_;
+    writing_ = pending_;
+    pending_ = block;
+
+    // If the pending buffer grew for a large write, don't hold onto it.
+    if (pending_.capacity > BUFFER_SIZE)
+    {
+      delete [] pending_.bytes;
+      pending_.bytes = new unsigned char[BUFFER_SIZE];
+      pending_.capacity = BUFFER_SIZE;
+    }
+
+    written_ = 0;
+    isWriting_ = true;
+    writeRemaining();
+  }
+
+  void FileWriter::writeRemaining()
+  {
+    uv_fs_write(loop_, &request_, file_, writing_.bytes + written_,
+                writing_.count - written_, -1, writeCallback);
+  }
+
+  void FileWriter::dispatch()
+  {
+    // Resuming a fiber may cause it to write more or close the file, so don't
+    // let close() free this out from under us.
+    isDispatching_ = true;
+
+    while (firstWaiting_ != NULL && isReady(firstWaiting_))
+    {
+      WriteWaitTask* task = firstWaiting_;
+      removeWaiting(task);
+      task->complete(task->fiber()->vm().getBool(!failed_));
+    }
+
+    isDispatching_ = false;
+
+    if (closeTask_ != NULL && isIdle()) finishClose();
+  }
+
+  bool FileWriter::isReady(WriteWaitTask* task) const
+  {
+    if (task->untilIdle_) return isIdle();
+    return !isWriting_ || pending_.count < BUFFER_SIZE;
+  }
+
+  void FileWriter::wait(gc<Fiber> fiber, bool untilIdle)
+  {
+    WriteWaitTask* task = new WriteWaitTask(fiber, this, untilIdle);
+    if (lastWaiting_ == NULL)
+    {
+      firstWaiting_ = task;
+    }
+    else
+    {
+      lastWaiting_->nextWaiting_ = task;
+    }
+
+    lastWaiting_ = task;
+  }
+
+  void FileWriter::removeWaiting(WriteWaitTask* task)
+  {
+    WriteWaitTask* previous = NULL;
+    WriteWaitTask* waiting = firstWaiting_;
+    while (waiting != NULL && waiting != task)
+    {
+      previous = waiting;
+      waiting = waiting->nextWaiting_;
+    }
+
+    if (waiting == NULL) return;
+
+    if (previous == NULL)
+    {
+      firstWaiting_ = task->nextWaiting_;
+    }
+    else
+    {
+      previous->nextWaiting_ = task->nextWaiting_;
+    }
+
+    if (lastWaiting_ == task) lastWaiting_ = previous;
+    task->nextWaiting_ = NULL;
+  }
+
+  void FileWriter::finishClose()
+  {
+    uv_fs_close(loop_, closeTask_->request(), file_,
+                failed_ ? closeFailedWriterCallback : closeFileCallback);
+    delete this;
+  }
+
+  WriteWaitTask::WriteWaitTask(gc<Fiber> fiber, FileWriter* writer,
+                               bool untilIdle)
+  : Task(fiber),
+    writer_(writer),
+    untilIdle_(untilIdle),
+    nextWaiting_(NULL)
+  {}
+
+  void WriteWaitTask::kill()
+  {
+    writer_->removeWaiting(this);
+  }
+
+  gc<Object> StreamObject::read(gc<Fiber> fiber)
+  {
+    FileReader* reader = file_->reader();
+
+    // Once the file is closed, there's nothing left to read.
+    if (reader == NULL) return fiber->vm().getBuiltIn(BUILT_IN_DONE);
+
+    return reader->read(fiber);
+  }
+
   gc<ClassObject> StreamObject::getClass(VM& vm) const
   {
     return vm.streamClass();
@@ -276,4 +1146,9 @@ namespace magpie
     // TODO(bob): Include some kind of ID or something here.
     return String::create("[stream]");
   }
+
+  void StreamObject::reach()
+  {
+    file_.reach();
+  }
 }
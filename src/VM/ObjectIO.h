@@ -5,6 +5,7 @@
 
 #include "Macros.h"
 #include "Managed.h"
+#include "MappedFile.h"
 #include "MagpieString.h"
 #include "Object.h"
 #include "Scheduler.h"
@@ -14,12 +15,31 @@ namespace magpie
   class BufferObject;
   class FileObject;
   class File;
+  class FileReader;
+  class FileWriter;
+  class MappedBufferObject;
   class StreamObject;
+  class StreamReadTask;
+  class WriteWaitTask;
+
+  // How a file is opened.
+  enum FileMode
+  {
+    // Read from the beginning.
+    FILE_MODE_READ,
+
+    // Write, creating the file if needed and discarding what was there.
+    FILE_MODE_WRITE,
+
+    // Write to the end, creating the file if needed.
+    FILE_MODE_APPEND
+  };
 
   // Unsafe downcasting functions. These must *only* be called after the object
   // has been verified as being the right type.
   gc<BufferObject> asBuffer(gc<Object> obj);
   gc<FileObject> asFile(gc<Object> obj);
+  gc<MappedBufferObject> asMappedBuffer(gc<Object> obj);
   gc<StreamObject> asStream(gc<Object> obj);
 
   // A task for a file system operation.
@@ -32,6 +52,7 @@ namespace magpie
     uv_fs_t* request() { return &fs_; }
 
     virtual void kill();
+    virtual bool hasPendingCallback() const { return true; }
 
     uv_fs_t fs_;
   };
@@ -50,6 +71,294 @@ namespace magpie
     gc<BufferObject> buffer_;
   };
 
+  // Reads several ranges of a file at explicit offsets. All of the reads are
+  // queued on the thread pool at once so that they can overlap, and the fiber
+  // is resumed once every one of them is done. The data is read into memory
+  // owned by the task, since the GC may move buffers while the reads are in
+  // flight.
+  class PositionalReadTask : public Task
+  {
+  public:
+    // If [returnList] is true, the fiber gets a list of buffers, one for each
+    // read. Otherwise, there must be exactly one read and it gets the buffer.
+    PositionalReadTask(gc<Fiber> fiber, int numReads, bool returnList);
+    ~PositionalReadTask();
+
+    // Starts read [index], which reads [size] bytes from [file] at [offset].
+    // Every read must be started before control returns to the event loop.
+    void read(int index, uv_file file, int offset, int size);
+
+    virtual void kill();
+    virtual bool hasPendingCallback() const { return true; }
+
+  private:
+    static void readCallback(uv_fs_t* request);
+
+    // Builds the result once all of the reads are done.
+    gc<Object> finish();
+
+    uv_fs_t* requests_;
+    char** buffers_;
+    int numReads_;
+    int numPending_;
+    bool returnList_;
+  };
+
+  // Computes the CRC-32 checksum of a buffer on the thread pool.
+  class Crc32Task : public WorkTask
+  {
+  public:
+    Crc32Task(gc<Fiber> fiber, gc<BufferObject> buffer);
+
+  protected:
+    virtual void work();
+    virtual gc<Object> finish();
+
+  private:
+    const unsigned char* bytes_;
+    int count_;
+    unsigned int crc_;
+  };
+
+  // Reads an entire file as UTF-8 text on the thread pool: opening, reading and
+  // closing it and validating the encoding all happen in one go, so the fiber
+  // only suspends once. The text is read into memory owned by the task and
+  // only copied into the GC heap once, into a String of the right size.
+  class ReadTextTask : public WorkTask
+  {
+  public:
+    ReadTextTask(gc<Fiber> fiber, gc<String> path);
+    ~ReadTextTask();
+
+  protected:
+    virtual void work();
+
+    // Returns the text as a string, the index of the first invalid byte as an
+    // int if it isn't valid UTF-8, or nothing if it couldn't be read.
+    virtual gc<Object> finish();
+
+  private:
+    const char* path_;
+    char* text_;
+    int length_;
+    bool failed_;
+    int invalid_;
+  };
+
+  // Reads a file from start to finish in fixed-size chunks. Chunks are read
+  // into a small ring of buffers that are reused for the life of the reader,
+  // and only copied into a BufferObject when they are consumed. Once every
+  // buffer is full, the reader stops issuing reads until the consumer catches
+  // up, so memory stays bounded no matter how big the file is.
+  //
+  // This lives on the native heap (and not in the GC heap) since libuv holds
+  // onto the request while a read is in flight.
+  class FileReader
+  {
+    friend class StreamReadTask;
+
+  public:
+    FileReader(uv_loop_t* loop, uv_file file, int chunkSize);
+    ~FileReader();
+
+    // Gets the next chunk of the file as a BufferObject, done at the end of
+    // the file, or nothing if reading failed. If the next chunk hasn't been
+    // read yet, suspends [fiber] until it has been, sends it the chunk then,
+    // and returns NULL.
+    gc<Object> read(gc<Fiber> fiber);
+
+    // Stops reading because the file is being closed. Once no read is in
+    // flight, closes the file using [closeTask] and frees the reader.
+    void close(FSTask* closeTask);
+
+  private:
+    // The number of chunks that can be read ahead of the consumer.
+    static const int NUM_CHUNKS = 2;
+
+    static void readCallback(uv_fs_t* request);
+
+    // Issues a read for the next chunk if there is a free buffer for it.
+    void readAhead();
+
+    // Hands chunks to waiting fibers until there are no more of one or the
+    // other.
+    void dispatch();
+
+    // Removes the oldest chunk and copies it into a new BufferObject.
+    gc<Object> take(VM& vm);
+
+    // Gets what a read past the last chunk returns: done, or nothing if
+    // reading failed.
+    gc<Object> end(VM& vm);
+
+    void removeWaiting(StreamReadTask* task);
+
+    void finishClose();
+
+    uv_loop_t* loop_;
+    uv_file file_;
+    int chunkSize_;
+
+    uv_fs_t request_;
+    bool isReading_;
+
+    // True once a read has hit the end of the file or failed, or the file is
+    // closed.
+    bool isDone_;
+
+    // True if a read failed. Chunks read before that are still handed out,
+    // and then every read gets nothing.
+    bool failed_;
+
+    // True while dispatch() is resuming fibers.
+    bool isDispatching_;
+
+    // The pending close, if the file has been closed.
+    FSTask* closeTask_;
+
+    // The ring of chunk buffers. [first_] is the oldest full chunk, and there
+    // are [numFull_] full chunks following it.
+    unsigned char* buffers_;
+    int counts_[NUM_CHUNKS];
+    int first_;
+    int numFull_;
+
+    // The fibers waiting for the next chunk, in the order they asked.
+    StreamReadTask* firstWaiting_;
+    StreamReadTask* lastWaiting_;
+
+    NO_COPY(FileReader);
+  };
+
+  // A fiber waiting on a FileReader for the next chunk.
+  class StreamReadTask : public Task
+  {
+    friend class FileReader;
+
+  public:
+    StreamReadTask(gc<Fiber> fiber, FileReader* reader);
+
+    virtual void kill();
+
+  private:
+    FileReader* reader_;
+    StreamReadTask* nextWaiting_;
+  };
+
+  // Collects small writes to a file in memory and writes them out in large
+  // blocks. Writing only suspends the fiber when the buffer is full and the
+  // previous block is still being written, so a fast producer can't get more
+  // than two buffers ahead of the disk.
+  //
+  // Like FileReader, this lives on the native heap since libuv holds onto the
+  // request and data while a write is in flight.
+  class FileWriter
+  {
+    friend class WriteWaitTask;
+
+  public:
+    FileWriter(uv_loop_t* loop, uv_file file);
+    ~FileWriter();
+
+    // Buffers [size] bytes of [data] to be written. Returns true if [fiber]
+    // can keep going, or false if it has been suspended until the buffer has
+    // room again.
+    bool write(gc<Fiber> fiber, const void* data, int size);
+
+    // Starts writing everything buffered so far. Returns true if there was
+    // nothing to write, or false if [fiber] has been suspended until it has
+    // all been written.
+    bool flush(gc<Fiber> fiber);
+
+    // Flushes, then closes the file using [closeTask] and frees the writer.
+    // The task gets false if any of the data couldn't be written.
+    void close(FSTask* closeTask);
+
+    // Returns true once a write has failed. After that, everything written
+    // is dropped and fibers waiting on the writer are resumed with false.
+    bool hasFailed() const { return failed_; }
+
+  private:
+    // Once this many bytes are buffered, they are written out.
+    static const int BUFFER_SIZE = 64 * 1024;
+
+    // A growable block of bytes.
+    struct Block
+    {
+      unsigned char* bytes;
+      int count;
+      int capacity;
+    };
+
+    static void writeCallback(uv_fs_t* request);
+
+    bool isIdle() const { return !isWriting_ && pending_.count == 0; }
+
+    // Starts writing the pending data, if there is any and a write isn't
+    // already in flight.
+    void startWrite();
+
+    // Writes whatever part of [writing_] hasn't been written yet.
+    void writeRemaining();
+
+    // Resumes the waiting fibers that can go now, oldest first.
+    void dispatch();
+
+    // Returns true if [task] no longer needs to wait.
+    bool isReady(WriteWaitTask* task) const;
+
+    void wait(gc<Fiber> fiber, bool untilIdle);
+    void removeWaiting(WriteWaitTask* task);
+
+    void finishClose();
+
+    uv_loop_t* loop_;
+    uv_file file_;
+
+    uv_fs_t request_;
+    bool isWriting_;
+    bool failed_;
+
+    // True while dispatch() is resuming fibers.
+    bool isDispatching_;
+
+    // The pending close, if the file has been closed.
+    FSTask* closeTask_;
+
+    // The data that will be written next.
+    Block pending_;
+
+    // The data being written now and how much of it has been written so far.
+    Block writing_;
+    int written_;
+
+    // The fibers waiting on this writer, in the order they started waiting.
+    WriteWaitTask* firstWaiting_;
+    WriteWaitTask* lastWaiting_;
+
+    NO_COPY(FileWriter);
+  };
+
+  // A fiber waiting for a FileWriter to have room or to finish writing.
+  class WriteWaitTask : public Task
+  {
+    friend class FileWriter;
+
+  public:
+    WriteWaitTask(gc<Fiber> fiber, FileWriter* writer, bool untilIdle);
+
+    virtual void kill();
+
+  private:
+    FileWriter* writer_;
+
+    // True if the fiber is waiting for everything to be written instead of
+    // just for room in the buffer.
+    bool untilIdle_;
+
+    WriteWaitTask* nextWaiting_;
+  };
+
   // A task using a uv_handle_t.
   class HandleTask : public Task
   {
@@ -64,14 +373,22 @@ namespace magpie
     uv_handle_t* handle_;
   };
 
+  // A mutable array of bytes. A buffer either stores its bytes inline, or is
+  // a view onto a range of some other buffer's bytes. Views are cheap to
+  // create and writing to one writes to the buffer it views.
   class BufferObject : public Object
   {
   public:
     static gc<BufferObject> create(int count);
 
+    // Creates a view of [count] bytes of [buffer] starting at [offset].
+    static gc<BufferObject> createView(gc<BufferObject> buffer, int offset,
+                                       int count);
+
     virtual gc<ClassObject> getClass(VM& vm) const;
 
     virtual gc<String> toString() const;
+    virtual void reach();
 
     int count() const { return count_; }
 
@@ -79,35 +396,124 @@ namespace magpie
     // current count. Does not free up memory, just logically shortens it.
     void truncate(int count);
 
-    // Gets a raw pointer to the buffer data.
-    void* data() { return bytes_; }
+    // Gets a raw pointer to the buffer data. Since buffers move during a
+    // collection, don't hold onto this across one.
+    unsigned char* data()
+    {
+      if (parent_.isNull()) return bytes_;
+      return parent_->bytes_ + offset_;
+    }
+
+    const unsigned char* data() const
+    {
+      if (parent_.isNull()) return bytes_;
+      return parent_->bytes_ + offset_;
+    }
+
+    // Calculates the CRC-32 checksum of [count] [bytes]. This doesn't touch
+    // the heap, so it's safe to call from any thread.
+    static unsigned int crc32(const unsigned char* bytes, int count);
     
-    unsigned char get(int index) { return bytes_[index]; }
-    void set(int index, unsigned char value) { bytes_[index] = value; }
+    unsigned char get(int index) { return data()[index]; }
+    void set(int index, unsigned char value) { data()[index] = value; }
+
+    // Finds the first occurrence of [value] at or after [start]. Returns -1
+    // if not found.
+    int indexOf(unsigned char value, int start);
+
+    // Finds the first occurrence of the bytes in [sequence] at or after
+    // [start]. Returns -1 if not found.
+    int indexOf(gc<BufferObject> sequence, int start);
+
+    // Compares the bytes of this buffer and [other] lexicographically.
+    // Returns -1, 0 or 1.
+    int compare(gc<BufferObject> other);
+
+    // Reads the [size]-byte integer at [offset].
+    int readInt(int offset, int size, bool isSigned, bool isBigEndian);
 
   private:
     BufferObject(int count)
     : Object(),
-      count_(count)
+      count_(count),
+      parent_(),
+      offset_(0)
     {}
 
     // Number of bytes in the buffer.
     int count_;
+
+    // The buffer this is a view of, or NULL if it owns its bytes. This is
+    // always a buffer that owns its bytes, never another view.
+    gc<BufferObject> parent_;
+
+    // Where this view's bytes start in the parent's.
+    int offset_;
+
     unsigned char bytes_[FLEXIBLE_SIZE];
   };
 
+  // A read-only buffer whose contents are a file mapped into memory. Only the
+  // object itself is on the GC heap, so collections don't copy the data. The
+  // file is unmapped when the buffer is closed or collected.
+  class MappedBufferObject : public Object
+  {
+  public:
+    // Maps the file at [path]. Returns NULL if it couldn't be mapped.
+    static gc<MappedBufferObject> create(gc<String> path);
+
+    virtual gc<ClassObject> getClass(VM& vm) const;
+    virtual gc<String> toString() const;
+    virtual void finalize();
+
+    bool isOpen() const { return file_ != NULL; }
+
+    // Gets the number of bytes in the buffer. Once closed, this is zero.
+    int count() const { return file_ == NULL ? 0 : file_->size(); }
+
+    const unsigned char* data() const { return file_->data(); }
+    unsigned char get(int index) const { return file_->data()[index]; }
+
+    // Unmaps the file.
+    void close();
+
+  private:
+    MappedBufferObject(MappedFile* file)
+    : Object(),
+      file_(file)
+    {}
+
+    MappedFile* file_;
+  };
+
   class FileObject : public Object
   {
   public:
-    static void open(gc<Fiber> fiber, gc<String> path);
+    static void open(gc<Fiber> fiber, gc<String> path, FileMode mode);
 
-    FileObject(uv_file file)
+    // Deletes the file at [path] and resumes [fiber] when done.
+    static void remove(gc<Fiber> fiber, gc<String> path);
+
+    FileObject(uv_file file, bool isWritable)
     : Object(),
       file_(file),
-      isOpen_(true)
+      isOpen_(true),
+      isWritable_(isWritable),
+      reader_(NULL),
+      writer_(NULL)
     {}
 
     bool isOpen() const { return isOpen_; }
+    bool isWritable() const { return isWritable_; }
+
+    // Gets the reader that streams this file or NULL if it isn't being
+    // streamed.
+    FileReader* reader() { return reader_; }
+
+    // Creates a stream that reads this file in chunks of [chunkSize] bytes.
+    // A file only has one reader, so if it is already being streamed, the
+    // new stream continues from where the other left off.
+    gc<StreamObject> streamBytes(gc<Fiber> fiber, int chunkSize);
 
     // Gets the size of this file and sends it to [fiber].
     void getSize(gc<Fiber> fiber);
@@ -116,7 +522,40 @@ namespace magpie
     // [fiber].
     void readBytes(gc<Fiber> fiber, int size);
 
-    // Closes this file and resumes [fiber] when done.
+    // Reads [size] bytes starting at [offset] and sends the result as a
+    // buffer to [fiber]. The buffer is shorter if the file ends first. Unlike
+    // readBytes(), this doesn't use or move the current position, so any
+    // number of these can be in flight at once. Data that has been written
+    // but not flushed isn't seen.
+    void readAt(gc<Fiber> fiber, int offset, int size);
+
+    // Reads each range described by the ints in [offsets] and [sizes] like
+    // readAt(), all at once, and sends [fiber] a list of the buffers.
+    void readRanges(gc<Fiber> fiber, gc<ListObject> offsets,
+                    gc<ListObject> sizes);
+
+    // Buffers [size] bytes of [data] to be written to this file. Returns true
+    // if [fiber] can keep running, or false if it has been suspended because
+    // too much data is waiting to be written. A suspended fiber is resumed
+    // with true, or false if writing has failed.
+    bool write(gc<Fiber> fiber, const void* data, int size);
+
+    // Writes out any buffered data. Returns true if there was none, or false
+    // if [fiber] has been suspended until it has all been written. A
+    // suspended fiber is resumed with true, or false if writing has failed.
+    bool flush(gc<Fiber> fiber);
+
+    // Returns true if data written to this file has been lost because the OS
+    // wouldn't take it.
+    bool hasWriteFailed() const;
+
+    // Tells the OS to commit what has been written so far to disk and resumes
+    // [fiber] when done. Does not flush buffered data first.
+    void sync(gc<Fiber> fiber);
+
+    // Closes this file and resumes [fiber] when done. Buffered data is written
+    // out first. The fiber gets true, or false if closing failed or some of
+    // the data written couldn't be.
     void close(gc<Fiber> fiber);
 
     virtual gc<ClassObject> getClass(VM& vm) const;
@@ -129,19 +568,34 @@ namespace magpie
     uv_file file_;
 
     bool isOpen_;
+    bool isWritable_;
+
+    FileReader* reader_;
+
+    // Created on the first write.
+    FileWriter* writer_;
   };
 
 
+  // A stream of the chunks of a file.
   class StreamObject : public Object
   {
   public:
-    StreamObject()
-    : Object()
+    StreamObject(gc<FileObject> file)
+    : Object(),
+      file_(file)
     {}
 
+    // Gets the next chunk and sends it to [fiber]. Returns the chunk if it's
+    // available now, otherwise suspends the fiber and returns NULL. Once the
+    // file is closed, the stream is done.
+    gc<Object> read(gc<Fiber> fiber);
+
     virtual gc<ClassObject> getClass(VM& vm) const;
     virtual gc<String> toString() const;
+    virtual void reach();
 
   private:
+    gc<FileObject> file_;
   };
 }
@@ -0,0 +1,674 @@
+#include <cstring>
+
+#include "Fiber.h"
+#include "ObjectIO.h"
+#include "ObjectNet.h"
+#include "VM.h"
+
+namespace magpie
+{
+  gc<SocketObject> asSocket(gc<Object> obj)
+  {
+    return static_cast<SocketObject*>(&(*obj));
+  }
+
+  gc<TcpServerObject> asTcpServer(gc<Object> obj)
+  {
+    return static_cast<TcpServerObject*>(&(*obj));
+  }
+
+  THREAD_LOCAL ReadBufferPool::Block* ReadBufferPool::free_;
+  THREAD_LOCAL int ReadBufferPool::numFree_;
+
+  char* ReadBufferPool::allocate()
+  {
+    if (free_ == NULL) return new char[BUFFER_SIZE];
+
+    Block* block = free_;
+    free_ = block->next;
+    numFree_--;
+    return reinterpret_cast<char*>(block);
+  }
+
+  void ReadBufferPool::free(char* buffer)
+  {
+    if (buffer == NULL) return;
+
+    if (numFree_ >= MAX_FREE)
+    {
+      delete [] buffer;
+      return;
+    }
+
+    Block* block = reinterpret_cast<Block*>(buffer);
+    block->next = free_;
+    free_ = block;
+    numFree_++;
+  }
+
+  void ReadBufferPool::trim()
+  {
+    while (free_ != NULL)
+    {
+      Block* block = free_;
+      free_ = block->next;
+      delete [] reinterpret_cast<char*>(block);
+    }
+
+    numFree_ = 0;
+  }
+
+  int ReadBufferPool::numFree()
+  {
+    return numFree_;
+  }
+
+  Connection::Connection(uv_loop_t* loop, ConnectionType type)
+  : isReading_(false),
+    isDone_(type == CONNECTION_WRITE_PIPE),
+    isClosed_(false),
+    failed_(false),
+    firstChunk_(NULL),
+    lastChunk_(NULL),
+    numChunks_(0),
+    firstWaiting_(NULL),
+    lastWaiting_(NULL)
+  {
+    if (type == CONNECTION_TCP)
+    {
+      uv_tcp_init(loop, &handle_.tcp);
+    }
+    else
+    {
+      uv_pipe_init(loop, &handle_.pipe, 0);
+    }
+
+    stream()->data = this;
+    updateRef();
+  }
+
+  void Connection::start()
+  {
+    updateReading();
+  }
+
+  gc<Object> Connection::read(gc<Fiber> fiber)
+  {
+    if (numChunks_ > 0)
+    {
+      gc<Object> chunk = take();
+
+      // Now that there is room, keep reading.
+      updateReading();
+      return chunk;
+    }
+
+    if (isDone_) return end(fiber->vm());
+
+    // Wait for something to come in.
+    SocketReadTask* task = new SocketReadTask(fiber, this);
+    if (lastWaiting_ == NULL)
+    {
+      firstWaiting_ = task;
+    }
+    else
+    {
+      lastWaiting_->nextWaiting_ = task;
+    }
+
+    lastWaiting_ = task;
+
+    updateRef();
+    return NULL;
+  }
+
+  bool Connection::write(gc<Fiber> fiber, const void* data, int size)
+  {
+    SocketWriteTask* task = new SocketWriteTask(fiber, data, size);
+    if (task->start(stream())) return true;
+
+    task->cancel();
+    return false;
+  }
+
+  void Connection::close()
+  {
+    if (isClosed_) return;
+
+    isClosed_ = true;
+    isDone_ = true;
+
+    // Throw away anything read ahead.
+    while (firstChunk_ != NULL)
+    {
+      Chunk* chunk = firstChunk_;
+      firstChunk_ = chunk->next;
+      ReadBufferPool::free(chunk->bytes);
+      delete chunk;
+    }
+
+    lastChunk_ = NULL;
+    numChunks_ = 0;
+
+    uv_close(reinterpret_cast<uv_handle_t*>(&handle_), closeCallback);
+  }
+
+  uv_buf_t Connection::allocCallback(uv_handle_t* handle,
+                                     size_t suggestedSize)
+  {
+    return uv_buf_init(ReadBufferPool::allocate(),
+                       ReadBufferPool::BUFFER_SIZE);
+  }
+
+  void Connection::readCallback(uv_stream_t* stream, ssize_t count,
+                                uv_buf_t buf)
+  {
+    Connection* connection = static_cast<Connection*>(stream->data);
+
+    if (count > 0)
+    {
+      Chunk* chunk = new Chunk();
+      chunk->bytes = buf.base;
+      chunk->count = static_cast<int>(count);
+      chunk->next = NULL;
+
+      if (connection->lastChunk_ == NULL)
+      {
+        connection->firstChunk_ = chunk;
+      }
+      else
+      {
+        connection->lastChunk_->next = chunk;
+      }
+
+      connection->lastChunk_ = chunk;
+      connection->numChunks_++;
+    }
+    else
+    {
+      ReadBufferPool::free(buf.base);
+
+      // Zero means there was nothing to read after all. Otherwise, either the
+      // other end closed the connection or reading failed. Either way,
+      // libuv can't read from it any more.
+      if (count < 0)
+      {
+        connection->isDone_ = true;
+
+        uv_loop_t* loop = stream->loop;
+        if (uv_last_error(loop).code != UV_EOF) connection->failed_ = true;
+      }
+    }
+
+    connection->dispatch();
+    if (!connection->isClosed_) connection->updateReading();
+  }
+
+  void Connection::closeCallback(uv_handle_t* handle)
+  {
+    Connection* connection = static_cast<Connection*>(handle->data);
+
+    // Anyone still waiting gets done.
+    connection->dispatch();
+    delete connection;
+  }
+
+  void Connection::updateReading()
+  {
+    bool shouldRead = !isDone_ && numChunks_ < MAX_CHUNKS;
+    if (shouldRead == isReading_) return;
+
+    if (shouldRead)
+    {
+      uv_read_start(stream(), allocCallback, readCallback);
+    }
+    else
+    {
+      uv_read_stop(stream());
+    }
+
+    isReading_ = shouldRead;
+  }
+
+  void Connection::updateRef()
+  {
+    uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(&handle_);
+    if (firstWaiting_ != NULL)
+    {
+      uv_ref(handle);
+    }
+    else
+    {
+      uv_unref(handle);
+    }
+  }
+
+  void Connection::dispatch()
+  {
+    // Note that resuming a fiber may cause it to read from or close this
+    // connection. Closing doesn't free it until closeCallback(), so it's
+    // safe to keep going.
+    while (firstWaiting_ != NULL && (numChunks_ > 0 || isDone_))
+    {
+      SocketReadTask* task = firstWaiting_;
+      removeWaiting(task);
+
+      gc<Object> chunk;
+      if (numChunks_ > 0)
+      {
+        chunk = take();
+      }
+      else
+      {
+        chunk = end(task->fiber()->vm());
+      }
+
+      task->complete(chunk);
+    }
+
+    updateRef();
+  }
+
+  gc<Object> Connection::take()
+  {
+    Chunk* chunk = firstChunk_;
+    firstChunk_ = chunk->next;
+    if (firstChunk_ == NULL) lastChunk_ = NULL;
+    numChunks_--;
+
+    gc<BufferObject> buffer = BufferObject::create(chunk->count);
+    memcpy(buffer->data(), chunk->bytes, chunk->count);
+
+    ReadBufferPool::free(chunk->bytes);
+    delete chunk;
+
+    return buffer;
+  }
+
+  gc<Object> Connection::end(VM& vm)
+  {
+    if (failed_) return vm.nothing();
+    return vm.getBuiltIn(BUILT_IN_DONE);
+  }
+
+  void Connection::removeWaiting(SocketReadTask* task)
+  {
+    SocketReadTask* previous = NULL;
+    SocketReadTask* waiting = firstWaiting_;
+    while (waiting != NULL && waiting != task)
+    {
+      previous = waiting;
+      waiting = waiting->nextWaiting_;
+    }
+
+    if (waiting == NULL) return;
+
+    if (previous == NULL)
+    {
+      firstWaiting_ = task->nextWaiting_;
+    }
+    else
+    {
+      previous->nextWaiting_ = task->nextWaiting_;
+    }
+
+    if (lastWaiting_ == task) lastWaiting_ = previous;
+    task->nextWaiting_ = NULL;
+  }
+
+  SocketReadTask::SocketReadTask(gc<Fiber> fiber, Connection* connection)
+  : Task(fiber),
+    connection_(connection),
+    nextWaiting_(NULL)
+  {}
+
+  void SocketReadTask::kill()
+  {
+    connection_->removeWaiting(this);
+    connection_->updateRef();
+  }
+
+  SocketWriteTask::SocketWriteTask(gc<Fiber> fiber, const void* data,
+                                   int size)
+  : Task(fiber)
+  {
+    request_.data = this;
+
+    // The data may be in the GC heap, which can move before libuv is done
+    // with it, so take a copy.
+    buffer_ = uv_buf_init(new char[size > 0 ? size : 1], size);
+    memcpy(buffer_.base, data, size);
+  }
+
+  SocketWriteTask::~SocketWriteTask()
+  {
+    delete [] buffer_.base;
+  }
+
+  bool SocketWriteTask::start(uv_stream_t* stream)
+  {
+    return uv_write(&request_, stream, &buffer_, 1, writeCallback) == 0;
+  }
+
+  void SocketWriteTask::writeCallback(uv_write_t* request, int status)
+  {
+    SocketWriteTask* task = static_cast<SocketWriteTask*>(request->data);
+
+    if (task->isKilled())
+    {
+      task->complete(NULL);
+      return;
+    }
+
+    task->complete(task->fiber()->vm().getBool(status == 0));
+  }
+
+  ConnectTask::ConnectTask(gc<Fiber> fiber, Connection* connection)
+  : Task(fiber),
+    connection_(connection)
+  {
+    request_.data = this;
+  }
+
+  bool ConnectTask::start(struct sockaddr_in address)
+  {
+    return uv_tcp_connect(&request_,
+        reinterpret_cast<uv_tcp_t*>(connection_->stream()), address,
+        connectCallback) == 0;
+  }
+
+  void ConnectTask::connectCallback(uv_connect_t* request, int status)
+  {
+    ConnectTask* task = static_cast<ConnectTask*>(request->data);
+
+    // If it failed or no one is waiting for it anymore, throw it away.
+    if (status != 0 || task->isKilled())
+    {
+      task->connection_->close();
+      task->complete(NULL);
+      return;
+    }
+
+    task->complete(SocketObject::create(task->connection_));
+  }
+
+  TcpServer* TcpServer::listen(uv_loop_t* loop, const char* host, int port)
+  {
+    TcpServer* server = new TcpServer(loop);
+
+    // Note that libuv may defer reporting a bind error until listen.
+    uv_tcp_t* handle = &server->handle_;
+    if (uv_tcp_bind(handle, uv_ip4_addr(host, port)) != 0 ||
+        uv_listen(reinterpret_cast<uv_stream_t*>(handle), BACKLOG,
+                  connectionCallback) != 0)
+    {
+      server->close();
+      return NULL;
+    }
+
+    return server;
+  }
+
+  TcpServer::TcpServer(uv_loop_t* loop)
+  : loop_(loop),
+    isClosed_(false),
+    firstPending_(NULL),
+    lastPending_(NULL),
+    firstWaiting_(NULL),
+    lastWaiting_(NULL)
+  {
+    uv_tcp_init(loop, &handle_);
+    handle_.data = this;
+    updateRef();
+  }
+
+  int TcpServer::port()
+  {
+    struct sockaddr_in address;
+    int length = sizeof(address);
+    uv_tcp_getsockname(&handle_, reinterpret_cast<struct sockaddr*>(&address),
+                       &length);
+    return ntohs(address.sin_port);
+  }
+
+  gc<Object> TcpServer::accept(gc<Fiber> fiber)
+  {
+    if (firstPending_ != NULL)
+    {
+      Pending* pending = firstPending_;
+      firstPending_ = pending->next;
+      if (firstPending_ == NULL) lastPending_ = NULL;
+
+      Connection* connection = pending->connection;
+      delete pending;
+
+      if (connection == NULL) return fiber->vm().nothing();
+      return SocketObject::create(connection);
+    }
+
+    if (isClosed_) return fiber->vm().getBuiltIn(BUILT_IN_DONE);
+
+    AcceptTask* task = new AcceptTask(fiber, this);
+    if (lastWaiting_ == NULL)
+    {
+      firstWaiting_ = task;
+    }
+    else
+    {
+      lastWaiting_->nextWaiting_ = task;
+    }
+
+    lastWaiting_ = task;
+
+    updateRef();
+    return NULL;
+  }
+
+  void TcpServer::close()
+  {
+    if (isClosed_) return;
+    isClosed_ = true;
+
+    // Connections no one accepted are just dropped.
+    while (firstPending_ != NULL)
+    {
+      Pending* pending = firstPending_;
+      firstPending_ = pending->next;
+      if (pending->connection != NULL) pending->connection->close();
+      delete pending;
+    }
+
+    lastPending_ = NULL;
+
+    uv_close(reinterpret_cast<uv_handle_t*>(&handle_), closeCallback);
+  }
+
+  void TcpServer::connectionCallback(uv_stream_t* stream, int status)
+  {
+    TcpServer* server = static_cast<TcpServer*>(stream->data);
+
+    if (server->isClosed_) return;
+
+    // If the connection couldn't be accepted, queue up the error in its place.
+    // The server keeps listening, since the next one may work.
+    Connection* connection = NULL;
+    if (status == 0)
+    {
+      connection = new Connection(server->loop_, CONNECTION_TCP);
+      if (uv_accept(stream, connection->stream()) != 0)
+      {
+        connection->close();
+        connection = NULL;
+      }
+    }
+
+    Pending* pending = new Pending();
+    pending->connection = connection;
+    pending->next = NULL;
+
+    if (server->lastPending_ == NULL)
+    {
+      server->firstPending_ = pending;
+    }
+    else
+    {
+      server->lastPending_->next = pending;
+    }
+
+    server->lastPending_ = pending;
+
+    server->dispatch();
+  }
+
+  void TcpServer::closeCallback(uv_handle_t* handle)
+  {
+    TcpServer* server = static_cast<TcpServer*>(handle->data);
+
+    // Anyone still waiting gets done.
+    server->dispatch();
+    delete server;
+  }
+
+  void TcpServer::updateRef()
+  {
+    uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(&handle_);
+    if (firstWaiting_ != NULL)
+    {
+      uv_ref(handle);
+    }
+    else
+    {
+      uv_unref(handle);
+    }
+  }
+
+  void TcpServer::dispatch()
+  {
+    while (firstWaiting_ != NULL && (firstPending_ != NULL || isClosed_))
+    {
+      AcceptTask* task = firstWaiting_;
+      removeWaiting(task);
+
+      // Reuse accept() to take the oldest connection or get done.
+      task->complete(accept(task->fiber()));
+    }
+
+    updateRef();
+  }
+
+  void TcpServer::removeWaiting(AcceptTask* task)
+  {
+    AcceptTask* previous = NULL;
+    AcceptTask* waiting = firstWaiting_;
+    while (waiting != NULL && waiting != task)
+    {
+      previous = waiting;
+      waiting = waiting->nextWaiting_;
+    }
+
+    if (waiting == NULL) return;
+
+    if (previous == NULL)
+    {
+      firstWaiting_ = task->nextWaiting_;
+    }
+    else
+    {
+      previous->nextWaiting_ = task->nextWaiting_;
+    }
+
+    if (lastWaiting_ == task) lastWaiting_ = previous;
+    task->nextWaiting_ = NULL;
+  }
+
+  AcceptTask::AcceptTask(gc<Fiber> fiber, TcpServer* server)
+  : Task(fiber),
+    server_(server),
+    nextWaiting_(NULL)
+  {}
+
+  void AcceptTask::kill()
+  {
+    server_->removeWaiting(this);
+    server_->updateRef();
+  }
+
+  gc<SocketObject> SocketObject::create(Connection* connection)
+  {
+    gc<SocketObject> socket = new SocketObject(connection);
+    Memory::current().addFinalizer(&(*socket));
+
+    connection->start();
+    return socket;
+  }
+
+  bool SocketObject::connect(gc<Fiber> fiber, gc<String> host, int port)
+  {
+    Connection* connection = new Connection(fiber->scheduler().loop(),
+                                            CONNECTION_TCP);
+
+    ConnectTask* task = new ConnectTask(fiber, connection);
+    if (task->start(uv_ip4_addr(host->cString(), port))) return true;
+
+    connection->close();
+    task->cancel();
+    return false;
+  }
+
+  gc<ClassObject> SocketObject::getClass(VM& vm) const
+  {
+    return vm.socketClass();
+  }
+
+  gc<String> SocketObject::toString() const
+  {
+    return String::create(isOpen() ? "[socket]" : "[closed socket]");
+  }
+
+  void SocketObject::finalize()
+  {
+    close();
+  }
+
+  void SocketObject::close()
+  {
+    if (connection_ == NULL) return;
+
+    connection_->close();
+    connection_ = NULL;
+  }
+
+  gc<TcpServerObject> TcpServerObject::listen(uv_loop_t* loop,
+                                              gc<String> host, int port)
+  {
+    TcpServer* server = TcpServer::listen(loop, host->cString(), port);
+    if (server == NULL) return NULL;
+
+    gc<TcpServerObject> serverObj = new TcpServerObject(server);
+    Memory::current().addFinalizer(&(*serverObj));
+    return serverObj;
+  }
+
+  gc<ClassObject> TcpServerObject::getClass(VM& vm) const
+  {
+    return vm.tcpServerClass();
+  }
+
+  gc<String> TcpServerObject::toString() const
+  {
+    return String::create(isOpen() ? "[tcp server]" : "[closed tcp server]");
+  }
+
+  void TcpServerObject::finalize()
+  {
+    close();
+  }
+
+  void TcpServerObject::close()
+  {
+    if (server_ == NULL) return;
+
+    server_->close();
+    server_ = NULL;
+  }
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include "uv.h"
+
+#include "Macros.h"
+#include "Managed.h"
+#include "MagpieString.h"
+#include "Object.h"
+#include "Scheduler.h"
+
+namespace magpie
+{
+  class AcceptTask;
+  class Connection;
+  class SocketObject;
+  class SocketReadTask;
+  class TcpServer;
+  class TcpServerObject;
+
+  // Unsafe downcasting functions. These must *only* be called after the object
+  // has been verified as being the right type.
+  gc<SocketObject> asSocket(gc<Object> obj);
+  gc<TcpServerObject> asTcpServer(gc<Object> obj);
+
+  // A per-thread pool of the fixed-size buffers that sockets read into. With
+  // lots of connections, most reads are handed right to a waiting fiber, so
+  // a few buffers get reused over and over instead of allocating new ones.
+  class ReadBufferPool
+  {
+  public:
+    static const int BUFFER_SIZE = 64 * 1024;
+
+    static char* allocate();
+    static void free(char* buffer);
+
+    // Frees all of the unused buffers.
+    static void trim();
+
+    // Gets the number of unused buffers.
+    static int numFree();
+
+  private:
+    // Unused buffers beyond this are freed.
+    static const int MAX_FREE = 32;
+
+    struct Block
+    {
+      Block* next;
+    };
+
+    static THREAD_LOCAL Block* free_;
+    static THREAD_LOCAL int numFree_;
+  };
+
+  // The kinds of libuv streams a Connection can wrap.
+  enum ConnectionType
+  {
+    // A TCP socket.
+    CONNECTION_TCP,
+
+    // A pipe that is only read from, like a child process's stdout.
+    CONNECTION_READ_PIPE,
+
+    // A pipe that is only written to, like a child process's stdin.
+    CONNECTION_WRITE_PIPE
+  };
+
+  // An open stream to something else: a TCP connection, either accepted by a
+  // server or connected to one, or a pipe to a child process. Once it's open,
+  // it reads ahead into pooled buffers. After a few chunks are waiting for a
+  // fiber to take them, it stops reading until one does, so a slow consumer
+  // doesn't make it buffer without bound.
+  //
+  // This lives on the native heap (and not in the GC heap) since libuv holds
+  // onto the handle. It doesn't keep the event loop alive unless a fiber is
+  // waiting to read from it, so idle connections don't keep a program from
+  // ending.
+  class Connection
+  {
+    friend class SocketReadTask;
+
+  public:
+    Connection(uv_loop_t* loop, ConnectionType type);
+
+    uv_stream_t* stream() { return reinterpret_cast<uv_stream_t*>(&handle_); }
+
+    // Starts reading ahead.
+    void start();
+
+    // Gets the next chunk read from the connection as a BufferObject, done
+    // once the other end closes it, or nothing if reading from it failed.
+    // Write-only pipes are always done. If nothing has been read yet, suspends
+    // [fiber] until something is, sends it the chunk then, and returns NULL.
+    gc<Object> read(gc<Fiber> fiber);
+
+    // Copies [size] bytes of [data] and suspends [fiber] until they have been
+    // written. Resumes it with true if successful. Returns false if the write
+    // couldn't be started, in which case [fiber] isn't suspended.
+    bool write(gc<Fiber> fiber, const void* data, int size);
+
+    // Closes the connection. Fibers waiting to read from it get done. The
+    // connection frees itself once libuv is done with it.
+    void close();
+
+  private:
+    // The number of chunks that can be read ahead of the consumer.
+    static const int MAX_CHUNKS = 4;
+
+    struct Chunk
+    {
+      char* bytes;
+      int count;
+      Chunk* next;
+    };
+
+    static uv_buf_t allocCallback(uv_handle_t* handle, size_t suggestedSize);
+    static void readCallback(uv_stream_t* stream, ssize_t count, uv_buf_t buf);
+    static void closeCallback(uv_handle_t* handle);
+
+    // Starts or stops reading based on how much is already waiting.
+    void updateReading();
+
+    // Keeps the event loop alive only while someone is waiting on this.
+    void updateRef();
+
+    // Hands chunks to waiting fibers until there are no more of one or the
+    // other.
+    void dispatch();
+
+    // Removes the oldest chunk and copies it into a new BufferObject.
+    gc<Object> take();
+
+    // Gets what a read past the last chunk returns: done, or nothing if
+    // reading failed.
+    gc<Object> end(VM& vm);
+
+    void removeWaiting(SocketReadTask* task);
+
+    union
+    {
+      uv_tcp_t tcp;
+      uv_pipe_t pipe;
+    } handle_;
+
+    bool isReading_;
+
+    // True once the other end has closed the connection or this end has, or
+    // reading from it failed.
+    bool isDone_;
+    bool isClosed_;
+
+    // True if reading failed for some reason other than the other end closing
+    // the connection. Chunks read before that are still handed out.
+    bool failed_;
+
+    // The chunks read so far that no one has taken, oldest first.
+    Chunk* firstChunk_;
+    Chunk* lastChunk_;
+    int numChunks_;
+
+    // The fibers waiting for the next chunk, in the order they asked.
+    SocketReadTask* firstWaiting_;
+    SocketReadTask* lastWaiting_;
+
+    NO_COPY(Connection);
+  };
+
+  // A fiber waiting on a Connection for the next chunk.
+  class SocketReadTask : public Task
+  {
+    friend class Connection;
+
+  public:
+    SocketReadTask(gc<Fiber> fiber, Connection* connection);
+
+    virtual void kill();
+
+  private:
+    Connection* connection_;
+    SocketReadTask* nextWaiting_;
+  };
+
+  // A pending write to a socket. Owns a copy of the data being written.
+  class SocketWriteTask : public Task
+  {
+  public:
+    SocketWriteTask(gc<Fiber> fiber, const void* data, int size);
+    ~SocketWriteTask();
+
+    // Starts writing to [stream]. Returns false if libuv refused the write.
+    bool start(uv_stream_t* stream);
+
+    // A write can't be cancelled, so this waits for the callback.
+    virtual void kill() {}
+    virtual bool hasPendingCallback() const { return true; }
+
+  private:
+    static void writeCallback(uv_write_t* request, int status);
+
+    uv_write_t request_;
+    uv_buf_t buffer_;
+  };
+
+  // A fiber waiting to connect to a server.
+  class ConnectTask : public Task
+  {
+  public:
+    ConnectTask(gc<Fiber> fiber, Connection* connection);
+
+    // Starts connecting to [address]. Returns false if libuv refused.
+    bool start(struct sockaddr_in address);
+
+    virtual void kill() {}
+    virtual bool hasPendingCallback() const { return true; }
+
+  private:
+    static void connectCallback(uv_connect_t* request, int status);
+
+    uv_connect_t request_;
+    Connection* connection_;
+  };
+
+  // A listening TCP socket. Connections that come in before anyone accepts
+  // them are queued up. Like Connection, this lives on the native heap and
+  // only keeps the event loop alive while a fiber is waiting to accept.
+  class TcpServer
+  {
+    friend class AcceptTask;
+
+  public:
+    // Starts listening on [host] and [port]. If [port] is zero, the OS picks
+    // one. Returns NULL if it couldn't listen.
+    static TcpServer* listen(uv_loop_t* loop, const char* host, int port);
+
+    // Gets the port the server is listening on.
+    int port();
+
+    // Gets the next incoming connection as a SocketObject, nothing if
+    // accepting it failed, or done once the server is closed. If there isn't
+    // one yet, suspends [fiber] until there is and returns NULL.
+    gc<Object> accept(gc<Fiber> fiber);
+
+    // Stops listening and closes any connections no one accepted. Fibers
+    // waiting to accept get done. The server frees itself once libuv is done
+    // with it.
+    void close();
+
+  private:
+    // How many pending connections the OS will queue up.
+    static const int BACKLOG = 511;
+
+    struct Pending
+    {
+      // NULL if the connection couldn't be accepted, so that the error is
+      // reported to whoever would have gotten it.
+      Connection* connection;
+      Pending* next;
+    };
+
+    TcpServer(uv_loop_t* loop);
+
+    static void connectionCallback(uv_stream_t* stream, int status);
+    static void closeCallback(uv_handle_t* handle);
+
+    void updateRef();
+    void dispatch();
+    void removeWaiting(AcceptTask* task);
+
+    uv_loop_t* loop_;
+    uv_tcp_t handle_;
+    bool isClosed_;
+
+    // Connections that have come in but haven't been accepted yet.
+    Pending* firstPending_;
+    Pending* lastPending_;
+
+    // The fibers waiting to accept, in the order they asked.
+    AcceptTask* firstWaiting_;
+    AcceptTask* lastWaiting_;
+
+    NO_COPY(TcpServer);
+  };
+
+  // A fiber waiting on a TcpServer for the next connection.
+  class AcceptTask : public Task
+  {
+    friend class TcpServer;
+
+  public:
+    AcceptTask(gc<Fiber> fiber, TcpServer* server);
+
+    virtual void kill();
+
+  private:
+    TcpServer* server_;
+    AcceptTask* nextWaiting_;
+  };
+
+  class SocketObject : public Object
+  {
+  public:
+    // Creates a socket for [connection] and starts reading from it.
+    static gc<SocketObject> create(Connection* connection);
+
+    // Connects to [host] and [port] and resumes [fiber] with the socket, or
+    // nothing if it couldn't connect. Returns false if the connection
+    // couldn't even be started, in which case [fiber] isn't suspended.
+    static bool connect(gc<Fiber> fiber, gc<String> host, int port);
+
+    virtual gc<ClassObject> getClass(VM& vm) const;
+    virtual gc<String> toString() const;
+    virtual void finalize();
+
+    bool isOpen() const { return connection_ != NULL; }
+    Connection* connection() { return connection_; }
+
+    void close();
+
+  private:
+    SocketObject(Connection* connection)
+    : Object(),
+      connection_(connection)
+    {}
+
+    Connection* connection_;
+  };
+
+  class TcpServerObject : public Object
+  {
+  public:
+    // Starts listening. Returns NULL if it couldn't.
+    static gc<TcpServerObject> listen(uv_loop_t* loop, gc<String> host,
+                                      int port);
+
+    virtual gc<ClassObject> getClass(VM& vm) const;
+    virtual gc<String> toString() const;
+    virtual void finalize();
+
+    bool isOpen() const { return server_ != NULL; }
+    TcpServer* server() { return server_; }
+
+    void close();
+
+  private:
+    TcpServerObject(TcpServer* server)
+    : Object(),
+      server_(server)
+    {}
+
+    TcpServer* server_;
+  };
+}
@@ -0,0 +1,278 @@
+#include <cstring>
+
+#include "Fiber.h"
+#include "ObjectProcess.h"
+#include "VM.h"
+
+namespace magpie
+{
+  gc<ProcessObject> asProcess(gc<Object> obj)
+  {
+    return static_cast<ProcessObject*>(&(*obj));
+  }
+
+  // Copies the strings in [list] into a NULL-terminated array, optionally
+  // preceded by [first]. The caller owns the result and must free it with
+  // freeStrings().
+  static char** copyStrings(gc<String> first, gc<ListObject> list)
+  {
+    int count = list->elements().count();
+    int start = first.isNull() ? 0 : 1;
+
+    char** strings = new char*[start + count + 1];
+    if (!first.isNull())
+    {
+      strings[0] = new char[first->length() + 1];
+      strcpy(strings[0], first->cString());
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      gc<String> string = asString(list->elements()[i]);
+      strings[start + i] = new char[string->length() + 1];
+      strcpy(strings[start + i], string->cString());
+    }
+
+    strings[start + count] = NULL;
+    return strings;
+  }
+
+  static void freeStrings(char** strings)
+  {
+    if (strings == NULL) return;
+
+    for (char** string = strings; *string != NULL; string++)
+    {
+      delete [] *string;
+    }
+
+    delete [] strings;
+  }
+
+  ChildProcess* ChildProcess::spawn(uv_loop_t* loop, gc<String> command,
+                                    gc<ListObject> args, gc<ListObject> env,
+                                    gc<String> cwd, Connection* stdio[3])
+  {
+    // The strings may be in the GC heap, and libuv wants NULL-terminated
+    // arrays anyway, so copy them.
+    char** argv = copyStrings(command, args);
+    char** envp = env.isNull() ? NULL : copyStrings(NULL, env);
+
+    // The child reads from stdin and writes to stdout and stderr.
+    uv_stdio_container_t containers[3];
+    for (int i = 0; i < 3; i++)
+    {
+      containers[i].flags = static_cast<uv_stdio_flags>(UV_CREATE_PIPE |
+          (i == 0 ? UV_READABLE_PIPE : UV_WRITABLE_PIPE));
+      containers[i].data.stream = stdio[i]->stream();
+    }
+
+    uv_process_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.exit_cb = exitCallback;
+    options.file = argv[0];
+    options.args = argv;
+    options.env = envp;
+    options.cwd = cwd.isNull() ? NULL : const_cast<char*>(cwd->cString());
+    options.stdio_count = 3;
+    options.stdio = containers;
+
+    ChildProcess* process = new ChildProcess();
+    int error = uv_spawn(loop, &process->handle_, options);
+
+    freeStrings(argv);
+    freeStrings(envp);
+
+    if (error != 0)
+    {
+      // The handle is still initialized, so it has to be closed before it can
+      // be freed.
+      process->isReleased_ = true;
+      uv_close(reinterpret_cast<uv_handle_t*>(&process->handle_),
+               closeCallback);
+      return NULL;
+    }
+
+    process->updateRef();
+    return process;
+  }
+
+  ChildProcess::ChildProcess()
+  : isExited_(false),
+    exitCode_(0),
+    isClosed_(false),
+    isReleased_(false),
+    waiting_(NULL),
+    waitingTail_(&waiting_)
+  {
+    handle_.data = this;
+  }
+
+  gc<Object> ChildProcess::wait(gc<Fiber> fiber)
+  {
+    if (isExited_) return new IntObject(exitCode_);
+
+    ProcessWaitTask* task = new ProcessWaitTask(fiber, this);
+    *waitingTail_ = task;
+    waitingTail_ = &task->nextWaiting_;
+
+    updateRef();
+    return NULL;
+  }
+
+  bool ChildProcess::kill(int signal)
+  {
+    if (isExited_) return true;
+    return uv_process_kill(&handle_, signal) == 0;
+  }
+
+  void ChildProcess::release()
+  {
+    if (isClosed_)
+    {
+      delete this;
+      return;
+    }
+
+    isReleased_ = true;
+  }
+
+  void ChildProcess::exitCallback(uv_process_t* handle, int exitStatus,
+                                  int termSignal)
+  {
+    ChildProcess* process = static_cast<ChildProcess*>(handle->data);
+
+    // Follow the shell's conventions for processes killed by a signal and
+    // commands that couldn't be run. libuv reports the latter as -1.
+    process->isExited_ = true;
+    if (termSignal != 0)
+    {
+      process->exitCode_ = 128 + termSignal;
+    }
+    else if (exitStatus == -1)
+    {
+      process->exitCode_ = 127;
+    }
+    else
+    {
+      process->exitCode_ = exitStatus;
+    }
+
+    // Resume the waiting fibers oldest first. One may end the program and
+    // kill the rest, which removes them from the list.
+    while (process->waiting_ != NULL)
+    {
+      ProcessWaitTask* task = process->waiting_;
+      process->waiting_ = task->nextWaiting_;
+      if (process->waiting_ == NULL)
+      {
+        process->waitingTail_ = &process->waiting_;
+      }
+
+      task->complete(new IntObject(process->exitCode_));
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(handle), closeCallback);
+  }
+
+  void ChildProcess::closeCallback(uv_handle_t* handle)
+  {
+    ChildProcess* process = static_cast<ChildProcess*>(handle->data);
+    process->isClosed_ = true;
+    if (process->isReleased_) delete process;
+  }
+
+  void ChildProcess::updateRef()
+  {
+    if (isExited_) return;
+
+    uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(&handle_);
+    if (waiting_ != NULL)
+    {
+      uv_ref(handle);
+    }
+    else
+    {
+      uv_unref(handle);
+    }
+  }
+
+  void ChildProcess::removeWaiting(ProcessWaitTask* task)
+  {
+    ProcessWaitTask** link = &waiting_;
+    while (*link != NULL)
+    {
+      if (*link == task)
+      {
+        *link = task->nextWaiting_;
+        if (waitingTail_ == &task->nextWaiting_) waitingTail_ = link;
+        return;
+      }
+
+      link = &(*link)->nextWaiting_;
+    }
+  }
+
+  ProcessWaitTask::ProcessWaitTask(gc<Fiber> fiber, ChildProcess* process)
+  : Task(fiber),
+    process_(process),
+    nextWaiting_(NULL)
+  {}
+
+  void ProcessWaitTask::kill()
+  {
+    process_->removeWaiting(this);
+    process_->updateRef();
+  }
+
+  gc<ProcessObject> ProcessObject::spawn(uv_loop_t* loop, gc<String> command,
+                                         gc<ListObject> args,
+                                         gc<ListObject> env, gc<String> cwd)
+  {
+    Connection* stdio[3];
+    stdio[0] = new Connection(loop, CONNECTION_WRITE_PIPE);
+    stdio[1] = new Connection(loop, CONNECTION_READ_PIPE);
+    stdio[2] = new Connection(loop, CONNECTION_READ_PIPE);
+
+    ChildProcess* process = ChildProcess::spawn(loop, command, args, env, cwd,
+                                                stdio);
+    if (process == NULL)
+    {
+      for (int i = 0; i < 3; i++) stdio[i]->close();
+      return NULL;
+    }
+
+    gc<ProcessObject> processObj = new ProcessObject(process);
+    Memory::current().addFinalizer(&(*processObj));
+
+    processObj->stdin_ = SocketObject::create(stdio[0]);
+    processObj->stdout_ = SocketObject::create(stdio[1]);
+    processObj->stderr_ = SocketObject::create(stdio[2]);
+    return processObj;
+  }
+
+  gc<ClassObject> ProcessObject::getClass(VM& vm) const
+  {
+    return vm.processClass();
+  }
+
+  gc<String> ProcessObject::toString() const
+  {
+    return String::format("[process %d]", process_->pid());
+  }
+
+  void ProcessObject::reach()
+  {
+    stdin_.reach();
+    stdout_.reach();
+    stderr_.reach();
+  }
+
+  void ProcessObject::finalize()
+  {
+    // The process keeps running. Its pipes are closed when their sockets are
+    // collected.
+    process_->release();
+    process_ = NULL;
+  }
+}
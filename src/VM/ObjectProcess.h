@@ -0,0 +1,133 @@
+#pragma once
+
+#include "uv.h"
+
+#include "Macros.h"
+#include "Managed.h"
+#include "MagpieString.h"
+#include "Object.h"
+#include "ObjectNet.h"
+#include "Scheduler.h"
+
+namespace magpie
+{
+  class ChildProcess;
+  class ProcessObject;
+  class ProcessWaitTask;
+
+  // Unsafe downcasting functions. These must *only* be called after the object
+  // has been verified as being the right type.
+  gc<ProcessObject> asProcess(gc<Object> obj);
+
+  // A child process started with uv_spawn(). Its stdio is connected to pipes
+  // that are wrapped in Connections separately, so this just tracks the
+  // process itself and the fibers waiting for it to exit.
+  //
+  // This lives on the native heap (and not in the GC heap) since libuv holds
+  // onto the handle. It is freed once both the process has exited and the
+  // ProcessObject for it has released it. Like sockets, it only keeps the
+  // event loop alive while a fiber is waiting for it.
+  class ChildProcess
+  {
+    friend class ProcessWaitTask;
+
+  public:
+    // Starts running [command] with [args] and connects its stdin, stdout and
+    // stderr to [stdio]. If [env] isn't NULL, it's a list of "NAME=value"
+    // strings that replace the current environment. If [cwd] isn't NULL, the
+    // process runs there. Returns NULL if the process couldn't be started.
+    static ChildProcess* spawn(uv_loop_t* loop, gc<String> command,
+                               gc<ListObject> args, gc<ListObject> env,
+                               gc<String> cwd, Connection* stdio[3]);
+
+    int pid() const { return handle_.pid; }
+    bool isRunning() const { return !isExited_; }
+
+    // Gets the process's exit code. If it hasn't exited yet, suspends [fiber]
+    // until it does, sends it the code then, and returns NULL.
+    gc<Object> wait(gc<Fiber> fiber);
+
+    // Sends [signal] to the process if it's still running. Returns false if
+    // the signal couldn't be sent.
+    bool kill(int signal);
+
+    // Called when the ProcessObject for this is collected.
+    void release();
+
+  private:
+    ChildProcess();
+
+    static void exitCallback(uv_process_t* handle, int exitStatus,
+                             int termSignal);
+    static void closeCallback(uv_handle_t* handle);
+
+    void updateRef();
+    void removeWaiting(ProcessWaitTask* task);
+
+    uv_process_t handle_;
+
+    bool isExited_;
+    int exitCode_;
+
+    // True once libuv is done with the handle.
+    bool isClosed_;
+
+    // True once the ProcessObject is gone.
+    bool isReleased_;
+
+    // The fibers waiting for the process to exit, in the order they started
+    // waiting, and the link at the end of the list to append the next one to.
+    ProcessWaitTask* waiting_;
+    ProcessWaitTask** waitingTail_;
+
+    NO_COPY(ChildProcess);
+  };
+
+  // A fiber waiting for a ChildProcess to exit.
+  class ProcessWaitTask : public Task
+  {
+    friend class ChildProcess;
+
+  public:
+    ProcessWaitTask(gc<Fiber> fiber, ChildProcess* process);
+
+    virtual void kill();
+
+  private:
+    ChildProcess* process_;
+    ProcessWaitTask* nextWaiting_;
+  };
+
+  class ProcessObject : public Object
+  {
+  public:
+    // Starts a child process. See ChildProcess::spawn(). Returns NULL if it
+    // couldn't be started.
+    static gc<ProcessObject> spawn(uv_loop_t* loop, gc<String> command,
+                                   gc<ListObject> args, gc<ListObject> env,
+                                   gc<String> cwd);
+
+    virtual gc<ClassObject> getClass(VM& vm) const;
+    virtual gc<String> toString() const;
+    virtual void reach();
+    virtual void finalize();
+
+    ChildProcess* process() { return process_; }
+
+    // The pipes connected to the process's stdio, as sockets.
+    gc<SocketObject> stdinPipe() { return stdin_; }
+    gc<SocketObject> stdoutPipe() { return stdout_; }
+    gc<SocketObject> stderrPipe() { return stderr_; }
+
+  private:
+    ProcessObject(ChildProcess* process)
+    : Object(),
+      process_(process)
+    {}
+
+    ChildProcess* process_;
+    gc<SocketObject> stdin_;
+    gc<SocketObject> stdout_;
+    gc<SocketObject> stderr_;
+  };
+}
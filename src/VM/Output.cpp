@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Output.h"
+#include "Scheduler.h"
+
+namespace magpie
+{
+  Output::Output(int fd)
+  : fd_(fd),
+    stream_(NULL),
+    isTty_(false),
+    buffer_(new char[BLOCK_SIZE]),
+    count_(0),
+    inFlight_(0),
+    isBroken_(false),
+    waiting_(NULL),
+    waitingTail_(&waiting_)
+  {}
+
+  Output::~Output()
+  {
+    delete [] buffer_;
+  }
+
+  void Output::start(uv_loop_t* loop)
+  {
+    switch (uv_guess_handle(fd_))
+    {
+      case UV_TTY:
+        uv_tty_init(loop, &tty_, fd_, 0);
+        uv_tty_set_mode(&tty_, 0);
+        stream_ = reinterpret_cast<uv_stream_t*>(&tty_);
+        isTty_ = true;
+        break;
+
+      case UV_NAMED_PIPE:
+        uv_pipe_init(loop, &pipe_, 0);
+        uv_pipe_open(&pipe_, fd_);
+        stream_ = reinterpret_cast<uv_stream_t*>(&pipe_);
+        break;
+
+      default:
+        // Files and anything else are written directly.
+        break;
+    }
+  }
+
+  void Output::stop()
+  {
+    if (isTty_) uv_tty_reset_mode();
+  }
+
+  void Output::write(const char* text, int length)
+  {
+    while (length > 0)
+    {
+      int size = BLOCK_SIZE - count_;
+      if (size > length) size = length;
+
+      memcpy(buffer_ + count_, text, size);
+      count_ += size;
+      text += size;
+      length -= size;
+
+      if (count_ == BLOCK_SIZE) flush();
+    }
+  }
+
+  void Output::write(const char* text)
+  {
+    write(text, static_cast<int>(strlen(text)));
+  }
+
+  void Output::write(gc<String> text)
+  {
+    write(text->cString(), text->length());
+  }
+
+  void Output::flush()
+  {
+    if (count_ == 0) return;
+
+    if (stream_ == NULL)
+    {
+      writeSync(buffer_, count_);
+      count_ = 0;
+      return;
+    }
+
+    // There's no one left to read it.
+    if (isBroken_)
+    {
+      count_ = 0;
+      return;
+    }
+
+    // Hand the filled block off to libuv and start a new one.
+    WriteRequest* request = new WriteRequest();
+    request->request.data = request;
+    request->output = this;
+    request->buffer.base = buffer_;
+    request->buffer.len = count_;
+
+    inFlight_ += count_;
+    buffer_ = new char[BLOCK_SIZE];
+    count_ = 0;
+
+    if (uv_write(&request->request, stream_, &request->buffer, 1,
+                 writeCallback) != 0)
+    {
+      // If libuv won't take it, don't lose it.
+      writeSync(request->buffer.base, request->buffer.len);
+      inFlight_ -= request->buffer.len;
+      delete [] request->buffer.base;
+      delete request;
+    }
+  }
+
+  void Output::wait(OutputWaitTask* task)
+  {
+    task->nextWaiting_ = NULL;
+    *waitingTail_ = task;
+    waitingTail_ = &task->nextWaiting_;
+  }
+
+  void Output::removeWaiting(OutputWaitTask* task)
+  {
+    OutputWaitTask** link = &waiting_;
+    while (*link != NULL)
+    {
+      if (*link == task)
+      {
+        *link = task->nextWaiting_;
+        if (waitingTail_ == &task->nextWaiting_) waitingTail_ = link;
+        return;
+      }
+
+      link = &(*link)->nextWaiting_;
+    }
+  }
+
+  void Output::writeCallback(uv_write_t* request, int status)
+  {
+    WriteRequest* write = static_cast<WriteRequest*>(request->data);
+    Output* output = write->output;
+
+    // If the stream won't take this block, it won't take the later ones
+    // either, so stop sending them. Blocks already sent will fail too, and
+    // still come back through here to be freed.
+    if (status != 0) output->isBroken_ = true;
+
+    output->inFlight_ -= write->buffer.len;
+    delete [] write->buffer.base;
+    delete write;
+
+    // Wake up waiting fibers one at a time, oldest first. Each one may write
+    // more and back the output up again, or end the program and kill the
+    // rest.
+    while (output->waiting_ != NULL && !output->isBackedUp())
+    {
+      OutputWaitTask* task = output->waiting_;
+      output->waiting_ = task->nextWaiting_;
+      if (output->waiting_ == NULL) output->waitingTail_ = &output->waiting_;
+      task->complete(task->value_);
+    }
+  }
+
+  void Output::writeSync(const char* data, int length)
+  {
+    FILE* file = fd_ == 2 ? stderr : stdout;
+    fwrite(data, 1, length, file);
+    fflush(file);
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "uv.h"
+
+#include "Macros.h"
+#include "MagpieString.h"
+
+namespace magpie
+{
+  class OutputWaitTask;
+
+  // Buffers text written to stdout or stderr and hands it to libuv in large
+  // blocks, so that printing doesn't cost a system call per line. Everything
+  // written to one Output comes out in the order it was written.
+  //
+  // The scheduler flushes it whenever it runs out of fibers to run, so output
+  // shows up before the program blocks on anything. When the output is a
+  // terminal, it's also flushed every time a fiber suspends so that prompts
+  // appear right away.
+  class Output
+  {
+  public:
+    // Writes are sent to libuv in blocks of this many bytes.
+    static const int BLOCK_SIZE = 64 * 1024;
+
+    // Once this many bytes have been sent but not written yet, the fiber
+    // writing more has to wait for some of it to drain.
+    static const int MAX_IN_FLIGHT = 4 * BLOCK_SIZE;
+
+    Output(int fd);
+    ~Output();
+
+    // Starts writing through [loop]. Until this is called, and when the
+    // output isn't a terminal or pipe (for example a regular file), flushes
+    // write directly.
+    void start(uv_loop_t* loop);
+
+    // Restores the terminal, if there is one.
+    void stop();
+
+    // Returns true if the output is a terminal.
+    bool isInteractive() const { return isTty_; }
+
+    void write(const char* text, int length);
+    void write(const char* text);
+    void write(gc<String> text);
+
+    // Sends everything buffered so far to be written. Once a write to the
+    // stream has failed, it is thrown away instead.
+    void flush();
+
+    // Returns true if writers should wait before writing more.
+    bool isBackedUp() const { return inFlight_ >= MAX_IN_FLIGHT; }
+
+    // Suspends [task]'s fiber until the output is no longer backed up.
+    void wait(OutputWaitTask* task);
+    void removeWaiting(OutputWaitTask* task);
+
+  private:
+    struct WriteRequest
+    {
+      uv_write_t request;
+      Output*    output;
+      uv_buf_t   buffer;
+    };
+
+    static void writeCallback(uv_write_t* request, int status);
+
+    // Writes [length] bytes directly, without going through libuv.
+    void writeSync(const char* data, int length);
+
+    int fd_;
+
+    // The stream writes are sent to, or NULL if they are written directly.
+    uv_stream_t* stream_;
+    uv_tty_t tty_;
+    uv_pipe_t pipe_;
+    bool isTty_;
+
+    // The block being filled.
+    char* buffer_;
+    int count_;
+
+    // Number of bytes handed to libuv that haven't been written yet.
+    int inFlight_;
+
+    // True once libuv has failed to write to the stream, for example because
+    // the other end of the pipe was closed. After that, output is dropped
+    // instead of being queued for a stream that won't take it.
+    bool isBroken_;
+
+    // Fibers waiting for the output to drain, in the order they started
+    // waiting, and the link at the end of the list to append the next one to.
+    OutputWaitTask* waiting_;
+    OutputWaitTask** waitingTail_;
+
+    NO_COPY(Output);
+  };
+}
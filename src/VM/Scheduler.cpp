@@ -1,9 +1,12 @@
+#include <cstring>
+
 #include "uv.h"
 
 #include "Fiber.h"
 #include "Module.h"
 #include "Object.h"
 #include "ObjectIO.h"
+#include "ObjectNet.h"
 #include "Scheduler.h"
 #include "VM.h"
 
@@ -16,6 +19,14 @@ namespace magpie
 
   void Task::complete(gc<Object> returnValue)
   {
+    // If the program ended while this was waiting, there is no one to
+    // resume. The only thing left to do is free it.
+    if (isKilled_)
+    {
+      delete this;
+      return;
+    }
+
     // Unlink from the list. We do this before running the fiber so that if
     // the main fiber ends and kills all waiting fibers, it doesn't see this
     // one.
@@ -34,8 +45,15 @@ namespace magpie
     delete this;
   }
 
+  void Task::cancel()
+  {
+    fiber_->scheduler().tasks_.remove(this);
+    delete this;
+  }
+
   Task::Task(gc<Fiber> fiber)
   : fiber_(fiber),
+    isKilled_(false),
     prev_(NULL),
     next_(NULL)
   {
@@ -61,12 +79,24 @@ namespace magpie
   void TaskList::killAll()
   {
     Task* task = head_;
+    head_ = NULL;
+    tail_ = NULL;
+
     while (task != NULL)
     {
+      Task* next = task->next_;
+      task->prev_ = NULL;
+      task->next_ = NULL;
+
+      task->isKilled_ = true;
       task->kill();
-      task = task->next_;
+
+      // If libuv is still going to invoke the callback, complete() will free
+      // the task then.
+      if (!task->hasPendingCallback()) delete task;
+
+      task = next;
     }
-    // TODO(bob): Delete Tasks.
   }
 
   void TaskList::reach()
@@ -90,8 +120,88 @@ namespace magpie
     tail_ = task;
   }
 
+  void SleepTask::kill()
+  {
+    fiber()->scheduler().timers().remove(this);
+  }
+
+  void SleepTask::fire()
+  {
+    // Calling sleep() returns nothing.
+    complete(NULL);
+  }
+
+  void OutputWaitTask::kill()
+  {
+    output_.removeWaiting(this);
+  }
+
+  void OutputWaitTask::reach()
+  {
+    Task::reach();
+    value_.reach();
+  }
+
+  WorkTask::WorkTask(gc<Fiber> fiber)
+  : Task(fiber),
+    input_(NULL)
+  {
+    request_.data = this;
+  }
+
+  WorkTask::~WorkTask()
+  {
+    delete [] input_;
+  }
+
+  void WorkTask::start()
+  {
+    uv_queue_work(loop(), &request_, workCallback, afterWorkCallback);
+  }
+
+  void WorkTask::kill()
+  {
+    // If the work hasn't started yet, this keeps it from running at all.
+    // Either way, afterWorkCallback() will still be called.
+    uv_cancel(reinterpret_cast<uv_req_t*>(&request_));
+  }
+
+  const unsigned char* WorkTask::copyInput(const void* data, int size)
+  {
+    ASSERT(input_ == NULL, "Can only copy one input.");
+
+    input_ = new unsigned char[size > 0 ? size : 1];
+    memcpy(input_, data, size);
+    return input_;
+  }
+
+  void WorkTask::workCallback(uv_work_t* request)
+  {
+    static_cast<WorkTask*>(request->data)->work();
+  }
+
+  void WorkTask::afterWorkCallback(uv_work_t* request, int status)
+  {
+    WorkTask* task = static_cast<WorkTask*>(request->data);
+
+    // Don't bother building a result for a fiber that isn't there anymore.
+    if (task->isKilled())
+    {
+      task->complete(NULL);
+      return;
+    }
+
+    task->complete(task->finish());
+  }
+
   Scheduler::Scheduler(VM& vm)
-  : vm_(vm)
+  : vm_(vm),
+    loop_(NULL),
+    out_(1),
+    err_(2),
+    exitCode_(0),
+    timers_(),
+    nextFiberId_(0)
   {}
 
   void Scheduler::run(Array<Module*> modules)
@@ -109,10 +219,10 @@ namespace magpie
     // Initialize the event loop. This way modules can schedule events during
     // their initialization.
     loop_ = uv_loop_new();
+    timers_.start(loop_);
 
-    // Initialize the TTY.
-    uv_tty_init(loop_, &tty_, 1, 0);
-    uv_tty_set_mode(&tty_, 0);
+    out_.start(loop_);
+    err_.start(loop_);
 
     // Start running the first module.
     run(moduleFiber);
@@ -121,7 +231,22 @@ namespace magpie
     // events), start the event loop.
     uv_run(loop_);
 
-    uv_tty_reset_mode();
+    // Nothing will receive from this VM's mailboxes now.
+    vm_.mailboxes().detachAll();
+
+    // Write whatever is left. Running the loop again waits for it to finish
+    // and frees the mailboxes' handles.
+    flushOutput();
+    uv_run(loop_);
+
+    out_.stop();
+    err_.stop();
+
+    // Every task is done now, so there is nothing left to recycle.
+    TaskPool::trim();
+    ReadBufferPool::trim();
+
+    if (exitCode_ != 0) exit(exitCode_);
   }
 
   gc<Object> Scheduler::runModule(Module* module)
@@ -147,6 +272,7 @@ namespace magpie
           if (fiber->isMain())
           {
             tasks_.killAll();
+            flushOutput();
             return value;
           }
 
@@ -157,6 +283,11 @@ namespace magpie
           break;
 
         case FIBER_SUSPEND:
+          // Someone may be waiting to see what was printed before the fiber
+          // suspended, like a prompt before reading input.
+          if (out_.isInteractive()) out_.flush();
+          if (err_.isInteractive()) err_.flush();
+
           // Try to move on to the next fiber.
           fiber = getNext();
           break;
@@ -171,12 +302,25 @@ namespace magpie
           // TODO(bob): Kind of hackish.
           // TODO(bob): Give other fibers a chance to handle this.
           // If we got an uncaught error, exit with an error.
-          std::cerr << "Uncaught error." << std::endl;
-          exit(3);
-          break;
+          err_.write("Uncaught error.\n");
+
+          // Stop everything else and let the event loop finish writing the
+          // output before exiting.
+          exitCode_ = 3;
+          ready_.clear();
+          tasks_.killAll();
+          flushOutput();
+
+          // Without an event loop, there is nothing left to wait for.
+          if (loop_ == NULL) exit(exitCode_);
+          return value;
       }
     }
 
+    // Nothing else can run now, so make sure the output has been sent before
+    // waiting on events.
+    flushOutput();
+
     // TODO(bob): Should return value from first fiber, not whatever fiber
     // was last completed.
     return value;
@@ -192,25 +336,9 @@ namespace magpie
     ready_.add(fiber);
   }
 
-  static void timerCallback(uv_timer_t* handle, int status)
-  {
-    // TODO(bob): Check status.
-    Task* task = static_cast<Task*>(handle->data);
-
-    // Calling sleep() returns nothing.
-    task->complete(NULL);
-  }
-
   void Scheduler::sleep(gc<Fiber> fiber, int ms)
   {
-    // TODO(bob): We could allocate this on the GC heap and then just reach it
-    // as needed.
-    uv_timer_t* request = new uv_timer_t;
-    HandleTask* task = new HandleTask(fiber,
-                                      reinterpret_cast<uv_handle_t*>(request));
-
-    uv_timer_init(task->loop(), request);
-    uv_timer_start(request, timerCallback, ms, 0);
+    timers_.add(new SleepTask(fiber), ms);
   }
 
   void Scheduler::reach()
@@ -224,6 +352,12 @@ namespace magpie
     tasks_.add(task);
   }
 
+  void Scheduler::flushOutput()
+  {
+    out_.flush();
+    err_.flush();
+  }
+
   gc<Fiber> Scheduler::getNext()
   {
     if (ready_.count() == 0) return NULL;
@@ -4,6 +4,9 @@
 
 #include "Array.h"
 #include "Macros.h"
+#include "Output.h"
+#include "TaskPool.h"
+#include "TimerWheel.h"
 
 namespace magpie
 {
@@ -16,30 +19,59 @@ namespace magpie
   class FunctionObject;
   class Module;
   class Object;
+  class VM;
 
   // Wraps a Fiber that is waiting for an asynchronous event to complete. This
-  // is a manually memory managed doubly linked list.
+  // is a manually memory managed doubly linked list. Tasks are allocated from
+  // a TaskPool, so creating one for each operation is cheap.
   class Task
   {
     friend class TaskList;
 
   public:
+    static void* operator new(size_t size) { return TaskPool::allocate(size); }
+
+    static void operator delete(void* memory, size_t size)
+    {
+      TaskPool::free(memory, size);
+    }
+
     virtual ~Task() {}
     
     gc<Fiber> fiber() { return fiber_; }
 
     // Gets the main libuv loop this task will run on.
     uv_loop_t* loop();
-    
+
+    // Returns true if the task was killed and its fiber will never resume.
+    bool isKilled() const { return isKilled_; }
+
+    // Stops waiting on the event. Called when the program is ending and the
+    // task's fiber will never be resumed.
     virtual void kill() = 0;
+
+    // Returns true if libuv still holds onto this task and will invoke its
+    // callback even after kill() is called. If so, the task won't be freed
+    // until complete() is called. Otherwise, it is freed right after being
+    // killed.
+    virtual bool hasPendingCallback() const { return false; }
     
     // Completes the task. Removes it from the list of pending tasks and runs
     // the fiber (and any other fibers that are able to be run).
     //
+    // If the task has been killed, this just frees it.
+    //
     // This object will be freed at the end of this call. You cannot use it
     // after this returns!
     void complete(gc<Object> returnValue);
 
+    // Removes the task without resuming its fiber and frees it. Use this when
+    // whatever the fiber was waiting on happened some other way.
+    //
+    // This object will be freed at the end of this call. You cannot use it
+    // after this returns!
+    void cancel();
+
     virtual void reach();
 
   protected:
@@ -49,6 +81,7 @@ namespace magpie
 
   private:
     gc<Fiber> fiber_;
+    bool isKilled_;
 
     Task* prev_;
     Task* next_;
@@ -68,7 +101,8 @@ namespace magpie
     // Removes [waiting] from this list. Does not free it.
     void remove(Task* task);
 
-    // Cancel all waiting fibers so that the event loop can exit.
+    // Cancel all waiting fibers so that the event loop can exit. Frees every
+    // task that libuv won't call back into later.
     void killAll();
 
     // Reach all of the waiting fibers so they don't get collected.
@@ -79,6 +113,88 @@ namespace magpie
     Task* tail_;
   };
 
+  // A fiber that is sleeping until a timer expires.
+  class SleepTask : public Task, public Timer
+  {
+  public:
+    SleepTask(gc<Fiber> fiber)
+    : Task(fiber),
+      Timer()
+    {}
+
+    virtual void kill();
+    virtual void fire();
+  };
+
+  // A fiber that printed while the output was backed up and is waiting for
+  // it to drain. Returns the printed value when it resumes.
+  class OutputWaitTask : public Task
+  {
+    friend class Output;
+
+  public:
+    OutputWaitTask(gc<Fiber> fiber, Output& output, gc<Object> value)
+    : Task(fiber),
+      output_(output),
+      value_(value),
+      nextWaiting_(NULL)
+    {}
+
+    virtual void kill();
+    virtual void reach();
+
+  private:
+    Output& output_;
+    gc<Object> value_;
+    OutputWaitTask* nextWaiting_;
+  };
+
+  // A task that does CPU-heavy work on libuv's thread pool instead of on the
+  // fiber's thread, so that other fibers keep running in the meantime. To use
+  // it, subclass it, copy whatever input the work needs out of the GC heap in
+  // the constructor, and call start().
+  //
+  // work() runs on a worker thread. It must not touch the VM, the heap or any
+  // gc<> pointer, since the collector may move objects while it runs. Once it
+  // is done, finish() is called back on the fiber's thread to turn the result
+  // into an object, which is then returned to the fiber.
+  class WorkTask : public Task
+  {
+  public:
+    // Inputs smaller than this many bytes are faster to process inline than
+    // to hand off to another thread.
+    static const int MIN_OFFLOAD_SIZE = 64 * 1024;
+
+    virtual ~WorkTask();
+
+    // Queues the work on the thread pool.
+    void start();
+
+    virtual void kill();
+    virtual bool hasPendingCallback() const { return true; }
+
+  protected:
+    WorkTask(gc<Fiber> fiber);
+
+    // Copies [size] bytes from [data] into memory owned by this task, which
+    // will stay put until the task is freed. Use this to take the input out
+    // of a GC object before the work starts.
+    const unsigned char* copyInput(const void* data, int size);
+
+    // Does the work. Called on a worker thread.
+    virtual void work() = 0;
+
+    // Gets the result of the work. Called on the fiber's thread.
+    virtual gc<Object> finish() = 0;
+
+  private:
+    static void workCallback(uv_work_t* request);
+    static void afterWorkCallback(uv_work_t* request, int status);
+
+    uv_work_t request_;
+    unsigned char* input_;
+  };
+
   // The Fiber scheduler.
   class Scheduler
   {
@@ -87,7 +203,17 @@ namespace magpie
   public:
     Scheduler(VM& vm);
 
-    uv_tty_t* tty() { return &tty_; }
+    // The buffered stdout and stderr streams.
+    Output& out() { return out_; }
+    Output& err() { return err_; }
+
+    // Gets the libuv event loop. This is NULL until the scheduler starts
+    // running.
+    uv_loop_t* loop() { return loop_; }
+
+    // Gets the timer wheel used for sleeping and timeouts. Timers can only be
+    // added once the scheduler is running.
+    TimerWheel& timers() { return timers_; }
     
     void run(Array<Module*> modules);
 
@@ -105,15 +231,27 @@ namespace magpie
     void sleep(gc<Fiber> fiber, int ms);
     void reach();
 
+    // Gets a unique ID for a newly created fiber. IDs are only unique within
+    // a single VM.
+    int nextFiberId() { return nextFiberId_++; }
+
   private:
     void add(Task* task);
 
     void waitForOSEvents();
     gc<Fiber> getNext();
 
+    // Sends any buffered output on its way.
+    void flushOutput();
+
     VM& vm_;
     uv_loop_t *loop_;
-    uv_tty_t tty_;
+    Output out_;
+    Output err_;
+
+    // If a fiber has an uncaught error, this is set to the code the program
+    // will exit with once it has finished writing its output.
+    int exitCode_;
 
     // Fibers that are not blocked and can run now.
     Array<gc<Fiber> > ready_;
@@ -121,6 +259,10 @@ namespace magpie
     // Fibers that are waiting on an OS event to complete.
     TaskList tasks_;
 
+    TimerWheel timers_;
+
+    int nextFiberId_;
+
     NO_COPY(Scheduler);
   };
 }
@@ -0,0 +1,540 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "Serializer.h"
+#include "VM.h"
+#include "Mailbox.h"
+#include "Module.h"
+#include "Object.h"
+
+namespace magpie
+{
+  // The first byte of each serialized value says what kind of value it is.
+  enum SerialTag
+  {
+    SERIAL_NOTHING = 0,
+    SERIAL_DONE,
+    SERIAL_FALSE,
+    SERIAL_TRUE,
+    SERIAL_INT,       // Zigzag varint.
+    SERIAL_FLOAT,     // Raw 8-byte double.
+    SERIAL_CHAR,      // Varint code point.
+    SERIAL_STRING,    // Varint length, then the characters.
+    SERIAL_LIST,      // Varint count, then each element.
+    SERIAL_RECORD,    // Varint count, then each field name and value.
+    SERIAL_OBJECT,    // Class name, varint field count, then each field.
+    SERIAL_REF,       // Varint index of a previously read list or object.
+    SERIAL_MAILBOX    // Varint index into the message's mailboxes.
+  };
+
+  // Maps objects that have already been written to the order they were
+  // written in, so that later references to them can be written as
+  // back-references. This is a simple open-addressed hash table keyed on
+  // address, which is only safe because no GC can happen while serializing.
+  class IdentityTable
+  {
+  public:
+    IdentityTable()
+    : capacity_(0),
+      count_(0),
+      keys_(NULL),
+      values_(NULL)
+    {}
+
+    ~IdentityTable()
+    {
+      delete [] keys_;
+      delete [] values_;
+    }
+
+    // Gets the index of [object], or -1 if it hasn't been added.
+    int find(Object* object) const
+    {
+      if (capacity_ == 0) return -1;
+
+      for (int i = hash(object); ; i = (i + 1) & (capacity_ - 1))
+      {
+        if (keys_[i] == object) return values_[i];
+        if (keys_[i] == NULL) return -1;
+      }
+    }
+
+    // Adds [object] and returns the index assigned to it.
+    int add(Object* object)
+    {
+      // Keep the load factor under 1/2.
+      if ((count_ + 1) * 2 > capacity_) grow();
+
+      int i = hash(object);
+      while (keys_[i] != NULL) i = (i + 1) & (capacity_ - 1);
+
+      keys_[i] = object;
+      values_[i] = count_;
+      return count_++;
+    }
+
+  private:
+    int hash(Object* object) const
+    {
+      // Objects are at least pointer-aligned, so the low bits are useless.
+      size_t bits = reinterpret_cast<size_t>(object) >> 3;
+      return static_cast<int>(bits * 2654435761u) & (capacity_ - 1);
+    }
+
+    void grow()
+    {
+      int oldCapacity = capacity_;
+      Object** oldKeys = keys_;
+      int* oldValues = values_;
+
+      capacity_ = (capacity_ == 0) ? 16 : capacity_ * 2;
+      keys_ = new Object*[capacity_];
+      values_ = new int[capacity_];
+      for (int i = 0; i < capacity_; i++) keys_[i] = NULL;
+
+      for (int i = 0; i < oldCapacity; i++)
+      {
+        if (oldKeys[i] == NULL) continue;
+
+        int j = hash(oldKeys[i]);
+        while (keys_[j] != NULL) j = (j + 1) & (capacity_ - 1);
+        keys_[j] = oldKeys[i];
+        values_[j] = oldValues[i];
+      }
+
+      delete [] oldKeys;
+      delete [] oldValues;
+    }
+
+    int capacity_;
+    int count_;
+    Object** keys_;
+    int* values_;
+
+    NO_COPY(IdentityTable);
+  };
+
+  // Walks an object graph and writes it to a Message.
+  class MessageWriter
+  {
+  public:
+    MessageWriter(VM& vm, Message& message)
+    : vm_(vm),
+      message_(message),
+      written_()
+    {}
+
+    // Writes [value]. Returns false if it can't be serialized.
+    bool write(gc<Object> value);
+
+  private:
+    void writeVarint(unsigned int value);
+    void writeString(gc<String> text);
+
+    // Writes a back-reference if [object] has been written before. Otherwise
+    // remembers it and returns false.
+    bool writeRef(Object* object);
+
+    VM& vm_;
+    Message& message_;
+    IdentityTable written_;
+  };
+
+  // Rebuilds an object graph from a Message.
+  class MessageReader
+  {
+  public:
+    MessageReader(VM& vm, const Message& message)
+    : vm_(vm),
+      message_(message),
+      position_(0),
+      objects_()
+    {}
+
+    gc<Object> read();
+
+  private:
+    unsigned char readByte();
+    unsigned int readVarint();
+    gc<String> readString();
+
+    // Looks for a class named [name] with [numFields] fields in any module
+    // the VM has loaded.
+    gc<ClassObject> findClass(gc<String> name, int numFields);
+
+    VM& vm_;
+    const Message& message_;
+    int position_;
+
+    // The lists and objects read so far, in the order they were read, so
+    // that back-references can be resolved.
+    Array<gc<Object> > objects_;
+  };
+
+  Message::Message()
+  : data_(NULL),
+    size_(0),
+    capacity_(0),
+    mailboxes_(NULL),
+    numMailboxes_(0)
+  {}
+
+  Message::~Message()
+  {
+    for (int i = 0; i < numMailboxes_; i++) mailboxes_[i]->release();
+
+    free(data_);
+    free(mailboxes_);
+  }
+
+  void Message::write(unsigned char byte)
+  {
+    write(&byte, 1);
+  }
+
+  void Message::write(const void* bytes, int size)
+  {
+    if (size_ + size > capacity_)
+    {
+      int capacity = (capacity_ == 0) ? 64 : capacity_;
+      while (capacity < size_ + size) capacity *= 2;
+
+      data_ = static_cast<unsigned char*>(realloc(data_, capacity));
+      capacity_ = capacity;
+    }
+
+    memcpy(data_ + size_, bytes, size);
+    size_ += size;
+  }
+
+  int Message::addMailbox(Mailbox* mailbox)
+  {
+    for (int i = 0; i < numMailboxes_; i++)
+    {
+      if (mailboxes_[i] == mailbox) return i;
+    }
+
+    mailboxes_ = static_cast<Mailbox**>(
+        realloc(mailboxes_, sizeof(Mailbox*) * (numMailboxes_ + 1)));
+    mailboxes_[numMailboxes_] = mailbox;
+    mailbox->retain();
+
+    return numMailboxes_++;
+  }
+
+  Message* Serializer::serialize(VM& vm, gc<Object> value)
+  {
+    Message* message = new Message();
+    MessageWriter writer(vm, *message);
+
+    if (!writer.write(value))
+    {
+      delete message;
+      return NULL;
+    }
+
+    return message;
+  }
+
+  gc<Object> Serializer::deserialize(VM& vm, const Message& message)
+  {
+    MessageReader reader(vm, message);
+    return reader.read();
+  }
+
+  bool MessageWriter::write(gc<Object> value)
+  {
+    // Singletons.
+    if (value.sameAs(vm_.nothing()))
+    {
+      message_.write(SERIAL_NOTHING);
+      return true;
+    }
+
+    if (value.sameAs(vm_.getBuiltIn(BUILT_IN_DONE)))
+    {
+      message_.write(SERIAL_DONE);
+      return true;
+    }
+
+    gc<ClassObject> type = value->getClass(vm_);
+
+    if (type.sameAs(vm_.boolClass()))
+    {
+      message_.write(value->toBool() ? SERIAL_TRUE : SERIAL_FALSE);
+      return true;
+    }
+
+    if (type.sameAs(vm_.intClass()))
+    {
+      // Zigzag encode so that small negative numbers stay small.
+      int n = asInt(value);
+      message_.write(SERIAL_INT);
+      writeVarint((static_cast<unsigned int>(n) << 1) ^
+                  static_cast<unsigned int>(n >> 31));
+      return true;
+    }
+
+    if (type.sameAs(vm_.floatClass()))
+    {
+      double n = asFloat(value);
+      message_.write(SERIAL_FLOAT);
+      message_.write(&n, sizeof(double));
+      return true;
+    }
+
+    if (type.sameAs(vm_.characterClass()))
+    {
+      message_.write(SERIAL_CHAR);
+      writeVarint(asCharacter(value));
+      return true;
+    }
+
+    if (type.sameAs(vm_.stringClass()))
+    {
+      message_.write(SERIAL_STRING);
+      writeString(asString(value));
+      return true;
+    }
+
+    if (type.sameAs(vm_.mailboxClass()))
+    {
+      message_.write(SERIAL_MAILBOX);
+      writeVarint(message_.addMailbox(asMailbox(value)->mailbox()));
+      return true;
+    }
+
+    if (type.sameAs(vm_.listClass()))
+    {
+      if (writeRef(&*value)) return true;
+
+      Array<gc<Object> >& elements = asList(value)->elements();
+      message_.write(SERIAL_LIST);
+      writeVarint(elements.count());
+
+      for (int i = 0; i < elements.count(); i++)
+      {
+        if (!write(elements[i])) return false;
+      }
+
+      return true;
+    }
+
+    RecordObject* record = value->toRecord();
+    if (record != NULL)
+    {
+      gc<RecordType> recordType = record->type();
+      message_.write(SERIAL_RECORD);
+      writeVarint(recordType->numFields());
+
+      for (int i = 0; i < recordType->numFields(); i++)
+      {
+        symbolId symbol = recordType->getSymbol(i);
+        writeString(vm_.getSymbol(symbol));
+        if (!write(record->getField(symbol))) return false;
+      }
+
+      return true;
+    }
+
+    DynamicObject* object = value->toDynamic();
+    if (object != NULL)
+    {
+      if (writeRef(object)) return true;
+
+      gc<ClassObject> classObj = object->classObj();
+      message_.write(SERIAL_OBJECT);
+      writeString(classObj->name());
+      writeVarint(classObj->numFields());
+
+      for (int i = 0; i < classObj->numFields(); i++)
+      {
+        if (!write(object->getField(i))) return false;
+      }
+
+      return true;
+    }
+
+    // Functions, classes, channels, files, etc. are tied to their VM.
+    return false;
+  }
+
+  void MessageWriter::writeVarint(unsigned int value)
+  {
+    // Seven bits at a time, least significant first. The high bit is set on
+    // every byte but the last.
+    while (value >= 0x80)
+    {
+      message_.write(static_cast<unsigned char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+
+    message_.write(static_cast<unsigned char>(value));
+  }
+
+  void MessageWriter::writeString(gc<String> text)
+  {
+    writeVarint(text->length());
+    message_.write(text->cString(), text->length());
+  }
+
+  bool MessageWriter::writeRef(Object* object)
+  {
+    int index = written_.find(object);
+    if (index != -1)
+    {
+      message_.write(SERIAL_REF);
+      writeVarint(index);
+      return true;
+    }
+
+    written_.add(object);
+    return false;
+  }
+
+  gc<Object> MessageReader::read()
+  {
+    switch (readByte())
+    {
+      case SERIAL_NOTHING: return vm_.nothing();
+      case SERIAL_DONE: return vm_.getBuiltIn(BUILT_IN_DONE);
+      case SERIAL_FALSE: return vm_.getBool(false);
+      case SERIAL_TRUE: return vm_.getBool(true);
+
+      case SERIAL_INT:
+      {
+        unsigned int bits = readVarint();
+        return new IntObject(static_cast<int>((bits >> 1) ^ -(bits & 1)));
+      }
+
+      case SERIAL_FLOAT:
+      {
+        double value;
+        memcpy(&value, message_.data() + position_, sizeof(double));
+        position_ += sizeof(double);
+        return new FloatObject(value);
+      }
+
+      case SERIAL_CHAR:
+        return new CharacterObject(readVarint());
+
+      case SERIAL_STRING:
+        return new StringObject(readString());
+
+      case SERIAL_LIST:
+      {
+        int count = readVarint();
+
+        // Register the list before reading its elements so that they can
+        // refer back to it.
+        gc<ListObject> list = new ListObject(count);
+        objects_.add(list);
+
+        for (int i = 0; i < count; i++)
+        {
+          gc<Object> element = read();
+          if (element.isNull()) return NULL;
+          list->elements().add(element);
+        }
+
+        return list;
+      }
+
+      case SERIAL_RECORD:
+      {
+        int count = readVarint();
+
+        Array<int> fields;
+        Array<gc<Object> > values;
+        for (int i = 0; i < count; i++)
+        {
+          fields.add(vm_.addSymbol(readString()));
+
+          gc<Object> value = read();
+          if (value.isNull()) return NULL;
+          values.add(value);
+        }
+
+        int type = vm_.addRecordType(fields);
+        return RecordObject::create(vm_.getRecordType(type), values, 0);
+      }
+
+      case SERIAL_OBJECT:
+      {
+        gc<String> name = readString();
+        int numFields = readVarint();
+
+        gc<ClassObject> classObj = findClass(name, numFields);
+        if (classObj.isNull()) return NULL;
+
+        gc<DynamicObject> object = DynamicObject::create(classObj);
+        objects_.add(object);
+
+        for (int i = 0; i < numFields; i++)
+        {
+          gc<Object> field = read();
+          if (field.isNull()) return NULL;
+          object->setField(i, field);
+        }
+
+        return object;
+      }
+
+      case SERIAL_REF:
+        return objects_[readVarint()];
+
+      case SERIAL_MAILBOX:
+        return vm_.mailboxes().wrap(message_.mailboxes_[readVarint()]);
+    }
+
+    ASSERT(false, "Unknown serialization tag.");
+    return NULL;
+  }
+
+  unsigned char MessageReader::readByte()
+  {
+    ASSERT_INDEX(position_, message_.size());
+    return message_.data()[position_++];
+  }
+
+  unsigned int MessageReader::readVarint()
+  {
+    unsigned int value = 0;
+    int shift = 0;
+    while (true)
+    {
+      unsigned char byte = readByte();
+      value |= static_cast<unsigned int>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return value;
+      shift += 7;
+    }
+  }
+
+  gc<String> MessageReader::readString()
+  {
+    int length = readVarint();
+    gc<String> text = String::create(
+        reinterpret_cast<const char*>(message_.data() + position_), length);
+    position_ += length;
+    return text;
+  }
+
+  gc<ClassObject> MessageReader::findClass(gc<String> name, int numFields)
+  {
+    for (int i = 0; i < vm_.numModules(); i++)
+    {
+      Module* module = vm_.getModule(i);
+      int index = module->findVariable(name);
+      if (index == -1) continue;
+
+      gc<Object> value = module->getVariable(index);
+      if (value.isNull()) continue;
+      if (!value->getClass(vm_).sameAs(vm_.classClass())) continue;
+
+      gc<ClassObject> classObj = asClass(value);
+      if (classObj->numFields() == numFields) return classObj;
+    }
+
+    return NULL;
+  }
+}
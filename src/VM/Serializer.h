@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Macros.h"
+#include "Managed.h"
+
+namespace magpie
+{
+  class Mailbox;
+  class Object;
+  class VM;
+
+  // An object graph that has been flattened into a contiguous byte buffer so
+  // it can be handed to a VM with a different heap. Messages live on the
+  // native heap and are owned by whoever currently holds them.
+  class Message
+  {
+    friend class MessageReader;
+    friend class MessageWriter;
+    friend class Serializer;
+
+  public:
+    ~Message();
+
+    // Gets the serialized bytes.
+    const unsigned char* data() const { return data_; }
+
+    // Gets the number of serialized bytes.
+    int size() const { return size_; }
+
+  private:
+    Message();
+
+    void write(unsigned char byte);
+    void write(const void* bytes, int size);
+
+    // Appends [mailbox] to the list of mailboxes this message keeps alive and
+    // returns its index in that list.
+    int addMailbox(Mailbox* mailbox);
+
+    unsigned char* data_;
+    int size_;
+    int capacity_;
+
+    // Mailboxes referred to by the message. It holds a reference to each of
+    // these so that they outlive the message even if every VM that had them
+    // lets go while it's in flight.
+    Mailbox** mailboxes_;
+    int numMailboxes_;
+
+    NO_COPY(Message);
+  };
+
+  // Converts object graphs to and from Messages.
+  //
+  // Ints, floats, bools, characters, strings, nothing and done are copied by
+  // value. Lists and instances of user-defined classes are copied with their
+  // identity intact, so shared and cyclic references survive the trip.
+  // Records are values, so they are copied each time they are reached.
+  // Mailboxes are sent by reference. Anything else (functions, classes,
+  // channels, files, ...) can't leave its VM.
+  class Serializer
+  {
+  public:
+    // Flattens the graph reachable from [value]. Returns NULL if the graph
+    // contains an object that can't be sent.
+    //
+    // This must not be interrupted by a garbage collection since it tracks
+    // objects by their address.
+    static Message* serialize(VM& vm, gc<Object> value);
+
+    // Rebuilds the object graph in [message] on [vm]'s heap. Returns NULL if
+    // the message refers to a class that [vm] doesn't have.
+    static gc<Object> deserialize(VM& vm, const Message& message);
+  };
+}
@@ -0,0 +1,72 @@
+#include <new>
+
+#include "TaskPool.h"
+
+namespace magpie
+{
+  THREAD_LOCAL TaskPool::Block* TaskPool::freeLists_[TaskPool::NUM_SIZES];
+  THREAD_LOCAL int TaskPool::numFree_[TaskPool::NUM_SIZES];
+
+  void* TaskPool::allocate(size_t size)
+  {
+    int index = sizeClass(size);
+    if (index == -1) return ::operator new(size);
+
+    Block* block = freeLists_[index];
+    if (block == NULL)
+    {
+      return ::operator new((index + 1) * GRANULARITY);
+    }
+
+    freeLists_[index] = block->next;
+    numFree_[index]--;
+    return block;
+  }
+
+  void TaskPool::free(void* memory, size_t size)
+  {
+    if (memory == NULL) return;
+
+    int index = sizeClass(size);
+    if (index == -1 || numFree_[index] >= MAX_FREE)
+    {
+      ::operator delete(memory);
+      return;
+    }
+
+    Block* block = static_cast<Block*>(memory);
+    block->next = freeLists_[index];
+    freeLists_[index] = block;
+    numFree_[index]++;
+  }
+
+  void TaskPool::trim()
+  {
+    for (int i = 0; i < NUM_SIZES; i++)
+    {
+      Block* block = freeLists_[i];
+      while (block != NULL)
+      {
+        Block* next = block->next;
+        ::operator delete(block);
+        block = next;
+      }
+
+      freeLists_[i] = NULL;
+      numFree_[i] = 0;
+    }
+  }
+
+  int TaskPool::numFree()
+  {
+    int count = 0;
+    for (int i = 0; i < NUM_SIZES; i++) count += numFree_[i];
+    return count;
+  }
+
+  int TaskPool::sizeClass(size_t size)
+  {
+    if (size == 0 || size > MAX_SIZE) return -1;
+    return static_cast<int>((size - 1) / GRANULARITY);
+  }
+}
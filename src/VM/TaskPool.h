@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Macros.h"
+
+namespace magpie
+{
+  // Recycles the memory used by Tasks. Every asynchronous operation creates a
+  // task and frees it when the operation completes, so a fiber doing I/O in a
+  // loop would otherwise hit malloc() twice per iteration. Freed blocks are
+  // kept on per-size free lists instead and handed back out to the next task
+  // of the same size. Since a task embeds its libuv request, that gets
+  // recycled along with it.
+  //
+  // Each thread has its own pool, so VMs running on different threads never
+  // contend on it. Blocks may be freed on a different thread than they were
+  // allocated on: they just end up in that thread's pool.
+  class TaskPool
+  {
+  public:
+    // Gets a block of at least [size] bytes.
+    static void* allocate(size_t size);
+
+    // Returns [memory], which was allocated with [size], to the pool.
+    static void free(void* memory, size_t size);
+
+    // Releases all of the free blocks held by the current thread's pool back
+    // to the system.
+    static void trim();
+
+    // Gets the number of free blocks held by the current thread's pool.
+    static int numFree();
+
+  private:
+    // Sizes are rounded up to a multiple of this.
+    static const size_t GRANULARITY = 64;
+
+    // Blocks larger than this aren't pooled.
+    static const size_t MAX_SIZE = 1024;
+
+    static const int NUM_SIZES = MAX_SIZE / GRANULARITY;
+
+    // The most blocks of a single size that a pool will hold onto. Anything
+    // freed past this goes back to the system so that a burst of concurrent
+    // operations doesn't pin its memory forever.
+    static const int MAX_FREE = 64;
+
+    // A free block. Its memory is reused to link it into the free list.
+    struct Block
+    {
+      Block* next;
+    };
+
+    // Gets the index of the free list for blocks of [size] or -1 if blocks of
+    // that size aren't pooled.
+    static int sizeClass(size_t size);
+
+    static THREAD_LOCAL Block* freeLists_[NUM_SIZES];
+    static THREAD_LOCAL int numFree_[NUM_SIZES];
+  };
+}
@@ -0,0 +1,363 @@
+#include "TimerWheel.h"
+
+namespace magpie
+{
+  // Returns the index of the lowest set bit in [bits], which must not be 0.
+  static int lowestBit(uint64_t bits)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+  }
+
+  // Rotates [bits] right by [amount], which must be in [0, 64).
+  static uint64_t rotateRight(uint64_t bits, int amount)
+  {
+    if (amount == 0) return bits;
+    return (bits >> amount) | (bits << (64 - amount));
+  }
+
+  Timer::~Timer()
+  {
+    if (wheel_ != NULL) wheel_->remove(this);
+  }
+
+  TimerWheel::TimerWheel()
+  : loop_(NULL),
+    now_(0),
+    armedFor_(0),
+    overflow_(NULL),
+    expired_(NULL),
+    count_(0),
+    nextSequence_(0),
+    isAdvancing_(false)
+  {
+    for (int level = 0; level < LEVELS; level++)
+    {
+      occupied_[level] = 0;
+      for (int slot = 0; slot < SLOTS; slot++) slots_[level][slot] = NULL;
+    }
+  }
+
+  void TimerWheel::start(uv_loop_t* loop)
+  {
+    loop_ = loop;
+    now_ = uv_now(loop);
+
+    uv_timer_init(loop, &tick_);
+    tick_.data = this;
+  }
+
+  void TimerWheel::add(Timer* timer, int ms)
+  {
+    ASSERT_NOT_NULL(loop_);
+
+    if (timer->wheel_ != NULL) remove(timer);
+
+    // If nothing is pending, the wheel's notion of the current time may be
+    // stale. Catch up for free instead of stepping through the gap later.
+    if (count_ == 0 && !isAdvancing_) now_ = uv_now(loop_);
+
+    // Never schedule for the current millisecond. That bucket has already
+    // been processed, so it wouldn't be seen again until the wheel comes
+    // back around.
+    uint64_t deadline = uv_now(loop_) + (ms > 0 ? ms : 0);
+    if (deadline <= now_) deadline = now_ + 1;
+
+    timer->wheel_ = this;
+    timer->deadline_ = deadline;
+    timer->sequence_ = nextSequence_++;
+    count_++;
+
+    place(timer);
+    schedule();
+  }
+
+  void TimerWheel::remove(Timer* timer)
+  {
+    if (timer->wheel_ != this) return;
+
+    unlink(timer);
+    timer->wheel_ = NULL;
+    count_--;
+
+    // Don't bother re-arming the libuv timer. If it goes off early, it will
+    // just find nothing to do and re-arm for the next real event.
+    if (count_ == 0 && !isAdvancing_) schedule();
+  }
+
+  void TimerWheel::tickCallback(uv_timer_t* handle, int status)
+  {
+    TimerWheel* wheel = static_cast<TimerWheel*>(handle->data);
+    wheel->armedFor_ = 0;
+    wheel->advance(uv_now(wheel->loop_));
+    wheel->schedule();
+  }
+
+  void TimerWheel::place(Timer* timer)
+  {
+    uint64_t delta = (timer->deadline_ > now_) ? timer->deadline_ - now_ : 0;
+
+    for (int level = 0; level < LEVELS; level++)
+    {
+      int shift = level * SLOT_BITS;
+      if (delta < (static_cast<uint64_t>(SLOTS) << shift))
+      {
+        link(timer, level, (timer->deadline_ >> shift) & SLOT_MASK);
+        return;
+      }
+    }
+
+    link(timer, OVERFLOW_LEVEL, 0);
+  }
+
+  Timer*& TimerWheel::listFor(Timer* timer)
+  {
+    switch (timer->level_)
+    {
+      case OVERFLOW_LEVEL: return overflow_;
+      case EXPIRED_LEVEL: return expired_;
+      default: return slots_[timer->level_][timer->slot_];
+    }
+  }
+
+  void TimerWheel::link(Timer* timer, int level, int slot)
+  {
+    timer->level_ = level;
+    timer->slot_ = slot;
+
+    // Each list is doubly linked, except that the head's [prev_] points to
+    // the tail so that we can append in O(1).
+    Timer*& head = listFor(timer);
+    if (head == NULL)
+    {
+      head = timer;
+      timer->prev_ = timer;
+      timer->next_ = NULL;
+    }
+    else
+    {
+      // Keep the list in the order the timers were added so that timers with
+      // the same deadline fire in that order. Timers are almost always added
+      // in order, so this rarely walks more than one step.
+      Timer* after = head->prev_;
+      while (after != NULL && after->sequence_ > timer->sequence_)
+      {
+        after = (after == head) ? NULL : after->prev_;
+      }
+
+      if (after == NULL)
+      {
+        timer->prev_ = head->prev_;
+        timer->next_ = head;
+        head->prev_ = timer;
+        head = timer;
+      }
+      else
+      {
+        timer->prev_ = after;
+        timer->next_ = after->next_;
+
+        if (after->next_ != NULL)
+        {
+          after->next_->prev_ = timer;
+        }
+        else
+        {
+          head->prev_ = timer;
+        }
+
+        after->next_ = timer;
+      }
+    }
+
+    if (level >= 0) occupied_[level] |= static_cast<uint64_t>(1) << slot;
+  }
+
+  void TimerWheel::unlink(Timer* timer)
+  {
+    Timer*& head = listFor(timer);
+
+    if (timer == head)
+    {
+      head = timer->next_;
+      if (head != NULL) head->prev_ = timer->prev_;
+    }
+    else
+    {
+      timer->prev_->next_ = timer->next_;
+
+      if (timer->next_ != NULL)
+      {
+        timer->next_->prev_ = timer->prev_;
+      }
+      else
+      {
+        head->prev_ = timer->prev_;
+      }
+    }
+
+    if (head == NULL && timer->level_ >= 0)
+    {
+      occupied_[timer->level_] &= ~(static_cast<uint64_t>(1) << timer->slot_);
+    }
+
+    timer->prev_ = NULL;
+    timer->next_ = NULL;
+  }
+
+  void TimerWheel::advance(uint64_t time)
+  {
+    isAdvancing_ = true;
+
+    while (now_ < time)
+    {
+      // Jump ahead to the next level 0 bucket that has something in it, or
+      // the start of the next block of buckets, whichever comes first.
+      uint64_t next = (now_ | SLOT_MASK) + 1;
+
+      int current = static_cast<int>(now_ & SLOT_MASK);
+      if (current < SLOT_MASK)
+      {
+        uint64_t later = occupied_[0] >> (current + 1);
+        if (later != 0)
+        {
+          uint64_t due = now_ + 1 + lowestBit(later);
+          if (due < next) next = due;
+        }
+      }
+
+      if (next > time) next = time;
+      now_ = next;
+
+      // Crossing into a new block, so redistribute the upper level buckets
+      // that now fall within range.
+      if ((now_ & SLOT_MASK) == 0)
+      {
+        int level;
+        for (level = 1; level < LEVELS; level++)
+        {
+          int slot = static_cast<int>((now_ >> (level * SLOT_BITS)) &
+                                      SLOT_MASK);
+          cascade(level, slot);
+
+          // Only carry into the next level up when this one wraps around.
+          if (slot != 0) break;
+        }
+
+        // The whole wheel has come around, so see which overflowed timers are
+        // now within reach.
+        if (level == LEVELS)
+        {
+          Timer* timer = overflow_;
+          overflow_ = NULL;
+          while (timer != NULL)
+          {
+            Timer* next = timer->next_;
+            place(timer);
+            timer = next;
+          }
+        }
+      }
+
+      // Fire everything due now. Move them to a separate list first since the
+      // callbacks may add and remove timers, including other expired ones.
+      int slot = static_cast<int>(now_ & SLOT_MASK);
+      Timer* timer = slots_[0][slot];
+      slots_[0][slot] = NULL;
+      occupied_[0] &= ~(static_cast<uint64_t>(1) << slot);
+
+      while (timer != NULL)
+      {
+        Timer* next = timer->next_;
+        link(timer, EXPIRED_LEVEL, 0);
+        timer = next;
+      }
+
+      while (expired_ != NULL)
+      {
+        Timer* expired = expired_;
+        unlink(expired);
+        expired->wheel_ = NULL;
+        count_--;
+
+        expired->fire();
+      }
+    }
+
+    isAdvancing_ = false;
+  }
+
+  void TimerWheel::cascade(int level, int slot)
+  {
+    Timer* timer = slots_[level][slot];
+    slots_[level][slot] = NULL;
+    occupied_[level] &= ~(static_cast<uint64_t>(1) << slot);
+
+    while (timer != NULL)
+    {
+      Timer* next = timer->next_;
+      place(timer);
+      timer = next;
+    }
+  }
+
+  bool TimerWheel::nextEvent(uint64_t& time) const
+  {
+    if (count_ == 0) return false;
+
+    bool found = false;
+
+    for (int level = 0; level < LEVELS; level++)
+    {
+      if (occupied_[level] == 0) continue;
+
+      // Find the first non-empty bucket after the current one. For level 0,
+      // that's when its timers fire. For upper levels, it's when it cascades.
+      int shift = level * SLOT_BITS;
+      uint64_t block = now_ >> shift;
+      int current = static_cast<int>(block & SLOT_MASK);
+
+      uint64_t bits = rotateRight(occupied_[level], (current + 1) & SLOT_MASK);
+      uint64_t event = (block + 1 + lowestBit(bits)) << shift;
+
+      if (!found || event < time) time = event;
+      found = true;
+    }
+
+    if (overflow_ != NULL)
+    {
+      int shift = LEVELS * SLOT_BITS;
+      uint64_t event = ((now_ >> shift) + 1) << shift;
+
+      if (!found || event < time) time = event;
+      found = true;
+    }
+
+    return found;
+  }
+
+  void TimerWheel::schedule()
+  {
+    if (isAdvancing_) return;
+
+    uint64_t time;
+    if (!nextEvent(time))
+    {
+      uv_timer_stop(&tick_);
+      armedFor_ = 0;
+      return;
+    }
+
+    // If it's already set to go off in time, leave it.
+    if (armedFor_ != 0 && armedFor_ <= time) return;
+
+    uint64_t now = uv_now(loop_);
+    uv_timer_start(&tick_, tickCallback, (time > now) ? time - now : 0, 0);
+    armedFor_ = time;
+  }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "uv.h"
+
+#include "Macros.h"
+
+namespace magpie
+{
+  class TimerWheel;
+
+  // Something that wants to be notified once a certain amount of time has
+  // passed. Timers are intrusive: the wheel links them together directly, so
+  // scheduling one doesn't allocate. A timer removes itself from its wheel if
+  // it is destroyed while pending.
+  class Timer
+  {
+    friend class TimerWheel;
+
+  public:
+    Timer()
+    : wheel_(NULL),
+      prev_(NULL),
+      next_(NULL),
+      deadline_(0),
+      sequence_(0),
+      level_(0),
+      slot_(0)
+    {}
+
+    virtual ~Timer();
+
+    // Returns true if this timer is scheduled and hasn't fired yet.
+    bool isPending() const { return wheel_ != NULL; }
+
+    // Called when the timer expires. By the time this is called, the timer
+    // has already been removed from its wheel, so it may reschedule or delete
+    // itself.
+    virtual void fire() = 0;
+
+  private:
+    TimerWheel* wheel_;
+    Timer* prev_;
+    Timer* next_;
+
+    // The time, in loop milliseconds, when this timer should fire.
+    uint64_t deadline_;
+
+    // Orders timers that have the same deadline by when they were added.
+    uint64_t sequence_;
+
+    // Where the timer is in the wheel. See TimerWheel::listFor().
+    int level_;
+    int slot_;
+
+    NO_COPY(Timer);
+  };
+
+  // A hierarchical timing wheel that drives any number of Timers using a
+  // single libuv timer.
+  //
+  // There are four levels of 64 buckets each. The first level holds timers due
+  // within the next 64 milliseconds, one bucket per millisecond. Each level
+  // above that covers 64 times the span of the one below it. When time crosses
+  // into a bucket on an upper level, its timers are redistributed to the
+  // finer levels below. Timers further out than the top level can reach wait
+  // in an overflow list. Adding and removing a timer is O(1), and the libuv
+  // timer is only armed for the next moment that something actually needs to
+  // happen.
+  class TimerWheel
+  {
+  public:
+    TimerWheel();
+
+    // Attaches the wheel to [loop]. Must be called before any timers are
+    // added.
+    void start(uv_loop_t* loop);
+
+    // Schedules [timer] to fire after [ms] milliseconds. If it is already
+    // pending, it is rescheduled.
+    void add(Timer* timer, int ms);
+
+    // Unschedules [timer] if it is pending.
+    void remove(Timer* timer);
+
+    // Gets the number of pending timers.
+    int count() const { return count_; }
+
+  private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int SLOT_MASK = SLOTS - 1;
+
+    // Special values for Timer::level_ for timers that aren't in a bucket.
+    static const int OVERFLOW_LEVEL = -1;
+    static const int EXPIRED_LEVEL = -2;
+
+    static void tickCallback(uv_timer_t* handle, int status);
+
+    // Puts [timer] in the bucket for its deadline relative to the wheel's
+    // current time.
+    void place(Timer* timer);
+
+    // Gets the head of the list that [timer] is in.
+    Timer*& listFor(Timer* timer);
+
+    void link(Timer* timer, int level, int slot);
+    void unlink(Timer* timer);
+
+    // Moves the wheel's current time forward to [time], firing every timer
+    // whose deadline has passed.
+    void advance(uint64_t time);
+
+    // Moves every timer in bucket [slot] on [level] down to a finer level.
+    void cascade(int level, int slot);
+
+    // Gets the next time at which the wheel needs to do something, either
+    // fire a timer or cascade a bucket. Returns false if there are no timers.
+    bool nextEvent(uint64_t& time) const;
+
+    // Arms the libuv timer for the next event, or stops it if there isn't
+    // one.
+    void schedule();
+
+    uv_loop_t* loop_;
+    uv_timer_t tick_;
+
+    // The time that the wheel has advanced to, in loop milliseconds.
+    uint64_t now_;
+
+    // When the libuv timer is set to go off, or 0 if it isn't running.
+    uint64_t armedFor_;
+
+    Timer* slots_[LEVELS][SLOTS];
+
+    // One bit per bucket, set if the bucket is non-empty.
+    uint64_t occupied_[LEVELS];
+
+    Timer* overflow_;
+
+    // Timers whose deadline has passed and that are waiting to be fired
+    // during the current advance().
+    Timer* expired_;
+
+    int count_;
+    uint64_t nextSequence_;
+
+    // True while advance() is running so that timers added by the callbacks
+    // don't re-arm the libuv timer over and over.
+    bool isAdvancing_;
+
+    NO_COPY(TimerWheel);
+  };
+}
@@ -5,13 +5,13 @@
 #include "Module.h"
 #include "NativesCore.h"
 #include "NativesIO.h"
+#include "NativesNet.h"
+#include "NativesProcess.h"
 #include "Object.h"
 #include "Parser.h"
 #include "Path.h"
 
-#define DEF_NATIVE(name) \
-    nativeNames_.add(String::create(#name)); \
-    natives_.add(name##Native);
+#define DEF_NATIVE(name) addNative(#name, name##Native)
 
 namespace magpie
 {
@@ -38,16 +38,26 @@ namespace magpie
   };
 
   VM::VM()
-  : modules_(),
+  : heap_(),
+    modules_(),
     replModule_(NULL),
     nativeNames_(),
     natives_(),
+    nativeIndex_(),
     recordTypes_(),
+    recordTypeIndex_(),
+    symbols_(),
+    symbolIndex_(),
     methods_(),
     multimethods_(),
-    scheduler_(*this)
+    multimethodIndex_(),
+    scheduler_(*this),
+    mailboxes_(scheduler_)
   {
-    Memory::initialize(this, 1024 * 1024 * 2); // TODO(bob): Use non-magic number.
+    heap_.initialize(this, 1024 * 1024 * 2); // TODO(bob): Use non-magic number.
+
+    // Objects created on this thread go into this VM's heap from now on.
+    Memory::setCurrent(&heap_);
 
     DEF_NATIVE(bindCore);
     DEF_NATIVE(bindIO);
@@ -92,7 +102,17 @@ namespace magpie
     DEF_NATIVE(channelIsOpen);
     DEF_NATIVE(channelNew);
     DEF_NATIVE(channelReceive);
+    DEF_NATIVE(channelReceiveTimeout);
+    DEF_NATIVE(channelDidTimeOut);
     DEF_NATIVE(channelSend);
+    DEF_NATIVE(mailboxClose);
+    DEF_NATIVE(mailboxFindString);
+    DEF_NATIVE(mailboxIsOpen);
+    DEF_NATIVE(mailboxIsOwner);
+    DEF_NATIVE(mailboxNew);
+    DEF_NATIVE(mailboxPublishString);
+    DEF_NATIVE(mailboxReceive);
+    DEF_NATIVE(mailboxSend);
     DEF_NATIVE(functionCall);
     DEF_NATIVE(listAdd);
     DEF_NATIVE(listClear);
@@ -103,17 +123,67 @@ namespace magpie
     DEF_NATIVE(listSubscriptRange);
     DEF_NATIVE(listSubscriptSetInt);
 
+    DEF_NATIVE(fileAppend);
     DEF_NATIVE(fileClose);
+    DEF_NATIVE(fileCreate);
+    DEF_NATIVE(fileDelete);
+    DEF_NATIVE(fileFlush);
     DEF_NATIVE(fileIsOpen);
+    DEF_NATIVE(fileIsWritable);
     DEF_NATIVE(fileOpen);
+    DEF_NATIVE(fileSync);
+    DEF_NATIVE(fileWriteBuffer);
+    DEF_NATIVE(fileWriteString);
     DEF_NATIVE(fileSize);
+    DEF_NATIVE(fileReadAt);
     DEF_NATIVE(fileReadBytesInt);
-    DEF_NATIVE(fileStreamBytes);
+    DEF_NATIVE(fileReadRanges);
+    DEF_NATIVE(fileReadText);
+    DEF_NATIVE(fileStreamBytesInt);
+    DEF_NATIVE(streamAdvance);
     DEF_NATIVE(bufferNewSize);
     DEF_NATIVE(bufferCount);
+    DEF_NATIVE(bufferCompareToBuffer);
+    DEF_NATIVE(bufferCopyIntoBuffer);
+    DEF_NATIVE(bufferCrc32);
+    DEF_NATIVE(bufferFillInt);
+    DEF_NATIVE(bufferIndexOfBuffer);
+    DEF_NATIVE(bufferIndexOfInt);
+    DEF_NATIVE(bufferReadInt);
     DEF_NATIVE(bufferSubscriptInt);
+    DEF_NATIVE(bufferSubscriptRange);
     DEF_NATIVE(bufferSubscriptSetInt);
     DEF_NATIVE(bufferDecodeAscii);
+    DEF_NATIVE(bufferDecodeUtf8);
+    DEF_NATIVE(fileMap);
+    DEF_NATIVE(mappedBufferClose);
+    DEF_NATIVE(mappedBufferCount);
+    DEF_NATIVE(mappedBufferDecodeAscii);
+    DEF_NATIVE(mappedBufferDecodeUtf8);
+    DEF_NATIVE(mappedBufferIsOpen);
+    DEF_NATIVE(mappedBufferSubscriptInt);
+    DEF_NATIVE(mappedBufferSubscriptRange);
+    DEF_NATIVE(bindNet);
+    DEF_NATIVE(socketClose);
+    DEF_NATIVE(socketConnect);
+    DEF_NATIVE(socketIsOpen);
+    DEF_NATIVE(socketRead);
+    DEF_NATIVE(socketWriteBuffer);
+    DEF_NATIVE(socketWriteString);
+    DEF_NATIVE(tcpServerAccept);
+    DEF_NATIVE(tcpServerClose);
+    DEF_NATIVE(tcpServerIsOpen);
+    DEF_NATIVE(tcpServerListen);
+    DEF_NATIVE(tcpServerPort);
+    DEF_NATIVE(bindProcess);
+    DEF_NATIVE(processIsRunning);
+    DEF_NATIVE(processKill);
+    DEF_NATIVE(processPid);
+    DEF_NATIVE(processSpawn);
+    DEF_NATIVE(processStderr);
+    DEF_NATIVE(processStdin);
+    DEF_NATIVE(processStdout);
+    DEF_NATIVE(processWait);
 
     true_ = new BoolObject(true);
     false_ = new BoolObject(false);
@@ -133,11 +203,15 @@ namespace magpie
     registerClass(core, floatClass_, "Float");
     registerClass(core, intClass_, "Int");
     registerClass(core, listClass_, "List");
+    registerClass(core, mailboxClass_, "Mailbox");
     registerClass(core, nothingClass_, "Nothing");
+    registerClass(core, rangeClass_, "Range");
     registerClass(core, recordClass_, "Record");
     registerClass(core, stringClass_, "String");
+    registerClass(core, methodCollisionErrorClass_, "MethodCollisionError");
     registerClass(core, noMatchErrorClass_, "NoMatchError");
     registerClass(core, noMethodErrorClass_, "NoMethodError");
+    registerClass(core, timeoutErrorClass_, "TimeoutError");
     registerClass(core, undefinedVarErrorClass_, "UndefinedVarError");
 
     int index = core->findVariable(String::create("done"));
@@ -151,9 +225,27 @@ namespace magpie
 
     registerClass(io, bufferClass_, "Buffer");
     registerClass(io, fileClass_, "File");
+    registerClass(io, mappedBufferClass_, "MappedBuffer");
     registerClass(io, streamClass_, "Stream");
   }
 
+  void VM::bindNet()
+  {
+    Module* net = findModule("net");
+    ASSERT_NOT_NULL(net);
+
+    registerClass(net, socketClass_, "Socket");
+    registerClass(net, tcpServerClass_, "TcpServer");
+  }
+
+  void VM::bindProcess()
+  {
+    Module* process = findModule("process");
+    ASSERT_NOT_NULL(process);
+
+    registerClass(process, processClass_, "Process");
+  }
+
   bool VM::runProgram(gc<String> path)
   {
     // Remember where the program is so we can import modules from there.
@@ -161,8 +253,9 @@ namespace magpie
 
     // Traverse the import graph.
     ErrorReporter reporter;
+    int first = modules_.count();
     addModule(reporter, NULL, path);
-    if (reporter.numErrors() > 0) return false;
+    if (!loadModules(reporter, first)) return false;
 
     // Sort the modules by their imports so that dependencies are run before
     // modules that depend on them.
@@ -235,8 +328,9 @@ namespace magpie
   bool VM::initRepl()
   {
     ErrorReporter reporter;
+    int first = modules_.count();
     Module* core = addModule(reporter, String::create("core"), NULL);
-    if (!core || reporter.numErrors() > 0) return false;
+    if (!core || !loadModules(reporter, first)) return false;
     if (!core->compile(*this)) return false;
     scheduler_.runModule(core);
 
@@ -275,6 +369,7 @@ namespace magpie
     programDir_.reach();
     recordTypes_.reach();
     scheduler_.reach();
+    mailboxes_.sweep();
     true_.reach();
     false_.reach();
     nothing_.reach();
@@ -297,6 +392,8 @@ namespace magpie
       case BUILT_IN_NO_METHOD:
         return DynamicObject::create(noMethodErrorClass_);
       case BUILT_IN_DONE: return done_;
+      case BUILT_IN_METHOD_COLLISION:
+        return DynamicObject::create(methodCollisionErrorClass_);
     }
 
     ASSERT(false, "Unknown built-in ID.");
@@ -304,9 +401,11 @@ namespace magpie
 
   int VM::findNative(gc<String> name)
   {
-    for (int i = 0; i < nativeNames_.count(); i++)
+    int slot = -1;
+    int index;
+    while ((index = nativeIndex_.find(name->hash(), slot)) != -1)
     {
-      if (nativeNames_[i] == name) return i;
+      if (nativeNames_[index] == name) return index;
     }
 
     return -1;
@@ -314,9 +413,18 @@ namespace magpie
 
   int VM::addRecordType(const Array<int>& fields)
   {
-    // TODO(bob): Should use a hash table or something more optimal.
+    // Hash the field symbols the same way strings are hashed.
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < fields.count(); i++)
+    {
+      hash ^= static_cast<unsigned int>(fields[i]);
+      hash *= 16777619u;
+    }
+
     // See if we already have a type for this signature.
-    for (int i = 0; i < recordTypes_.count(); i++)
+    int slot = -1;
+    int i;
+    while ((i = recordTypeIndex_.find(hash, slot)) != -1)
     {
       RecordType& type = *recordTypes_[i];
 
@@ -339,6 +447,7 @@ namespace magpie
 
     // It's a new type, so add it.
     gc<RecordType> type = RecordType::create(fields);
+    recordTypeIndex_.add(hash, recordTypes_.count());
     recordTypes_.add(type);
     return recordTypes_.count() - 1;
   }
@@ -351,12 +460,15 @@ namespace magpie
   symbolId VM::addSymbol(gc<String> name)
   {
     // See if it's already in the table.
-    for (int i = 0; i < symbols_.count(); i++)
+    int slot = -1;
+    int index;
+    while ((index = symbolIndex_.find(name->hash(), slot)) != -1)
     {
-      if (*name == *symbols_[i]) return i;
+      if (*name == *symbols_[index]) return index;
     }
 
     // It's a new symbol.
+    symbolIndex_.add(name->hash(), symbols_.count());
     symbols_.add(name);
     return symbols_.count() - 1;
   }
@@ -369,6 +481,7 @@ namespace magpie
 
   methodId VM::addMethod(gc<Method> method)
   {
+    method->setId(methods_.count());
     methods_.add(method);
     return methods_.count() - 1;
   }
@@ -380,15 +493,18 @@ namespace magpie
     if (index != -1) return index;
 
     // It's a new multimethod.
+    multimethodIndex_.add(signature->hash(), multimethods_.count());
     multimethods_.add(new Multimethod(signature));
     return multimethods_.count() - 1;
   }
 
   int VM::findMultimethod(gc<String> signature)
   {
-    for (int i = 0; i < multimethods_.count(); i++)
+    int slot = -1;
+    int index;
+    while ((index = multimethodIndex_.find(signature->hash(), slot)) != -1)
     {
-      if (signature == multimethods_[i]->signature()) return i;
+      if (signature == multimethods_[index]->signature()) return index;
     }
 
     // Not found.
@@ -427,7 +543,10 @@ namespace magpie
       }
     }
 
-    // Locate the path to the module if we aren't given it.
+    // Locate the path to the module if we aren't given it. Only modules that
+    // are imported by name use the parse cache, so that running a script
+    // doesn't leave cache files next to it.
+    bool useCache = path.isNull();
     if (path.isNull())
     {
       ASSERT(!name.isNull(), "Must be given a path or a name.");
@@ -440,14 +559,49 @@ namespace magpie
       }
     }
 
-    Module* module = new Module(name, path);
+    Module* module = new Module(name, path, useCache);
     modules_.add(module);
+    return module;
+  }
+
+  bool VM::loadModules(ErrorReporter& reporter, int first)
+  {
+    if (reporter.numErrors() > 0) return false;
+
+    // Parse the import graph a level at a time. Each level is the modules
+    // that were first imported by the previous one. Parsing a module doesn't
+    // depend on any other, so a whole level can be parsed in parallel. Adding
+    // imports stays on this thread and goes in module order, so modules are
+    // numbered the same way on every run.
+    while (first < modules_.count())
+    {
+      Array<Module*> level;
+      for (int i = first; i < modules_.count(); i++)
+      {
+        level.add(modules_[i]);
+      }
 
-    if (!module->parse(reporter)) return NULL;
+      first = modules_.count();
 
-    module->addImports(*this, reporter);
+      if (!Module::parseAll(reporter, level)) return false;
 
-    return module;
+      for (int i = 0; i < level.count(); i++)
+      {
+        level[i]->addImports(*this, reporter);
+      }
+
+      if (reporter.numErrors() > 0) return false;
+    }
+
+    return true;
+  }
+
+  void VM::addNative(const char* name, Native native)
+  {
+    gc<String> nameString = String::create(name);
+    nativeIndex_.add(nameString->hash(), nativeNames_.count());
+    nativeNames_.add(nameString);
+    natives_.add(native);
   }
 
   void VM::registerClass(Module* module, gc<ClassObject>& classObj,
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "Fiber.h"
+#include "HashIndex.h"
 #include "Lexer.h"
 #include "Macros.h"
+#include "Mailbox.h"
 #include "Memory.h"
 #include "Method.h"
 #include "RootSource.h"
@@ -30,6 +32,9 @@ namespace magpie
 
     virtual void reachRoots();
 
+    // Gets the garbage-collected heap owned by this VM.
+    Memory& heap() { return heap_; }
+
     // This is called by a native method at the end of the core library so the
     // VM can register the types defined there that it cares about.
     void bindCore();
@@ -38,6 +43,14 @@ namespace magpie
     // VM can register the types defined there that it cares about.
     void bindIO();
 
+    // This is called by a native method at the end of the net library so the
+    // VM can register the types defined there that it cares about.
+    void bindNet();
+
+    // This is called by a native method at the end of the process library so
+    // the VM can register the types defined there that it cares about.
+    void bindProcess();
+
     bool runProgram(gc<String> path);
 
     // Gets the directory containing the main program file being executed.
@@ -49,6 +62,7 @@ namespace magpie
     bool initRepl();
     gc<Object> evaluateReplExpression(gc<Expr> expr);
 
+    int numModules() const { return modules_.count(); }
     Module* getModule(int index) { return modules_[index]; }
     int getModuleIndex(Module& module) const;
 
@@ -64,12 +78,19 @@ namespace magpie
     inline gc<ClassObject> functionClass() const { return functionClass_; }
     inline gc<ClassObject> intClass() const { return intClass_; }
     inline gc<ClassObject> listClass() const { return listClass_; }
+    inline gc<ClassObject> mailboxClass() const { return mailboxClass_; }
+    inline gc<ClassObject> mappedBufferClass() const { return mappedBufferClass_; }
     inline gc<ClassObject> nothingClass() const { return nothingClass_; }
+    inline gc<ClassObject> processClass() const { return processClass_; }
+    inline gc<ClassObject> rangeClass() const { return rangeClass_; }
     inline gc<ClassObject> recordClass() const { return recordClass_; }
+    inline gc<ClassObject> socketClass() const { return socketClass_; }
     inline gc<ClassObject> streamClass() const { return streamClass_; }
     inline gc<ClassObject> stringClass() const { return stringClass_; }
+    inline gc<ClassObject> tcpServerClass() const { return tcpServerClass_; }
     inline gc<ClassObject> noMatchErrorClass() const { return noMatchErrorClass_; }
     inline gc<ClassObject> noMethodErrorClass() const { return noMethodErrorClass_; }
+    inline gc<ClassObject> timeoutErrorClass() const { return timeoutErrorClass_; }
     inline gc<ClassObject> undefinedVarErrorClass() const { return undefinedVarErrorClass_; }
 
     inline gc<Object> getBool(bool value) const
@@ -93,41 +114,63 @@ namespace magpie
     // Adds a method to the list of methods that have been compiled, but whose
     // definitions have not yet been executed.
     methodId addMethod(gc<Method> method);
+    gc<Method> getMethod(methodId method) const { return methods_[method]; }
 
     int declareMultimethod(gc<String> signature);
     int findMultimethod(gc<String> signature);
     void defineMethod(int multimethod, methodId method);
     gc<Multimethod> getMultimethod(int multimethod);
 
+    // Gets the mailboxes this VM has handles to.
+    MailboxSet& mailboxes() { return mailboxes_; }
+
   private:
-    // Loads module [name] from [path] and the recursively loads its imports.
-    // [from] is the module that's depending on the added one. If [path] is
-    // NULL, then it will try to determine it from the name by searching the
-    // file system. If [name] is NULL, it will infer it from the path.
+    // Adds module [name] at [path] if it hasn't already been added. It isn't
+    // parsed until loadModules(). If [path] is NULL, then it will try to
+    // determine it from the name by searching the file system. If [name] is
+    // NULL, it will infer it from the path.
     Module* addModule(ErrorReporter& reporter, gc<String> name,
                       gc<String> path);
 
+    // Parses the modules starting at index [first] in [modules_], and then
+    // the modules they import, recursively. Returns false if there were any
+    // errors.
+    bool loadModules(ErrorReporter& reporter, int first);
+
+    void addNative(const char* name, Native native);
+
     void registerClass(Module* module, gc<ClassObject>& classObj,
                        const char* name);
 
     Module* findModule(const char* name);
 
+    // This must come first so that the heap is set up before any other members
+    // try to allocate from it.
+    Memory heap_;
+
     gc<String> programDir_;
 
     Array<Module*> modules_;
     Module* replModule_;
 
+    // Each of these tables has a HashIndex of its keys so that looking them
+    // up while compiling doesn't have to scan the whole table.
     Array<gc<String> > nativeNames_;
     Array<Native> natives_;
+    HashIndex nativeIndex_;
 
     Array<gc<RecordType> > recordTypes_;
-    // TODO(bob): Something more optimal than an O(n) array.
+    HashIndex recordTypeIndex_;
+
     Array<gc<String> > symbols_;
+    HashIndex symbolIndex_;
 
     Array<gc<Method> > methods_;
     Array<gc<Multimethod> > multimethods_;
+    HashIndex multimethodIndex_;
 
     Scheduler scheduler_;
+    MailboxSet mailboxes_;
 
     gc<Object> true_;
     gc<Object> false_;
@@ -143,12 +186,20 @@ namespace magpie
     gc<ClassObject> functionClass_;
     gc<ClassObject> intClass_;
     gc<ClassObject> listClass_;
+    gc<ClassObject> mailboxClass_;
+    gc<ClassObject> mappedBufferClass_;
     gc<ClassObject> nothingClass_;
+    gc<ClassObject> processClass_;
+    gc<ClassObject> rangeClass_;
     gc<ClassObject> recordClass_;
+    gc<ClassObject> socketClass_;
     gc<ClassObject> streamClass_;
     gc<ClassObject> stringClass_;
+    gc<ClassObject> tcpServerClass_;
+    gc<ClassObject> methodCollisionErrorClass_;
     gc<ClassObject> noMatchErrorClass_;
     gc<ClassObject> noMethodErrorClass_;
+    gc<ClassObject> timeoutErrorClass_;
     gc<ClassObject> undefinedVarErrorClass_;
 
     NO_COPY(VM);